@@ -1,17 +1,46 @@
+#extension GL_EXT_gpu_shader4 : enable
+
+// the transforms of the objects, see ogl::TransformBuffer
+#ifdef GL_EXT_gpu_shader4
+uniform samplerBuffer transforms;
+#endif
+attribute float transformIndex;
+
 varying vec3 v;
 varying vec3 lightvec;
 varying vec3 normal;
 //varying vec3 position;
 
+// returns the transform of the object, or the identity if the
+// transform is part of the modelview matrix
+mat4 objectMatrix()
+{
+#ifdef GL_EXT_gpu_shader4
+	if (transformIndex > 0.5) {
+		int i = int(transformIndex - 0.5) * 3;
+		vec4 r0 = texelFetchBuffer(transforms, i);
+		vec4 r1 = texelFetchBuffer(transforms, i + 1);
+		vec4 r2 = texelFetchBuffer(transforms, i + 2);
+		return mat4(r0.x, r1.x, r2.x, 0.0,
+					r0.y, r1.y, r2.y, 0.0,
+					r0.z, r1.z, r2.z, 0.0,
+					r0.w, r1.w, r2.w, 1.0);
+	}
+#endif
+	return mat4(1.0);
+}
+
 void main()
 {
-	normal = normalize(gl_NormalMatrix * gl_Normal);
-	v = vec3(gl_ModelViewMatrix * gl_Vertex);
+	mat4 model = objectMatrix();
+	vec4 vertex = model * gl_Vertex;
+	normal = normalize(gl_NormalMatrix * (model * vec4(gl_Normal, 0.0)).xyz);
+	v = vec3(gl_ModelViewMatrix * vertex);
 	lightvec = normalize(gl_LightSource[0].position.xyz - v);
  
 	gl_TexCoord[0] = gl_MultiTexCoord0;
 
-	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+	gl_Position = gl_ModelViewProjectionMatrix * vertex;
 	//position = vec3(gl_Position);
 }
 
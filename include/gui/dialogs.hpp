@@ -8,12 +8,14 @@
 #define DIALOGS_HPP_
 
 #include <util/erroradapters.hpp>
+#include <simulation/generator.hpp>
 #include <QtGui/QDialog>
 #include <QtGui/QMessageBox>
 #include <QtGui/QWidget>
 
 class QString;
 class QCheckBox;
+class QComboBox;
 class QDialogButtonBox;
 class QDoubleSpinBox;
 class QGridLayout;
@@ -23,6 +25,7 @@ class QLineEdit;
 class QListWidget;
 class QListWidgetItem;
 class QPushButton;
+class QSpinBox;
 class QStackedWidget;
 
 
@@ -90,6 +93,38 @@ private:
 	static const float m_rangeHigh;
 };
 
+/**
+ * the GeneratorDialog queries the parameters of a procedurally generated
+ * scene, see sim::Generator
+ */
+class GeneratorDialog: public QDialog {
+Q_OBJECT
+public:
+	/**
+	 * Constructor
+	 *
+	 * @param parent 	if given, the instance will be set modal in respect to
+	 * 					the parent widget
+	 */
+	GeneratorDialog(QWidget* parent = 0);
+	/**
+	 * Shows the dialog and fills in the parameters, if it was accepted.
+	 *
+	 * @param params 	the parameters of the scene
+	 * @return returns true, if the dialog was accepted
+	 */
+	bool run(sim::Generator::Params& params);
+
+private:
+	QComboBox* m_layout;
+	QSpinBox* m_count;
+	QComboBox* m_type;
+	QDoubleSpinBox* m_gap;
+	QLineEdit* m_materials;
+	QLineEdit* m_environment;
+	QSpinBox* m_seed;
+};
+
 class MessageDialog: public QMessageBox {
 Q_OBJECT
 public:
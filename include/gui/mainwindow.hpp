@@ -75,6 +75,12 @@ private slots:
 	 * on MainWindow::m_open
 	 */
 	void onOpenPressed();
+	/**
+	 * The slot function onGeneratePressed() is executed each time the user
+	 * clicks on MainWindow::m_generate. A GeneratorDialog will then occur and
+	 * the generated scene is saved and loaded.
+	 */
+	void onGeneratePressed();
 
 	//Simulation
 	/**
@@ -89,6 +95,28 @@ private slots:
 	 * the sim::Simulation gravity can be changed.
 	 */
 	void onGravityPressed();
+	/**
+	 * The slot function onReplayControlsPressed() is executed each time the
+	 * user clicks on one of the actions in MainWindow::m_menuReplay.
+	 */
+	void onReplayControlsPressed();
+	/**
+	 * The slot function onReplayFilePressed() is executed each time the
+	 * user clicks on MainWindow::m_replaySave or MainWindow::m_replayLoad.
+	 * It writes the recording to a file or reads it from one.
+	 */
+	void onReplayFilePressed();
+	/**
+	 * The slot function onFastForwardPressed() is executed each time the
+	 * user clicks on MainWindow::m_fastForward or MainWindow::m_settle
+	 */
+	void onFastForwardPressed();
+	/**
+	 * The slot function onTracePressed() is executed each time the user
+	 * clicks on MainWindow::m_trace. It starts a capture of the profiler
+	 * or writes the captured trace.
+	 */
+	void onTracePressed();
 
 	void onSoundControlsPressed();
 
@@ -152,6 +180,10 @@ private:
 	 * When triggered MainWindow::onOpenPressed() is executed
 	 */
 	QAction* m_open;
+	/**
+	 * When triggered MainWindow::onGeneratePressed() is executed
+	 */
+	QAction* m_generate;
 	/**
 	 * When triggered MainWindow::onClosePressed() is executed
 	 */
@@ -176,9 +208,44 @@ private:
 	 */
 	QAction* m_gravity;
 
+	/**
+	 * When triggered MainWindow::onFastForwardPressed() is executed
+	 */
+	QAction* m_fastForward;
+	QAction* m_settle;
+
+	/** True, while the result of m_settle is awaited */
+	bool m_settling;
+
+	/**
+	 * The Replay menu. If MainWindow::m_record is checked, the simulation
+	 * is recorded between MainWindow::m_play and MainWindow::m_stop. The
+	 * other actions control the playback of the recording.
+	 */
+	QMenu* m_menuReplay;
+	QAction* m_record;
+	QAction* m_replayPlay;
+	QAction* m_replayPause;
+	QAction* m_replaySlower;
+	QAction* m_replayFaster;
+	QAction* m_replayBack;
+	QAction* m_replayForward;
+	QAction* m_replayStop;
+	QAction* m_replaySave;
+	QAction* m_replayLoad;
+
 	QMenu* m_menuOptions;
 	QAction* m_sound_play;
 	QAction* m_sound_stop;
+
+	/**
+	 * When toggled RenderWidget::setProfilerVisible(bool) is executed
+	 */
+	QAction* m_profiler;
+	/**
+	 * When triggered MainWindow::onTracePressed() is executed
+	 */
+	QAction* m_trace;
 	QAction* m_preferences;
 
 	/**
@@ -105,17 +105,58 @@ protected:
 	 */
 	virtual void mouseDoubleClickEvent(QMouseEvent* event);
 
+	/**
+	 * Renders the times of the phases of the last frames as stacked bars,
+	 * see util::Profiler. The legend shows the average of each phase and
+	 * counter.
+	 */
+	void renderProfiler();
+
+	/**
+	 * Marks the sim::Simulation as changed and renders the next frame as
+	 * soon as possible. Called by all input events.
+	 */
+	void invalidate();
+
+protected slots:
+	/**
+	 * Connected to RenderWidget::m_timer. Calls <a href="http://doc.qt.nokia.com/4.7/qglwidget.html#updateGL">
+	 * QGLWidget::updateGL()</a> only if sim::Simulation::needsRender()
+	 * returns true or, while idle, at most "idleFrameRate" times per
+	 * second. An idle widget checks for changes every few milliseconds
+	 * instead of spinning.
+	 */
+	void updateFrame();
+
+public slots:
+	/**
+	 * @param visible True, to render the profiler overlay
+	 */
+	void setProfilerVisible(bool visible);
+
 public:
 	/**
 	 * RenderWidget::m_timer is used to update and repaint the display. The
-	 * timeout() signal is connected to <a href="http://doc.qt.nokia.com/4.7/qglwidget.html#updateGL">
-	 * QGLWidget::updateGL()</a>
+	 * timeout() signal is connected to RenderWidget::updateFrame()
 	 */
 	QTimer* m_timer;
 	/**
 	 * An instance of util::Clock to nicely get the frames per second and emit them to MainWindow
 	 */
 	util::Clock m_clock;
+	/**
+	 * The number of frames since the last reset of RenderWidget::m_clock
+	 */
+	int m_frames;
+	/**
+	 * The time since the last frame
+	 */
+	util::Clock m_idleClock;
+	/**
+	 * The maximum number of frames per second while nothing changes, e.g.
+	 * to let the clouds of the skydome drift. 0 renders only on changes
+	 */
+	float m_idleFrameRate;
 	/**
 	 * An instance of a util::QtMouseAdapter for any mouse interaction with
 	 * the sim:Simulation
@@ -126,11 +167,15 @@ public:
 	 * sim:Simulation
 	 */
 	QtKeyAdapter m_keyAdapter;
+	/**
+	 * True, if RenderWidget::renderProfiler() is called after each frame
+	 */
+	bool m_showProfiler;
 
 signals:
 	/**
 	 * framesPerSecondChanged(int) is emitted every second by
-	 * RenderWidget::m_clock and is connected to
+	 * RenderWidget::m_clock, also while idle, and is connected to
 	 * MainWindow::updateFramesPerSecond(int)
 	 */
 	void framesPerSecondChanged(int);
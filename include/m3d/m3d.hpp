@@ -28,6 +28,24 @@
 #include <GL/glew.h>
 #endif
 
+// use the SSE implementations of the float operations, see simd.hpp
+#if !defined(M3D_NO_SSE) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define M3D_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// align Vec4 and Mat4 to 16 bytes where the heap guarantees it, i.e.
+// on x86-64. The SSE implementations do not depend on the alignment.
+#if defined(__x86_64__) || defined(_M_X64)
+	#ifdef _MSC_VER
+		#define M3D_ALIGN __declspec(align(16))
+	#else
+		#define M3D_ALIGN __attribute__((aligned(16)))
+	#endif
+#else
+	#define M3D_ALIGN
+#endif
+
 const double PI = 3.14159265358979323846;
 const double EPSILON = 0.00001;
 
@@ -60,6 +78,7 @@ typedef Quat<double> Quatd;
 #include "vec3.hpp"
 #include "vec4.hpp"
 #include "mat4.hpp"
+#include "simd.hpp"
 #include "quat.hpp"
 #include "operators.hpp"
 
@@ -9,7 +9,7 @@
 #define MAT4_HPP_
 
 template<typename T>
-class Mat4 {
+class M3D_ALIGN Mat4 {
 public:
 	/**
 	 * Constructs an empty matrix, i.e all elements are 0.
@@ -124,8 +124,37 @@ public:
 	 */
 	Mat4<T>& rotMultiply(const Mat4<T>& m);
 
+	/**
+	 * Multiplies two affine matrices, i.e. matrices whose last column is
+	 * (0, 0, 0, 1). This is the case for all rigid transforms and for
+	 * transforms with a scale, but not for projections. The last column
+	 * is not computed, which saves a quarter of the operations.
+	 *
+	 * @param m An affine matrix
+	 * @return  The product of this matrix and m
+	 */
+	Mat4<T> affineMultiply(const Mat4<T>& m) const;
+
 	Mat4<T> transposed() const;
+
+	/**
+	 * Returns the inverse of a general matrix. Prefer affineInverse() or
+	 * orthonormalInverse() if the matrix is known to be affine or rigid.
+	 */
 	Mat4<T> inverse() const;
+
+	/**
+	 * Returns the inverse of an affine matrix, i.e. a matrix whose last
+	 * column is (0, 0, 0, 1), using the inverse of the 3x3 rotation and
+	 * scale part.
+	 */
+	Mat4<T> affineInverse() const;
+
+	/**
+	 * Returns the inverse of a rigid transform, i.e. a matrix with an
+	 * orthonormal rotation part, a translation and the last column
+	 * (0, 0, 0, 1). The rotation is inverted by transposing it.
+	 */
 	Mat4<T> orthonormalInverse() const;
 
 	/**
@@ -324,46 +353,38 @@ template<typename T>
 inline
 Mat4<T>& Mat4<T>::operator*=(const Mat4<T>& m)
 {
-	T t1, t2, t3, t4;
-	t1 = _11*m._11 + _12*m._21 + _13*m._31 + _14*m._41;
-	t2 = _11*m._12 + _12*m._22 + _13*m._32 + _14*m._42;
-	t3 = _11*m._13 + _12*m._23 + _13*m._33 + _14*m._43;
-	t4 = _11*m._14 + _12*m._24 + _13*m._34 + _14*m._44;
-	_11 = t1;
-	_12 = t2;
-	_13 = t3;
-	_14 = t4;
-
-	t1 = _21*m._11 + _22*m._21 + _23*m._31 + _24*m._41;
-	t2 = _21*m._12 + _22*m._22 + _23*m._32 + _24*m._42;
-	t3 = _21*m._13 + _22*m._23 + _23*m._33 + _24*m._43;
-	t4 = _21*m._14 + _22*m._24 + _23*m._34 + _24*m._44;
-	_21 = t1;
-	_22 = t2;
-	_23 = t3;
-	_24 = t4;
-
-	t1 = _31*m._11 + _32*m._21 + _33*m._31 + _34*m._41;
-	t2 = _31*m._12 + _32*m._22 + _33*m._32 + _34*m._42;
-	t3 = _31*m._13 + _32*m._23 + _33*m._33 + _34*m._43;
-	t4 = _31*m._14 + _32*m._24 + _33*m._34 + _34*m._44;
-	_31 = t1;
-	_32 = t2;
-	_33 = t3;
-	_34 = t4;
-
-	t1 = _41*m._11 + _42*m._21 + _43*m._31 + _44*m._41;
-	t2 = _41*m._12 + _42*m._22 + _43*m._32 + _44*m._42;
-	t3 = _41*m._13 + _42*m._23 + _43*m._33 + _44*m._43;
-	t4 = _41*m._14 + _42*m._24 + _43*m._34 + _44*m._44;
-	_41 = t1;
-	_42 = t2;
-	_43 = t3;
-	_44 = t4;
-
+	// m may be this matrix, so the rows cannot be updated in place
+	*this = *this * m;
 	return *this;
 }
 
+template<typename T>
+inline
+Mat4<T> Mat4<T>::affineMultiply(const Mat4<T>& m) const
+{
+	return Mat4<T>(
+	        (_11*m._11 + _12*m._21 + _13*m._31),
+	        (_11*m._12 + _12*m._22 + _13*m._32),
+	        (_11*m._13 + _12*m._23 + _13*m._33),
+	        (T)0,
+
+	        (_21*m._11 + _22*m._21 + _23*m._31),
+	        (_21*m._12 + _22*m._22 + _23*m._32),
+	        (_21*m._13 + _22*m._23 + _23*m._33),
+	        (T)0,
+
+	        (_31*m._11 + _32*m._21 + _33*m._31),
+	        (_31*m._12 + _32*m._22 + _33*m._32),
+	        (_31*m._13 + _32*m._23 + _33*m._33),
+	        (T)0,
+
+	        (_41*m._11 + _42*m._21 + _43*m._31 + m._41),
+	        (_41*m._12 + _42*m._22 + _43*m._32 + m._42),
+	        (_41*m._13 + _42*m._23 + _43*m._33 + m._43),
+	        (T)1
+	);
+}
+
 template<typename T>
 inline
 Mat4<T>& Mat4<T>::operator*=(const T& t)
@@ -598,6 +619,29 @@ Mat4<T> Mat4<T>::inverse() const
 	return res;
 }
 
+template<typename T>
+inline
+Mat4<T> Mat4<T>::affineInverse() const
+{
+	// the cofactors of the first row
+	T c11 = _22*_33 - _23*_32;
+	T c12 = _23*_31 - _21*_33;
+	T c13 = _21*_32 - _22*_31;
+	T det = 1.0 / (_11*c11 + _12*c12 + _13*c13);
+
+	// the transposed cofactor matrix divided by the determinant
+	Mat4<T> res(c11 * det, (_13*_32 - _12*_33) * det, (_12*_23 - _13*_22) * det, (T)0,
+				c12 * det, (_11*_33 - _13*_31) * det, (_13*_21 - _11*_23) * det, (T)0,
+				c13 * det, (_12*_31 - _11*_32) * det, (_11*_22 - _12*_21) * det, (T)0,
+				(T)0, (T)0, (T)0, (T)1);
+
+	// the inverse translation
+	res._41 = -(_41*res._11 + _42*res._21 + _43*res._31);
+	res._42 = -(_41*res._12 + _42*res._22 + _43*res._32);
+	res._43 = -(_41*res._13 + _42*res._23 + _43*res._33);
+	return res;
+}
+
 template<typename T>
 inline
 Mat4<T> Mat4<T>::orthonormalInverse() const
@@ -18,6 +18,7 @@ public:
 	Quat<T>(const T* const q);
 	Quat<T>(const Vec3<T>& p);
 	Quat<T>(const Vec3<T>& axis, const T& angle);
+	explicit Quat<T>(const Mat4<T>& m);
 
 	T norm() const;
 	Mat4<T> mat4() const;
@@ -95,6 +96,43 @@ Quat<T>::Quat(const Vec3<T>& axis, const T& angle)
 	d = _sin * axis.z;
 }
 
+/**
+ * Extracts the rotation of the given matrix, the inverse of mat4(). The
+ * upper 3x3 part of the matrix has to be orthonormal.
+ */
+template<typename T>
+inline
+Quat<T>::Quat(const Mat4<T>& m)
+{
+	// use the largest diagonal element for numerical stability
+	const T trace = m._11 + m._22 + m._33;
+	if (trace > (T)0) {
+		T s = sqrt(trace + (T)1) * (T)2;
+		a = s / (T)4;
+		b = (m._23 - m._32) / s;
+		c = (m._31 - m._13) / s;
+		d = (m._12 - m._21) / s;
+	} else if (m._11 > m._22 && m._11 > m._33) {
+		T s = sqrt((T)1 + m._11 - m._22 - m._33) * (T)2;
+		a = (m._23 - m._32) / s;
+		b = s / (T)4;
+		c = (m._12 + m._21) / s;
+		d = (m._31 + m._13) / s;
+	} else if (m._22 > m._33) {
+		T s = sqrt((T)1 - m._11 + m._22 - m._33) * (T)2;
+		a = (m._31 - m._13) / s;
+		b = (m._12 + m._21) / s;
+		c = s / (T)4;
+		d = (m._23 + m._32) / s;
+	} else {
+		T s = sqrt((T)1 - m._11 - m._22 + m._33) * (T)2;
+		a = (m._12 - m._21) / s;
+		b = (m._31 + m._13) / s;
+		c = (m._23 + m._32) / s;
+		d = s / (T)4;
+	}
+}
+
 template<typename T>
 inline
 Quat<T>& Quat<T>::operator+=(const Quat<T>& q)
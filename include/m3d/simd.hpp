@@ -0,0 +1,310 @@
+/*
+ * simd.hpp
+ *
+ * SSE implementations of the most frequently used single precision
+ * matrix and vector operations. They replace the generic versions for
+ * T = float if M3D_USE_SSE is defined, i.e. they are chosen at compile
+ * time. The generic versions remain the fallback for all other types and
+ * platforms.
+ *
+ * The matrix and vector multiplications perform the same operations in
+ * the same order as the generic versions, so their results are identical
+ * as long as the compiler does not contract the generic code into fused
+ * multiply-adds. The inverse uses Cramer's rule and differs by rounding.
+ *
+ * All loads and stores are unaligned. The types are 16 byte aligned on
+ * x86-64 (see M3D_ALIGN), which makes them as fast as aligned accesses,
+ * but the operations remain correct for matrices that are stored at
+ * arbitrary addresses, e.g. in Newton's buffers.
+ *
+ *  Created on: Oct 13, 2011
+ *      Author: Markus Doellinger
+ */
+
+#ifndef SIMD_HPP_
+#define SIMD_HPP_
+
+/**
+ * Transforms count points by the matrix m, i.e. out[i] = in[i] * m. The
+ * points are positions, so the translation of the matrix is applied. in
+ * and out may be the same array.
+ *
+ * @param m     The transformation matrix
+ * @param in    The points to transform
+ * @param out   The transformed points
+ * @param count The number of points
+ */
+template<typename T>
+inline
+void transformPoints(const Mat4<T>& m, const Vec3<T>* in, Vec3<T>* out, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i)
+		out[i] = in[i] * m;
+}
+
+#ifdef M3D_USE_SSE
+
+/**
+ * Returns v.x * r0 + v.y * r1 + v.z * r2 + r3, in the order of the
+ * generic Vec3 * Mat4 multiplication.
+ */
+inline
+__m128 _m3d_transform3(const float* v, const __m128& r0, const __m128& r1, const __m128& r2, const __m128& r3)
+{
+	__m128 res = _mm_mul_ps(_mm_set1_ps(v[0]), r0);
+	res = _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(v[1]), r1));
+	res = _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(v[2]), r2));
+	return _mm_add_ps(res, r3);
+}
+
+/**
+ * Returns v.x * r0 + v.y * r1 + v.z * r2 + v.w * r3, in the order of the
+ * generic Vec4 * Mat4 multiplication.
+ */
+inline
+__m128 _m3d_transform4(const float* v, const __m128& r0, const __m128& r1, const __m128& r2, const __m128& r3)
+{
+	__m128 res = _mm_mul_ps(_mm_set1_ps(v[0]), r0);
+	res = _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(v[1]), r1));
+	res = _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(v[2]), r2));
+	return _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(v[3]), r3));
+}
+
+/**
+ * Stores the first three components of v, without touching the memory
+ * after them.
+ */
+inline
+void _m3d_store3(float* dst, const __m128& v)
+{
+	_mm_storel_pi((__m64*)dst, v);
+	_mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+}
+
+template<>
+inline
+Mat4<float> Mat4<float>::operator*(const Mat4<float>& m) const
+{
+	const __m128 r0 = _mm_loadu_ps(&m._11);
+	const __m128 r1 = _mm_loadu_ps(&m._21);
+	const __m128 r2 = _mm_loadu_ps(&m._31);
+	const __m128 r3 = _mm_loadu_ps(&m._41);
+
+	Mat4<float> res;
+	_mm_storeu_ps(&res._11, _m3d_transform4(&_11, r0, r1, r2, r3));
+	_mm_storeu_ps(&res._21, _m3d_transform4(&_21, r0, r1, r2, r3));
+	_mm_storeu_ps(&res._31, _m3d_transform4(&_31, r0, r1, r2, r3));
+	_mm_storeu_ps(&res._41, _m3d_transform4(&_41, r0, r1, r2, r3));
+	return res;
+}
+
+template<>
+inline
+Mat4<float>& Mat4<float>::operator*=(const Mat4<float>& m)
+{
+	*this = *this * m;
+	return *this;
+}
+
+template<>
+inline
+Mat4<float> Mat4<float>::affineMultiply(const Mat4<float>& m) const
+{
+	// the last column of m is (0, 0, 0, 1), so the last column of the
+	// product is correct without further masking
+	const __m128 r0 = _mm_loadu_ps(&m._11);
+	const __m128 r1 = _mm_loadu_ps(&m._21);
+	const __m128 r2 = _mm_loadu_ps(&m._31);
+	const __m128 r3 = _mm_loadu_ps(&m._41);
+	const __m128 zero = _mm_setzero_ps();
+
+	Mat4<float> res;
+	_mm_storeu_ps(&res._11, _m3d_transform3(&_11, r0, r1, r2, zero));
+	_mm_storeu_ps(&res._21, _m3d_transform3(&_21, r0, r1, r2, zero));
+	_mm_storeu_ps(&res._31, _m3d_transform3(&_31, r0, r1, r2, zero));
+	_mm_storeu_ps(&res._41, _m3d_transform3(&_41, r0, r1, r2, r3));
+	return res;
+}
+
+template<>
+inline
+Mat4<float> Mat4<float>::orthonormalInverse() const
+{
+	// transpose the rotation, the last column of a rigid transform is
+	// (0, 0, 0, 1), which becomes the zero row r3
+	__m128 r0 = _mm_loadu_ps(&_11);
+	__m128 r1 = _mm_loadu_ps(&_21);
+	__m128 r2 = _mm_loadu_ps(&_31);
+	__m128 r3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	// the inverse translation is -(pos * rotation^T), w = 1
+	const __m128 w = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	__m128 pos = _mm_mul_ps(_mm_set1_ps(_41), r0);
+	pos = _mm_add_ps(pos, _mm_mul_ps(_mm_set1_ps(_42), r1));
+	pos = _mm_add_ps(pos, _mm_mul_ps(_mm_set1_ps(_43), r2));
+
+	Mat4<float> res;
+	_mm_storeu_ps(&res._11, r0);
+	_mm_storeu_ps(&res._21, r1);
+	_mm_storeu_ps(&res._31, r2);
+	_mm_storeu_ps(&res._41, _mm_sub_ps(w, pos));
+	return res;
+}
+
+template<>
+inline
+Mat4<float> Mat4<float>::transposed() const
+{
+	__m128 r0 = _mm_loadu_ps(&_11);
+	__m128 r1 = _mm_loadu_ps(&_21);
+	__m128 r2 = _mm_loadu_ps(&_31);
+	__m128 r3 = _mm_loadu_ps(&_41);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	Mat4<float> res;
+	_mm_storeu_ps(&res._11, r0);
+	_mm_storeu_ps(&res._21, r1);
+	_mm_storeu_ps(&res._31, r2);
+	_mm_storeu_ps(&res._41, r3);
+	return res;
+}
+
+template<>
+inline
+Mat4<float> Mat4<float>::inverse() const
+{
+	// Source: http://www.intel.com/design/pentiumiii/sml/245043.htm
+	// The SIMD version of the cofactor inverse, but with an exact division
+	// instead of the reciprocal approximation.
+	const float* src = &_11;
+	__m128 minor0, minor1, minor2, minor3;
+	__m128 row0, row1, row2, row3;
+	__m128 det, tmp1 = _mm_setzero_ps();
+
+	// load the transposed matrix
+	row1 = _mm_setzero_ps();
+	tmp1 = _mm_loadh_pi(_mm_loadl_pi(tmp1, (const __m64*)(src)), (const __m64*)(src + 4));
+	row1 = _mm_loadh_pi(_mm_loadl_pi(row1, (const __m64*)(src + 8)), (const __m64*)(src + 12));
+	row0 = _mm_shuffle_ps(tmp1, row1, 0x88);
+	row1 = _mm_shuffle_ps(row1, tmp1, 0xDD);
+	row3 = _mm_setzero_ps();
+	tmp1 = _mm_loadh_pi(_mm_loadl_pi(tmp1, (const __m64*)(src + 2)), (const __m64*)(src + 6));
+	row3 = _mm_loadh_pi(_mm_loadl_pi(row3, (const __m64*)(src + 10)), (const __m64*)(src + 14));
+	row2 = _mm_shuffle_ps(tmp1, row3, 0x88);
+	row3 = _mm_shuffle_ps(row3, tmp1, 0xDD);
+
+	// the cofactors
+	tmp1 = _mm_mul_ps(row2, row3);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+	minor0 = _mm_mul_ps(row1, tmp1);
+	minor1 = _mm_mul_ps(row0, tmp1);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+	minor0 = _mm_sub_ps(_mm_mul_ps(row1, tmp1), minor0);
+	minor1 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor1);
+	minor1 = _mm_shuffle_ps(minor1, minor1, 0x4E);
+
+	tmp1 = _mm_mul_ps(row1, row2);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+	minor0 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor0);
+	minor3 = _mm_mul_ps(row0, tmp1);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+	minor0 = _mm_sub_ps(minor0, _mm_mul_ps(row3, tmp1));
+	minor3 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor3);
+	minor3 = _mm_shuffle_ps(minor3, minor3, 0x4E);
+
+	tmp1 = _mm_mul_ps(_mm_shuffle_ps(row1, row1, 0x4E), row3);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+	row2 = _mm_shuffle_ps(row2, row2, 0x4E);
+	minor0 = _mm_add_ps(_mm_mul_ps(row2, tmp1), minor0);
+	minor2 = _mm_mul_ps(row0, tmp1);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+	minor0 = _mm_sub_ps(minor0, _mm_mul_ps(row2, tmp1));
+	minor2 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor2);
+	minor2 = _mm_shuffle_ps(minor2, minor2, 0x4E);
+
+	tmp1 = _mm_mul_ps(row0, row1);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+	minor2 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor2);
+	minor3 = _mm_sub_ps(_mm_mul_ps(row2, tmp1), minor3);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+	minor2 = _mm_sub_ps(_mm_mul_ps(row3, tmp1), minor2);
+	minor3 = _mm_sub_ps(minor3, _mm_mul_ps(row2, tmp1));
+
+	tmp1 = _mm_mul_ps(row0, row3);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+	minor1 = _mm_sub_ps(minor1, _mm_mul_ps(row2, tmp1));
+	minor2 = _mm_add_ps(_mm_mul_ps(row1, tmp1), minor2);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+	minor1 = _mm_add_ps(_mm_mul_ps(row2, tmp1), minor1);
+	minor2 = _mm_sub_ps(minor2, _mm_mul_ps(row1, tmp1));
+
+	tmp1 = _mm_mul_ps(row0, row2);
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+	minor1 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor1);
+	minor3 = _mm_sub_ps(minor3, _mm_mul_ps(row1, tmp1));
+	tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+	minor1 = _mm_sub_ps(minor1, _mm_mul_ps(row3, tmp1));
+	minor3 = _mm_add_ps(_mm_mul_ps(row1, tmp1), minor3);
+
+	// the determinant
+	det = _mm_mul_ps(row0, minor0);
+	det = _mm_add_ps(_mm_shuffle_ps(det, det, 0x4E), det);
+	det = _mm_add_ss(_mm_shuffle_ps(det, det, 0xB1), det);
+	det = _mm_div_ss(_mm_set_ss(1.0f), det);
+	det = _mm_shuffle_ps(det, det, 0x00);
+
+	Mat4<float> res;
+	_mm_storeu_ps(&res._11, _mm_mul_ps(det, minor0));
+	_mm_storeu_ps(&res._21, _mm_mul_ps(det, minor1));
+	_mm_storeu_ps(&res._31, _mm_mul_ps(det, minor2));
+	_mm_storeu_ps(&res._41, _mm_mul_ps(det, minor3));
+	return res;
+}
+
+template<>
+inline
+Vec4<float> Vec4<float>::operator*(const Mat4<float>& m) const
+{
+	Vec4<float> res;
+	_mm_storeu_ps(&res.x, _m3d_transform4(&x, _mm_loadu_ps(&m._11), _mm_loadu_ps(&m._21),
+			_mm_loadu_ps(&m._31), _mm_loadu_ps(&m._41)));
+	return res;
+}
+
+template<>
+inline
+Vec4<float>& Vec4<float>::operator*=(const Mat4<float>& m)
+{
+	_mm_storeu_ps(&x, _m3d_transform4(&x, _mm_loadu_ps(&m._11), _mm_loadu_ps(&m._21),
+			_mm_loadu_ps(&m._31), _mm_loadu_ps(&m._41)));
+	return *this;
+}
+
+template<>
+inline
+Vec3<float> Vec3<float>::operator*(const Mat4<float>& m) const
+{
+	Vec3<float> res;
+	_m3d_store3(&res.x, _m3d_transform3(&x, _mm_loadu_ps(&m._11), _mm_loadu_ps(&m._21),
+			_mm_loadu_ps(&m._31), _mm_loadu_ps(&m._41)));
+	return res;
+}
+
+template<>
+inline
+void transformPoints(const Mat4<float>& m, const Vec3<float>* in, Vec3<float>* out, unsigned count)
+{
+	// load the matrix only once for all points
+	const __m128 r0 = _mm_loadu_ps(&m._11);
+	const __m128 r1 = _mm_loadu_ps(&m._21);
+	const __m128 r2 = _mm_loadu_ps(&m._31);
+	const __m128 r3 = _mm_loadu_ps(&m._41);
+
+	for (unsigned i = 0; i < count; ++i)
+		_m3d_store3(&out[i].x, _m3d_transform3(&in[i].x, r0, r1, r2, r3));
+}
+
+#endif /* M3D_USE_SSE */
+
+#endif /* SIMD_HPP_ */
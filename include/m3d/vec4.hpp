@@ -9,7 +9,7 @@
 #define VEC4_HPP_
 
 template<typename T>
-class Vec4 {
+class M3D_ALIGN Vec4 {
 public:
 	Vec4<T>();
 	Vec4<T>(const Vec4<int32_t>& v);
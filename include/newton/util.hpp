@@ -9,15 +9,74 @@
 
 #include <m3d/m3d.hpp>
 #include <opengl/camera.hpp>
+#include <util/threadlocal.hpp>
 #include <Newton.h>
-#include <list>
+#include <boost/tr1/unordered_set.hpp>
+#include <vector>
 
 namespace newton {
 
 using namespace m3d;
 
-extern NewtonWorld* world;
-extern float gravity;
+/** The world of the calling thread, see sim::World::makeCurrent() */
+extern THREAD_LOCAL NewtonWorld* world;
+
+/**
+ * A set of bodies that are ignored by the spatial queries.
+ */
+typedef std::tr1::unordered_set<const NewtonBody*> BodySet;
+
+/**
+ * A ray query from p0 to p1.
+ */
+struct Ray {
+	Vec3f p0, p1;
+
+	Ray() { }
+	Ray(const Vec3f& p0, const Vec3f& p1) : p0(p0), p1(p1) { }
+};
+
+/**
+ * The result of a ray query. If nothing was hit, the body is NULL
+ * and the parameter is greater than 1.
+ */
+struct RayHit {
+	/** The closest body hit by the ray, or NULL */
+	NewtonBody* body;
+
+	/** The intersection parameter between p0 and p1 */
+	float param;
+
+	/** The normal at the intersection */
+	Vec3f normal;
+};
+
+/**
+ * A convex cast query, that sweeps the collision from the position of
+ * the given matrix to the target position.
+ */
+struct ConvexCast {
+	const NewtonCollision* collision;
+	Mat4f matrix;
+	Vec3f target;
+
+	ConvexCast() : collision(NULL) { }
+	ConvexCast(const NewtonCollision* collision, const Mat4f& matrix, const Vec3f& target)
+		: collision(collision), matrix(matrix), target(target) { }
+};
+
+/**
+ * The result of a convex cast. The parameter is the fraction of the way
+ * to the target the collision can travel before the first contact. If
+ * nothing was hit, the parameter is 1 and the body is NULL.
+ */
+struct ConvexHit {
+	/** The first body hit by the cast, or NULL */
+	const NewtonBody* body;
+
+	/** The parameter of the first contact between start and target */
+	float param;
+};
 
 /**
  * Calculates the forces resulting of the explosion at the given position
@@ -39,6 +98,30 @@ void applyExplosion(const Vec3f& position, float strength, float radius);
  */
 NewtonBody* getRayCastBody(const Vec3f& origin, const Vec3f& dir);
 
+/**
+ * Casts all rays into the world and stores the closest hit of each ray
+ * in hits, in the same order. Large batches are split across the worker
+ * threads of the world. The world must not be updated until the call
+ * returns.
+ *
+ * @param rays    The rays to cast
+ * @param hits    The hits, resized to the number of rays
+ * @param exclude Bodies to ignore, or NULL
+ */
+void castRays(const std::vector<Ray>& rays, std::vector<RayHit>& hits, const BodySet* exclude = NULL);
+
+/**
+ * Sweeps all convex collisions through the world and stores the first
+ * contact of each cast in hits, in the same order. Large batches are
+ * split across the worker threads of the world. The world must not be
+ * updated until the call returns.
+ *
+ * @param casts   The convex casts to perform
+ * @param hits    The hits, resized to the number of casts
+ * @param exclude Bodies to ignore, or NULL
+ */
+void castConvex(const std::vector<ConvexCast>& casts, std::vector<ConvexHit>& hits, const BodySet* exclude = NULL);
+
 
 /**
  * Returns the vertical position of the world at the given position
@@ -51,16 +134,37 @@ NewtonBody* getRayCastBody(const Vec3f& origin, const Vec3f& dir);
  */
 float getVerticalPosition(float x, float z);
 
+/**
+ * Returns the vertical positions of the world at all given positions
+ * of the plane, using a single batch of ray casts.
+ *
+ * @param points The x and z positions in the plane
+ * @param result The y positions in the world, in the same order
+ */
+void getVerticalPositions(const std::vector<Vec2f>& points, std::vector<float>& result);
+
 /**
  * Does a convex cast of the body and returns the vertical position of
  * the body so that it just collides with the ground. This function takes
  * into consideration all collision shapes and bodies of the given world.
  * This also works with compound collisions.
  *
- * @param body The body to use for the convex cast
- * @return     The new vertical position of the body
+ * @param body    The body to use for the convex cast
+ * @param exclude Additional bodies to ignore, or NULL
+ * @return        The new vertical position of the body
+ */
+float getConvexCastPlacement(NewtonBody* body, const BodySet* exclude = NULL);
+
+/**
+ * Does the convex cast placement of getConvexCastPlacement() for all
+ * given bodies in a single batch. The bodies themselves are ignored
+ * by all casts.
+ *
+ * @param bodies  The bodies to place
+ * @param result  The new vertical positions, in the same order
+ * @param exclude Additional bodies to ignore, or NULL
  */
-float getConvexCastPlacement(NewtonBody* body, std::list<NewtonBody*>* noCollision = NULL);
+void getConvexCastPlacements(const std::vector<NewtonBody*>& bodies, std::vector<float>& result, const BodySet* exclude = NULL);
 
 /**
  * Renders the specified collision shape, transformed with the given matrix.
@@ -127,6 +127,15 @@ public:
 	 */
 	Vec3f pointer(int x, int y) const;
 
+	/**
+	 * Returns the projected radius in pixels of a unit sphere at a
+	 * distance of 1. The size of an object on the screen is its radius
+	 * times this scale divided by its distance.
+	 *
+	 * @return The scale from the radius to pixels at a distance of 1
+	 */
+	float pixelScale() const;
+
 	/**
 	 * Checks whether the given axis-aligned bounding box is partially
 	 * or fully visible. If so, returns True.
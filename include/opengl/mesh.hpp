@@ -43,6 +43,15 @@ protected:
 
 	/** The sub-meshes of the mesh */
 	ogl::SubBuffers m_buffers;
+
+	/**
+	 * Generates the simplified levels of detail of all sub-meshes and
+	 * appends their indices. The vertices are clustered in a grid that
+	 * gets coarser with each level, triangles that collapse are removed.
+	 * The simplified levels reference the vertices of the full mesh, so
+	 * only indices are added.
+	 */
+	void genLODs();
 public:
 	virtual ~__Mesh();
 
@@ -65,11 +74,15 @@ public:
 	virtual const ogl::SubBuffers& getBuffers();
 
 	/**
-	 * Inserts the vertices, indices and sub-meshes into the given VBO.
+	 * Inserts the vertices, indices and sub-meshes into the given VBO. If
+	 * userData is specified, it replaces the userData of the sub-meshes,
+	 * which allows sharing a single mesh between multiple objects.
 	 *
-	 * @param vbo The VBO to insert the data in.
+	 * @param vbo       The VBO to insert the data in.
+	 * @param userData  The userData for the new sub-buffers, or NULL
+	 * @param transform The transform slot for the new sub-buffers
 	 */
-	virtual void genBuffers(ogl::VertexBuffer& vbo);
+	virtual void genBuffers(ogl::VertexBuffer& vbo, void* userData = NULL, uint32_t transform = 0);
 
 	/**
 	 * Returns a mesh created from a 3ds file. The userData of the sub-meshes will
@@ -0,0 +1,180 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 4, 2011
+ * @file opengl/renderstate.hpp
+ */
+
+#ifndef RENDERSTATE_HPP_
+#define RENDERSTATE_HPP_
+
+#include <GL/glew.h>
+#include <string.h>
+#include <map>
+
+namespace ogl {
+
+/**
+ * A shadow copy of the OpenGL state that changes most often between
+ * draw calls: the bound program, the texture of each unit, the active
+ * texture unit, the front material and the uniform values of each
+ * program. Changes are only passed to OpenGL if they differ from the
+ * shadowed value.
+ *
+ * All state changes have to be made through this class, e.g. by using
+ * __Shader::bind() and __Texture::bind(). If the state is changed in any
+ * other way, for instance by compiling or calling a display list, call
+ * invalidate() to force the next changes to be passed to OpenGL.
+ */
+class RenderState {
+public:
+	/** The number of tracked texture units */
+	static const unsigned TEXTURE_UNITS = 8;
+
+	/** Marks a shadowed value as unknown */
+	static const GLuint UNKNOWN = ~0u;
+private:
+	static RenderState* s_instance;
+	RenderState();
+	RenderState(const RenderState& other);
+	virtual ~RenderState();
+protected:
+	/** The value of a uniform, compared bitwise */
+	struct Uniform {
+		GLfloat data[4];
+	};
+
+	GLuint m_program;
+	GLuint m_activeUnit;
+	GLuint m_textures[TEXTURE_UNITS];
+
+	/** The front material: ambient, diffuse, specular, emission */
+	GLfloat m_material[4][4];
+	bool m_materialValid[4];
+	GLfloat m_shininess;
+	bool m_shininessValid;
+
+	/** The uniform values, indexed by program and location */
+	std::map<std::pair<GLuint, GLint>, Uniform> m_uniforms;
+
+	/**
+	 * Updates the shadowed value of the given uniform of the current program.
+	 *
+	 * @return True, if the value changed and has to be passed to OpenGL
+	 */
+	bool setUniform(GLint location, const GLfloat* data, unsigned size);
+public:
+	static RenderState& instance();
+	static void destroy();
+
+	/** Forgets the complete shadowed state. */
+	void invalidate();
+
+	/** Binds the given program, 0 unbinds the current program. */
+	void useProgram(GLuint program);
+
+	/** @param unit The new active texture unit, GL_TEXTURE0 + n */
+	void activeTexture(GLenum unit);
+
+	/** Binds the texture to the active texture unit. */
+	void bindTexture(GLenum target, GLuint texture);
+
+	/** Binds the texture to the given unit, GL_TEXTURE0 + n. */
+	void bindTexture(GLenum unit, GLenum target, GLuint texture);
+
+	/**
+	 * Sets a color of the front material.
+	 *
+	 * @param pname  GL_AMBIENT, GL_DIFFUSE, GL_SPECULAR or GL_EMISSION
+	 * @param params The RGBA color
+	 */
+	void material(GLenum pname, const GLfloat* params);
+
+	/** @param shininess The shininess of the front material */
+	void shininess(GLfloat shininess);
+
+	/**
+	 * Sets the uniforms of the currently bound program.
+	 *
+	 * @param location The location of the uniform, -1 is ignored
+	 */
+	void uniform1i(GLint location, GLint value);
+	void uniform1f(GLint location, GLfloat value);
+	void uniform4fv(GLint location, const GLfloat* value);
+
+	/** Removes a deleted texture from the shadowed state. */
+	void textureDeleted(GLuint texture);
+
+	/** Removes a deleted program from the shadowed state. */
+	void programDeleted(GLuint program);
+
+	/** @return The bound program or UNKNOWN */
+	GLuint getProgram() const;
+
+	/** @return The active texture unit, GL_TEXTURE0 + n, or UNKNOWN */
+	GLuint getActiveTexture() const;
+};
+
+
+inline
+RenderState& RenderState::instance()
+{
+	if (!s_instance)
+		s_instance = new RenderState();
+	return *s_instance;
+}
+
+inline
+void RenderState::useProgram(GLuint program)
+{
+	if (program != m_program) {
+		glUseProgram(program);
+		m_program = program;
+	}
+}
+
+inline
+void RenderState::activeTexture(GLenum unit)
+{
+	if (unit != m_activeUnit) {
+		glActiveTexture(unit);
+		m_activeUnit = unit - GL_TEXTURE0 < TEXTURE_UNITS ? unit : UNKNOWN;
+	}
+}
+
+inline
+void RenderState::bindTexture(GLenum target, GLuint texture)
+{
+	if (m_activeUnit == UNKNOWN) {
+		// any of the units could have been changed
+		glBindTexture(target, texture);
+		memset(m_textures, 0xff, sizeof(m_textures));
+	} else if (target != GL_TEXTURE_2D) {
+		glBindTexture(target, texture);
+	} else if (m_textures[m_activeUnit - GL_TEXTURE0] != texture) {
+		glBindTexture(target, texture);
+		m_textures[m_activeUnit - GL_TEXTURE0] = texture;
+	}
+}
+
+inline
+void RenderState::bindTexture(GLenum unit, GLenum target, GLuint texture)
+{
+	activeTexture(unit);
+	bindTexture(target, texture);
+}
+
+inline
+GLuint RenderState::getProgram() const
+{
+	return m_program;
+}
+
+inline
+GLuint RenderState::getActiveTexture() const
+{
+	return m_activeUnit;
+}
+
+}
+
+#endif /* RENDERSTATE_HPP_ */
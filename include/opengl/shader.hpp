@@ -9,7 +9,9 @@
 
 #include <GL/glew.h>
 #include <boost/tr1/memory.hpp>
+#include <opengl/renderstate.hpp>
 #include <iostream>
+#include <string>
 #include <map>
 
 namespace ogl {
@@ -43,25 +45,81 @@ protected:
 	GLuint m_vertexObject, m_fragmentObject;
 	GLuint m_programObject;
 
+	// cached uniform locations, indexed by the name of the uniform
+	std::map<std::string, GLint> m_uniformLocations;
+
 	// returns the info (error) log
 	void getInfoLog(GLuint object);
+
+	/**
+	 * Returns a hash of the sources and of the vendor, renderer and
+	 * version of the driver. A program binary is only valid for the
+	 * same key.
+	 */
+	std::size_t getCacheKey() const;
 public:
 	__Shader(GLchar* vertexSource, GLchar* fragmentSource);
 	virtual ~__Shader();
 
 	/**
 	 * Compiles and links the shader objects. Returns true if successful.
+	 * This is the same as compileObjects() followed by link().
 	 *
 	 * @return true if successful, false else
 	 */
 	bool compile();
 
+	/**
+	 * Compiles the vertex and the fragment shader objects.
+	 *
+	 * @return true if both compiled, false else
+	 */
+	bool compileObjects();
+
+	/**
+	 * Links the shader objects created by compileObjects() to the program.
+	 *
+	 * @return true if successful, false else
+	 */
+	bool link();
+
+	/**
+	 * Loads the linked program from the given cache file instead of
+	 * compiling it. The file is only used if it has been written for the
+	 * same sources and the same driver. Returns true if successful.
+	 *
+	 * @param fileName The program binary cache file
+	 * @return         true if successful, false if the shader has to be compiled
+	 */
+	bool loadBinary(const std::string& fileName);
+
+	/**
+	 * Writes the linked program to the given cache file.
+	 *
+	 * @param fileName The program binary cache file
+	 * @return         true if successful, false otherwise
+	 */
+	bool saveBinary(const std::string& fileName);
+
 	/** Binds the shader program */
 	void bind();
 
 	/** Unbinds the current shader program */
 	static void unbind();
 
+	/**
+	 * Returns the location of the given uniform. The location is only
+	 * queried once per uniform and then cached.
+	 *
+	 * @param uniform The name of the uniform
+	 * @return        The location or -1, if the uniform is not active
+	 */
+	GLint getUniformLocation(const char* uniform);
+
+	/**
+	 * Sets the uniforms of the shader, which has to be bound. Values
+	 * that did not change are not passed to OpenGL.
+	 */
 	void setUniform4fv(const char* uniform, GLfloat* data);
 	void setUniform1f(const char* uniform, GLfloat data);
 	void setUniform1i(const char* uniform, GLint data);
@@ -91,6 +149,11 @@ private:
 	ShaderMgr(const ShaderMgr& other);
 	virtual ~ShaderMgr();
 protected:
+	/** Incremented whenever shaders are added */
+	unsigned m_generation;
+
+	/** The folder of the program binary cache, empty if the cache is disabled */
+	std::string m_cacheFolder;
 public:
 	static ShaderMgr& instance();
 	static void destroy();
@@ -100,43 +163,70 @@ public:
 
 	/** Loads all shaders in the specified folder. Vertex (*.vs) and
 	 * fragment shader (*.fs) files with the same name are linked together
-	 * and stored with the file name as a key.
+	 * and stored with the file name as a key. Linked programs are taken
+	 * from the program binary cache, if possible. The time needed for each
+	 * shader is reported on the console.
 	 */
 	unsigned load(const std::string& folder);
 
 	/** Returns the associated shader or an empty smart pointer */
 	Shader get(const std::string& name);
+
+	/**
+	 * Returns a counter that changes whenever the shaders returned by
+	 * get() might have changed.
+	 *
+	 * @return The current generation of the manager
+	 */
+	unsigned getGeneration() const;
 };
 
 
 inline
 void __Shader::bind()
 {
-	glUseProgram(m_programObject);
+	RenderState::instance().useProgram(m_programObject);
 }
 
 inline
 void __Shader::unbind()
 {
-	glUseProgram(0);
+	RenderState::instance().useProgram(0);
+}
+
+inline
+GLint __Shader::getUniformLocation(const char* uniform)
+{
+	std::map<std::string, GLint>::iterator itr = m_uniformLocations.find(uniform);
+	if (itr != m_uniformLocations.end())
+		return itr->second;
+	GLint location = glGetUniformLocation(m_programObject, uniform);
+	m_uniformLocations[uniform] = location;
+	return location;
 }
 
 inline
 void __Shader::setUniform4fv(const char* uniform, GLfloat* data)
 {
-	glUniform4fv(glGetUniformLocation(m_programObject, uniform), 1, data);
+	RenderState::instance().uniform4fv(getUniformLocation(uniform), data);
 }
 
 inline
 void __Shader::setUniform1f(const char* uniform, GLfloat data)
 {
-	glUniform1f(glGetUniformLocation(m_programObject, uniform), data);
+	RenderState::instance().uniform1f(getUniformLocation(uniform), data);
 }
 
 inline
 void __Shader::setUniform1i(const char* uniform, GLint data)
 {
-	glUniform1i(glGetUniformLocation(m_programObject, uniform), data);
+	RenderState::instance().uniform1i(getUniformLocation(uniform), data);
+}
+
+inline
+unsigned ShaderMgr::getGeneration() const
+{
+	return m_generation;
 }
 
 inline
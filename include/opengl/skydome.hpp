@@ -8,6 +8,7 @@
 #define SKYDOME_HPP_
 
 #include <string>
+#include <vector>
 #include <m3d/m3d.hpp>
 #include <opengl/texture.hpp>
 #include <opengl/shader.hpp>
@@ -19,17 +20,68 @@ using namespace m3d;
 
 /**
  * A fancy skydome with dynamic clouds and a sun with optional lens flares.
+ *
+ * The visibility of the sun is determined by two occlusion queries on the
+ * sun disc, one counting all samples of the disc and one counting only the
+ * samples that pass the depth test. The results are read back a frame late,
+ * and only if they are already available, so the query never stalls the
+ * pipeline.
  */
 class Skydome {
 protected:
+	/**
+	 * A range of flare quads in the flare buffer that is drawn with the
+	 * same blend function and depth test.
+	 */
+	typedef struct {
+		GLenum blend;
+		bool depthTest;
+		GLint first;
+		GLsizei count;
+	} FlareBatch;
+
 	GLuint m_flares;
-	GLuint m_list;
 	Shader m_shader;
 	GLuint m_clouds;
 	float m_radius;
 	Vec4f m_horizon;
 	float m_time, m_delta;
 	float m_fadeTime;
+
+	/** The vertex buffer of the dome and its number of vertices */
+	GLuint m_dome;
+	GLsizei m_domeVertices;
+
+	/** The streamed vertex buffer of the flares, interleaved uv, color and position */
+	GLuint m_flareBuffer;
+	std::vector<float> m_flareData;
+	std::vector<FlareBatch> m_flareBatches;
+
+	/** Two sets of queries, counting all and the visible samples of the sun disc */
+	GLuint m_queries[2][2];
+	bool m_queryPending[2];
+
+	/** The visible fraction of the sun disc, as of the last available query */
+	float m_sunVisibility;
+
+	/** True, if the flares faded in or out during the last frame */
+	bool m_fading;
+
+	/**
+	 * Reads the results of all pending queries that are available without
+	 * waiting and issues a new query for the sun disc, if a query set is free.
+	 *
+	 * @param modelview The modelview matrix of the camera
+	 * @param light     The position of the sun
+	 */
+	void querySun(const Mat4f& modelview, const Vec3f& light);
+
+	/**
+	 * Appends a flare quad to the flare buffer. Consecutive flares with the
+	 * same blend function and depth test are drawn in one batch.
+	 */
+	void addFlare(GLenum blend, bool depthTest, int flare, const Vec4f& color,
+			const Mat4f& mat, const Vec3f& position, float scale);
 public:
 	typedef enum { BIG_GLOW = 0, GLOW, HALO, STREAK } Flares;
 
@@ -43,9 +95,34 @@ public:
 	void clear();
 
 	void update(float dt);
-	void render(const Camera& cam, const Vec3f& light, bool concealed);
+	void render(const Camera& cam, const Vec3f& light);
+
+	/** @return The visible fraction of the sun disc, between 0 and 1 */
+	float getSunVisibility() const;
+
+	/**
+	 * Returns whether the flares are fading in or out, i.e. whether the
+	 * next frames differ noticeably. The slow drift of the clouds is not
+	 * included.
+	 *
+	 * @return True, while the flares fade
+	 */
+	bool isFading() const;
 };
 
+
+inline
+float Skydome::getSunVisibility() const
+{
+	return m_sunVisibility;
+}
+
+inline
+bool Skydome::isFading() const
+{
+	return m_fading;
+}
+
 }
 
 #endif /* SKYDOME_HPP_ */
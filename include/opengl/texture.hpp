@@ -10,7 +10,11 @@
 
 #include <GL/glew.h>
 #include <boost/tr1/memory.hpp>
+#include <boost/thread.hpp>
+#include <opengl/renderstate.hpp>
 #include <string>
+#include <vector>
+#include <queue>
 #include <map>
 
 namespace ogl {
@@ -70,11 +74,47 @@ public:
 
 	GLuint m_textureID;
 	GLuint m_target;
+
+	/** False, as long as only the placeholder image is uploaded */
+	bool m_loaded;
+};
+
+/**
+ * A texture image that is decoded by the streaming thread of the
+ * TextureMgr. The levels contain either raw RGBA data or data in the
+ * compressed format, if the image was read from the texture cache.
+ */
+struct TextureJob {
+	/** A single mip-map level */
+	struct Level {
+		GLsizei width;
+		GLsizei height;
+		std::vector<unsigned char> data;
+	};
+
+	std::string name;
+	std::string fileName;
+	std::string cacheFile;
+
+	/** The compressed internal format of the levels, or 0 for raw RGBA data */
+	GLenum format;
+
+	/** True, if this job writes the levels to the cache file */
+	bool store;
+
+	std::vector<Level> levels;
 };
 
 /**
  * A simple texture manager for named texture objects. Provides
  * methods to load and add new textures efficiently.
+ *
+ * Textures registered with load() are streamed in lazily: the first call
+ * to get() returns a texture with a placeholder image and queues the file
+ * for the streaming thread, which decodes it and generates the mip-maps.
+ * The finished images are uploaded by update() using a pixel buffer object.
+ * If S3TC is supported, the compressed mip-maps are stored in the texture
+ * cache, so later runs neither decode the file nor generate mip-maps.
  */
 class TextureMgr : public std::map<std::string, Texture> {
 private:
@@ -83,6 +123,86 @@ private:
 	TextureMgr(const TextureMgr& other);
 	virtual ~TextureMgr();
 protected:
+	/** The registered texture files, indexed by the texture name */
+	std::map<std::string, std::string> m_files;
+
+	/** The folder of the texture cache, empty if the cache is disabled */
+	std::string m_cacheFolder;
+
+	/** The streaming thread and the queues it shares with the render thread */
+	boost::thread* m_thread;
+	boost::mutex m_mutex;
+	boost::condition_variable m_condition;
+	std::queue<TextureJob*> m_pending;
+	std::queue<TextureJob*> m_finished;
+	bool m_running;
+
+	/** The pixel buffer object used for uploads, or 0 */
+	GLuint m_pbo;
+
+	/** Incremented whenever textures are registered, added or removed */
+	unsigned m_generation;
+
+	/** The number of textures requested by get() that are not uploaded yet */
+	unsigned m_streaming;
+
+	/**
+	 * A texture compressed by the driver, whose levels are read back for
+	 * the texture cache.
+	 */
+	struct Readback {
+		Texture texture;
+
+		/** The job that stores the levels, its sizes are already set */
+		TextureJob* job;
+
+		/** The pixel buffer object the levels are transferred into, or 0 */
+		GLuint pbo;
+	};
+
+	/** The textures uploaded since the last call to update() */
+	std::vector<Readback> m_readbacks;
+
+	/** The main loop of the streaming thread. */
+	void run();
+
+	/**
+	 * Decodes the image of the job, either from the texture cache or
+	 * from the texture file. Called by the streaming thread.
+	 *
+	 * @param job The job to process
+	 * @return    True, if the job contains at least one level
+	 */
+	bool decode(TextureJob* job);
+
+	/**
+	 * Writes the levels of the job to its cache file. Called by the
+	 * streaming thread.
+	 *
+	 * @param job The job to store
+	 */
+	void store(TextureJob* job);
+
+	/**
+	 * Uploads the levels of the job to the texture. Raw images are
+	 * compressed by the driver and read back for the cache, if possible.
+	 *
+	 * @param job     The finished job
+	 * @param texture The texture to upload the levels to
+	 */
+	void upload(TextureJob* job, Texture texture);
+
+	/**
+	 * Reads the compressed levels of the given textures back and passes
+	 * them to the streaming thread. The levels of all textures are copied
+	 * into pixel buffer objects before the first one is mapped.
+	 *
+	 * @param readbacks The textures to read back
+	 */
+	void readBack(std::vector<Readback>& readbacks);
+
+	/** @param job The job to pass to the streaming thread */
+	void enqueue(TextureJob* job);
 public:
 	static TextureMgr& instance();
 	static void destroy();
@@ -97,21 +217,49 @@ public:
 	Texture add(const std::string& name, Texture texture);
 
 	/**
-	 * Loads all textures within the given folder. The texture names will
+	 * Registers all textures within the given folder. The texture names will
 	 * be the base name of the files, i.e. the file name without its extension.
+	 * The files are not read until the texture is requested with get().
 	 *
 	 * @param folder The folder to load the textures from
+	 * @return       The number of registered textures
 	 */
 	unsigned load(const std::string& folder);
 
 	/**
 	 * Returns the texture object with the given name, or an empty
-	 * smart pointer if it does not exist.
+	 * smart pointer if it does not exist. If the texture is not loaded
+	 * yet, it will be streamed in and a placeholder is bound meanwhile.
 	 *
 	 * @param name The name of the texture
 	 * @return     The associated texture object or an empty smart pointer
 	 */
 	Texture get(const std::string& name);
+
+	/**
+	 * Uploads textures that have been decoded by the streaming thread.
+	 * This has to be called regularly from the thread of the GL context,
+	 * e.g. once per frame.
+	 *
+	 * @param maxUploads The maximum number of textures to upload
+	 * @return           The number of uploaded textures
+	 */
+	unsigned update(unsigned maxUploads = 2);
+
+	/**
+	 * Returns a counter that changes whenever the textures returned by
+	 * get() might have changed. Users that keep texture objects have to
+	 * look them up again if the value differs.
+	 *
+	 * @return The current generation of the manager
+	 */
+	unsigned getGeneration() const;
+
+	/**
+	 * @return True, if textures are streamed in, i.e. the next calls to
+	 *         update() will change the textures
+	 */
+	bool isStreaming() const;
 };
 
 
@@ -156,20 +304,32 @@ void __Texture::setWrap(GLint s, GLint t)
 inline
 void __Texture::bind()
 {
-	glBindTexture(m_target, m_textureID);
+	RenderState::instance().bindTexture(m_target, m_textureID);
 }
 
 inline
 void __Texture::unbind()
 {
-	glBindTexture(m_target, 0);
+	RenderState::instance().bindTexture(m_target, 0);
 }
 
 
 inline
 void __Texture::stage(GLuint stage)
 {
-	glActiveTexture(stage);
+	RenderState::instance().activeTexture(stage);
+}
+
+inline
+unsigned TextureMgr::getGeneration() const
+{
+	return m_generation;
+}
+
+inline
+bool TextureMgr::isStreaming() const
+{
+	return m_streaming > 0;
 }
 
 inline
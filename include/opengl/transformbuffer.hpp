@@ -0,0 +1,129 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 15, 2011
+ * @file opengl/transformbuffer.hpp
+ */
+
+#ifndef TRANSFORMBUFFER_HPP_
+#define TRANSFORMBUFFER_HPP_
+
+#include <GL/glew.h>
+
+namespace ogl {
+
+/**
+ * A buffer of object transforms on the GPU. The vertex shaders fetch the
+ * transform of the current object from it, so that only the transforms
+ * that changed have to be uploaded, instead of passing every matrix with
+ * glMultMatrixf in every frame.
+ *
+ * The buffer is a texture buffer with three RGBA32F texels per slot, the
+ * first three rows of the transposed, i.e. OpenGL-style, matrix. The
+ * last row is always (0, 0, 0, 1). The slot of the current object is
+ * passed in a generic vertex attribute as slot + 1, the default value 0
+ * tells the shaders to use the modelview matrix only.
+ *
+ * The buffer requires GL_ARB_texture_buffer_object. The shaders require
+ * GL_EXT_gpu_shader4 and declare the sampler "transforms" if they support
+ * it.
+ */
+class TransformBuffer {
+public:
+	/** The generic vertex attribute that holds the slot plus one */
+	static const GLuint ATTRIBUTE = 7;
+
+	/** The name of the attribute in the shaders */
+	static const char* const ATTRIBUTE_NAME;
+
+	/** The name of the sampler in the shaders */
+	static const char* const SAMPLER_NAME;
+
+	/** The texture unit of the buffer */
+	static const GLenum UNIT = GL_TEXTURE6;
+
+	/** The number of floats per transform */
+	static const unsigned FLOATS = 12;
+
+protected:
+	GLuint m_buffer;
+	GLuint m_texture;
+
+	/** The number of transforms that fit into the buffer */
+	unsigned m_capacity;
+
+	/** The number of bytes uploaded since the last call to getUploaded() */
+	unsigned m_uploaded;
+
+public:
+	TransformBuffer();
+	~TransformBuffer();
+
+	/** @return True, if the extensions of the buffer are supported */
+	static bool isSupported();
+
+	/**
+	 * Makes sure that the buffer holds at least the given number of
+	 * transforms. If the buffer has to grow, it is re-allocated and all
+	 * transforms have to be uploaded again.
+	 *
+	 * @param count The number of transforms
+	 * @return      True, if the buffer has been re-allocated
+	 */
+	bool reserve(unsigned count);
+
+	/**
+	 * Uploads a range of transforms, FLOATS floats per transform.
+	 *
+	 * @param first The slot of the first transform
+	 * @param count The number of transforms
+	 * @param data  The transforms
+	 */
+	void upload(unsigned first, unsigned count, const float* data);
+
+	/** Binds the buffer to its texture unit */
+	void bind() const;
+
+	/** @return The number of transforms that fit into the buffer */
+	unsigned getCapacity() const;
+
+	/** @return The number of uploaded bytes since the last call, and resets it */
+	unsigned getUploaded();
+
+	/**
+	 * Selects the transform of the following draw calls.
+	 *
+	 * @param slot The slot of the transform
+	 */
+	static void setSlot(unsigned slot);
+
+	/** Tells the shaders to use the modelview matrix only */
+	static void resetSlot();
+};
+
+
+inline unsigned TransformBuffer::getCapacity() const
+{
+	return m_capacity;
+}
+
+inline unsigned TransformBuffer::getUploaded()
+{
+	unsigned result = m_uploaded;
+	m_uploaded = 0;
+	return result;
+}
+
+inline void TransformBuffer::setSlot(unsigned slot)
+{
+	// floats represent all slots below 2^24 exactly
+	glVertexAttrib1f(ATTRIBUTE, (GLfloat)(slot + 1));
+}
+
+inline void TransformBuffer::resetSlot()
+{
+	glVertexAttrib1f(ATTRIBUTE, 0.0f);
+}
+
+}
+
+#endif /* TRANSFORMBUFFER_HPP_ */
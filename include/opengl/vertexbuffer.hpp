@@ -17,6 +17,8 @@
 #include <stdint.h>
 #endif
 #include <iostream>
+#include <map>
+#include <set>
 
 namespace ogl {
 
@@ -29,12 +31,21 @@ typedef std::vector<uint32_t> UInts;
  * objects within a single VBO.
  */
 struct SubBuffer {
-	// material of the sub mesh
-	std::string material;
+	/** The number of levels of detail, level 0 is the full geometry */
+	static const unsigned LOD_LEVELS = 3;
+
+	/** The level of sub-buffers that are too small to be drawn at all */
+	static const unsigned LOD_SKIPPED = LOD_LEVELS;
+
+	// dense id of the material of the sub mesh, see materialID()
+	int material;
 
 	// the object that generated this sub mesh
 	void* userData;
 
+	// the slot of the transform of the object, see sim::TransformStore
+	uint32_t transform;
+
 	// the offset and size in the global index buffer
 	uint32_t indexOffset;
 	uint32_t indexCount;
@@ -43,16 +54,76 @@ struct SubBuffer {
 	uint32_t dataOffset;
 	uint32_t dataCount;
 
+	// the offsets and sizes of the simplified levels 1 and above in the
+	// global index buffer, a size of 0 means the level is not available
+	uint32_t lodOffset[LOD_LEVELS - 1];
+	uint32_t lodCount[LOD_LEVELS - 1];
+
+	// the radius of the geometry around the origin of the object, or 0
+	// if the level of detail is not selected by the size on the screen
+	float radius;
+
+	// the level of detail of the last frame, see Simulation::render()
+	uint32_t lod;
+
 	SubBuffer() {
-		material = "";
+		material = 0;
 		indexOffset = indexCount = 0;
 		dataOffset = dataCount = 0;
 		userData = NULL;
+		transform = 0;
+		for (unsigned i = 0; i < LOD_LEVELS - 1; ++i)
+			lodOffset[i] = lodCount[i] = 0;
+		radius = 0.0f;
+		lod = 0;
+	}
+
+	/**
+	 * Returns the index range of the given level of detail. Levels that
+	 * are not available fall back to the next finer level.
+	 *
+	 * @param level  The level of detail, less than LOD_LEVELS
+	 * @param offset The offset in the global index buffer
+	 * @param count  The number of indices
+	 */
+	void getRange(unsigned level, uint32_t& offset, uint32_t& count) const {
+		while (level > 0 && !lodCount[level - 1])
+			--level;
+		offset = level ? lodOffset[level - 1] : indexOffset;
+		count = level ? lodCount[level - 1] : indexCount;
+	}
+
+	/** Copies the levels of detail and the radius of the given sub-buffer */
+	void copyLOD(const SubBuffer& other, uint32_t indexDelta) {
+		for (unsigned i = 0; i < LOD_LEVELS - 1; ++i) {
+			lodOffset[i] = other.lodOffset[i] + indexDelta;
+			lodCount[i] = other.lodCount[i];
+		}
+		radius = other.radius;
 	}
 
 	static bool compare(const SubBuffer* const first, const SubBuffer* const second) {
 		return first->material < second->material;
 	}
+
+	/**
+	 * Returns the dense id of the given material name. A name gets a new
+	 * id when it is used for the first time, ids are never reused. The
+	 * empty name has the id 0.
+	 *
+	 * @param name The material name
+	 * @return     The id of the material name
+	 */
+	static int materialID(const std::string& name);
+
+	/**
+	 * @param id A material id returned by materialID()
+	 * @return   The name of the material, or the empty name
+	 */
+	static const std::string& materialName(int id);
+
+	/** @return The number of material ids assigned so far */
+	static unsigned materialCount();
 };
 
 /** A linked list of SubBuffers */
@@ -108,6 +179,18 @@ public:
 	 * Clears the internal data and destroys the buffers.
 	 */
 	void flush();
+
+	/**
+	 * Deletes the given sub-buffers together with their geometry, i.e.
+	 * their index ranges of all levels of detail and their vertex ranges.
+	 * The offsets of the remaining sub-buffers and the indices behind the
+	 * erased vertices are moved accordingly. Ranges shared by several of
+	 * the given sub-buffers are erased once. The buffers are not uploaded.
+	 *
+	 * @param buffers The sub-buffers to delete, their geometry must not be
+	 *                used by any other sub-buffer
+	 */
+	void erase(const std::set<SubBuffer*>& buffers);
 };
 
 inline
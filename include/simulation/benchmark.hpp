@@ -0,0 +1,156 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 12, 2011
+ * @file simulation/benchmark.hpp
+ */
+
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+#include <simulation/generator.hpp>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace sim {
+
+/**
+ * A reproducible end-to-end benchmark of the Simulation. It runs a fixed
+ * set of scenarios on the bundled levels and on generated scenes, records
+ * the timings and the memory growth of each scenario and compares the
+ * timings to a baseline.
+ *
+ * The Simulation instance has to be created and a current OpenGL context
+ * is required, because the scenarios include uploading and rendering.
+ */
+class Benchmark {
+public:
+	/**
+	 * The parameters of the benchmark.
+	 */
+	struct Params {
+		/** The number of runs of each scenario, the first load is the cold load */
+		unsigned runs;
+
+		/** The number of physics steps per run */
+		unsigned steps;
+
+		/** The number of rendered frames per run */
+		unsigned frames;
+
+		/** The number of objects added and removed in the editor scenario */
+		unsigned editorObjects;
+
+		/** The directory with the levels, or an empty string for no levels */
+		std::string levels;
+
+		/** The scenes to generate, one for each layout by default */
+		std::vector<Generator::Params> generated;
+
+		/** The directory for the generated scenes and saved levels */
+		std::string scratch;
+
+		/** The allowed relative increase of the median before it is a regression */
+		double threshold;
+
+		Params();
+	};
+
+	/**
+	 * The timings of a scenario on a level, in milliseconds.
+	 */
+	struct Result {
+		std::string level;
+		std::string scenario;
+		unsigned samples;
+		double min;
+		double median;
+		double p99;
+
+		/**
+		 * The growth of the resident set size of the process during the
+		 * scenario in the first run, or the second run for the warm load,
+		 * in KiB. It is negative if memory has been released.
+		 */
+		long memoryGrowth;
+	};
+
+	/** The results, in the order of the scenarios */
+	typedef std::vector<Result> Results;
+
+protected:
+	Params m_params;
+	Results m_results;
+
+	/**
+	 * Measures the m3d matrix operations that are used on the hot paths,
+	 * i.e. one million multiplications, inverses and point transformations
+	 * per sample, and adds the results for the level "m3d".
+	 */
+	void runMath();
+
+	/**
+	 * Runs all scenarios on the given level and adds the results.
+	 *
+	 * @param name     The name of the level in the results
+	 * @param fileName The level file
+	 * @return         False, if the level could not be loaded
+	 */
+	bool runLevel(const std::string& name, const std::string& fileName);
+
+	/**
+	 * Computes the statistics of the samples and adds them as a result.
+	 *
+	 * @param level        The name of the level
+	 * @param scenario     The name of the scenario
+	 * @param samples      The timings, in milliseconds
+	 * @param memoryGrowth The growth of the resident set size, in KiB
+	 */
+	void addResult(const std::string& level, const std::string& scenario, std::vector<double>& samples,
+			long memoryGrowth);
+public:
+	Benchmark(const Params& params);
+
+	/**
+	 * Runs the benchmark on all levels and generated scenes.
+	 *
+	 * @return The results
+	 */
+	const Results& run();
+
+	/**
+	 * Writes the results as JSON.
+	 *
+	 * @param fileName The output file
+	 * @throws std::runtime_error The file could not be written
+	 */
+	void save(const std::string& fileName) const;
+
+	/**
+	 * Compares the medians of the results with a baseline that has been
+	 * written by save() and prints all regressions.
+	 *
+	 * @param fileName The baseline file
+	 * @throws std::runtime_error The file could not be read
+	 * @return         The number of regressions
+	 */
+	unsigned compare(const std::string& fileName) const;
+
+	/**
+	 * Returns the peak resident set size of the process.
+	 *
+	 * @return The peak memory usage in KiB, or 0 if unknown
+	 */
+	static long getPeakMemory();
+
+	/**
+	 * Returns the current resident set size of the process.
+	 *
+	 * @return The memory usage in KiB, or 0 if unknown
+	 */
+	static long getMemory();
+};
+
+}
+
+#endif /* BENCHMARK_HPP_ */
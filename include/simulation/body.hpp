@@ -9,6 +9,7 @@
 
 #include <Newton.h>
 #include <m3d/m3d.hpp>
+#include <simulation/transformstore.hpp>
 
 using namespace m3d;
 
@@ -48,11 +49,20 @@ private:
 	 * @param threadIndex The id of the calling thread
 	 */
 	static void __applyForceAndTorqueCallback(const NewtonBody* body, dFloat timestep, int threadIndex);
+
+	Body(const Body& other);
+	Body& operator=(const Body& other);
 protected:
-	/** The matrix of the body, access has to be monitored
-	 * in order to alert Newton when the matrix changes.
+	/** The transforms of the world the body was created in */
+	TransformStore* m_store;
+
+	/** The slot of the body in the TransformStore */
+	unsigned m_slot;
+
+	/** The matrix of the body in the TransformStore, access has to be
+	 * monitored in order to alert Newton when the matrix changes.
 	 */
-	Mat4f m_matrix;
+	Mat4f* m_matrix;
 
 public:
 	/** Creates an empty body object. Does not create a NewtonBody. */
@@ -106,6 +116,9 @@ public:
 	/** @return The Matrix of this body */
 	virtual const Mat4f& getMatrix() const;
 
+	/** @return The slot of this body in the TransformStore */
+	unsigned getSlot() const;
+
 	/**
 	 * Sets the matrix of this body.
 	 *
@@ -146,12 +159,17 @@ inline NewtonCollision* Body::getCollision() const
 
 inline const Mat4f& Body::getMatrix() const
 {
-	return m_matrix;
+	return *m_matrix;
+}
+
+inline unsigned Body::getSlot() const
+{
+	return m_slot;
 }
 
 inline void Body::setMatrix(const Mat4f& matrix)
 {
-	m_matrix = matrix;
+	m_store->setMatrix(m_slot, matrix);
 	NewtonBodySetMatrix(m_body, matrix[0]);
 }
 
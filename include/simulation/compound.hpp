@@ -57,7 +57,7 @@ public:
 
 	virtual void getAABB(Vec3f& min, Vec3f& max);
 
-	virtual float convexCastPlacement(bool apply = true, std::list<NewtonBody*>* noCollision = NULL);
+	virtual float convexCastPlacement(bool apply = true, const newton::BodySet* exclude = NULL);
 
 	Hinge createHinge(const Vec3f& pivot, const Vec3f& pinDir, const Object& child, const Object& parent,
 			bool limited = false, float minAngle = -1.0f, float maxAngle = 1.0f);
@@ -69,8 +69,9 @@ public:
 
 	virtual bool contains(const NewtonBody* const body);
 	virtual bool contains(const __Object* object);
+	virtual void getBodies(std::vector<Body*>& bodies);
 	virtual void genBuffers(ogl::VertexBuffer& vbo);
-	virtual void render();
+	virtual void render(const ogl::Camera& camera);
 
 	static Compound createCompound(const Mat4f& matrix = Mat4f::identity());
 
@@ -9,7 +9,6 @@
 
 #include <m3d/m3d.hpp>
 #include <vector>
-#include <list>
 
 namespace sim {
 
@@ -17,10 +16,14 @@ using namespace m3d;
 
 /**
  * Arc-length parameterized Catmull Rom spline.
+ *
+ * The arc-length table is built incrementally. An update only rebuilds
+ * the segments that depend on knots that changed since the last update,
+ * so appending a knot recomputes only the last few segments.
  */
 class CRSpline {
 protected:
-	/** Help point with t parameter of spline, the arc length the position and tangent */
+	/** Help point with the knot parameter of the spline, the arc length, the position and tangent */
 	struct HelpPoint {
 		float t, len;
 		Vec2f pos, tangent;
@@ -29,30 +32,35 @@ protected:
 	/** A vector of help points for indexed access */
 	typedef std::vector<HelpPoint> HelpTable;
 
-	/** A list of help points for fast insertion */
-	typedef std::list<HelpPoint> HelpList;
-
 	/** Table of help points */
 	HelpTable m_table;
 
+	/** The index of the first help point of each segment in the table */
+	std::vector<unsigned> m_segments;
+
 	/** The control points */
 	std::vector<Vec2f> m_knots;
 
+	/** The control points the table was built from */
+	std::vector<Vec2f> m_builtKnots;
+
 	/** The maximum error allowed when calculating the arc length */
 	float m_error;
 
 	/**
-	 * Divides the given segment into two equally sized segments and checks whether
-	 * the deviation of the linear segments deviates from the spline more than the
-	 * specified error. If so, the two generated segments are again subdivided
-	 * recursively.
+	 * Divides the segment between the two given help points into two equally
+	 * sized segments and checks whether the linear segments deviate from the
+	 * spline more than the specified error. If so, the two generated segments
+	 * are again subdivided recursively. Otherwise, the next help point is
+	 * appended to the table. The current help point has to be the last help
+	 * point in the table.
 	 *
-	 * @param helpPoints The current list of help points
-	 * @param point      The current help point of interest
-	 * @param knot       The current knot to handle
-	 * @return           The next help point to handle
+	 * @param knot  The current knot to handle
+	 * @param cur   The current help point
+	 * @param next  The next help point
+	 * @param depth The current depth of the recursion
 	 */
-	HelpList::iterator divideSegment(HelpList &helpPoints, HelpList::iterator cur, unsigned knot);
+	void divideSegment(unsigned knot, const HelpPoint& cur, const HelpPoint& next, unsigned depth = 0);
 
 	/**
 	 * Perform a binary search on the internal table in order to find
@@ -63,6 +71,17 @@ protected:
 	 */
 	unsigned binarySearch(float length);
 
+	/**
+	 * Finds the lower help point of the segment that contains the given
+	 * length. The segment of the given hint and its successor are checked
+	 * first, so sorted batches of lengths are resolved in constant time.
+	 *
+	 * @param length The length of the curve
+	 * @param hint   The lower index of the previous lookup
+	 * @return       The lower index of the two help points that span the segment
+	 */
+	unsigned findSegment(float length, unsigned hint);
+
 	/**
 	 * Returns a valid knot at the given index. All security check included.
 	 *
@@ -70,6 +89,24 @@ protected:
 	 * @return      A valid knot
 	 */
 	Vec2f at(int index);
+
+	/**
+	 * Returns the position in the plane at the given length of the curve.
+	 *
+	 * @param length The length on the curve
+	 * @param hint   The lower index of the previous lookup, updated
+	 * @return       The x and z coordinates at this length
+	 */
+	Vec2f getPlanePos(float length, unsigned& hint);
+
+	/**
+	 * Returns the tangent in the plane at the given length of the curve.
+	 *
+	 * @param length The length on the curve
+	 * @param hint   The lower index of the previous lookup, updated
+	 * @return       The tangent at this length
+	 */
+	Vec2f getPlaneTangent(float length, unsigned& hint);
 public:
 	/**
 	 * Constructs a new Catmull-Rom spline with the given length deviation.
@@ -81,8 +118,9 @@ public:
 
 	/**
 	 * Calculates the arc length of the spline and updates the internal
-	 * table of help points. Clears the help points if the number of knots
-	 * is smaller than three.
+	 * table of help points. Only the segments affected by knots that
+	 * changed since the last update are recomputed. Clears the help
+	 * points if the number of knots is smaller than three.
 	 *
 	 * @return The length of the spline
 	 */
@@ -111,6 +149,25 @@ public:
 	 */
 	Vec3f getPos(float length);
 
+	/**
+	 * Returns the positions on the spline at all given lengths of the
+	 * curve. The vertical positions are determined in a single batch,
+	 * sorted lengths are evaluated in linear time.
+	 *
+	 * @param lengths The lengths on the curve
+	 * @param result  The positions at these lengths
+	 */
+	void getPositions(const std::vector<float>& lengths, std::vector<Vec3f>& result);
+
+	/**
+	 * Returns the tangents on the spline at all given lengths of the
+	 * curve. Sorted lengths are evaluated in linear time.
+	 *
+	 * @param lengths The lengths on the curve
+	 * @param result  The tangents at these lengths
+	 */
+	void getTangents(const std::vector<float>& lengths, std::vector<Vec3f>& result);
+
 	/**
 	 * Returns the tangent on the spline at the given length
 	 * of the curve.
@@ -17,23 +17,17 @@ typedef std::tr1::shared_ptr<__Domino> Domino;
 /**
  * This class encapsulates domino pieces. They are simple boxes
  * derived from __RigidBody. Since there are only three different
- * types of dominos, this class provides caching for the collision
- * objects and the geometry.
+ * types of dominos, this class provides caching for the geometry.
+ * Each domino has its own collision, because the material is stored
+ * in the collision.
  */
 class __Domino : public __RigidBody {
 protected:
 	/**
-	 * DEPRECATED because collisions need to have materials.
-	 *
-	 * Collision geometry cache for the domino pieces, indexed by
-	 * DOMINO_SMALL, DOMINO_MIDDLE, DOMINO_LARGE.
-	 */
-	static NewtonCollision* s_domino_collision[3];
-
-	/**
-	 * DEPRECATED because collisions need to have materials.
-	 *
-	 * Returns a new collision object with the given type and material.
+	 * Returns the collision of the given type and material from the
+	 * collision cache of the current world, e.g. to generate the geometry.
+	 * It is not used for the bodies, because setMaterial() changes the
+	 * material of the collision.
 	 *
 	 * @param type       The domino type
 	 * @param materialID The material of the domino
@@ -44,11 +38,32 @@ protected:
 	/** Sizes for the domino pieces, indexed by
 	 * DOMINO_SMALL, DOMINO_MIDDLE, DOMINO_LARGE. */
 	static Vec3f s_domino_size[3];
+
+	/**
+	 * Generates the simplified levels of detail of a domino type in the
+	 * geometry cache. Distant dominos only need their largest faces.
+	 *
+	 * @param type      The domino type
+	 * @param vbo       The vertex buffer to add the indices to
+	 * @param buffer    The sub-buffer of the type in the cache
+	 * @param positions The first vertex position of the type
+	 * @param indices   The indices of the type, relative to its first vertex
+	 */
+	static void genDominoLODs(Type type, ogl::VertexBuffer& vbo, ogl::SubBuffer* buffer,
+			const float* positions, const uint32_t* indices);
 public:
 	/** Gaps for curves for the domino pieces, indexed by
 	 * DOMINO_SMALL, DOMINO_MIDDLE, DOMINO_LARGE. */
 	static float s_domino_gap[3];
 
+	/**
+	 * Returns the size of the given domino type.
+	 *
+	 * @param type The domino type
+	 * @return     The width, height and depth of the domino
+	 */
+	static const Vec3f& getSize(Type type);
+
 	/**
 	 * Constructs a new domino object.
 	 *
@@ -77,11 +92,14 @@ public:
 	static void genDominoBuffers(ogl::VertexBuffer& vbo);
 
 	/**
-	 * DEPRECATED because collisions need to have materials.
+	 * Places dominos of the given type on the ground. The vertical position
+	 * of each matrix is replaced, the rays of all dominos are cast in a
+	 * single batch.
 	 *
-	 * Clears the domino geometry cache.
+	 * @param type     The domino type
+	 * @param matrices The matrices of the dominos
 	 */
-	static void freeCollisions();
+	static void placeDominos(Type type, std::vector<Mat4f>& matrices);
 
 	/**
 	 * Creates a new domino object with the given attributes.
@@ -96,6 +114,13 @@ public:
 	static Domino createDomino(Type type, const Mat4f& matrix, float mass, const std::string& material = "", bool doPlacement = true);
 };
 
+
+inline
+const Vec3f& __Domino::getSize(Type type)
+{
+	return s_domino_size[std::min(type, DOMINO_LARGE)];
+}
+
 }
 
 #endif /* DOMINO_HPP_ */
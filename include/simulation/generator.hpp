@@ -0,0 +1,104 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 11, 2011
+ * @file simulation/generator.hpp
+ */
+
+#ifndef GENERATOR_HPP_
+#define GENERATOR_HPP_
+
+#include <simulation/object.hpp>
+#include <m3d/m3d.hpp>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+using namespace m3d;
+
+/**
+ * A procedural generator for large domino scenes. The generated levels
+ * are reproducible, i.e. the same parameters and seed always result in
+ * the same level file. They are meant as workloads for benchmarks of the
+ * physics, the rendering, the loading and the memory consumption.
+ */
+class Generator {
+public:
+	/**
+	 * The layouts of the dominos.
+	 */
+	typedef enum {
+		GRID = 0,	/**< Parallel rows of dominos. */
+		SPIRAL,		/**< An archimedean spiral around the origin. */
+		TREE,		/**< A tree of lines that branch into two lines. */
+		HILBERT		/**< A space-filling hilbert curve. */
+	} Layout;
+
+	/** Simple string representations for the layouts above */
+	static const char* LayoutStr[];
+
+	/**
+	 * The parameters of a generated scene.
+	 */
+	struct Params {
+		/** The layout of the dominos */
+		Layout layout;
+
+		/** The number of dominos */
+		unsigned count;
+
+		/** The domino type, DOMINO_SMALL, DOMINO_MIDDLE or DOMINO_LARGE */
+		__Object::Type type;
+
+		/** The gap between two dominos, or 0 for the gap of the type */
+		float gap;
+
+		/** The materials of the dominos, chosen randomly for each domino */
+		std::vector<std::string> materials;
+
+		/** The material of the ground box, if no environment is used */
+		std::string groundMaterial;
+
+		/** The environment model, or an empty string for a flat ground box */
+		std::string environment;
+
+		/** The seed of the random number generator */
+		unsigned seed;
+
+		Params();
+	};
+
+	/**
+	 * Generates the matrices of the dominos of the given layout. The dominos
+	 * stand on the plane y = 0 and face along their local z-axis.
+	 *
+	 * @param params   The parameters of the scene
+	 * @param matrices The generated matrices
+	 */
+	static void generate(const Params& params, std::vector<Mat4f>& matrices);
+
+	/**
+	 * Generates a scene and writes it as a level file. The file is written
+	 * directly without building a document in memory, so even scenes with
+	 * millions of dominos can be generated.
+	 *
+	 * @param params   The parameters of the scene
+	 * @param fileName The level file to write
+	 * @throws std::runtime_error The file could not be written
+	 * @return         The number of generated dominos
+	 */
+	static unsigned save(const Params& params, const std::string& fileName);
+
+	/**
+	 * Returns the layout with the given string representation.
+	 *
+	 * @param name The name of the layout
+	 * @throws std::runtime_error Unknown layout
+	 * @return     The layout
+	 */
+	static Layout getLayout(const std::string& name);
+};
+
+}
+
+#endif /* GENERATOR_HPP_ */
@@ -0,0 +1,155 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/heightfield.hpp
+ */
+
+#ifndef HEIGHTFIELD_HPP_
+#define HEIGHTFIELD_HPP_
+
+#include <simulation/object.hpp>
+
+namespace sim {
+
+class __HeightField;
+typedef std::tr1::shared_ptr<__HeightField> HeightField;
+
+/**
+ * A static terrain on a regular grid, loaded from a height map. It is a
+ * cheaper alternative to the tree collision for large outdoor levels,
+ * because the collision, the memory and the rendering all use the grid
+ * instead of a triangle soup.
+ *
+ * The height map is decoded by stb_image, which reads 8 bits per channel
+ * only. Grey images give heights with 8 bits of precision. For 16 bits,
+ * the high byte is stored in the red and the low byte in the green
+ * channel. Grey images stored as RGB read the same as grey images.
+ *
+ * The terrain is rendered in chunks of CHUNK_CELLS x CHUNK_CELLS cells.
+ * Chunks outside the frustum are skipped, distant chunks use a coarser
+ * grid. Each chunk has a skirt along its border that hides the cracks
+ * between chunks of different levels of detail.
+ *
+ * The terrain can be translated and rotated like any other body.
+ */
+class __HeightField : public __Object, public Body {
+public:
+	/** The number of cells of a chunk in both directions, a power of two */
+	static const unsigned CHUNK_CELLS = 32;
+
+	/** The number of levels of detail, level n uses every 2^n-th sample */
+	static const unsigned LOD_LEVELS = 4;
+
+	/** The number of vertices of a chunk, the grid and the skirt */
+	static const unsigned CHUNK_VERTICES = (CHUNK_CELLS + 1) * (CHUNK_CELLS + 1) + 4 * CHUNK_CELLS;
+
+protected:
+	/** A chunk of the grid with its bounding box in local and in world coordinates */
+	struct Chunk {
+		Vec3f localMin, localMax;
+		Vec3f min, max;
+	};
+
+	std::string m_fileName;
+	std::string m_material;
+
+	/** The distance between two samples */
+	float m_scale;
+
+	/** The height of the highest possible sample */
+	float m_height;
+
+	/** The number of samples in x and z direction */
+	int m_width, m_depth;
+
+	/** The samples, row by row in z direction */
+	std::vector<unsigned short> m_elevation;
+
+	/** The number of chunks in x and z direction */
+	unsigned m_chunksX, m_chunksZ;
+	std::vector<Chunk> m_chunks;
+
+	/** The buffers, created on the first call to render() */
+	GLuint m_vbo, m_ibo;
+
+	/** The ranges of the levels of detail in the index buffer */
+	uint32_t m_lodOffset[LOD_LEVELS];
+	uint32_t m_lodCount[LOD_LEVELS];
+
+	/** Whether the material is applied with shadows, read once on load */
+	bool m_useShadows;
+
+	/** @return The sample at the given position, clamped to the borders */
+	float sample(int x, int z) const;
+
+	/** Creates the vertex and index buffers of all chunks */
+	void createBuffers();
+
+	/** Transforms the local bounding boxes of the chunks with the matrix of the terrain */
+	void updateChunks();
+
+public:
+	/**
+	 * Loads the height map and creates the terrain. The origin of the
+	 * matrix is the corner of the first sample.
+	 *
+	 * @param matrix   The matrix of the terrain
+	 * @param fileName The file name of the height map
+	 * @param scale    The distance between two samples
+	 * @param height   The height of the highest possible sample
+	 * @param material The material of the terrain
+	 * @throws std::runtime_error If the height map could not be loaded
+	 */
+	__HeightField(const Mat4f& matrix, const std::string& fileName, float scale, float height,
+			const std::string& material);
+	~__HeightField();
+
+	virtual const Mat4f& getMatrix() const { return Body::getMatrix(); }
+	virtual void setMatrix(const Mat4f& matrix);
+
+	virtual void getAABB(Vec3f& min, Vec3f& max) { NewtonBodyGetAABB(m_body, &min[0], &max[0]); }
+
+	virtual float convexCastPlacement(bool apply = true, const newton::BodySet* exclude = NULL) { return 0.0f; };
+
+	virtual bool contains(const NewtonBody* const body);
+	virtual bool contains(const __Object* object);
+	virtual void getBodies(std::vector<Body*>& bodies);
+
+	virtual std::string getMaterial() { return m_material; }
+
+	virtual void genBuffers(ogl::VertexBuffer&);
+	virtual void render(const ogl::Camera& camera);
+
+	/** @return The number of bytes of the samples held in main memory */
+	unsigned getMemoryUsage() const;
+
+	/**
+	 * Saves the height field to the environment node.
+	 *
+	 * @param object	Reference to object to save
+	 * @param node		Pointer to root node
+	 * @param doc		Pointer to XML document
+	 */
+	static void save(__HeightField& object, rapidxml::xml_node<>* node, rapidxml::xml_document<>* doc);
+
+	/**
+	 * Loads a height field from an environment node.
+	 *
+	 * @param	node	Pointer to XML node
+	 * @throws	rapidxml::parse_error	Attribute not found
+	 * @return	HeightField object
+	 */
+	static HeightField load(rapidxml::xml_node<>* node);
+};
+
+
+inline float __HeightField::sample(int x, int z) const
+{
+	x = x < 0 ? 0 : (x >= m_width ? m_width - 1 : x);
+	z = z < 0 ? 0 : (z >= m_depth ? m_depth - 1 : z);
+	return m_elevation[z * m_width + x] * (m_height / 65535.0f);
+}
+
+}
+
+#endif /* HEIGHTFIELD_HPP_ */
@@ -0,0 +1,193 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/levelpager.hpp
+ */
+
+#ifndef LEVELPAGER_HPP_
+#define LEVELPAGER_HPP_
+
+#include <simulation/object.hpp>
+#include <xml/rapidxml.hpp>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace sim {
+
+/**
+ * Pages the objects and the environment of a large level in and out of
+ * the simulation. The level is partitioned into a grid of square cells
+ * on the ground plane, the <cell> nodes of the level file.
+ *
+ * Cells within the load distance of the camera or of an active body are
+ * instantiated. Cells beyond the unload distance, in which all bodies are
+ * sleeping, are serialized and their objects are removed from the
+ * simulation. Objects that moved into another cell are stored with the
+ * cell they are in when they are unloaded.
+ *
+ * The unloaded cells are kept as XML text in main memory, which is a small
+ * fraction of the memory of the bodies, collisions and vertex buffers.
+ */
+class LevelPager {
+public:
+	/** The grid coordinates of a cell */
+	typedef std::pair<int, int> Key;
+	typedef std::vector<Key> Keys;
+
+protected:
+	struct Cell {
+		/** The objects, while the cell is unloaded */
+		std::string objects;
+
+		/** The environment nodes, they never change */
+		std::string environment;
+
+		/** The environment, while the cell is loaded */
+		std::list<Object> environments;
+
+		bool loaded;
+
+		Cell() : loaded(false) { }
+	};
+
+	typedef std::map<Key, Cell> Cells;
+
+	/** The size of a cell, 0 if the level is not paged */
+	float m_cellSize;
+
+	/** The distances in cells, within which cells are loaded and beyond which they are unloaded */
+	float m_loadDistance, m_unloadDistance;
+
+	Cells m_cells;
+
+	/** @return The squared distance of the point to the cell on the ground plane */
+	float distance2(const Key& key, const Vec3f& point) const;
+
+public:
+	LevelPager();
+
+	/** Removes all cells and disables the paging */
+	void clear();
+
+	/** @return True, if the level is paged */
+	bool isEnabled() const;
+
+	/** @param cellSize The size of a cell, 0 to disable the paging */
+	void setCellSize(float cellSize);
+
+	/** @return The size of a cell */
+	float getCellSize() const;
+
+	/** @return The key of the cell that contains the given point */
+	Key getKey(const Vec3f& point) const;
+
+	/**
+	 * Computes the bounds of all cells on the ground plane.
+	 *
+	 * @param min The minimum
+	 * @param max The maximum
+	 * @return    False, if there are no cells
+	 */
+	bool getBounds(Vec3f& min, Vec3f& max) const;
+
+	/**
+	 * Adds an unloaded cell from a <cell> node of a level file. The ids of
+	 * its objects are returned, so that new objects do not reuse them
+	 * before the cell is loaded.
+	 *
+	 * @param node The <cell> node
+	 * @throws rapidxml::parse_error Attribute not found
+	 * @return     The largest object id in the cell, or -1 if it has no objects
+	 */
+	int addCell(rapidxml::xml_node<>* node);
+
+	/**
+	 * Returns the unloaded cells within the load distance of one of the
+	 * given points.
+	 *
+	 * @param points The camera and the active bodies
+	 * @param result The keys of the cells to load
+	 */
+	void getCellsToLoad(const std::vector<Vec3f>& points, Keys& result) const;
+
+	/**
+	 * @param key    The key of a cell
+	 * @param points The camera and the active bodies
+	 * @return       True, if the cell is beyond the unload distance of all points
+	 */
+	bool isFar(const Key& key, const std::vector<Vec3f>& points) const;
+
+	/**
+	 * Returns the loaded cells beyond the unload distance of all given
+	 * points, which do not contain an active body.
+	 *
+	 * @param points The camera and the active bodies
+	 * @param result The keys of the cells to unload
+	 */
+	void getCellsToUnload(const std::vector<Vec3f>& points, Keys& result) const;
+
+	/**
+	 * Instantiates the objects and the environment of the given cell.
+	 *
+	 * @param key     The key of the cell
+	 * @param objects The objects of the cell, to be added to the simulation
+	 * @throws rapidxml::parse_error The cell could not be parsed
+	 */
+	void load(const Key& key, std::list<Object>& objects);
+
+	/**
+	 * Serializes the given objects into the given cell and releases its
+	 * environment. The objects have to be removed from the simulation.
+	 *
+	 * @param key     The key of the cell
+	 * @param objects The objects that are in the cell
+	 */
+	void unload(const Key& key, const std::list<Object>& objects);
+
+	/** @return True, if the given cell is loaded */
+	bool isLoaded(const Key& key) const;
+
+	/**
+	 * Saves all cells to the level node. The unloaded cells are copied,
+	 * the loaded cells are saved with the given objects.
+	 *
+	 * @param objects The loaded objects that are paged
+	 * @param level   The level node
+	 * @param doc     The document
+	 */
+	void save(const std::list<Object>& objects, rapidxml::xml_node<>* level, rapidxml::xml_document<>* doc) const;
+
+	/**
+	 * Renders the environments of the loaded cells.
+	 *
+	 * @param camera The camera of the frame
+	 */
+	void render(const ogl::Camera& camera);
+
+	/** @return The number of cells */
+	unsigned getCellCount() const;
+
+	/** @return The number of loaded cells */
+	unsigned getLoadedCount() const;
+};
+
+
+inline bool LevelPager::isEnabled() const
+{
+	return m_cellSize > 0.0f;
+}
+
+inline float LevelPager::getCellSize() const
+{
+	return m_cellSize;
+}
+
+inline unsigned LevelPager::getCellCount() const
+{
+	return m_cells.size();
+}
+
+}
+
+#endif /* LEVELPAGER_HPP_ */
@@ -8,10 +8,13 @@
 #define MATERIAL_HPP_
 
 #include <m3d/m3d.hpp>
+#include <opengl/texture.hpp>
+#include <opengl/shader.hpp>
 #include <Newton.h>
 #include <map>
 #include <string>
 #include <list>
+#include <vector>
 #include <set>
 #include <xml/rapidxml.hpp>
 
@@ -135,6 +138,35 @@ struct MaterialPair {
 	void save(rapidxml::xml_node<>* materials, rapidxml::xml_document<>* doc) const;
 };
 
+/**
+ * A material resolved for rendering. The texture and shader objects and
+ * the uniform locations are looked up once, so that applying the material
+ * does not need any name lookups. A record is recompiled when the materials,
+ * the textures or the shaders change.
+ */
+struct RenderMaterial {
+	/** The material, or NULL if there is no material with this name */
+	const Material* material;
+
+	ogl::Texture texture;
+	ogl::Texture texture1;
+	ogl::Shader shader;
+
+	/** The locations of the uniforms in the shader, or -1 */
+	GLint texture0Location;
+	GLint texture1Location;
+	GLint shadowMapLocation;
+	GLint shadowTexelLocation;
+	GLint transformsLocation;
+
+	/** The generations of the managers the record was compiled for */
+	unsigned generation;
+	unsigned textureGeneration;
+	unsigned shaderGeneration;
+
+	RenderMaterial();
+};
+
 /**
  * The material manager is a container for all materials and
  * material interactions. It maps the material names to the
@@ -156,6 +188,21 @@ protected:
 	/** For each pair of material ids, there is a material interaction */
 	std::map<std::pair<int, int>, MaterialPair> m_pairs;
 
+	/** The compiled materials, indexed by the dense id of ogl::SubBuffer */
+	std::vector<RenderMaterial> m_renderMaterials;
+
+	/** Incremented whenever materials are added or removed */
+	unsigned m_generation;
+
+	/**
+	 * Resolves the material with the given name and its textures,
+	 * shader and uniform locations.
+	 *
+	 * @param name   The name of the material
+	 * @param record The record to compile into
+	 */
+	void compile(const std::string& name, RenderMaterial& record);
+
 public:
 	/**
 	 * Returns an instance of the MaterialMgr and creates it,
@@ -191,6 +238,24 @@ public:
 	 */
 	void applyMaterial(const std::string& material, bool useShadows = false);
 
+	/**
+	 * Applies the material with the given dense id, as stored in the
+	 * sub-buffers. If it is not available, does nothing.
+	 *
+	 * @param id         The id returned by ogl::SubBuffer::materialID()
+	 * @param useShadows True, if the shadow map uniforms should be set
+	 */
+	void applyMaterial(int id, bool useShadows = false);
+
+	/**
+	 * Returns the compiled material with the given dense id. The record
+	 * is recompiled, if the materials, textures or shaders have changed.
+	 *
+	 * @param id The id returned by ogl::SubBuffer::materialID()
+	 * @return   The compiled material
+	 */
+	const RenderMaterial& getRenderMaterial(int id);
+
 	/**
 	 * Adds a material to the internal material map and returns the
 	 * name of the material.
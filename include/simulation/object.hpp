@@ -10,11 +10,15 @@
 
 #include <boost/tr1/memory.hpp>
 #include <string>
+#include <map>
+#include <vector>
 #include <simulation/body.hpp>
 #include <opengl/vertexbuffer.hpp>
+#include <opengl/camera.hpp>
 #include <lib3ds/file.h>
 #include <xml/rapidxml.hpp>
 #include <opengl/mesh.hpp>
+#include <newton/util.hpp>
 
 namespace sim {
 
@@ -54,6 +58,7 @@ public:
 		CONVEX_ASSEMBLY, //!< A convex assembly (physics) with a complex representation (graphics)
 		COMPOUND,        //!< A composition of objects and joints
 		TREE_COLLISION,  //!< A complex, static collision for the environment
+		HEIGHTFIELD,     //!< A static terrain on a regular grid for the environment
 		NONE             //!< Dummy type
 	} Type;
 
@@ -153,10 +158,11 @@ public:
 	/**
 	 * Sets the vertical position of the object according to the convex cast of its collision.
 	 *
-	 * @param apply True, if the new position should be applied, False otherwise
-	 * @return      The new vertical position
+	 * @param apply   True, if the new position should be applied, False otherwise
+	 * @param exclude Additional bodies to ignore, or NULL
+	 * @return        The new vertical position
 	 */
-	virtual float convexCastPlacement(bool apply = true, std::list<NewtonBody*>* noCollision = NULL) = 0;
+	virtual float convexCastPlacement(bool apply = true, const newton::BodySet* exclude = NULL) = 0;
 
 	/**
 	 * Checks whether this object contains the given NewtonBody.
@@ -174,6 +180,14 @@ public:
 	 */
 	virtual bool contains(const __Object* object) = 0;
 
+	/**
+	 * Appends the bodies of this object to the given list. The order is
+	 * the same each time the object is created from the same description.
+	 *
+	 * @param bodies The list to append to
+	 */
+	virtual void getBodies(std::vector<Body*>& bodies) = 0;
+
 	/**
 	 * Generates the vertices, uv-coordinates, normals and indices (buffers)
 	 * of this object. The data will be added to the given vertex buffer object.
@@ -183,8 +197,13 @@ public:
 	 */
 	virtual void genBuffers(ogl::VertexBuffer& vbo) = 0;
 
-	/** Renders the object in debugging mode. */
-	virtual void render() = 0;
+	/**
+	 * Renders the object in debugging mode. Environments render their
+	 * geometry and may use the camera to select the visible parts.
+	 *
+	 * @param camera The camera of the frame
+	 */
+	virtual void render(const ogl::Camera& camera) = 0;
 
 	/**
 	 * Saves the given object to the specified node by creating a
@@ -240,14 +259,15 @@ public:
 
 	virtual bool scale(const Vec3f& scale, bool add = false);
 
-	virtual float convexCastPlacement(bool apply = true, std::list<NewtonBody*>* noCollision = NULL);
+	virtual float convexCastPlacement(bool apply = true, const newton::BodySet* exclude = NULL);
 
 	virtual bool contains(const NewtonBody* const body);
 	virtual bool contains(const __Object* object);
+	virtual void getBodies(std::vector<Body*>& bodies);
 
 	virtual void genBuffers(ogl::VertexBuffer& vbo);
 
-	virtual void render();
+	virtual void render(const ogl::Camera& camera);
 
 	/**
 	 *	Saves RigidBody object to XML node and appends it to document
@@ -297,6 +317,23 @@ protected:
 	/** The visual representation of the object */
 	ogl::Mesh m_visual;
 
+	/**
+	 * Model cache, indexed by the file name. All convex objects created
+	 * from the same file share a single mesh, in all worlds.
+	 */
+	static std::map<std::string, ogl::Mesh> s_meshes;
+
+	/**
+	 * Returns the cached mesh of the given model file. Loads the file,
+	 * if it is not yet in the cache.
+	 *
+	 * @param fileName       The model file
+	 * @param originalMeshes A container to insert the original sub-meshes, or NULL.
+	 *                       If not NULL, the file is always loaded.
+	 * @return               The mesh, or an empty smart pointer
+	 */
+	static ogl::Mesh getMesh(const std::string& fileName, ogl::SubBuffers* originalMeshes = NULL);
+
 	// protected constructor to prevent direct public instantiation
 	__Convex(Type type, const Mat4f& matrix, float mass, const std::string& material, const std::string& fileName,
 			int freezeState = 0, const Vec4f& damping = Vec4f(0.1f, 0.1f, 0.1f, 0.1f));
@@ -331,6 +368,12 @@ public:
 	static Convex createAssembly(const Mat4f& matrix, float mass, const std::string& material, const std::string& fileName,
 			int freezeState = 0, const Vec4f& damping = Vec4f(0.1f, 0.1f, 0.1f, 0.1f));
 
+	/**
+	 * Releases all cached meshes. The collisions are cached by the world,
+	 * indexed by the type, material and file name.
+	 */
+	static void freeMeshes();
+
 	virtual void genBuffers(ogl::VertexBuffer& vbo);
 
 	/**
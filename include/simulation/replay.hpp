@@ -0,0 +1,229 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/replay.hpp
+ */
+
+#ifndef REPLAY_HPP_
+#define REPLAY_HPP_
+
+#include <simulation/object.hpp>
+#include <simulation/transformstore.hpp>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+/**
+ * Records the transforms of all bodies after each physics step and plays
+ * them back later without the physics. The playback writes the matrices
+ * into the TransformStore, i.e. into Body::m_matrix, while the Newton
+ * world stays paused.
+ *
+ * A transform is stored as a quantised position and the three smallest
+ * components of its quaternion. Each frame only stores the bodies that
+ * are awake and moved, as differences to their previous transform. Every
+ * KEYFRAME_INTERVAL frames, a keyframe stores all bodies, so that any
+ * frame can be decoded from the preceding keyframe.
+ *
+ * The bodies are identified by their order in the object list. A replay
+ * can be played back on the objects it was recorded on, or on a level
+ * that has been saved before the recording and loaded again.
+ */
+class Replay {
+public:
+	/** The number of frames of a chunk, the first frame is a keyframe */
+	static const unsigned KEYFRAME_INTERVAL = 64;
+
+	/** The positions are quantised to steps of 1 / POSITION_SCALE */
+	static const int POSITION_SCALE = 1024;
+
+	/** The range of the quantised quaternion components */
+	static const int ROTATION_SCALE = 32767;
+
+	typedef enum {
+		IDLE = 0,
+		RECORDING,
+		PLAYING
+	} State;
+
+protected:
+	/** The quantised transform of a body */
+	struct Transform {
+		int32_t position[3];
+
+		/** The index of the largest quaternion component, which is not stored */
+		uint8_t largest;
+		int16_t rotation[3];
+
+		Transform();
+	};
+
+	/** A keyframe and the frames up to the next keyframe */
+	struct Chunk {
+		std::vector<uint8_t> data;
+
+		/** The offsets of the frames in the data */
+		std::vector<uint32_t> frames;
+	};
+
+	State m_state;
+
+	/** The bodies, in the order of the objects */
+	std::vector<Body*> m_bodies;
+	TransformStore* m_store;
+
+	std::vector<Chunk> m_chunks;
+	unsigned m_frameCount;
+	unsigned m_bodyCount;
+
+	/** The time between two frames at normal speed, in seconds */
+	float m_timeStep;
+
+	/** The last encoded or decoded transform of each body */
+	std::vector<Transform> m_transforms;
+
+	/** The encoded bodies of the frame in record(), kept to reuse its memory */
+	std::vector<uint8_t> m_records;
+
+	/** The decoded frame, or m_frameCount if there is none */
+	unsigned m_frame;
+
+	/** The position of the playback, in seconds */
+	float m_time;
+	float m_speed;
+	bool m_paused;
+
+	/** Collects the bodies of the objects and resets the transforms */
+	void attach(const std::list<Object>& objects);
+
+	/** Decodes the given frame and applies it to the bodies */
+	void decode(unsigned frame);
+
+	/** Decodes the frames up to the given one */
+	void seekFrame(unsigned frame);
+
+	static Transform quantise(const Mat4f& matrix);
+	static Mat4f dequantise(const Transform& transform);
+
+public:
+	Replay();
+
+	/** Stops the replay and removes all frames */
+	void clear();
+
+	/**
+	 * Starts a new recording of the bodies of the given objects. The
+	 * current transforms are recorded as the first frame.
+	 *
+	 * @param objects  The objects of the simulation
+	 * @param store    The TransformStore of the bodies
+	 * @param timeStep The time between two steps at normal speed, in seconds
+	 */
+	void startRecording(const std::list<Object>& objects, TransformStore& store, float timeStep);
+
+	/** Records the transforms after a physics step */
+	void record();
+
+	/**
+	 * Starts the playback on the bodies of the given objects.
+	 *
+	 * @param objects The objects of the simulation
+	 * @param store   The TransformStore of the bodies
+	 * @return        False, if there are no frames or the objects do not match
+	 */
+	bool startPlayback(const std::list<Object>& objects, TransformStore& store);
+
+	/**
+	 * Advances the playback and moves the bodies.
+	 *
+	 * @param delta The real time since the last update, in seconds
+	 */
+	void update(float delta);
+
+	/**
+	 * Stops a recording or a playback. After a playback, the Newton bodies
+	 * are moved to the played back transforms and come to a rest. The
+	 * bodies have to exist.
+	 */
+	void stop();
+
+	/** @param time The new position of the playback, in seconds */
+	void seek(float time);
+
+	/** @param speed The factor of the playback speed, 1 is real time */
+	void setSpeed(float speed);
+
+	/** @param paused True, to hold the current frame */
+	void setPaused(bool paused);
+
+	/**
+	 * Writes the frames to a binary file. The file is in the byte order
+	 * of the machine.
+	 *
+	 * @param fileName The file to write
+	 * @throws std::runtime_error The file could not be written
+	 */
+	void save(const std::string& fileName) const;
+
+	/**
+	 * Reads the frames of a file written by save(). The file is checked
+	 * completely before the current frames are replaced, so they are
+	 * kept if it cannot be read.
+	 *
+	 * @param fileName The file to read
+	 * @throws std::runtime_error The file could not be read or is corrupt
+	 */
+	void load(const std::string& fileName);
+
+	State getState() const;
+	float getSpeed() const;
+	bool isPaused() const;
+
+	/** @return The position of the playback, in seconds */
+	float getTime() const;
+
+	/** @return The length of the recording, in seconds */
+	float getDuration() const;
+
+	unsigned getFrameCount() const;
+
+	/** @return The number of bytes used by the frames */
+	unsigned getMemoryUsage() const;
+};
+
+
+inline Replay::State Replay::getState() const
+{
+	return m_state;
+}
+
+inline float Replay::getSpeed() const
+{
+	return m_speed;
+}
+
+inline bool Replay::isPaused() const
+{
+	return m_paused;
+}
+
+inline float Replay::getTime() const
+{
+	return m_time;
+}
+
+inline float Replay::getDuration() const
+{
+	return m_frameCount > 0 ? (m_frameCount - 1) * m_timeStep : 0.0f;
+}
+
+inline unsigned Replay::getFrameCount() const
+{
+	return m_frameCount;
+}
+
+}
+
+#endif /* REPLAY_HPP_ */
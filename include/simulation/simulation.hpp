@@ -14,9 +14,14 @@
 #include <util/erroradapters.hpp>
 #include <opengl/camera.hpp>
 #include <opengl/vertexbuffer.hpp>
+#include <opengl/transformbuffer.hpp>
 #include <opengl/skydome.hpp>
 #include <opengl/framebuffer.hpp>
 #include <simulation/object.hpp>
+#include <simulation/levelpager.hpp>
+#include <simulation/world.hpp>
+#include <simulation/replay.hpp>
+#include <simulation/statehash.hpp>
 #include <map>
 #include <Newton.h>
 #include <iostream>
@@ -67,6 +72,28 @@ public:
 		INT_DOMINO_CURVE,	/**< Create a domino curve by creating multiple control points */
 		INT_CREATE_OBJECT
 	} InteractionType;
+
+	/**
+	 * The progress and outcome of runUntilSettled().
+	 */
+	struct SettleResult {
+		/** True, while the bodies are stepped */
+		bool running;
+
+		/** True, if all bodies fell asleep before the timeout */
+		bool settled;
+
+		/** The number of physics steps */
+		unsigned steps;
+
+		/** The physics time of the steps, i.e. steps * World::TIME_STEP, in seconds */
+		float simulatedTime;
+
+		/** The wall clock time spent, in seconds */
+		double realTime;
+
+		SettleResult();
+	};
 private:
 	static Simulation* s_instance;
 	Simulation(util::KeyAdapter& keyAdapter, util::MouseAdapter& mouseAdapter);
@@ -97,13 +124,45 @@ protected:
 	int m_newObjectFreezeState;
 	Vec3f m_newObjectSize;
 
+	/** The world of the simulation, created by init() */
+	World* m_world;
+
 	int m_nextID;
 	ObjectList m_objects;
 	Object m_environment;
 
+	/** Pages the cells of large levels in and out, see updatePaging() */
+	LevelPager m_pager;
+
+	/** The time since the last call to updatePaging(), in seconds */
+	float m_pagingTime;
+
+	/** Records the physics steps and plays them back */
+	Replay m_replay;
+
+	/** Steps the physics as often as possible in each frame, see update() */
+	bool m_fastForward;
+
+	/** The steps after which runUntilSettled() gives up */
+	unsigned m_settleSteps;
+	SettleResult m_settle;
+	util::Clock m_settleClock;
+
+	/** The hashes of the physical state after each step, see startStateHash() */
+	StateHash m_stateHash;
+
+	/** The number of steps since startStateHash() */
+	unsigned m_stepCount;
+
 	/** The currently selected object, or an empty smart pointer */
 	Object m_selectedObject;
 
+	/** True, if the scene changed since the last call to render() */
+	bool m_dirty;
+
+	/** True, if the camera has been moved by keys in the last call to update() */
+	bool m_moving;
+
 	/**
 	 * The vertex buffer contains the vertices, uvs and normals for all
 	 * objects in the simulation. For each object, there are one or more
@@ -120,6 +179,19 @@ protected:
 	 */
 	ogl::SubBuffers m_sortedBuffers;
 
+	/**
+	 * The transforms of all bodies on the GPU, indexed by their slot in
+	 * the TransformStore. Only the transforms that changed since the last
+	 * frame are uploaded.
+	 */
+	ogl::TransformBuffer m_transforms;
+
+	/** The packed transforms of an upload, see uploadTransforms() */
+	std::vector<float> m_transformData;
+
+	/** The number of sub-buffers drawn with each level of detail in the last frame */
+	unsigned m_lodCounts[ogl::SubBuffer::LOD_LEVELS + 1];
+
 	/**
 	 * The skydome of the simulation.
 	 */
@@ -135,6 +207,28 @@ protected:
 	 */
 	void upload(const ObjectList::iterator& begin, const ObjectList::iterator& end);
 
+	/**
+	 * Uploads the transforms that changed since the last frame into the
+	 * transform buffer and clears the dirty bits of the TransformStore.
+	 */
+	void uploadTransforms();
+
+	/**
+	 * Loads the cells of a paged level near the camera and the active
+	 * bodies, and unloads the distant cells in which all bodies sleep.
+	 */
+	void updatePaging();
+
+	/** @return True, if all bodies with a mass sleep */
+	bool isSettled();
+
+	/**
+	 * Finishes a run of runUntilSettled().
+	 *
+	 * @param settled True, if all bodies sleep
+	 */
+	void finishSettle(bool settled);
+
 	/**
 	 * Checks if the given interaction type is activated in any button.
 	 *
@@ -176,12 +270,59 @@ public:
 	 */
 	void clear();
 
-	/** @param enabled True, if the simulation should be enabled, false otherwise */
+	/**
+	 * Enables or disables the simulation. The time before it is enabled
+	 * is not simulated, even if update() was not called in between.
+	 *
+	 * @param enabled True, if the simulation should be enabled, false otherwise
+	 */
 	void setEnabled(bool enabled);
 
 	/** @return True, if the simulation is enabled, false otherwise */
 	bool isEnabled();
 
+	/**
+	 * In fast forward mode, update() steps the physics as often as fits
+	 * into a fixed time budget per frame, instead of once per elapsed
+	 * time slice. Only the state after the last step is rendered.
+	 * Disabling it cancels runUntilSettled().
+	 *
+	 * @param enabled True, to enable the fast forward mode
+	 */
+	void setFastForward(bool enabled);
+
+	/** @return True, if the fast forward mode is enabled */
+	bool isFastForward() const;
+
+	/**
+	 * Steps the enabled simulation in fast forward mode until all bodies
+	 * sleep or the timeout is reached. The fast forward mode is disabled
+	 * afterwards, see getSettleResult().
+	 *
+	 * @param timeout The maximum physics time of the steps, in seconds
+	 */
+	void runUntilSettled(float timeout);
+
+	/** @return The progress of the last call to runUntilSettled() */
+	const SettleResult& getSettleResult() const;
+
+	/**
+	 * Marks the scene as changed, e.g. after an object has been modified
+	 * directly, so that needsRender() returns true until the next frame.
+	 */
+	void invalidate();
+
+	/**
+	 * Returns whether the next frame may differ from the last one. This is
+	 * the case while the physics or a playback is running, the camera is
+	 * moved by keys, textures are streamed in or the flares of the skydome
+	 * fade, and after the scene has been changed. The slow drift of the
+	 * clouds is not included.
+	 *
+	 * @return True, if the next frame should be rendered
+	 */
+	bool needsRender() const;
+
 	/** @param type Set the type of objects that will be created to type */
 	void setNewObjectType(__Object::Type type);
 	void setNewObjectMaterial(const std::string& material);
@@ -196,6 +337,41 @@ public:
 	/** @return The number of objects in the simulation */
 	unsigned getObjectCount();
 
+	/** @return The environment of the level, or NULL if it has none */
+	const Object& getEnvironment() const;
+
+	/** @return The pager of the level */
+	const LevelPager& getPager() const;
+
+	/** @return The world of the simulation, or NULL before init() */
+	World* getWorld() const;
+
+	/** @return The recorded replay, stopped with Replay::stop() */
+	Replay& getReplay();
+
+	/**
+	 * Starts recording the transforms of all bodies after each physics
+	 * step. The level is not paged during the recording.
+	 */
+	void startRecording();
+
+	/**
+	 * Starts the playback of the recorded replay. The physics are not
+	 * updated during the playback.
+	 *
+	 * @return False, if there is no replay or it does not match the objects
+	 */
+	bool startPlayback();
+
+	/**
+	 * Returns the number of sub-buffers that were drawn with the given
+	 * level of detail in the last frame.
+	 *
+	 * @param level The level of detail, or ogl::SubBuffer::LOD_SKIPPED
+	 * @return      The number of sub-buffers
+	 */
+	unsigned getLODCount(unsigned level) const;
+
 	/** @return The current interaction type */
 	InteractionType getInteractionType(util::Button button);
 
@@ -280,6 +456,31 @@ public:
 	virtual void mouseWheel(int delta);
 
 
+	/**
+	 * Advances the physics by a single fixed time step, independent of the
+	 * elapsed time and of whether the simulation is enabled.
+	 */
+	void step();
+
+	/**
+	 * Writes a hash of the physical state after each step, starting with
+	 * the current state. Runs are only comparable with the same settings
+	 * "physicsThreads" and "solverModel".
+	 *
+	 * @param fileName The output file
+	 * @throws std::runtime_error The file could not be opened
+	 */
+	void startStateHash(const std::string& fileName);
+
+	/** Stops writing the state hashes */
+	void stopStateHash();
+
+	/**
+	 * Discards the vertex data of all objects and generates and uploads
+	 * it again.
+	 */
+	void rebuildBuffers();
+
 	void update();
 	void render();
 };
@@ -294,7 +495,11 @@ inline Simulation& Simulation::instance()
 
 inline void Simulation::setEnabled(bool enabled)
 {
+	// update() may not have been called for a long time, see needsRender()
+	if (enabled && !m_enabled)
+		m_clock.reset();
 	m_enabled = enabled;
+	m_dirty = true;
 }
 
 inline bool Simulation::isEnabled()
@@ -302,6 +507,21 @@ inline bool Simulation::isEnabled()
 	return m_enabled;
 }
 
+inline bool Simulation::isFastForward() const
+{
+	return m_fastForward;
+}
+
+inline const Simulation::SettleResult& Simulation::getSettleResult() const
+{
+	return m_settle;
+}
+
+inline void Simulation::invalidate()
+{
+	m_dirty = true;
+}
+
 inline void Simulation::setNewObjectType(__Object::Type type)
 {
 	m_newObjectType = type;
@@ -342,6 +562,31 @@ inline unsigned Simulation::getObjectCount()
 	return m_objects.size();
 }
 
+inline const Object& Simulation::getEnvironment() const
+{
+	return m_environment;
+}
+
+inline const LevelPager& Simulation::getPager() const
+{
+	return m_pager;
+}
+
+inline World* Simulation::getWorld() const
+{
+	return m_world;
+}
+
+inline Replay& Simulation::getReplay()
+{
+	return m_replay;
+}
+
+inline unsigned Simulation::getLODCount(unsigned level) const
+{
+	return m_lodCounts[level];
+}
+
 inline Object Simulation::getSelectedObject()
 {
 	return m_selectedObject;
@@ -0,0 +1,123 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/statehash.hpp
+ */
+
+#ifndef STATEHASH_HPP_
+#define STATEHASH_HPP_
+
+#include <simulation/object.hpp>
+#include <fstream>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+/**
+ * Writes a checksum of the physical state after every physics step, in
+ * order to verify that a change of the code does not change the outcome
+ * of a simulation. The hash of a body covers the exact bits of its
+ * matrix, velocity, omega and freeze state, so any difference shows up
+ * in the step it occurs.
+ *
+ * The hashes are written as text, one line per step with the hash of the
+ * world followed by the hashes of all bodies. The bodies are ordered like
+ * the objects, see __Object::getBodies(). Two streams can be compared
+ * with compare(), which finds the first step and body that diverge.
+ */
+class StateHash {
+public:
+	/**
+	 * The outcome of compare().
+	 */
+	struct Divergence {
+		/** True, if the streams differ */
+		bool diverged;
+
+		/** The first step that differs */
+		unsigned step;
+
+		/** The index of the first body that differs, or -1 for the whole world */
+		int body;
+
+		/** The id of the object of the body, or -1 */
+		int id;
+
+		/** The number of steps that are equal */
+		unsigned steps;
+
+		/** A description of the difference */
+		std::string reason;
+
+		Divergence();
+	};
+
+protected:
+	std::ofstream m_file;
+	std::vector<Body*> m_bodies;
+	std::vector<uint64_t> m_hashes;
+
+public:
+	/**
+	 * Hashes the given data with the 64 bit FNV-1a hash. Unlike
+	 * boost::hash, the result is the same for all builds.
+	 *
+	 * @param data The data to hash
+	 * @param size The size of the data in bytes
+	 * @param hash The hash of the preceding data
+	 * @return     The hash of the data
+	 */
+	static uint64_t hash(const void* data, unsigned size, uint64_t hash = 0xcbf29ce484222325ULL);
+
+	/**
+	 * @param body The body to hash
+	 * @return     The hash of the physical state of the body
+	 */
+	static uint64_t hash(const NewtonBody* body);
+
+	/**
+	 * Opens the output file and writes the ids of the bodies of the given
+	 * objects.
+	 *
+	 * @param fileName The output file
+	 * @param objects  The objects of the simulation
+	 * @throws std::runtime_error The file could not be opened
+	 */
+	void start(const std::string& fileName, const std::list<Object>& objects);
+
+	/**
+	 * Writes the hashes of the current state.
+	 *
+	 * @param step The number of the step
+	 */
+	void record(unsigned step);
+
+	/** Closes the output file */
+	void stop();
+
+	/** @return True, if the hashes are written */
+	bool isRecording() const;
+
+	/**
+	 * Compares two streams written by record(). A stream that ends before
+	 * the other one diverges at the first step it is missing.
+	 *
+	 * @param fileName0 The first stream
+	 * @param fileName1 The second stream
+	 * @throws std::runtime_error A file could not be read
+	 * @return          The first difference
+	 */
+	static Divergence compare(const std::string& fileName0, const std::string& fileName1);
+};
+
+
+inline bool StateHash::isRecording() const
+{
+	return m_file.is_open();
+}
+
+}
+
+#endif /* STATEHASH_HPP_ */
@@ -0,0 +1,137 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/sweep.hpp
+ */
+
+#ifndef SWEEP_HPP_
+#define SWEEP_HPP_
+
+#include <simulation/generator.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+/**
+ * A parameter sweep over generated domino scenes. Each run simulates one
+ * scene in its own headless World, so the runs are independent of each
+ * other and of the Simulation. They are executed concurrently on a pool
+ * of threads, each world uses a single Newton thread.
+ *
+ * A run tips the first domino and counts the dominos that have fallen
+ * after the given number of steps. The materials have to be loaded
+ * before, the runs only read them.
+ */
+class Sweep {
+public:
+	/**
+	 * The parameters of a run.
+	 */
+	struct Run {
+		/** The layout, count, type, gap and seed of the dominos */
+		Generator::Params scene;
+
+		/** The mass of a domino, -1 = according to its volume */
+		float mass;
+
+		/** The material of the dominos */
+		std::string material;
+
+		/** The number of physics steps */
+		unsigned steps;
+
+		Run();
+	};
+
+	/**
+	 * The outcome of a run.
+	 */
+	struct Result {
+		/** The number of dominos */
+		unsigned count;
+
+		/** The number of dominos that have fallen */
+		unsigned fallen;
+
+		/** The simulated time when the last domino fell, in seconds */
+		float lastFall;
+
+		/** The wall clock time of the run, in milliseconds */
+		double duration;
+
+		/** The error message, if the run failed */
+		std::string error;
+
+		Result();
+	};
+
+protected:
+	std::vector<Run> m_runs;
+	std::vector<Result> m_results;
+
+	/** The index of the next run to be started by a worker */
+	unsigned m_next;
+	boost::mutex m_mutex;
+
+	/** Runs the pending runs until there are none left */
+	void work();
+
+	/**
+	 * Simulates the given run in a new world of the calling thread.
+	 *
+	 * @param run The parameters of the run
+	 * @return    The outcome of the run
+	 */
+	static Result simulate(const Run& run);
+
+public:
+	Sweep();
+
+	/** @param run The run to add */
+	void add(const Run& run);
+
+	/**
+	 * Adds one run for each combination of the given values, all other
+	 * parameters are taken from the base run. Empty vectors keep the
+	 * value of the base run.
+	 *
+	 * @param base      The base run
+	 * @param gaps      The gaps between the dominos
+	 * @param masses    The masses of the dominos
+	 * @param materials The materials of the dominos
+	 * @param grounds   The materials of the ground
+	 */
+	void addGrid(const Run& base, const std::vector<float>& gaps, const std::vector<float>& masses,
+			const std::vector<std::string>& materials, const std::vector<std::string>& grounds);
+
+	/** @return The runs, in the order they were added */
+	const std::vector<Run>& getRuns() const;
+
+	/**
+	 * Executes all runs on a pool of threads.
+	 *
+	 * @param threads The number of threads, 0 for one per core
+	 * @return        The results, in the order of the runs
+	 */
+	const std::vector<Result>& run(unsigned threads = 0);
+
+	/**
+	 * Writes the runs and their results as JSON.
+	 *
+	 * @param fileName The output file
+	 * @throws std::runtime_error The file could not be written
+	 */
+	void save(const std::string& fileName) const;
+};
+
+
+inline const std::vector<Sweep::Run>& Sweep::getRuns() const
+{
+	return m_runs;
+}
+
+}
+
+#endif /* SWEEP_HPP_ */
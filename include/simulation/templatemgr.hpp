@@ -0,0 +1,122 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 3, 2011
+ * @file simulation/templatemgr.hpp
+ */
+
+#ifndef TEMPLATEMGR_HPP_
+#define TEMPLATEMGR_HPP_
+
+#include <simulation/object.hpp>
+#include <xml/rapidxml.hpp>
+#include <xml/rapidxml_utils.hpp>
+#include <boost/tr1/memory.hpp>
+#include <string>
+#include <map>
+
+namespace sim {
+
+class __Template;
+typedef std::tr1::shared_ptr<__Template> Template;
+
+/**
+ * An immutable prototype of a template file. The file is read and parsed
+ * exactly once, the resulting document is kept in memory and new objects
+ * are instantiated from it without touching the file system again.
+ */
+class __Template {
+protected:
+	/** The file the template was loaded from */
+	std::string m_fileName;
+
+	/** The raw file data, the nodes of the document point into it */
+	rapidxml::file<char>* m_file;
+
+	/** The parsed document */
+	rapidxml::xml_document<> m_doc;
+
+	/** The object or compound node of the template */
+	rapidxml::xml_node<>* m_node;
+
+	__Template(const std::string& fileName);
+	__Template(const __Template& other);
+public:
+	virtual ~__Template();
+
+	/** @return The file the template was loaded from */
+	const std::string& getFileName() const;
+
+	/**
+	 * Creates a new object from the prototype and places it at the
+	 * given matrix.
+	 *
+	 * @param matrix The matrix of the new object
+	 * @throws rapidxml::parse_error Attribute not found
+	 * @return The new object
+	 */
+	Object instantiate(const Mat4f& matrix) const;
+
+	/**
+	 * Reads and parses the given template file.
+	 *
+	 * @param fileName The template file
+	 * @throws std::runtime_error    File could not be read
+	 * @throws rapidxml::parse_error File is not a valid template
+	 * @return The template prototype
+	 */
+	static Template load(const std::string& fileName);
+};
+
+/**
+ * A manager for template prototypes, keyed by their file name. Each
+ * template file is parsed only once, either explicitly using load(),
+ * or lazily on the first call to get().
+ */
+class TemplateMgr : public std::map<std::string, Template> {
+private:
+	static TemplateMgr* s_instance;
+	TemplateMgr();
+	TemplateMgr(const TemplateMgr& other);
+	virtual ~TemplateMgr();
+public:
+	static TemplateMgr& instance();
+	static void destroy();
+
+	/**
+	 * Loads the given template file and adds its prototype to the manager.
+	 * Displays an error and returns an empty smart pointer if the template
+	 * is invalid.
+	 *
+	 * @param fileName The template file
+	 * @return         The prototype or an empty smart pointer
+	 */
+	Template load(const std::string& fileName);
+
+	/**
+	 * Returns the prototype of the given template file. Loads the file,
+	 * if it is not yet in the manager.
+	 *
+	 * @param fileName The template file
+	 * @return         The prototype or an empty smart pointer
+	 */
+	Template get(const std::string& fileName);
+};
+
+
+inline
+const std::string& __Template::getFileName() const
+{
+	return m_fileName;
+}
+
+inline
+TemplateMgr& TemplateMgr::instance()
+{
+	if (!s_instance)
+		s_instance = new TemplateMgr();
+	return *s_instance;
+}
+
+}
+
+#endif /* TEMPLATEMGR_HPP_ */
@@ -0,0 +1,175 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 14, 2011
+ * @file simulation/transformstore.hpp
+ */
+
+#ifndef TRANSFORMSTORE_HPP_
+#define TRANSFORMSTORE_HPP_
+
+#include <m3d/m3d.hpp>
+#include <vector>
+#ifdef _WIN32
+#include <pstdint.h>
+#else
+#include <stdint.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace sim {
+
+using namespace m3d;
+
+/**
+ * The transforms of all bodies of a world, stored contiguously and
+ * indexed by a stable slot per body. The matrices and the positions are
+ * kept in separate arrays, so that the renderer and the culling can
+ * iterate over them without touching the objects.
+ *
+ * The slots are allocated in pages that never move, so references to a
+ * matrix remain valid until its slot is released. A dirty bitset marks
+ * the slots that have been changed since the last call to clearDirty().
+ *
+ * The Newton transform callback writes into the store concurrently from
+ * multiple threads. This is safe as long as each thread writes different
+ * slots, which is the case because each body has its own slot. Slots
+ * must not be allocated or released while Newton updates the world.
+ */
+class TransformStore {
+public:
+	/** The number of slots in a page, a power of two */
+	static const unsigned PAGE_SIZE = 1024;
+	static const unsigned PAGE_SHIFT = 10;
+
+private:
+	TransformStore(const TransformStore& other);
+	TransformStore& operator=(const TransformStore& other);
+
+protected:
+	/** A page of slots */
+	struct Page {
+		Mat4f matrices[PAGE_SIZE];
+		Vec3f positions[PAGE_SIZE];
+	};
+
+	/** The pages, they are never moved or freed */
+	std::vector<Page*> m_pages;
+
+	/** One bit per slot, set if the transform has been changed */
+	std::vector<uint32_t> m_dirty;
+
+	/** The released slots, reused before new slots are used */
+	std::vector<unsigned> m_free;
+
+	/** The number of slots that have been used so far */
+	unsigned m_size;
+
+public:
+	TransformStore();
+	virtual ~TransformStore();
+
+	/**
+	 * Allocates a slot for a new body and marks it as dirty.
+	 *
+	 * @param matrix The initial matrix of the slot
+	 * @return       The slot
+	 */
+	unsigned allocate(const Mat4f& matrix);
+
+	/**
+	 * Releases the given slot, so that it can be reused by another body.
+	 *
+	 * @param slot The slot to release
+	 */
+	void release(unsigned slot);
+
+	/**
+	 * Sets the transform of the given slot and marks it as dirty. This
+	 * is safe to call from different threads for different slots.
+	 *
+	 * @param slot   The slot of the body
+	 * @param matrix The new matrix
+	 */
+	void setMatrix(unsigned slot, const Mat4f& matrix);
+
+	/** @return The matrix of the given slot */
+	const Mat4f& getMatrix(unsigned slot) const;
+
+	/** @return A pointer to the matrix of the given slot, valid until it is released */
+	Mat4f* getMatrixPtr(unsigned slot);
+
+	/** @return The position of the given slot */
+	const Vec3f& getPosition(unsigned slot) const;
+
+	/** @return True, if the given slot has been changed since the last clearDirty() */
+	bool isDirty(unsigned slot) const;
+
+	/**
+	 * Returns the dirty bitset, one bit per slot. Bit i % 32 of the word
+	 * i / 32 is set if the slot i has been changed.
+	 *
+	 * @return The dirty bitset
+	 */
+	const std::vector<uint32_t>& getDirty() const;
+
+	/** Clears the dirty bits of all slots */
+	void clearDirty();
+
+	/** @return The number of slots, including the released ones */
+	unsigned size() const;
+};
+
+
+inline void TransformStore::setMatrix(unsigned slot, const Mat4f& matrix)
+{
+	Page* const page = m_pages[slot >> PAGE_SHIFT];
+	const unsigned index = slot & (PAGE_SIZE - 1);
+	page->matrices[index] = matrix;
+	page->positions[index] = matrix.getW();
+
+	// bodies of other threads may share the word
+	const uint32_t bit = 1u << (slot & 31);
+	if (!(m_dirty[slot >> 5] & bit)) {
+#ifdef _MSC_VER
+		_InterlockedOr((volatile long*)&m_dirty[slot >> 5], (long)bit);
+#else
+		__sync_fetch_and_or(&m_dirty[slot >> 5], bit);
+#endif
+	}
+}
+
+inline const Mat4f& TransformStore::getMatrix(unsigned slot) const
+{
+	return m_pages[slot >> PAGE_SHIFT]->matrices[slot & (PAGE_SIZE - 1)];
+}
+
+inline Mat4f* TransformStore::getMatrixPtr(unsigned slot)
+{
+	return &m_pages[slot >> PAGE_SHIFT]->matrices[slot & (PAGE_SIZE - 1)];
+}
+
+inline const Vec3f& TransformStore::getPosition(unsigned slot) const
+{
+	return m_pages[slot >> PAGE_SHIFT]->positions[slot & (PAGE_SIZE - 1)];
+}
+
+inline bool TransformStore::isDirty(unsigned slot) const
+{
+	return (m_dirty[slot >> 5] >> (slot & 31)) & 1;
+}
+
+inline const std::vector<uint32_t>& TransformStore::getDirty() const
+{
+	return m_dirty;
+}
+
+inline unsigned TransformStore::size() const
+{
+	return m_size;
+}
+
+}
+
+#endif /* TRANSFORMSTORE_HPP_ */
@@ -32,20 +32,46 @@ protected:
 		bool inside(uint32_t* i0);
 		int drawWireFrame(bool test = true);
 		int draw(bool test = true);
+
+		/** @return The size of the node and its childs in bytes */
+		unsigned getMemoryUsage() const;
+	};
+
+	/** A range of faces with the same material in m_indices */
+	struct Range {
+		// dense id of the material, see ogl::SubBuffer::materialID()
+		int material;
+		uint32_t offset;
+		uint32_t count;
 	};
 
 	std::string m_fileName;
 	int m_nodeCount;
 	Node* m_node;
-	// T2F_N3F_V3F
+
+	/**
+	 * The welded vertices in the T2F_N3F_V3F format. This is the only copy
+	 * of the geometry, the collision, the vertex buffers and the octree
+	 * are built from it.
+	 */
 	std::vector<float> m_data;
+
+	/** The triangles, sorted by material */
 	std::vector<uint32_t> m_indices;
-NewtonMesh* m_mesh;
-	int m_vertexCount;
-	Lib3dsVector* m_vertices;
-	Lib3dsVector* m_normals;
-	Lib3dsTexel* m_uvs;
-	GLuint m_list;
+	std::vector<Range> m_ranges;
+
+	/** The buffers of render(), created on the first call */
+	GLuint m_vbo, m_ibo;
+
+	/** Whether the materials are applied with shadows, read once on load */
+	bool m_useShadows;
+
+	/** The number of floats per vertex in m_data, and the offset of the position */
+	static const unsigned VERTEX_SIZE = 2 + 3 + 3;
+	static const unsigned POSITION_OFFSET = 2 + 3;
+
+	/** @return The position of the given vertex */
+	const float* position(uint32_t index) const;
 public:
 	__TreeCollision(const Mat4f& matrix, std::string& fileName);
 	~__TreeCollision();
@@ -55,15 +81,37 @@ public:
 
 	virtual void getAABB(Vec3f& min, Vec3f& max) { NewtonBodyGetAABB(m_body, &min[0], &max[0]); }
 
-	virtual float convexCastPlacement(bool apply = true, std::list<NewtonBody*>* noCollision = NULL) { return 0.0f; };
+	virtual float convexCastPlacement(bool apply = true, const newton::BodySet* exclude = NULL) { return 0.0f; };
 
 	virtual bool contains(const NewtonBody* const body);
 	virtual bool contains(const __Object* object);
+	virtual void getBodies(std::vector<Body*>& bodies);
 
 	virtual void genBuffers(ogl::VertexBuffer& vbo);
 
 	virtual void createOctree();
-	virtual void render();
+	virtual void render(const ogl::Camera& camera);
+
+	/** @return The number of welded vertices */
+	unsigned getVertexCount() const;
+
+	/** @return The number of triangles */
+	unsigned getFaceCount() const;
+
+	/**
+	 * Returns the number of bytes of the geometry held in main memory, i.e.
+	 * the vertex store, the indices and the octree. The copy in the Newton
+	 * collision and the buffers on the GPU are not included.
+	 *
+	 * @return The size of the geometry in bytes
+	 */
+	unsigned getMemoryUsage() const;
+
+	/**
+	 * @return The size of the vertex store without welding, i.e. with one
+	 *         vertex per corner of each face, in bytes
+	 */
+	unsigned getUnweldedMemoryUsage() const;
 
 	/**
 	 * Saves TreeCollision object to XML
@@ -83,6 +131,28 @@ public:
 	 */
 	static TreeCollision load(rapidxml::xml_node<>* node);
 };
+
+
+inline const float* __TreeCollision::position(uint32_t index) const
+{
+	return &m_data[index * VERTEX_SIZE + POSITION_OFFSET];
+}
+
+inline unsigned __TreeCollision::getVertexCount() const
+{
+	return m_data.size() / VERTEX_SIZE;
+}
+
+inline unsigned __TreeCollision::getFaceCount() const
+{
+	return m_indices.size() / 3;
+}
+
+inline unsigned __TreeCollision::getUnweldedMemoryUsage() const
+{
+	return m_indices.size() * VERTEX_SIZE * sizeof(float);
+}
+
 }
 
 #endif /* TREECOLLISION_HPP_ */
@@ -0,0 +1,183 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/world.hpp
+ */
+
+#ifndef WORLD_HPP_
+#define WORLD_HPP_
+
+#include <Newton.h>
+#include <simulation/transformstore.hpp>
+#include <map>
+#include <string>
+
+namespace sim {
+
+/**
+ * The state of one Newton world: the world itself, its gravity, the
+ * transforms of its bodies and the collisions shared by its bodies.
+ * Several worlds can exist at the same time, e.g. to run headless
+ * simulations on a thread pool.
+ *
+ * Each thread has a current world, newton::world, which is used by the
+ * factories of the objects and by the queries in newton/util.hpp. A
+ * world must only be used by one thread at a time. Newton calls back from
+ * its own worker threads, so the callbacks find the world of a body with
+ * fromNewton() instead.
+ *
+ * The materials and the meshes are shared by all worlds, the shaders and
+ * textures belong to the thread that renders.
+ */
+class World {
+public:
+	/** The half size of a new world in all directions */
+	static const float DEFAULT_SIZE;
+
+	/** The simulated time of a physics step, in seconds */
+	static const float TIME_STEP;
+
+	/** The collision cache, indexed by the type, material and file name */
+	typedef std::map<std::string, NewtonCollision*> Collisions;
+
+private:
+	World(const World& other);
+	World& operator=(const World& other);
+
+protected:
+	NewtonWorld* m_world;
+
+	/** The gravity along the y axis, in world units */
+	float m_gravity;
+
+	/** True, if the world is neither rendered nor heard */
+	bool m_headless;
+
+	/** The half size of the world on the ground plane */
+	float m_size;
+
+	TransformStore m_transforms;
+	Collisions m_collisions;
+
+public:
+	/**
+	 * Creates a new Newton world and makes it the current world of the
+	 * calling thread.
+	 *
+	 * @param threads  The number of worker threads of Newton
+	 * @param headless True, if the world is not rendered and plays no sounds
+	 */
+	World(int threads, bool headless = false);
+
+	/**
+	 * Releases the cached collisions and destroys the Newton world. All
+	 * bodies have to be destroyed before.
+	 */
+	~World();
+
+	/** Makes this world the current world of the calling thread */
+	void makeCurrent();
+
+	/** @return The current world of the calling thread, or NULL */
+	static World* current();
+
+	/**
+	 * @param world A Newton world created by a World
+	 * @return      The World that owns the Newton world
+	 */
+	static World* fromNewton(const NewtonWorld* world);
+
+	/** @return The Newton world */
+	NewtonWorld* getNewton() const;
+
+	/** @return The gravity along the y axis */
+	float getGravity() const;
+
+	/** @param gravity The gravity along the y axis */
+	void setGravity(float gravity);
+
+	/** @return True, if the world is neither rendered nor heard */
+	bool isHeadless() const;
+
+	/** @return The half size of the world on the ground plane */
+	float getSize() const;
+
+	/**
+	 * Sets the half size of the world on the ground plane. Bodies outside
+	 * the world are frozen. The height stays DEFAULT_SIZE.
+	 *
+	 * @param size The half size of the world on the ground plane
+	 */
+	void setSize(float size);
+
+	/** @return The transforms of the bodies of this world */
+	TransformStore& getTransforms();
+
+	/**
+	 * Returns the entry of the collision cache with the given key. The
+	 * entry is NULL, if the collision has not been created yet. The cache
+	 * holds one reference to each collision until the world is destroyed.
+	 *
+	 * @param key The key of the collision
+	 * @return    The cached collision, or a reference to NULL
+	 */
+	NewtonCollision*& getCollision(const std::string& key);
+
+	/**
+	 * Removes an empty entry from the collision cache, e.g. if the
+	 * collision could not be created.
+	 *
+	 * @param key The key of the collision
+	 */
+	void eraseCollision(const std::string& key);
+};
+
+
+inline World* World::fromNewton(const NewtonWorld* world)
+{
+	return (World*)NewtonWorldGetUserData(world);
+}
+
+inline NewtonWorld* World::getNewton() const
+{
+	return m_world;
+}
+
+inline float World::getGravity() const
+{
+	return m_gravity;
+}
+
+inline void World::setGravity(float gravity)
+{
+	m_gravity = gravity;
+}
+
+inline bool World::isHeadless() const
+{
+	return m_headless;
+}
+
+inline float World::getSize() const
+{
+	return m_size;
+}
+
+inline TransformStore& World::getTransforms()
+{
+	return m_transforms;
+}
+
+inline NewtonCollision*& World::getCollision(const std::string& key)
+{
+	return m_collisions[key];
+}
+
+inline void World::eraseCollision(const std::string& key)
+{
+	m_collisions.erase(key);
+}
+
+}
+
+#endif /* WORLD_HPP_ */
@@ -22,15 +22,25 @@ namespace test {
  * orthonormalInverse
  * inverse
  * gramSchmidt
+ * multiplication
+ * vector transformation
+ * general inverse
+ * affine multiplication and inverse
+ * performance of the matrix operations
  */
 class m3dTest : public CPPUNIT_NS::TestFixture {
 	CPPUNIT_TEST_SUITE(m3dTest);
 	CPPUNIT_TEST(saveLoadTest);
 	CPPUNIT_TEST(quaternionTest);
+	CPPUNIT_TEST(quaternionFromMatrixTest);
 	CPPUNIT_TEST(eulerAnglesTest);
 	CPPUNIT_TEST(orthonormalInverseTest);
 	CPPUNIT_TEST(invertTest);
 	CPPUNIT_TEST(gramSchmidtTest);
+	CPPUNIT_TEST(multiplyTest);
+	CPPUNIT_TEST(transformTest);
+	CPPUNIT_TEST(generalInverseTest);
+	CPPUNIT_TEST(affineTest);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -65,6 +75,13 @@ protected:
 	 */
 	void quaternionTest();
 
+	/**
+	 * Tests the conversion of rotation matrices to quaternions. The
+	 * quaternion of a random rotation is converted back to a matrix,
+	 * which should be equal to the rotation.
+	 */
+	void quaternionFromMatrixTest();
+
 	/**
 	 * Tests the m3d orthonormal inverse and inverse method.
 	 *
@@ -104,6 +121,44 @@ protected:
 	 * sanity (perpendicular axes, correct position, NaN).
 	 */
 	void gramSchmidtTest();
+
+	/**
+	 * Tests the single precision matrix multiplication and transposition,
+	 * which use SSE if M3D_USE_SSE is defined.
+	 *
+	 * Creates two arbitrary matrices and multiplies them. The product is
+	 * compared to the product of the double precision matrices, which
+	 * always use the generic implementation. The transposed matrix has
+	 * to be exactly equal.
+	 */
+	void multiplyTest();
+
+	/**
+	 * Tests the transformation of Vec3 and Vec4 vectors by a matrix,
+	 * including the batch transformation of points.
+	 *
+	 * The results are compared to the double precision transformations.
+	 */
+	void transformTest();
+
+	/**
+	 * Tests the inverse of a general matrix, i.e. one with a rotation,
+	 * a non-uniform scale and a translation.
+	 *
+	 * The inverse is compared to the double precision inverse.
+	 */
+	void generalInverseTest();
+
+	/**
+	 * Tests the multiplication and inverse of affine matrices, and the
+	 * orthonormal inverse of rigid transforms.
+	 *
+	 * Creates an arbitrary rigid transform and an affine matrix with a
+	 * non-uniform scale. The affine multiplication and inverses are
+	 * compared to the double precision general multiplication and
+	 * inverse.
+	 */
+	void affineTest();
 };
 
 }
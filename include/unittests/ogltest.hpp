@@ -0,0 +1,50 @@
+/**
+ * @author Markus Doellinger
+ * @date October 19, 2026
+ * @file unittests/ogltest.hpp
+ */
+
+#ifndef OGLTEST_HPP_
+#define OGLTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+namespace test {
+
+/**
+ * This class tests the ogl module without an OpenGL context. The
+ * following tests are being performed:
+ *
+ * erasing sub-buffers with levels of detail from a vertex buffer
+ */
+class oglTest : public CPPUNIT_NS::TestFixture {
+	CPPUNIT_TEST_SUITE(oglTest);
+	CPPUNIT_TEST(eraseTest);
+	CPPUNIT_TEST(eraseLODTest);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+protected:
+
+	/**
+	 * Erases the first and the last of three objects and checks
+	 * that the remaining object is moved to the front.
+	 */
+	void eraseTest();
+
+	/**
+	 * Erases the middle of three objects, the way Simulation::remove()
+	 * does, and renders every level of detail of the remaining objects.
+	 * The ranges have to stay inside the index buffer, hold the original
+	 * pattern and only refer to the vertices of their object.
+	 */
+	void eraseLODTest();
+};
+
+}
+
+#endif /* OGLTEST_HPP_ */
@@ -0,0 +1,107 @@
+/**
+ * @author Markus Doellinger
+ * @date October 19, 2026
+ * @file unittests/simtest.hpp
+ */
+
+#ifndef SIMTEST_HPP_
+#define SIMTEST_HPP_
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+namespace test {
+
+/**
+ * This class tests the sim module. The following tests are being
+ * performed:
+ *
+ * level pager cell keys
+ * level pager cells to load and unload
+ * level pager load/unload round trip and object ids
+ * replay quantisation
+ * replay encoding, save, load and decoding
+ * replay files that are corrupt
+ * state hash function
+ * state hash comparison
+ * state hashes of two runs of the same level
+ */
+class simTest : public CPPUNIT_NS::TestFixture {
+	CPPUNIT_TEST_SUITE(simTest);
+	CPPUNIT_TEST(pagerKeyTest);
+	CPPUNIT_TEST(pagerCellsTest);
+	CPPUNIT_TEST(pagerRoundTripTest);
+	CPPUNIT_TEST(replayQuantiseTest);
+	CPPUNIT_TEST(replayEncodeTest);
+	CPPUNIT_TEST(replayCorruptTest);
+	CPPUNIT_TEST(stateHashTest);
+	CPPUNIT_TEST(stateHashCompareTest);
+	CPPUNIT_TEST(stateHashRunTest);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+protected:
+
+	/**
+	 * Checks the cell keys of points inside, on the border and on the
+	 * negative side of the cells.
+	 */
+	void pagerKeyTest();
+
+	/**
+	 * Checks that only the unloaded cells near a point are loaded, and
+	 * that only the loaded cells far from all points are unloaded.
+	 */
+	void pagerCellsTest();
+
+	/**
+	 * Loads a cell, unloads its objects and loads it again. The objects
+	 * have to keep their ids, and the largest id of a cell has to be
+	 * known before the cell is loaded.
+	 */
+	void pagerRoundTripTest();
+
+	/**
+	 * Quantises and dequantises transforms with arbitrary rotations,
+	 * including ones with negative quaternion components. The result
+	 * has to be within the precision of the quantisation.
+	 */
+	void replayQuantiseTest();
+
+	/**
+	 * Records falling bodies for more than one keyframe interval, saves
+	 * and loads the recording and plays it back. Every frame has to
+	 * match the recorded transforms.
+	 */
+	void replayEncodeTest();
+
+	/**
+	 * Loads truncated and modified replay files. Each has to be rejected
+	 * without replacing the current recording.
+	 */
+	void replayCorruptTest();
+
+	/**
+	 * Checks the hash against the reference values of FNV-1a and checks
+	 * that hashing in parts gives the same result.
+	 */
+	void stateHashTest();
+
+	/**
+	 * Compares equal streams, streams with a different body and streams
+	 * where one ends early.
+	 */
+	void stateHashCompareTest();
+
+	/**
+	 * Simulates a level twice. The streams of both runs have to be equal.
+	 */
+	void stateHashRunTest();
+};
+
+}
+
+#endif /* SIMTEST_HPP_ */
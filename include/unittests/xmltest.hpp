@@ -37,6 +37,7 @@ class xmlTest : public CPPUNIT_NS::TestFixture {
 	CPPUNIT_TEST(loadLevelEmptyRootTest);
 	CPPUNIT_TEST(loadLevelEnvOnlyTest);
 	CPPUNIT_TEST(loadLevelNoEnvTest);
+	CPPUNIT_TEST(loadGeneratedLevelTest);
 	CPPUNIT_TEST(loadLevelNoRootTest);
 	CPPUNIT_TEST(loadLevelRootUpBrokenTest);
 	CPPUNIT_TEST(loadLevelRootPositionBrokenTest);
@@ -50,6 +51,9 @@ class xmlTest : public CPPUNIT_NS::TestFixture {
 	CPPUNIT_TEST(loadLevelObjectMatrixBrokenTest);
 	CPPUNIT_TEST(loadLevelObjectDampingBrokenTest);
 	CPPUNIT_TEST(loadLevelEnvNoSuchModelTest);
+	CPPUNIT_TEST(loadLevelHeightFieldTest);
+	CPPUNIT_TEST(saveLevelHeightFieldTest);
+	CPPUNIT_TEST(loadLevelHeightFieldBrokenTest);
 	/* level files end*/
 
 	/* materials file */
@@ -99,6 +103,7 @@ protected:
 	void loadLevelEmptyRootTest();
 	void loadLevelEnvOnlyTest();
 	void loadLevelNoEnvTest();
+	void loadGeneratedLevelTest();
 	void loadLevelNoRootTest();
 	void loadLevelCompoundMatrixBrokenTest();
 	void loadLevelRootUpBrokenTest();
@@ -108,6 +113,9 @@ protected:
 	void loadLevelJointPivotBrokenTest();
 	void loadLevelJointPinDirBrokenTest();
 	void loadLevelEnvNoSuchModelTest();
+	void loadLevelHeightFieldTest();
+	void saveLevelHeightFieldTest();
+	void loadLevelHeightFieldBrokenTest();
 	void loadLevelObjectTypeBrokenTest();
 	void loadLevelObjectMaterialBrokenTest();
 	void loadLevelObjectMatrixBrokenTest();
@@ -0,0 +1,324 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file util/profiler.hpp
+ */
+
+#ifndef PROFILER_HPP_
+#define PROFILER_HPP_
+
+#include <util/threadlocal.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <string>
+#include <vector>
+
+/** Define NO_PROFILER to compile without any instrumentation */
+#ifndef NO_PROFILER
+#define ENABLE_PROFILER
+#endif
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/** Measures the time until the end of the enclosing block, the name has to be a literal */
+#define PROFILE_SCOPE(name) util::ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+/** The same as PROFILE_SCOPE(), tagged with the thread index of a Newton callback */
+#define PROFILE_SCOPE_THREAD(name, threadIndex) util::ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(name, threadIndex)
+
+/** Adds the value to a counter of the current frame, the name has to be a literal */
+#define PROFILE_COUNT(name, value) util::Profiler::count(name, value)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_SCOPE_THREAD(name, threadIndex)
+#define PROFILE_COUNT(name, value)
+#endif
+
+namespace util {
+
+/**
+ * Collects the times of named scopes and the values of counters per
+ * frame. Each thread writes into its own buffer, so there are no locks on
+ * the hot path. The buffers are read by endFrame(), which has to be called
+ * while no other thread records, e.g. after NewtonUpdate() returned.
+ *
+ * The times of scopes are exclusive, i.e. the time of nested scopes is
+ * only counted in the innermost one. The entries of the last HISTORY
+ * frames are kept for the overlay.
+ *
+ * During a capture, each scope is also stored as an event with its start
+ * and duration. The events are written in the Chrome trace event format,
+ * which can be opened in chrome://tracing or Perfetto.
+ */
+class Profiler {
+public:
+	/** A point in time or a duration, in nanoseconds */
+	typedef boost::uint64_t Time;
+
+	/** The number of frames that are kept */
+	static const unsigned HISTORY = 128;
+
+	/** The maximum number of scopes and counters of a thread */
+	static const unsigned MAX_ENTRIES = 32;
+
+	/** The maximum number of captured events of a thread, the rest is dropped */
+	static const unsigned MAX_EVENTS = 1 << 20;
+
+	/**
+	 * A scope or a counter and its values in the last frames.
+	 */
+	struct Entry {
+		std::string name;
+		bool counter;
+
+		/** True, if the scope is recorded by the thread that calls endFrame() */
+		bool mainThread;
+
+		/** The times in milliseconds or the counts, indexed by frame % HISTORY */
+		float values[HISTORY];
+
+		Entry(const std::string& name, bool counter);
+	};
+
+protected:
+	/**
+	 * A captured scope.
+	 */
+	struct Event {
+		const char* name;
+		Time start;
+		Time duration;
+
+		/** The thread index of the Newton callback, or -1 */
+		int threadIndex;
+	};
+
+	/**
+	 * The values of a thread in the current frame. Only the thread itself
+	 * writes to it, except for endFrame(). It is freed when the thread
+	 * exits, unless it holds captured events that are not written yet.
+	 */
+	struct ThreadBuffer {
+		const char* names[MAX_ENTRIES];
+		bool counter[MAX_ENTRIES];
+		Time values[MAX_ENTRIES];
+		unsigned size;
+
+		/** The number of the thread in the trace, in the order of the first scope */
+		unsigned index;
+		std::vector<Event> events;
+		unsigned dropped;
+
+		/** True, if the thread has exited and the buffer is only kept for its events */
+		bool exited;
+
+		ThreadBuffer* next;
+	};
+
+	static Profiler* s_instance;
+
+	/** True, while the events are captured */
+	static volatile bool s_capturing;
+
+	/** The buffer of the calling thread */
+	static THREAD_LOCAL ThreadBuffer* t_buffer;
+
+	/** Guards the list of buffers */
+	boost::mutex m_mutex;
+	ThreadBuffer* m_buffers;
+
+	/** The number of buffers created so far, used as the thread number of the trace */
+	unsigned m_threads;
+
+	/** Owns the buffer of the calling thread and releases it on exit */
+	boost::thread_specific_ptr<ThreadBuffer> m_owner;
+
+	std::vector<Entry> m_entries;
+	unsigned m_frame;
+	Time m_frameStart;
+	float m_frameTimes[HISTORY];
+
+	std::string m_captureFile;
+	Time m_captureStart;
+
+	/** The number of frames until the capture ends, or 0 */
+	unsigned m_captureFrames;
+
+	Profiler();
+
+	/** @return The buffer of the calling thread, it is created once */
+	ThreadBuffer* getBuffer();
+
+	/**
+	 * Adds the values of the current frame of the buffer to the entries
+	 * and resets them. The mutex has to be locked.
+	 */
+	void merge(ThreadBuffer* buffer);
+
+	/** Removes the buffer from the list and deletes it. The mutex has to be locked. */
+	void remove(ThreadBuffer* buffer);
+
+	/** Called when a thread exits, adds its values to the current frame and frees the buffer */
+	static void releaseBuffer(ThreadBuffer* buffer);
+
+	/** Adds the value to the entry of the calling thread */
+	static void add(const char* name, bool counter, Time value);
+
+public:
+	~Profiler();
+
+	static Profiler& instance();
+
+	/** @return The time of a monotonic high-resolution clock */
+	static Time now();
+
+	/**
+	 * Adds the given time to a scope of the current frame.
+	 *
+	 * @param name The name of the scope, a literal
+	 * @param time The exclusive time
+	 */
+	static void time(const char* name, Time time);
+
+	/**
+	 * Adds the given value to a counter of the current frame.
+	 *
+	 * @param name  The name of the counter, a literal
+	 * @param value The value to add
+	 */
+	static void count(const char* name, Time value);
+
+	/**
+	 * Stores a scope as an event of the capture of the calling thread.
+	 *
+	 * @param name        The name of the scope, a literal
+	 * @param start       The start of the scope
+	 * @param duration    The inclusive time of the scope
+	 * @param threadIndex The thread index of the Newton callback, or -1
+	 */
+	static void record(const char* name, Time start, Time duration, int threadIndex);
+
+	/** @return True, if the scopes are captured as events */
+	static bool isCapturing();
+
+	/**
+	 * Starts capturing all scopes of all threads as events.
+	 *
+	 * @param fileName The output file of the trace
+	 * @param frames   The number of frames until the trace is written, or 0
+	 *                 for stopCapture()
+	 */
+	void startCapture(const std::string& fileName, unsigned frames = 0);
+
+	/**
+	 * Ends the capture and writes the trace. Like endFrame(), it has to be
+	 * called while no other thread records.
+	 *
+	 * @throws std::runtime_error The file could not be written
+	 */
+	void stopCapture();
+
+	/**
+	 * Moves the values of all threads into the history and starts the
+	 * next frame.
+	 */
+	void endFrame();
+
+	/** @return The number of finished frames */
+	unsigned getFrame() const;
+
+	/** @return The entries, in the order they appeared */
+	const std::vector<Entry>& getEntries() const;
+
+	/**
+	 * @param frame A frame of the last HISTORY frames
+	 * @return      The time between the end of the frame and the previous one, in milliseconds
+	 */
+	float getFrameTime(unsigned frame) const;
+};
+
+/**
+ * Measures the time of its lifetime and adds it to a scope of the
+ * Profiler, without the time of the timers created meanwhile by the same
+ * thread. Use it with PROFILE_SCOPE().
+ */
+class ScopedTimer {
+protected:
+	const char* m_name;
+	Profiler::Time m_start;
+
+	/** The time of the nested timers */
+	Profiler::Time m_nested;
+	ScopedTimer* m_parent;
+	int m_threadIndex;
+
+	/** The innermost timer of the calling thread */
+	static THREAD_LOCAL ScopedTimer* t_current;
+
+public:
+	/**
+	 * @param name        The name of the scope, a literal
+	 * @param threadIndex The thread index of a Newton callback, or -1
+	 */
+	ScopedTimer(const char* name, int threadIndex = -1);
+	~ScopedTimer();
+};
+
+
+inline unsigned Profiler::getFrame() const
+{
+	return m_frame;
+}
+
+inline const std::vector<Profiler::Entry>& Profiler::getEntries() const
+{
+	return m_entries;
+}
+
+inline float Profiler::getFrameTime(unsigned frame) const
+{
+	return m_frameTimes[frame % HISTORY];
+}
+
+inline void Profiler::time(const char* name, Time time)
+{
+	add(name, false, time);
+}
+
+inline void Profiler::count(const char* name, Time value)
+{
+	add(name, true, value);
+}
+
+inline bool Profiler::isCapturing()
+{
+	return s_capturing;
+}
+
+inline ScopedTimer::ScopedTimer(const char* name, int threadIndex)
+	: m_name(name),
+	  m_start(Profiler::now()),
+	  m_nested(0),
+	  m_parent(t_current),
+	  m_threadIndex(threadIndex)
+{
+	t_current = this;
+}
+
+inline ScopedTimer::~ScopedTimer()
+{
+	const Profiler::Time duration = Profiler::now() - m_start;
+	Profiler::time(m_name, duration > m_nested ? duration - m_nested : 0);
+	if (Profiler::isCapturing())
+		Profiler::record(m_name, m_start, duration, m_threadIndex);
+	if (m_parent)
+		m_parent->m_nested += duration;
+	t_current = m_parent;
+}
+
+}
+
+#endif /* PROFILER_HPP_ */
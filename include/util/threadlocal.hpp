@@ -0,0 +1,17 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 18, 2011
+ * @file util/threadlocal.hpp
+ */
+
+#ifndef THREADLOCAL_HPP_
+#define THREADLOCAL_HPP_
+
+/** Declares a variable with one instance per thread */
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+#endif /* THREADLOCAL_HPP_ */
@@ -8,7 +8,9 @@
 #include <util/config.hpp>
 
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtGui/QCheckBox>
+#include <QtGui/QComboBox>
 #include <QtGui/QDialogButtonBox>
 #include <QtGui/QDoubleSpinBox>
 #include <QtGui/QGridLayout>
@@ -17,6 +19,7 @@
 #include <QtGui/QLineEdit>
 #include <QtGui/QListWidget>
 #include <QtGui/QPushButton>
+#include <QtGui/QSpinBox>
 #include <QtGui/QStackedWidget>
 
 namespace gui {
@@ -108,6 +111,88 @@ float GravityDialog::run()
 	}
 }
 
+GeneratorDialog::GeneratorDialog(QWidget* parent) :
+		QDialog(parent)
+{
+	using namespace sim;
+	QGridLayout* layout = new QGridLayout();
+	QDialogButtonBox* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+	Generator::Params defaults;
+
+	layout->setSizeConstraint(QLayout::SetFixedSize);
+
+	m_layout = new QComboBox();
+	for (int i = Generator::GRID; i <= Generator::HILBERT; ++i)
+		m_layout->addItem(Generator::LayoutStr[i]);
+	m_layout->setCurrentIndex(defaults.layout);
+	layout->addWidget(new QLabel("Layout"), 0, 0);
+	layout->addWidget(m_layout, 0, 1);
+
+	m_count = new QSpinBox();
+	m_count->setRange(1, 1000000);
+	m_count->setSingleStep(1000);
+	m_count->setValue(defaults.count);
+	layout->addWidget(new QLabel("Dominos"), 1, 0);
+	layout->addWidget(m_count, 1, 1);
+
+	m_type = new QComboBox();
+	for (int i = __Object::DOMINO_SMALL; i <= __Object::DOMINO_LARGE; ++i)
+		m_type->addItem(__Object::TypeStr[i]);
+	m_type->setCurrentIndex(defaults.type - __Object::DOMINO_SMALL);
+	layout->addWidget(new QLabel("Type"), 2, 0);
+	layout->addWidget(m_type, 2, 1);
+
+	m_gap = new QDoubleSpinBox();
+	m_gap->setRange(0.0f, 100.0f);
+	m_gap->setSpecialValueText("default");
+	m_gap->setValue(defaults.gap);
+	layout->addWidget(new QLabel("Gap"), 3, 0);
+	layout->addWidget(m_gap, 3, 1);
+
+	m_materials = new QLineEdit("planks");
+	m_materials->setToolTip("A comma separated list of materials, chosen randomly for each domino");
+	layout->addWidget(new QLabel("Materials"), 4, 0);
+	layout->addWidget(m_materials, 4, 1);
+
+	m_environment = new QLineEdit();
+	m_environment->setToolTip("The environment model, or empty for a flat ground");
+	layout->addWidget(new QLabel("Environment"), 5, 0);
+	layout->addWidget(m_environment, 5, 1);
+
+	m_seed = new QSpinBox();
+	m_seed->setRange(0, 1 << 30);
+	m_seed->setValue(defaults.seed);
+	layout->addWidget(new QLabel("Seed"), 6, 0);
+	layout->addWidget(m_seed, 6, 1);
+
+	layout->addWidget(buttons, 7, 0, 1, 2);
+	connect(buttons, SIGNAL(accepted()), this, SLOT(accept()));
+	connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
+
+	setWindowTitle("TUStudios - Generate Scene");
+	setLayout(layout);
+}
+
+bool GeneratorDialog::run(sim::Generator::Params& params)
+{
+	using namespace sim;
+	if (exec() != QDialog::Accepted)
+		return false;
+
+	params.layout = (Generator::Layout)m_layout->currentIndex();
+	params.count = m_count->value();
+	params.type = (__Object::Type)(__Object::DOMINO_SMALL + m_type->currentIndex());
+	params.gap = m_gap->value();
+	params.environment = m_environment->text().trimmed().toStdString();
+	params.seed = m_seed->value();
+
+	params.materials.clear();
+	QStringList materials = m_materials->text().split(',', QString::SkipEmptyParts);
+	for (QStringList::const_iterator itr = materials.begin(); itr != materials.end(); ++itr)
+		params.materials.push_back(itr->trimmed().toStdString());
+	return true;
+}
+
 MessageDialog::MessageDialog(const std::string title, const std::string message, const MessageType type) :
 		QMessageBox()
 {
@@ -13,6 +13,7 @@
 #include <newton/util.hpp>
 #include <sound/soundmgr.hpp>
 #include <util/config.hpp>
+#include <util/profiler.hpp>
 
 #include <QtCore/QList>
 #include <QtCore/QTextCodec>
@@ -37,6 +38,7 @@ MainWindow::MainWindow(QApplication* app)
 {
 	m_modified = true;
 	m_tmp_file = NULL;
+	m_settling = false;
 
 	// load the splash screen
 	SplashScreen splash(100);
@@ -90,6 +92,7 @@ MainWindow::MainWindow(QApplication* app)
 	// connect the newly created widgets with specific slots
 	connect(m_renderWidget, SIGNAL(framesPerSecondChanged(int)), this, SLOT(updateFramesPerSecond(int)));
 	connect(m_renderWidget, SIGNAL(objectsCountChanged(int)), this, SLOT(updateObjectsCount(int)));
+	connect(m_profiler, SIGNAL(toggled(bool)), m_renderWidget, SLOT(setProfilerVisible(bool)));
 
 	connect(m_renderWidget, SIGNAL(objectSelected(sim::Object)), m_toolBox, SLOT(updateData(sim::Object)));
 	connect(m_renderWidget, SIGNAL(objectSelected(sim::__Object::Type)), m_toolBox, SLOT(showModificationWidgets(sim::__Object::Type)));
@@ -131,6 +134,10 @@ void MainWindow::createMenu()
 	connect(m_open, SIGNAL(triggered()), this, SLOT(onOpenPressed()));
 	m_menuFile->addAction(m_open);
 
+	m_generate = new QAction("&Generate Scene", this);
+	connect(m_generate, SIGNAL(triggered()), this, SLOT(onGeneratePressed()));
+	m_menuFile->addAction(m_generate);
+
 	m_save = new QAction("&Save", this);
 	m_save->setShortcuts(QKeySequence::Save);
 	connect(m_save, SIGNAL(triggered()), this, SLOT(onSavePressed()));
@@ -169,12 +176,60 @@ void MainWindow::createMenu()
 	connect(m_stop_no_reset, SIGNAL(triggered()), this, SLOT(onSimulationControlsPressed()));
 	m_menuSimulation->addAction(m_stop_no_reset);
 
+	m_fastForward = new QAction("&Fast Forward", this);
+	m_fastForward->setCheckable(true);
+	m_fastForward->setShortcut(Qt::Key_F8);
+	connect(m_fastForward, SIGNAL(triggered()), this, SLOT(onFastForwardPressed()));
+	m_menuSimulation->addAction(m_fastForward);
+
+	m_settle = new QAction("Run Until &Settled", this);
+	m_settle->setShortcut(Qt::CTRL | Qt::Key_F8);
+	connect(m_settle, SIGNAL(triggered()), this, SLOT(onFastForwardPressed()));
+	m_menuSimulation->addAction(m_settle);
+
 	m_menuSimulation->addSeparator();
 
 	m_gravity = new QAction("&Gravity", this);
 	connect(m_gravity, SIGNAL(triggered()), this, SLOT(onGravityPressed()));
 	m_menuSimulation->addAction(m_gravity);
 
+	m_menuReplay = m_menuSimulation->addMenu("&Replay");
+
+	m_record = new QAction("&Record", this);
+	m_record->setCheckable(true);
+	m_menuReplay->addAction(m_record);
+
+	m_menuReplay->addSeparator();
+
+	m_replayPlay = new QAction("&Play Recording", this);
+	m_replayPlay->setShortcut(Qt::Key_F10);
+	m_replayPause = new QAction("P&ause", this);
+	m_replayPause->setCheckable(true);
+	m_replaySlower = new QAction("S&lower", this);
+	m_replayFaster = new QAction("&Faster", this);
+	m_replayBack = new QAction("Skip &Back", this);
+	m_replayForward = new QAction("Skip F&orward", this);
+	m_replayStop = new QAction("&Stop Playback", this);
+	m_replayStop->setShortcut(Qt::CTRL | Qt::Key_F10);
+
+	QAction* playback[] = { m_replayPlay, m_replayPause, m_replaySlower, m_replayFaster,
+			m_replayBack, m_replayForward, m_replayStop };
+	for (unsigned i = 0; i < sizeof(playback) / sizeof(playback[0]); ++i) {
+		playback[i]->setEnabled(i == 0);
+		connect(playback[i], SIGNAL(triggered()), this, SLOT(onReplayControlsPressed()));
+		m_menuReplay->addAction(playback[i]);
+	}
+
+	m_menuReplay->addSeparator();
+
+	m_replaySave = new QAction("Sa&ve Recording...", this);
+	connect(m_replaySave, SIGNAL(triggered()), this, SLOT(onReplayFilePressed()));
+	m_menuReplay->addAction(m_replaySave);
+
+	m_replayLoad = new QAction("Loa&d Recording...", this);
+	connect(m_replayLoad, SIGNAL(triggered()), this, SLOT(onReplayFilePressed()));
+	m_menuReplay->addAction(m_replayLoad);
+
 	// Options
 	m_menuOptions = menuBar()->addMenu("&Options");
 
@@ -190,6 +245,17 @@ void MainWindow::createMenu()
 
 	m_menuOptions->addSeparator();
 
+	m_profiler = new QAction("Show P&rofiler", this);
+	m_profiler->setCheckable(true);
+	m_profiler->setShortcut(Qt::Key_F3);
+	m_menuOptions->addAction(m_profiler);
+
+	m_trace = new QAction("Capture &Trace", this);
+	m_trace->setCheckable(true);
+	m_trace->setShortcut(Qt::Key_F4);
+	connect(m_trace, SIGNAL(triggered()), this, SLOT(onTracePressed()));
+	m_menuOptions->addAction(m_trace);
+
 	m_preferences = new QAction("&Preferences", this);
 	connect(m_preferences, SIGNAL(triggered()), this, SLOT(onPreferencesPressed()));
 	m_menuOptions->addAction(m_preferences);
@@ -232,6 +298,22 @@ void MainWindow::createStatusBar()
 void MainWindow::updateFramesPerSecond(int frames)
 {
 	m_framesPerSec->setText(QString("%1 fps   ").arg(frames));
+
+	sim::Simulation& simulation = sim::Simulation::instance();
+	m_framesPerSec->setToolTip(QString("Objects drawn per level of detail: %1 full, %2 simplified, "
+			"%3 coarse, %4 too small")
+			.arg(simulation.getLODCount(0)).arg(simulation.getLODCount(1))
+			.arg(simulation.getLODCount(2)).arg(simulation.getLODCount(ogl::SubBuffer::LOD_SKIPPED)));
+
+	const sim::Simulation::SettleResult& settle = simulation.getSettleResult();
+	if (m_settling) {
+		m_simulationStatus->setText(QString("%1 %2 s of physics time in %3 s")
+				.arg(settle.running ? "Running:" : (settle.settled ? "Settled:" : "Timeout:"))
+				.arg(settle.simulatedTime, 0, 'f', 1).arg(settle.realTime, 0, 'f', 1));
+		m_settling = settle.running;
+	}
+	m_fastForward->setChecked(simulation.isFastForward());
+	m_trace->setChecked(util::Profiler::isCapturing());
 }
 
 void MainWindow::updateObjectsCount(int count)
@@ -300,22 +382,62 @@ void MainWindow::onOpenPressed()
 	}
 }
 
+void MainWindow::onGeneratePressed()
+{
+	sim::Generator::Params params;
+	GeneratorDialog generator(this);
+	if (!generator.run(params))
+		return;
+
+	QFileDialog dialog(this);
+	dialog.setAcceptMode(QFileDialog::AcceptSave);
+	dialog.setFileMode(QFileDialog::AnyFile);
+	dialog.setDirectory(QString::fromStdString(util::Config::instance().get<std::string>("levels", "data/levels/")));
+	dialog.setFilter("TUStudios Dominator (*.xml)");
+	dialog.setDefaultSuffix("xml");
+	if (dialog.exec()) {
+		QString filename = dialog.selectedFiles().first();
+		try {
+			sim::Generator::save(params, filename.toStdString());
+		} catch (std::exception& e) {
+			MessageDialog("The scene could not be generated.", e.what(), MessageDialog::QERROR);
+			return;
+		}
+		sim::Simulation::instance().setEnabled(false);
+		m_filename = filename;
+		m_currentFilename->setText(m_filename);
+		sim::Simulation::instance().load(m_filename.toStdString());
+		m_modified = false;
+	}
+}
+
 void MainWindow::onSimulationControlsPressed()
 {
 	bool status;
+	sim::Replay& replay = sim::Simulation::instance().getReplay();
 	if (QObject::sender() == m_play) {
+		replay.stop();
 		sim::Simulation::instance().setEnabled(false);
 		m_tmp_file = new QTemporaryFile();
 		m_tmp_file->open();
 		sim::Simulation::instance().save(m_tmp_file->fileName().toStdString());
+		if (m_record->isChecked())
+			sim::Simulation::instance().startRecording();
 		status = true;
 	} else {
+		// stop before the level is reloaded, the frames are kept
+		replay.stop();
+		sim::Simulation::instance().setFastForward(false);
+		m_settling = false;
 		status = false;
 	}
 
 	m_play->setEnabled(!status);
 	m_stop->setEnabled(status);
 	m_stop_no_reset->setEnabled(status);
+	m_record->setEnabled(!status);
+	m_replayPlay->setEnabled(!status);
+	m_replayLoad->setEnabled(!status);
 	sim::Simulation::instance().setEnabled(status);
 
 	if (!status && m_tmp_file) {
@@ -335,8 +457,130 @@ void MainWindow::onSimulationControlsPressed()
 
 void MainWindow::onGravityPressed()
 {
-	GravityDialog* dialog = new GravityDialog(newton::gravity, this);
-	newton::gravity = dialog->run();
+	sim::World* world = sim::Simulation::instance().getWorld();
+	GravityDialog* dialog = new GravityDialog(world->getGravity(), this);
+	world->setGravity(dialog->run());
+}
+
+void MainWindow::onFastForwardPressed()
+{
+	sim::Simulation& simulation = sim::Simulation::instance();
+	if (QObject::sender() == m_settle) {
+		if (m_play->isEnabled())
+			m_play->trigger();
+		if (!simulation.isEnabled())
+			return;
+		// the timeout is physics time, i.e. 50000 steps
+		simulation.runUntilSettled(util::Config::instance().get("settleTimeout", 12000.0f));
+		m_settling = true;
+		m_simulationStatus->setText("Running until all bodies sleep");
+	} else {
+		simulation.setFastForward(m_fastForward->isChecked());
+	}
+	m_fastForward->setChecked(simulation.isFastForward());
+}
+
+void MainWindow::onTracePressed()
+{
+	util::Profiler& profiler = util::Profiler::instance();
+	if (m_trace->isChecked()) {
+		QString fileName = QFileDialog::getSaveFileName(this, "TUStudios Dominator - Save trace", 0,
+				"Chrome Trace (*.json)");
+		if (!fileName.isEmpty())
+			profiler.startCapture(fileName.toStdString(), util::Config::instance().get("traceFrames", 0u));
+	} else {
+		try {
+			profiler.stopCapture();
+		} catch (std::runtime_error& e) {
+			MessageDialog("The trace could not be saved.", e.what(), MessageDialog::QERROR);
+		}
+	}
+	m_trace->setChecked(util::Profiler::isCapturing());
+}
+
+void MainWindow::onReplayControlsPressed()
+{
+	// the amount of time skipped by MainWindow::m_replayBack and m_replayForward
+	static const float SKIP_TIME = 5.0f;
+
+	sim::Replay& replay = sim::Simulation::instance().getReplay();
+	if (QObject::sender() == m_replayPlay) {
+		if (!sim::Simulation::instance().startPlayback()) {
+			MessageDialog("The recording could not be played.",
+					"Record the simulation first. The level must not be changed after the recording.",
+					MessageDialog::QERROR);
+			return;
+		}
+		replay.setSpeed(1.0f);
+		m_replayPause->setChecked(false);
+	} else if (QObject::sender() == m_replayPause) {
+		replay.setPaused(m_replayPause->isChecked());
+	} else if (QObject::sender() == m_replaySlower) {
+		replay.setSpeed(replay.getSpeed() * 0.5f);
+	} else if (QObject::sender() == m_replayFaster) {
+		replay.setSpeed(replay.getSpeed() * 2.0f);
+	} else if (QObject::sender() == m_replayBack) {
+		replay.seek(replay.getTime() - SKIP_TIME);
+	} else if (QObject::sender() == m_replayForward) {
+		replay.seek(replay.getTime() + SKIP_TIME);
+	} else if (QObject::sender() == m_replayStop) {
+		replay.stop();
+	}
+
+	const bool playing = replay.getState() == sim::Replay::PLAYING;
+	m_play->setEnabled(!playing);
+	m_record->setEnabled(!playing);
+	m_replayPlay->setEnabled(!playing);
+	m_replayPause->setEnabled(playing);
+	m_replaySlower->setEnabled(playing);
+	m_replayFaster->setEnabled(playing);
+	m_replayBack->setEnabled(playing);
+	m_replayForward->setEnabled(playing);
+	m_replayStop->setEnabled(playing);
+	m_replayLoad->setEnabled(!playing);
+
+	if (playing) {
+		m_simulationStatus->setText(QString("Replay %1 s of %2 s at %3x, %4 KB")
+				.arg(replay.getTime(), 0, 'f', 1).arg(replay.getDuration(), 0, 'f', 1)
+				.arg(replay.getSpeed()).arg(replay.getMemoryUsage() / 1024));
+	} else {
+		m_simulationStatus->setText("Replay stopped");
+	}
+}
+
+void MainWindow::onReplayFilePressed()
+{
+	sim::Replay& replay = sim::Simulation::instance().getReplay();
+	if (QObject::sender() == m_replaySave) {
+		if (!replay.getFrameCount()) {
+			MessageDialog("The recording could not be saved.", "Record the simulation first.",
+					MessageDialog::QERROR);
+			return;
+		}
+		QString fileName = QFileDialog::getSaveFileName(this, "TUStudios Dominator - Save recording", 0,
+				"Dominator Recording (*.rec)");
+		if (fileName.isEmpty())
+			return;
+		try {
+			replay.save(fileName.toStdString());
+		} catch (std::runtime_error& e) {
+			MessageDialog("The recording could not be saved.", e.what(), MessageDialog::QERROR);
+			return;
+		}
+		m_simulationStatus->setText("Recording saved");
+	} else {
+		QString fileName = QFileDialog::getOpenFileName(this, "TUStudios Dominator - Load recording", 0,
+				"Dominator Recording (*.rec)");
+		if (fileName.isEmpty())
+			return;
+		try {
+			replay.load(fileName.toStdString());
+		} catch (std::runtime_error& e) {
+			MessageDialog("The recording could not be loaded.", e.what(), MessageDialog::QERROR);
+			return;
+		}
+		m_simulationStatus->setText(QString("Recording of %1 s loaded").arg(replay.getDuration(), 0, 'f', 1));
+	}
 }
 
 void MainWindow::onSoundControlsPressed()
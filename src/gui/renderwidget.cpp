@@ -7,6 +7,7 @@
 #include <gui/renderwidget.hpp>
 
 #include <iostream>
+#include <algorithm>
 
 #include <m3d/m3d.hpp>
 #include <opengl/shader.hpp>
@@ -15,6 +16,7 @@
 #include <simulation/material.hpp>
 #include <simulation/simulation.hpp>
 #include <util/config.hpp>
+#include <util/profiler.hpp>
 
 #include <QtCore/QString>
 
@@ -28,13 +30,38 @@ using namespace m3d;
 
 namespace gui {
 
+/** The height of the profiler graph in pixels */
+static const float PROFILER_HEIGHT = 150.0f;
+
+/** The frame time at the top of the profiler graph in milliseconds */
+static const float PROFILER_RANGE = 50.0f;
+
+/** The width of the bar of a frame in pixels */
+static const float PROFILER_BAR = 3.0f;
+
+/** The number of frames that are averaged for the legend */
+static const unsigned PROFILER_AVERAGE = 30;
+
+/** The interval in which an idle widget checks for changes, in milliseconds */
+static const int IDLE_INTERVAL = 15;
+
+/** The colors of the phases in the profiler graph */
+static const GLubyte PROFILER_COLORS[][3] = {
+	{ 230, 25, 75 }, { 60, 180, 75 }, { 255, 225, 25 }, { 0, 130, 200 },
+	{ 245, 130, 48 }, { 145, 30, 180 }, { 70, 240, 240 }, { 240, 50, 230 },
+	{ 210, 245, 60 }, { 250, 190, 190 }, { 0, 128, 128 }, { 170, 110, 40 }
+};
+
 RenderWidget::RenderWidget(QWidget* parent) :
-	QGLWidget(parent)
+	QGLWidget(parent),
+	m_frames(0),
+	m_idleFrameRate(util::Config::instance().get("idleFrameRate", 10.0f)),
+	m_showProfiler(false)
 {
 	setFocusPolicy(Qt::WheelFocus);
 	//updateGL();
 	m_timer = new QTimer(this);
-	connect(m_timer, SIGNAL(timeout()), this, SLOT(updateGL()));
+	connect(m_timer, SIGNAL(timeout()), this, SLOT(updateFrame()));
 	//m_timer->start();
 }
 
@@ -49,6 +76,7 @@ void RenderWidget::initializeGL()
 	// load per-pixel lighting shader
 
 	ogl::ShaderMgr::instance().load(util::Config::instance().get("enableShadows", false) ? "data/shaders_shadow/" : "data/shaders/");
+	// the textures are only registered here and streamed in on demand
 	ogl::TextureMgr::instance().load("data/textures/");
 
 	glShadeModel(GL_SMOOTH);
@@ -83,55 +111,187 @@ void RenderWidget::paintGL()
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	ogl::TextureMgr::instance().update();
 	sim::Simulation::instance().update();
 	sim::Simulation::instance().render();
 
-	static int frames = 0;
-	frames++;
+	if (m_showProfiler)
+		renderProfiler();
+	util::Profiler::instance().endFrame();
+
+	m_frames++;
+	m_idleClock.reset();
+}
+
+void RenderWidget::updateFrame()
+{
+	// the profiler shows the times of consecutive frames
+	const bool idle = !m_showProfiler && !sim::Simulation::instance().needsRender();
+	if (!idle || (m_idleFrameRate > 0.0f && m_idleClock.get() * m_idleFrameRate >= 1.0f))
+		updateGL();
+	m_timer->setInterval(idle ? IDLE_INTERVAL : 0);
+
+	// emitted by the timer, so that the status is updated while idle
 	if (m_clock.get() >= 1.0f) {
-		emit framesPerSecondChanged(frames);
+		emit framesPerSecondChanged(m_frames);
 		emit objectsCountChanged(sim::Simulation::instance().getObjectCount());
 		if (sim::Simulation::instance().getSelectedObject()) {
 			emit objectSelected(sim::Simulation::instance().getSelectedObject());
 		}
 		m_clock.reset();
-		frames = 0;
+		m_frames = 0;
+	}
+}
+
+void RenderWidget::invalidate()
+{
+	sim::Simulation::instance().invalidate();
+	if (m_timer->isActive())
+		m_timer->start(0);
+}
+
+void RenderWidget::setProfilerVisible(bool visible)
+{
+	m_showProfiler = visible;
+	invalidate();
+}
+
+void RenderWidget::renderProfiler()
+{
+	using util::Profiler;
+	const Profiler& profiler = Profiler::instance();
+	const std::vector<Profiler::Entry>& entries = profiler.getEntries();
+	const unsigned frames = std::min(profiler.getFrame(), Profiler::HISTORY);
+	const unsigned first = profiler.getFrame() - frames;
+	const float scale = PROFILER_HEIGHT / PROFILER_RANGE;
+	const float margin = 10.0f;
+
+	ogl::__Shader::unbind();
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	// pixel coordinates with the origin in the bottom left corner
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0.0, width(), 0.0, height(), -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	const float right = margin + Profiler::HISTORY * PROFILER_BAR;
+	glColor4ub(0, 0, 0, 160);
+	glRectf(margin, margin, right, margin + PROFILER_HEIGHT);
+
+	// the phases of the main thread are stacked, the rest of the frame is gray
+	glBegin(GL_QUADS);
+	for (unsigned f = 0; f < frames; ++f) {
+		const unsigned slot = (first + f) % Profiler::HISTORY;
+		const float x0 = margin + f * PROFILER_BAR, x1 = x0 + PROFILER_BAR - 1.0f;
+		float y = margin, total = 0.0f;
+		for (unsigned i = 0; i < entries.size(); ++i) {
+			if (entries[i].counter || !entries[i].mainThread)
+				continue;
+			const float value = std::min(entries[i].values[slot], PROFILER_RANGE - total);
+			glColor3ubv(PROFILER_COLORS[i % (sizeof(PROFILER_COLORS) / sizeof(PROFILER_COLORS[0]))]);
+			glVertex2f(x0, y);
+			glVertex2f(x1, y);
+			glVertex2f(x1, y + value * scale);
+			glVertex2f(x0, y + value * scale);
+			y += value * scale;
+			total += value;
+		}
+		const float frame = std::min(profiler.getFrameTime(first + f), PROFILER_RANGE);
+		if (frame > total) {
+			glColor3ub(96, 96, 96);
+			glVertex2f(x0, y);
+			glVertex2f(x1, y);
+			glVertex2f(x1, margin + frame * scale);
+			glVertex2f(x0, margin + frame * scale);
+		}
+	}
+	glEnd();
+
+	// 60 and 30 frames per second
+	glColor4ub(255, 255, 255, 128);
+	glBegin(GL_LINES);
+	glVertex2f(margin, margin + 16.7f * scale);
+	glVertex2f(right, margin + 16.7f * scale);
+	glVertex2f(margin, margin + 33.3f * scale);
+	glVertex2f(right, margin + 33.3f * scale);
+	glEnd();
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glPopAttrib();
+
+	// the legend with the averages of the last frames, next to the graph
+	const unsigned count = std::min(frames, PROFILER_AVERAGE);
+	int line = height() - (int)margin;
+	for (unsigned i = entries.size(); i-- > 0; ) {
+		float sum = 0.0f;
+		for (unsigned f = 0; f < count; ++f)
+			sum += entries[i].values[(profiler.getFrame() - 1 - f) % Profiler::HISTORY];
+		const float average = count ? sum / count : 0.0f;
+
+		if (entries[i].counter || !entries[i].mainThread)
+			glColor3ub(255, 255, 255);
+		else
+			glColor3ubv(PROFILER_COLORS[i % (sizeof(PROFILER_COLORS) / sizeof(PROFILER_COLORS[0]))]);
+		QString text = entries[i].counter ? QString("%1: %2").arg(QString::fromStdString(entries[i].name)).arg(average, 0, 'f', 0)
+				: QString("%1: %2 ms").arg(QString::fromStdString(entries[i].name)).arg(average, 0, 'f', 2);
+		renderText((int)right + 8, line, text);
+		line -= 14;
 	}
 }
 
 void RenderWidget::keyPressEvent(QKeyEvent* event)
 {
 	m_keyAdapter.keyEvent(event);
+	invalidate();
 }
 
 void RenderWidget::keyReleaseEvent(QKeyEvent* event)
 {
 	m_keyAdapter.keyEvent(event);
+	invalidate();
 }
 
 void RenderWidget::mouseMoveEvent(QMouseEvent* event)
 {
 	m_mouseAdapter.mouseEvent(event);
+	invalidate();
 }
 
 void RenderWidget::mousePressEvent(QMouseEvent* event)
 {
 	m_mouseAdapter.mouseEvent(event);
+	invalidate();
 }
 
 void RenderWidget::mouseReleaseEvent(QMouseEvent* event)
 {
 	m_mouseAdapter.mouseEvent(event);
+	invalidate();
 }
 
 void RenderWidget::wheelEvent(QWheelEvent* event)
 {
 	m_mouseAdapter.mouseWheelEvent(event);
+	invalidate();
 }
 
 void RenderWidget::mouseDoubleClickEvent(QMouseEvent* event)
 {
 	m_mouseAdapter.mouseEvent(event);
+	invalidate();
 
 	if (sim::Simulation::instance().getSelectedObject()) {
 		emit objectSelected(sim::Simulation::instance().getSelectedObject());
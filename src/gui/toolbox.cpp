@@ -12,6 +12,7 @@
 #include <simulation/material.hpp>
 #include <simulation/object.hpp>
 #include <simulation/simulation.hpp>
+#include <simulation/templatemgr.hpp>
 
 #include <QtCore/QDir>
 #include <QtCore/QFileInfoList>
@@ -279,9 +280,11 @@ void ToolBox::updateMaterials(QString filename)
 void ToolBox::loadTemplates(QString directory)
 {
 	m_template_menu->clear();
+	TemplateMgr::instance().clear();
 	QFileInfoList list = QDir(directory).entryInfoList(QStringList("*.xml"), QDir::Files | QDir::Readable);
 	for (int i = 0; i < list.size(); ++i) {
-		if (list.at(i).isFile()) {
+		// parse the template once, broken templates are not added to the menu
+		if (list.at(i).isFile() && TemplateMgr::instance().load(list.at(i).absoluteFilePath().toStdString())) {
 			m_template_menu->addAction(new QObjectAction(list.at(i)));
 		}
 	}
@@ -462,6 +465,7 @@ void ToolBox::updateLocation(double value)
 			matrix._43 = (float) value;
 		}
 		obj->setMatrix(matrix);
+		Simulation::instance().invalidate();
 		updateData(obj);
 	}
 }
@@ -476,6 +480,7 @@ void ToolBox::updateRotation(double value)
 		Mat4f matrix = Mat4f::rotZ(m_rotationZ->value() * PI / 180.0f) * Mat4f::rotX(m_rotationX->value() * PI / 180.0f) * Mat4f::rotY(
 				m_rotationY->value() * PI / 180.0f) * Mat4f::translate(obj->getMatrix().getW());
 		obj->setMatrix(matrix);
+		Simulation::instance().invalidate();
 		updateData(obj);
 	}
 }
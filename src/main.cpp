@@ -47,7 +47,387 @@ int main (int argc, char* argv[])
 #include <QtGui/QApplication>
 #include <gui/mainwindow.hpp>
 #include <clocale>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <QtOpenGL/QGLPixelBuffer>
 #include <util/config.hpp>
+#include <util/inputadapters.hpp>
+#include <simulation/generator.hpp>
+#include <simulation/benchmark.hpp>
+#include <simulation/sweep.hpp>
+#include <simulation/material.hpp>
+#include <simulation/simulation.hpp>
+#include <simulation/statehash.hpp>
+#include <opengl/shader.hpp>
+#include <opengl/texture.hpp>
+
+/**
+ * Splits a comma separated list, e.g. "wood,stone".
+ *
+ * @param value  The list
+ * @param result The elements are appended to this vector
+ */
+static void splitList(const std::string& value, std::vector<std::string>& result)
+{
+	size_t start = 0, end;
+	do {
+		end = value.find(',', start);
+		result.push_back(value.substr(start, end - start));
+		start = end + 1;
+	} while (end != std::string::npos);
+}
+
+/**
+ * Parses the domino type of the command line.
+ *
+ * @param value The string representation of the type
+ * @throws std::runtime_error Unknown domino type
+ * @return      The domino type
+ */
+static sim::__Object::Type getDominoType(const std::string& value)
+{
+	using namespace sim;
+	int type = __Object::DOMINO_SMALL;
+	while (type <= __Object::DOMINO_LARGE && value != __Object::TypeStr[type])
+		++type;
+	if (type > __Object::DOMINO_LARGE)
+		throw std::runtime_error("Unknown domino type " + value);
+	return (__Object::Type)type;
+}
+
+/**
+ * Generates a level without starting the user interface, e.g.
+ * dominator --generate out.xml --layout spiral --count 100000 --seed 7
+ *
+ * @return The exit code of the application
+ */
+static int generate(int argc, char **argv)
+{
+	using namespace sim;
+	Generator::Params params;
+	std::string fileName = argv[2];
+
+	try {
+		for (int i = 3; i < argc; ++i) {
+			std::string arg(argv[i]);
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value for " + arg);
+			std::string value(argv[++i]);
+
+			if (arg == "--layout") {
+				params.layout = Generator::getLayout(value);
+			} else if (arg == "--count") {
+				params.count = (unsigned)atoi(value.c_str());
+			} else if (arg == "--type") {
+				params.type = getDominoType(value);
+			} else if (arg == "--gap") {
+				params.gap = (float)atof(value.c_str());
+			} else if (arg == "--materials") {
+				splitList(value, params.materials);
+			} else if (arg == "--ground") {
+				params.groundMaterial = value;
+			} else if (arg == "--environment") {
+				params.environment = value;
+			} else if (arg == "--seed") {
+				params.seed = (unsigned)strtoul(value.c_str(), NULL, 10);
+			} else {
+				throw std::runtime_error("Unknown option " + arg);
+			}
+		}
+
+		unsigned count = Generator::save(params, fileName);
+		std::cout << "Generated " << count << " dominos (" << Generator::LayoutStr[params.layout]
+				  << ", seed " << params.seed << ") in " << fileName << std::endl;
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl
+				  << "usage: " << argv[0] << " --generate <file> [--layout grid|spiral|tree|hilbert] [--count n]"
+				  << " [--type domino_small|domino_middle|domino_large] [--gap f] [--materials a,b,...]"
+				  << " [--ground material] [--environment file] [--seed n]" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Creates the Simulation in an offscreen OpenGL context with the same
+ * state as the render widget. The QApplication has to exist.
+ *
+ * @param buffer The offscreen buffer, the size matches the default window size
+ * @return       False, if there is no offscreen OpenGL context
+ */
+static bool createOffscreenSimulation(QGLPixelBuffer& buffer, util::KeyAdapter& keyAdapter,
+		util::MouseAdapter& mouseAdapter)
+{
+	using namespace sim;
+	if (!buffer.isValid() || !buffer.makeCurrent() || glewInit() != GLEW_OK) {
+		std::cerr << "Could not create an offscreen OpenGL context" << std::endl;
+		return false;
+	}
+
+	ogl::ShaderMgr::instance().load(util::Config::instance().get("enableShadows", false) ? "data/shaders_shadow/" : "data/shaders/");
+	ogl::TextureMgr::instance().load("data/textures/");
+	glShadeModel(GL_SMOOTH);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClearDepth(1.0f);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+
+	Simulation::createInstance(keyAdapter, mouseAdapter);
+
+	glViewport(0, 0, buffer.size().width(), buffer.size().height());
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(60.0f, (float)buffer.size().width() / (float)buffer.size().height(), 0.1f, 4096.0f);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	Simulation::instance().getCamera().m_viewport = Vec4<GLint>::viewport();
+	Simulation::instance().getCamera().m_projection = Mat4f::projection();
+	return true;
+}
+
+/**
+ * Runs the benchmark in an offscreen OpenGL context, e.g.
+ * dominator --benchmark out.json --baseline baseline.json --threshold 0.1
+ *
+ * @return 0 on success, 1 on errors and 2 if there are regressions
+ */
+static int benchmark(int argc, char **argv)
+{
+	using namespace sim;
+	Benchmark::Params params;
+	std::string output = argv[2];
+	std::string baseline;
+
+	try {
+		for (int i = 3; i < argc; ++i) {
+			std::string arg(argv[i]);
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value for " + arg);
+			std::string value(argv[++i]);
+
+			if (arg == "--baseline") {
+				baseline = value;
+			} else if (arg == "--threshold") {
+				params.threshold = atof(value.c_str());
+			} else if (arg == "--runs") {
+				params.runs = std::max(1, atoi(value.c_str()));
+			} else if (arg == "--steps") {
+				params.steps = (unsigned)atoi(value.c_str());
+			} else if (arg == "--frames") {
+				params.frames = (unsigned)atoi(value.c_str());
+			} else if (arg == "--objects") {
+				params.editorObjects = (unsigned)atoi(value.c_str());
+			} else if (arg == "--levels") {
+				params.levels = value;
+			} else if (arg == "--count") {
+				// the number of dominos in the generated scenes, 0 disables them
+				unsigned count = (unsigned)atoi(value.c_str());
+				if (count == 0)
+					params.generated.clear();
+				for (unsigned j = 0; j < params.generated.size(); ++j)
+					params.generated[j].count = count;
+			} else {
+				throw std::runtime_error("Unknown option " + arg);
+			}
+		}
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl
+				  << "usage: " << argv[0] << " --benchmark <file> [--baseline file] [--threshold f] [--runs n]"
+				  << " [--steps n] [--frames n] [--objects n] [--levels directory] [--count n]" << std::endl;
+		return 1;
+	}
+
+	QApplication app(argc, argv);
+	QGLPixelBuffer buffer(1024, 768);
+	util::KeyAdapter keyAdapter;
+	util::MouseAdapter mouseAdapter;
+	if (!createOffscreenSimulation(buffer, keyAdapter, mouseAdapter))
+		return 1;
+
+	int result = 0;
+	try {
+		Benchmark benchmark(params);
+		benchmark.run();
+		benchmark.save(output);
+		std::cout << "Peak memory usage: " << Benchmark::getPeakMemory() << " KiB" << std::endl;
+
+		if (!baseline.empty() && benchmark.compare(baseline) > 0)
+			result = 2;
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		result = 1;
+	}
+
+	Simulation::destroyInstance();
+	return result;
+}
+
+/**
+ * Runs a parameter sweep of headless simulations on all cores, e.g.
+ * dominator --sweep out.json --count 200 --gaps 2,2.5,3 --materials planks,stone
+ *
+ * @return The exit code of the application
+ */
+static int sweep(int argc, char **argv)
+{
+	using namespace sim;
+	Sweep::Run base;
+	std::vector<float> gaps, masses;
+	std::vector<std::string> materials, grounds;
+	std::string output = argv[2];
+	unsigned threads = 0;
+
+	try {
+		for (int i = 3; i < argc; ++i) {
+			std::string arg(argv[i]);
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value for " + arg);
+			std::string value(argv[++i]);
+
+			if (arg == "--layout") {
+				base.scene.layout = Generator::getLayout(value);
+			} else if (arg == "--count") {
+				base.scene.count = (unsigned)atoi(value.c_str());
+			} else if (arg == "--type") {
+				base.scene.type = getDominoType(value);
+			} else if (arg == "--gaps" || arg == "--masses") {
+				std::vector<std::string> values;
+				splitList(value, values);
+				for (unsigned j = 0; j < values.size(); ++j)
+					(arg == "--gaps" ? gaps : masses).push_back((float)atof(values[j].c_str()));
+			} else if (arg == "--materials") {
+				splitList(value, materials);
+			} else if (arg == "--grounds") {
+				splitList(value, grounds);
+			} else if (arg == "--steps") {
+				base.steps = (unsigned)atoi(value.c_str());
+			} else if (arg == "--seed") {
+				base.scene.seed = (unsigned)strtoul(value.c_str(), NULL, 10);
+			} else if (arg == "--threads") {
+				threads = (unsigned)atoi(value.c_str());
+			} else {
+				throw std::runtime_error("Unknown option " + arg);
+			}
+		}
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl
+				  << "usage: " << argv[0] << " --sweep <file> [--layout grid|spiral|tree|hilbert] [--count n]"
+				  << " [--type domino_small|domino_middle|domino_large] [--gaps f,...] [--masses f,...]"
+				  << " [--materials a,...] [--grounds a,...] [--steps n] [--seed n] [--threads n]" << std::endl;
+		return 1;
+	}
+
+	// the runs share the materials, but nothing else
+	MaterialMgr::instance().load(util::Config::instance().get<std::string>("materialsxml", "data/materials.xml"));
+
+	Sweep sweep;
+	sweep.addGrid(base, gaps, masses, materials, grounds);
+	std::cout << "Running " << sweep.getRuns().size() << " simulations" << std::endl;
+	sweep.run(threads);
+
+	try {
+		sweep.save(output);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Simulates a level and writes the hash of the physical state after each
+ * step, e.g. dominator --hash level.xml out.hash --steps 1000 --threads 1
+ *
+ * @return The exit code of the application
+ */
+static int stateHash(int argc, char **argv)
+{
+	using namespace sim;
+	std::string level = argv[2];
+	std::string output = argv[3];
+	unsigned steps = 1000;
+
+	try {
+		for (int i = 4; i < argc; ++i) {
+			std::string arg(argv[i]);
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value for " + arg);
+			std::string value(argv[++i]);
+
+			if (arg == "--steps") {
+				steps = (unsigned)atoi(value.c_str());
+			} else if (arg == "--threads") {
+				util::Config::instance().set("physicsThreads", std::max(1, atoi(value.c_str())));
+			} else if (arg == "--solver") {
+				util::Config::instance().set("solverModel", atoi(value.c_str()));
+			} else {
+				throw std::runtime_error("Unknown option " + arg);
+			}
+		}
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl
+				  << "usage: " << argv[0] << " --hash <level> <file> [--steps n] [--threads n] [--solver n]" << std::endl;
+		return 1;
+	}
+
+	// the level has to be loaded like in the editor
+	QApplication app(argc, argv);
+	QGLPixelBuffer buffer(1024, 768);
+	util::KeyAdapter keyAdapter;
+	util::MouseAdapter mouseAdapter;
+	if (!createOffscreenSimulation(buffer, keyAdapter, mouseAdapter))
+		return 1;
+	MaterialMgr::instance().load(util::Config::instance().get<std::string>("materialsxml", "data/materials.xml"));
+
+	int result = 0;
+	Simulation& simulation = Simulation::instance();
+	try {
+		if (!simulation.load(level))
+			throw std::runtime_error("Could not load the level " + level);
+		simulation.startStateHash(output);
+		for (unsigned i = 0; i < steps; ++i)
+			simulation.step();
+		simulation.stopStateHash();
+		std::cout << "Wrote the state hashes of " << steps << " steps to " << output << std::endl;
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		result = 1;
+	}
+
+	Simulation::destroyInstance();
+	return result;
+}
+
+/**
+ * Compares the state hashes of two runs, e.g.
+ * dominator --compare-hashes before.hash after.hash
+ *
+ * @return 0 if the runs are equal, 1 on errors and 2 if they diverge
+ */
+static int compareHashes(int argc, char **argv)
+{
+	using namespace sim;
+	try {
+		StateHash::Divergence result = StateHash::compare(argv[2], argv[3]);
+		if (!result.diverged) {
+			std::cout << "The runs are equal for " << result.steps << " steps" << std::endl;
+			return 0;
+		}
+
+		std::cout << result.reason << " at step " << result.step;
+		if (result.body >= 0)
+			std::cout << ", body " << result.body << " (object id " << result.id << ")";
+		std::cout << std::endl;
+		return 2;
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
 
 int main(int argc, char **argv) {
 
@@ -58,6 +438,17 @@ int main(int argc, char **argv) {
 	using namespace util;
 	Config::instance().load("data/config.xml");
 
+	if (argc >= 3 && strcmp(argv[1], "--generate") == 0)
+		return generate(argc, argv);
+	if (argc >= 3 && strcmp(argv[1], "--benchmark") == 0)
+		return benchmark(argc, argv);
+	if (argc >= 3 && strcmp(argv[1], "--sweep") == 0)
+		return sweep(argc, argv);
+	if (argc >= 4 && strcmp(argv[1], "--hash") == 0)
+		return stateHash(argc, argv);
+	if (argc >= 4 && strcmp(argv[1], "--compare-hashes") == 0)
+		return compareHashes(argc, argv);
+
 	std::cout << "Totally Unrelated Studios proudly presents:" << std::endl
 			  << "\tDOMINATOR" << std::endl << std::endl;
 
@@ -6,6 +6,14 @@
 
 #include <opengl/oglutil.hpp>
 #include <newton/util.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <queue>
+#include <limits>
 #include <iostream>
 #include <dVector.h>
 #include <dMatrix.h>
@@ -13,8 +21,7 @@
 
 namespace newton {
 
-NewtonWorld* world = NULL;
-float gravity = 0.0f;
+THREAD_LOCAL NewtonWorld* world = NULL;
 
 
 struct ExplosionData {
@@ -106,50 +113,274 @@ float getVerticalPosition(float x, float z)
 }
 
 
-static unsigned ConvexCastCallback(const NewtonBody* body, const NewtonCollision* collision, void* userData)
+/** Batches smaller than this per worker thread run on the calling thread */
+#define MIN_QUERIES_PER_THREAD 32
+
+/**
+ * The worker threads of runParallel(). They are started by the first large
+ * query and then wait for further chunks, so that queries issued every
+ * frame, e.g. by the spline preview, do not create new threads. Several
+ * threads may run queries at the same time, each waits for its own tasks.
+ */
+class WorkerPool {
+public:
+	typedef boost::function<void ()> Task;
+
+	static WorkerPool& instance()
+	{
+		static WorkerPool pool;
+		return pool;
+	}
+
+	/**
+	 * Runs the first task on the calling thread and the others on the
+	 * workers, and returns when all tasks are finished.
+	 */
+	void run(const std::vector<Task>& tasks)
+	{
+		unsigned remaining = tasks.size() - 1;
+		m_mutex.lock();
+		for (; m_threadCount < remaining; ++m_threadCount)
+			m_threads.create_thread(boost::bind(&WorkerPool::work, this));
+		for (unsigned i = 1; i < tasks.size(); ++i)
+			m_tasks.push(Item(tasks[i], &remaining));
+		m_condition.notify_all();
+		m_mutex.unlock();
+
+		tasks[0]();
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		while (remaining > 0)
+			m_finished.wait(lock);
+	}
+
+private:
+	/** A queued task and the counter of the query it belongs to */
+	struct Item {
+		Task task;
+		unsigned* remaining;
+
+		Item() : remaining(NULL) { }
+		Item(const Task& task, unsigned* remaining) : task(task), remaining(remaining) { }
+	};
+
+	boost::thread_group m_threads;
+	unsigned m_threadCount;
+	boost::mutex m_mutex;
+	boost::condition_variable m_condition;
+	boost::condition_variable m_finished;
+	std::queue<Item> m_tasks;
+	bool m_running;
+
+	WorkerPool() : m_threadCount(0), m_running(true) { }
+
+	~WorkerPool()
+	{
+		m_mutex.lock();
+		m_running = false;
+		m_condition.notify_all();
+		m_mutex.unlock();
+		m_threads.join_all();
+	}
+
+	void work()
+	{
+		for (;;) {
+			Item item;
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				while (m_running && m_tasks.empty())
+					m_condition.wait(lock);
+				if (!m_running)
+					return;
+				item = m_tasks.front();
+				m_tasks.pop();
+			}
+
+			item.task();
+
+			boost::mutex::scoped_lock lock(m_mutex);
+			if (--(*item.remaining) == 0)
+				m_finished.notify_all();
+		}
+	}
+};
+
+/**
+ * Splits the range [0, count) into chunks and runs the job for each chunk
+ * on a worker thread. The index of the worker is passed to the job, it is
+ * always smaller than the number of threads of the world.
+ *
+ * Concurrent queries on one world are safe as long as it is not updated:
+ * Newton only reads the broadphase and the collision trees during ray and
+ * convex casts and keeps the traversal state on the stack, the convex
+ * casts use the scratch memory of the given thread index. The callbacks
+ * below only write to the data of their own chunk.
+ */
+template <typename Job>
+static void runParallel(const Job& job, unsigned count)
+{
+	unsigned threads = std::min((unsigned)NewtonGetThreadsCount(world), count / MIN_QUERIES_PER_THREAD);
+	if (threads <= 1) {
+		job(0, count, 0);
+		return;
+	}
+
+	const unsigned chunk = (count + threads - 1) / threads;
+	std::vector<WorkerPool::Task> tasks;
+	tasks.reserve(threads);
+	for (unsigned t = 0; t < threads; ++t)
+		tasks.push_back(boost::bind<void>(job, t * chunk, std::min(count, (t + 1) * chunk), (int)t));
+	WorkerPool::instance().run(tasks);
+}
+
+static unsigned excludePrefilter(const NewtonBody* body, const NewtonCollision* collision, void* userData)
 {
-	//NewtonBody* other = (NewtonBody*)userData;
-	std::list<NewtonBody*>* others = (std::list<NewtonBody*>*)userData;
-	return std::find(others->begin(), others->end(), body) == others->end();
-	//return (other == body) ? 0 : 1;
+	const BodySet* exclude = *(const BodySet**)userData;
+	return exclude->find(body) == exclude->end();
 }
 
-float getConvexCastPlacement(NewtonBody* body, std::list<NewtonBody*>* noCollision)
+struct CastRayData {
+	/** Has to be the first member, it is used by excludePrefilter */
+	const BodySet* exclude;
+	RayHit hit;
+};
+
+static float castRayFilter(const NewtonBody* body, const float* normal, int collisionID, void* userData, float intersectParam)
 {
-	std::list<NewtonBody*> temp;
-	if (noCollision == NULL) {
-		noCollision = &temp;
+	CastRayData* data = (CastRayData*)userData;
+	if (intersectParam < data->hit.param) {
+		data->hit.param = intersectParam;
+		data->hit.body = const_cast<NewtonBody*>(body);
+		data->hit.normal = Vec3f(normal[0], normal[1], normal[2]);
 	}
-	noCollision->push_back(body);
+	return data->hit.param;
+}
 
-	Mat4f matrix;
-	NewtonBodyGetMatrix(body, matrix[0]);
-	matrix._42 += 200.0f;
-	Vec3f p(matrix.getW());
-	p.y -= 400.0f;
+struct CastRayJob {
+	/** The world of the calling thread, the workers have none */
+	NewtonWorld* world;
+	const std::vector<Ray>* rays;
+	std::vector<RayHit>* hits;
+	const BodySet* exclude;
 
-	NewtonCollision* collision = NewtonBodyGetCollision(body);
+	void operator()(unsigned begin, unsigned end, int thread) const
+	{
+		CastRayData data;
+		data.exclude = exclude;
+		for (unsigned i = begin; i < end; ++i) {
+			data.hit.body = NULL;
+			data.hit.param = 1.2f;
+			const Ray& ray = (*rays)[i];
+			NewtonWorldRayCast(world, &ray.p0[0], &ray.p1[0], castRayFilter, &data, exclude ? excludePrefilter : NULL);
+			(*hits)[i] = data.hit;
+		}
+	}
+};
 
-	float param = 0.0f;
-	NewtonWorldConvexCastReturnInfo info[16];
+void castRays(const std::vector<Ray>& rays, std::vector<RayHit>& hits, const BodySet* exclude)
+{
+	hits.resize(rays.size());
+	CastRayJob job = { world, &rays, &hits, exclude };
+	runParallel(job, rays.size());
+}
 
-	NewtonCollisionInfoRecord collisionInfo;
-	NewtonCollisionGetInfo(collision, &collisionInfo);
+struct CastConvexJob {
+	NewtonWorld* world;
+	const std::vector<ConvexCast>* casts;
+	std::vector<ConvexHit>* hits;
+	const BodySet* exclude;
 
-	if (collisionInfo.m_collisionType == SERIALIZE_ID_COMPOUND) {
-		float maximum = -200.0f;
-		for (int i = 0; i < collisionInfo.m_compoundCollision.m_chidrenCount; ++i) {
-			NewtonCollision* node = collisionInfo.m_compoundCollision.m_chidren[i];
-			NewtonWorldConvexCast(world, matrix[0], &p[0], node, &param, noCollision, ConvexCastCallback, info, 16, 0);
-			float current = matrix._42 + (p.y - matrix._42) * param;
-			if (current > maximum) maximum = current;
+	void operator()(unsigned begin, unsigned end, int thread) const
+	{
+		NewtonWorldConvexCastReturnInfo info[16];
+		const BodySet* userData = exclude;
+		for (unsigned i = begin; i < end; ++i) {
+			const ConvexCast& cast = (*casts)[i];
+			ConvexHit& hit = (*hits)[i];
+			hit.param = 1.0f;
+			int contacts = NewtonWorldConvexCast(world, cast.matrix[0], &cast.target[0], cast.collision, &hit.param,
+					&userData, exclude ? excludePrefilter : NULL, info, 16, thread);
+			hit.body = contacts > 0 ? info[0].m_hitBody : NULL;
 		}
-		return maximum;
-	} else {
-		NewtonWorldConvexCast(world, matrix[0], &p[0], collision, &param, noCollision, ConvexCastCallback, info, 16, 0);
+	}
+};
+
+void castConvex(const std::vector<ConvexCast>& casts, std::vector<ConvexHit>& hits, const BodySet* exclude)
+{
+	hits.resize(casts.size());
+	CastConvexJob job = { world, &casts, &hits, exclude };
+	runParallel(job, casts.size());
+}
+
+void getVerticalPositions(const std::vector<Vec2f>& points, std::vector<float>& result)
+{
+	// shoot vertical rays from a high altitude and collect the intersection parameters.
+	std::vector<Ray> rays;
+	rays.reserve(points.size());
+	for (std::vector<Vec2f>::const_iterator itr = points.begin(); itr != points.end(); ++itr)
+		rays.push_back(Ray(Vec3f(itr->x, 1000.0f, itr->y), Vec3f(itr->x, -1000.0f, itr->y)));
+
+	std::vector<RayHit> hits;
+	castRays(rays, hits);
+
+	// the intersections are the interpolated values
+	result.resize(points.size());
+	for (unsigned i = 0; i < hits.size(); ++i)
+		result[i] = 1000.0f - 2000.0f * hits[i].param;
+}
+
+float getConvexCastPlacement(NewtonBody* body, const BodySet* exclude)
+{
+	std::vector<NewtonBody*> bodies(1, body);
+	std::vector<float> result;
+	getConvexCastPlacements(bodies, result, exclude);
+	return result[0];
+}
+
+void getConvexCastPlacements(const std::vector<NewtonBody*>& bodies, std::vector<float>& result, const BodySet* exclude)
+{
+	BodySet ignore;
+	if (exclude)
+		ignore = *exclude;
+	ignore.insert(bodies.begin(), bodies.end());
+
+	// one cast per body, or per child of compound collisions
+	std::vector<ConvexCast> casts;
+	std::vector<unsigned> owners;
+	casts.reserve(bodies.size());
+	owners.reserve(bodies.size());
+	for (unsigned i = 0; i < bodies.size(); ++i) {
+		Mat4f matrix;
+		NewtonBodyGetMatrix(bodies[i], matrix[0]);
+		matrix._42 += 200.0f;
+		Vec3f p(matrix.getW());
+		p.y -= 400.0f;
+
+		NewtonCollision* collision = NewtonBodyGetCollision(bodies[i]);
+		NewtonCollisionInfoRecord collisionInfo;
+		NewtonCollisionGetInfo(collision, &collisionInfo);
+
+		if (collisionInfo.m_collisionType == SERIALIZE_ID_COMPOUND) {
+			for (int j = 0; j < collisionInfo.m_compoundCollision.m_chidrenCount; ++j) {
+				casts.push_back(ConvexCast(collisionInfo.m_compoundCollision.m_chidren[j], matrix, p));
+				owners.push_back(i);
+			}
+		} else {
+			casts.push_back(ConvexCast(collision, matrix, p));
+			owners.push_back(i);
+		}
+	}
+
+	std::vector<ConvexHit> hits;
+	castConvex(casts, hits, &ignore);
 
-		matrix._42 += (p.y - matrix._42) * param;
-		return matrix._42;
+	// the highest contact of all casts of a body is its new position
+	result.assign(bodies.size(), -std::numeric_limits<float>::max());
+	for (unsigned i = 0; i < casts.size(); ++i) {
+		const float start = casts[i].matrix._42;
+		const float current = start + (casts[i].target.y - start) * hits[i].param;
+		result[owners[i]] = std::max(result[owners[i]], current);
 	}
 }
 
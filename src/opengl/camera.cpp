@@ -88,7 +88,8 @@ void Camera::update()
 	m_strafe.normalize();
 
 	m_modelview = Mat4f::lookAt(m_position, m_eye, m_up);
-	m_inverse = m_modelview.inverse();
+	// the view matrix is a rigid transform
+	m_inverse = m_modelview.orthonormalInverse();
 
 	Mat4f mvproj = m_modelview * m_projection;
 
@@ -232,6 +233,12 @@ Vec3f Camera::pointer() const
 				   (m_viewport.w - m_viewport.y) / 2);
 }
 
+float Camera::pixelScale() const
+{
+	// the viewport is stored as (x, y, width, height)
+	return m_projection._22 * m_viewport.w * 0.5f;
+}
+
 Vec3f Camera::pointer(int x, int y) const
 {
 	Mat4d modelview(m_modelview);
@@ -9,11 +9,14 @@
 #include <lib3ds/file.h>
 #include <lib3ds/mesh.h>
 #include <boost/foreach.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <map>
 
 namespace ogl {
 
 
-void __Mesh::genBuffers(ogl::VertexBuffer& vbo)
+void __Mesh::genBuffers(ogl::VertexBuffer& vbo, void* userData, uint32_t transform)
 {
 	// get the offset in floats and vertices
 	const unsigned vertexSize = vbo.floatSize();
@@ -28,7 +31,9 @@ void __Mesh::genBuffers(ogl::VertexBuffer& vbo)
 	BOOST_FOREACH(const ogl::SubBuffer* old, m_buffers) {
 		ogl::SubBuffer* buffer = new ogl::SubBuffer();
 		buffer->material = old->material;
-		buffer->userData = old->userData;
+		buffer->userData = userData ? userData : old->userData;
+		buffer->transform = transform;
+		buffer->copyLOD(*old, vbo.m_indices.size());
 
 		buffer->dataCount = old->dataCount;
 		buffer->dataOffset = old->dataOffset + vertexOffset;
@@ -44,6 +49,90 @@ void __Mesh::genBuffers(ogl::VertexBuffer& vbo)
 		vbo.m_indices.push_back(vertexOffset + m_indices[i]);
 }
 
+/**
+ * Clusters the vertices of the given triangles in a grid with the given
+ * number of cells along the largest extent. Each vertex is replaced by the
+ * first vertex in its cell, triangles that collapse are not copied.
+ *
+ * @param positions The vertex positions, stride floats apart
+ * @param stride    The number of floats per vertex
+ * @param indices   The triangles to simplify
+ * @param count     The number of indices
+ * @param cells     The number of cells along the largest extent
+ * @param result    The indices of the simplified triangles
+ */
+static void simplify(const float* positions, unsigned stride, const uint32_t* indices,
+		unsigned count, unsigned cells, std::vector<uint32_t>& result)
+{
+	Vec3f min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (unsigned i = 0; i < count; ++i) {
+		const float* v = positions + indices[i] * stride;
+		for (int j = 0; j < 3; ++j) {
+			min[j] = std::min(min[j], v[j]);
+			max[j] = std::max(max[j], v[j]);
+		}
+	}
+
+	const Vec3f extent = max - min;
+	const float size = std::max(extent.x, std::max(extent.y, extent.z)) / cells;
+	if (!(size > 0.0f))
+		return;
+
+	std::map<unsigned, uint32_t> clusters;
+	std::vector<uint32_t> mapped(count);
+	for (unsigned i = 0; i < count; ++i) {
+		const float* v = positions + indices[i] * stride;
+		unsigned key = 0;
+		for (int j = 0; j < 3; ++j)
+			key = key * (cells + 1) + std::min(cells, (unsigned)((v[j] - min[j]) / size));
+		mapped[i] = clusters.insert(std::make_pair(key, indices[i])).first->second;
+	}
+
+	for (unsigned i = 0; i + 2 < count; i += 3) {
+		if (mapped[i] != mapped[i + 1] && mapped[i + 1] != mapped[i + 2] && mapped[i] != mapped[i + 2]) {
+			result.push_back(mapped[i]);
+			result.push_back(mapped[i + 1]);
+			result.push_back(mapped[i + 2]);
+		}
+	}
+}
+
+void __Mesh::genLODs()
+{
+	// the number of grid cells of the simplified levels
+	static const unsigned CELLS[SubBuffer::LOD_LEVELS - 1] = { 16, 6 };
+
+	const unsigned stride = floatSize();
+	const float* positions = firstVertex();
+	if (!positions || m_indices.empty())
+		return;
+
+	// the radius around the origin of the object
+	float radius = 0.0f;
+	for (unsigned i = 0; i < vertexCount(); ++i)
+		radius = std::max(radius, Vec3f(positions + i * stride).len());
+
+	std::vector<uint32_t> indices;
+	for (SubBuffers::iterator itr = m_buffers.begin(); itr != m_buffers.end(); ++itr) {
+		SubBuffer* buffer = *itr;
+		buffer->radius = radius;
+
+		uint32_t count = buffer->indexCount;
+		for (unsigned level = 0; level < SubBuffer::LOD_LEVELS - 1; ++level) {
+			indices.clear();
+			simplify(positions, stride, &m_indices[buffer->indexOffset], buffer->indexCount, CELLS[level], indices);
+
+			// keep the finer level, if the simplification does not
+			// save anything or removes the whole sub-mesh
+			if (indices.empty() || indices.size() >= count)
+				continue;
+			buffer->lodOffset[level] = m_indices.size();
+			buffer->lodCount[level] = count = indices.size();
+			m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+		}
+	}
+}
+
 // functor to sort meshes by their material
 struct MeshSorter {
 	bool operator()(Lib3dsMesh* first, Lib3dsMesh* second) {
@@ -107,7 +196,7 @@ Mesh __Mesh::load3ds(const std::string& fileName, void* userData, ogl::SubBuffer
 		if (originalMeshes) {
 			ogl::SubBuffer* buffer = new ogl::SubBuffer();
 			buffer->userData = userData;
-			buffer->material = faceMaterial;
+			buffer->material = ogl::SubBuffer::materialID(faceMaterial);
 
 			buffer->dataCount = finishedFaces*3 - model_vOffset;
 			buffer->dataOffset = model_vOffset;
@@ -125,7 +214,7 @@ Mesh __Mesh::load3ds(const std::string& fileName, void* userData, ogl::SubBuffer
 		if (next == meshes.end() || ((*next)->faces ? (*next)->faceL[0].material : "") != faceMaterial) {
 			ogl::SubBuffer* buffer = new ogl::SubBuffer();
 			buffer->userData = userData;
-			buffer->material = faceMaterial;
+			buffer->material = ogl::SubBuffer::materialID(faceMaterial);
 
 			buffer->dataCount = finishedFaces*3 - buffer_vOffset;
 			buffer->dataOffset = buffer_vOffset;
@@ -157,6 +246,7 @@ Mesh __Mesh::load3ds(const std::string& fileName, void* userData, ogl::SubBuffer
 	delete uvs;
 	delete vertices;
 
+	result->genLODs();
 	return result;
 }
 
@@ -0,0 +1,140 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 4, 2011
+ * @file opengl/renderstate.cpp
+ */
+
+#include <opengl/renderstate.hpp>
+
+namespace ogl {
+
+RenderState* RenderState::s_instance = NULL;
+
+RenderState::RenderState()
+{
+	invalidate();
+}
+
+RenderState::RenderState(const RenderState& other)
+{
+}
+
+RenderState::~RenderState()
+{
+}
+
+void RenderState::destroy()
+{
+	if (s_instance)
+		delete s_instance;
+	s_instance = NULL;
+}
+
+void RenderState::invalidate()
+{
+	m_program = UNKNOWN;
+	m_activeUnit = UNKNOWN;
+	memset(m_textures, 0xff, sizeof(m_textures));
+	for (unsigned i = 0; i < 4; ++i)
+		m_materialValid[i] = false;
+	m_shininessValid = false;
+	m_uniforms.clear();
+}
+
+void RenderState::material(GLenum pname, const GLfloat* params)
+{
+	int index;
+	switch (pname) {
+	case GL_AMBIENT: index = 0; break;
+	case GL_DIFFUSE: index = 1; break;
+	case GL_SPECULAR: index = 2; break;
+	case GL_EMISSION: index = 3; break;
+	default:
+		glMaterialfv(GL_FRONT, pname, params);
+		return;
+	}
+
+	if (m_materialValid[index] && memcmp(m_material[index], params, 4 * sizeof(GLfloat)) == 0)
+		return;
+
+	glMaterialfv(GL_FRONT, pname, params);
+	memcpy(m_material[index], params, 4 * sizeof(GLfloat));
+	m_materialValid[index] = true;
+}
+
+void RenderState::shininess(GLfloat shininess)
+{
+	if (m_shininessValid && m_shininess == shininess)
+		return;
+
+	glMaterialf(GL_FRONT, GL_SHININESS, shininess);
+	m_shininess = shininess;
+	m_shininessValid = true;
+}
+
+bool RenderState::setUniform(GLint location, const GLfloat* data, unsigned size)
+{
+	if (location < 0)
+		return false;
+
+	// the value of an unknown program cannot be shadowed
+	if (m_program == UNKNOWN)
+		return true;
+
+	Uniform value;
+	memset(value.data, 0, sizeof(value.data));
+	memcpy(value.data, data, size);
+
+	std::pair<std::map<std::pair<GLuint, GLint>, Uniform>::iterator, bool> result =
+			m_uniforms.insert(std::make_pair(std::make_pair(m_program, location), value));
+	if (result.second)
+		return true;
+	if (memcmp(result.first->second.data, value.data, sizeof(value.data)) == 0)
+		return false;
+	result.first->second = value;
+	return true;
+}
+
+void RenderState::uniform1i(GLint location, GLint value)
+{
+	if (setUniform(location, (const GLfloat*)&value, sizeof(GLint)))
+		glUniform1i(location, value);
+}
+
+void RenderState::uniform1f(GLint location, GLfloat value)
+{
+	if (setUniform(location, &value, sizeof(GLfloat)))
+		glUniform1f(location, value);
+}
+
+void RenderState::uniform4fv(GLint location, const GLfloat* value)
+{
+	if (setUniform(location, value, 4 * sizeof(GLfloat)))
+		glUniform4fv(location, 1, value);
+}
+
+void RenderState::textureDeleted(GLuint texture)
+{
+	// OpenGL binds 0 to all units the texture was bound to
+	for (unsigned i = 0; i < TEXTURE_UNITS; ++i)
+		if (m_textures[i] == texture)
+			m_textures[i] = 0;
+}
+
+void RenderState::programDeleted(GLuint program)
+{
+	// the program stays in use until another one is bound, but its
+	// name might be reused for a new program
+	if (m_program == program)
+		m_program = UNKNOWN;
+
+	std::map<std::pair<GLuint, GLint>, Uniform>::iterator itr = m_uniforms.begin();
+	while (itr != m_uniforms.end()) {
+		if (itr->first.first == program)
+			m_uniforms.erase(itr++);
+		else
+			++itr;
+	}
+}
+
+}
@@ -5,6 +5,7 @@
  */
 
 #include <opengl/shader.hpp>
+#include <opengl/transformbuffer.hpp>
 #include <iostream>
 #include <stdlib.h>
 #include <stdio.h>
@@ -15,11 +16,20 @@
 #include <string>
 #define BOOST_FILESYSTEM_VERSION 2
 #include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
 #include <stdexcept>
+#include <stdint.h>
+#include <vector>
+#include <util/config.hpp>
+#include <util/clock.hpp>
 
 
 namespace ogl {
 
+/** Identifies the files of the program binary cache */
+static const char SHADER_CACHE_MAGIC[4] = { 'D', 'S', 'H', 'B' };
+static const uint32_t SHADER_CACHE_VERSION = 1;
+
 ShaderMgr* ShaderMgr::s_instance = NULL;
 
 __Shader::__Shader(GLchar* vertexSource, GLchar* fragmentSource) :
@@ -35,7 +45,10 @@ __Shader::~__Shader() {
 #endif
 	if (m_vertexSource) delete m_vertexSource;
 	if (m_fragmentSource) delete m_fragmentSource;
-	if (m_programObject) glDeleteProgram(m_programObject);
+	if (m_programObject) {
+		glDeleteProgram(m_programObject);
+		RenderState::instance().programDeleted(m_programObject);
+	}
 }
 
 void __Shader::getInfoLog(GLuint object)
@@ -51,6 +64,13 @@ void __Shader::getInfoLog(GLuint object)
 }
 
 bool __Shader::compile()
+{
+	// link anyway to print the log of the program
+	const bool compiled = compileObjects();
+	return link() && compiled;
+}
+
+bool __Shader::compileObjects()
 {
 	// load vertex source
 	m_vertexObject = glCreateShader(GL_VERTEX_SHADER);
@@ -58,7 +78,7 @@ bool __Shader::compile()
 	glShaderSource(m_vertexObject, 1, (const GLchar**)&m_vertexSource, &len);
 	glCompileShader(m_vertexObject);
 
-	GLint result[3];
+	GLint result[2];
 
 	// check if compiled
 	glGetObjectParameterivARB(m_vertexObject, GL_COMPILE_STATUS, &result[0]);
@@ -74,17 +94,31 @@ bool __Shader::compile()
 	glGetObjectParameterivARB(m_fragmentObject, GL_COMPILE_STATUS, &result[1]);
 	getInfoLog(m_fragmentObject);
 
+	return result[0] && result[1];
+}
+
+bool __Shader::link()
+{
 	// create and link program
 	m_programObject = glCreateProgram();
 
 	glAttachShader(m_programObject, m_vertexObject);
 	glAttachShader(m_programObject, m_fragmentObject);
 
+	// the slot of the object in the transform buffer, unused by most shaders
+	glBindAttribLocation(m_programObject, TransformBuffer::ATTRIBUTE, TransformBuffer::ATTRIBUTE_NAME);
+
+	// allow to store the program in the binary cache
+	if (GLEW_ARB_get_program_binary)
+		glProgramParameteri(m_programObject, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	glLinkProgram(m_programObject);
+	m_uniformLocations.clear();
 
-	glGetProgramiv(m_programObject, GL_LINK_STATUS, &result[2]);
+	GLint result;
+	glGetProgramiv(m_programObject, GL_LINK_STATUS, &result);
 	getInfoLog(m_programObject);
-	if (!result[0] || !result[1] || !result[2]) return false;
+	if (!result) return false;
 
 	glDeleteShader(m_vertexObject);
 	glDeleteShader(m_fragmentObject);
@@ -93,6 +127,102 @@ bool __Shader::compile()
 }
 
 
+std::size_t __Shader::getCacheKey() const
+{
+	std::size_t seed = 0;
+	const GLubyte* vendor = glGetString(GL_VENDOR);
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	const GLubyte* version = glGetString(GL_VERSION);
+	boost::hash_combine(seed, std::string(vendor ? (const char*)vendor : ""));
+	boost::hash_combine(seed, std::string(renderer ? (const char*)renderer : ""));
+	boost::hash_combine(seed, std::string(version ? (const char*)version : ""));
+	boost::hash_combine(seed, std::string(m_vertexSource ? m_vertexSource : ""));
+	boost::hash_combine(seed, std::string(m_fragmentSource ? m_fragmentSource : ""));
+	return seed;
+}
+
+bool __Shader::loadBinary(const std::string& fileName)
+{
+	if (!GLEW_ARB_get_program_binary)
+		return false;
+
+	std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+
+	char magic[4];
+	uint32_t version, format, length;
+	uint64_t key;
+	file.read(magic, 4);
+	file.read((char*)&version, sizeof(version));
+	file.read((char*)&key, sizeof(key));
+	file.read((char*)&format, sizeof(format));
+	file.read((char*)&length, sizeof(length));
+	if (!file || memcmp(magic, SHADER_CACHE_MAGIC, 4) != 0 ||
+			version != SHADER_CACHE_VERSION || key != (uint64_t)getCacheKey() || !length)
+		return false;
+
+	std::vector<char> binary(length);
+	if (!file.read(&binary[0], length))
+		return false;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, &binary[0], length);
+
+	// the driver rejects binaries that it cannot use anymore
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		glDeleteProgram(program);
+		return false;
+	}
+
+	m_programObject = program;
+	m_uniformLocations.clear();
+	return true;
+}
+
+bool __Shader::saveBinary(const std::string& fileName)
+{
+	if (!GLEW_ARB_get_program_binary || !m_programObject)
+		return false;
+
+	GLint length = 0;
+	glGetProgramiv(m_programObject, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(m_programObject, length, NULL, &format, &binary[0]);
+
+	using namespace boost::filesystem;
+	try {
+		path folder = path(fileName).branch_path();
+		if (!folder.empty() && !exists(folder))
+			create_directories(folder);
+	} catch (...) {
+		return false;
+	}
+
+	std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	const uint32_t version = SHADER_CACHE_VERSION;
+	const uint64_t key = getCacheKey();
+	const uint32_t format32 = format;
+	const uint32_t length32 = length;
+	file.write(SHADER_CACHE_MAGIC, 4);
+	file.write((const char*)&version, sizeof(version));
+	file.write((const char*)&key, sizeof(key));
+	file.write((const char*)&format32, sizeof(format32));
+	file.write((const char*)&length32, sizeof(length32));
+	file.write(&binary[0], length);
+	return file.good();
+}
+
+
 static unsigned long getFileLength(std::ifstream& file)
 {
     if (!file.good()) return 0;
@@ -122,16 +252,10 @@ static GLchar* getFileContent(std::string& fileName)
 	if (source == 0)
 		return NULL;
 
-	source[len] = 0;
-
-	unsigned int i = 0;
-	while (file.good()) {
-		source[i] = file.get();
-		if (!file.eof())
-			i++;
-	}
-
-	source[i] = 0;
+	// read the whole file at once, in text mode there might be less
+	// characters than bytes
+	file.read(source, len);
+	source[file.gcount()] = 0;
 
 	file.close();
 
@@ -152,8 +276,10 @@ Shader __Shader::load(std::string vertexFile, std::string fragmentFile)
 
 
 ShaderMgr::ShaderMgr()
-	: std::map<std::string, Shader>()
+	: std::map<std::string, Shader>(),
+	  m_generation(0)
 {
+	m_cacheFolder = util::Config::instance().get<std::string>("shaderCache", "data/cache/");
 }
 
 ShaderMgr::ShaderMgr(const ShaderMgr& other)
@@ -173,6 +299,7 @@ void ShaderMgr::destroy()
 
 Shader ShaderMgr::add(const std::string& name, Shader shader)
 {
+	m_generation++;
 	(*this)[name] = shader;
 	return shader;
 }
@@ -183,7 +310,11 @@ unsigned ShaderMgr::load(const std::string& folder)
 	using namespace boost::filesystem;
 
 	path p (folder);
-	
+
+	// the shaders of different folders have the same names
+	std::string prefix = p.leaf().empty() || p.leaf() == "." ? p.branch_path().leaf() : p.leaf();
+
+	util::Clock total;
 	if(is_directory(p)) {
 		if(!is_empty(p)) {
 			directory_iterator end_itr;
@@ -192,14 +323,38 @@ unsigned ShaderMgr::load(const std::string& folder)
 					std::string vs = itr->string();
 					std::string fs = vs;
 					fs.replace(vs.size() - 2, 1, "f");
+
+					util::Clock clock;
 					Shader shader = __Shader::load(vs, fs);
-					shader->compile();
-					add(basename(*itr), shader);
+					if (!shader)
+						continue;
+
+					std::string name = basename(*itr);
+					std::string cacheFile = m_cacheFolder.empty() ? "" : m_cacheFolder + prefix + "_" + name + ".bin";
+					if (!cacheFile.empty() && shader->loadBinary(cacheFile)) {
+						std::cout << "Shader " << name << " loaded from cache in "
+								  << clock.get() * 1000.0f << " ms" << std::endl;
+					} else {
+						const bool compiled = shader->compileObjects();
+						const float compileTime = clock.get() * 1000.0f;
+						clock.reset();
+						const bool linked = shader->link();
+						std::cout << "Shader " << name << " compiled in " << compileTime
+								  << " ms, linked in " << clock.get() * 1000.0f << " ms" << std::endl;
+
+						// a broken program must not be cached
+						if (compiled && linked && !cacheFile.empty())
+							shader->saveBinary(cacheFile);
+					}
+
+					add(name, shader);
+					count++;
 				}
 			}
 		}
 
 	}
+	std::cout << count << " shaders loaded in " << total.get() * 1000.0f << " ms" << std::endl;
 	return count;
 }
 
@@ -9,6 +9,7 @@
 #include <lib3ds/file.h>
 #include <lib3ds/mesh.h>
 #include <string.h>
+#include <algorithm>
 #include <iostream>
 
 namespace ogl {
@@ -28,16 +29,39 @@ static const float flare_uv[4][4][2] = {
 };
 
 Skydome::Skydome()
-	: m_list(0),
-	  m_radius(1000.0f * 0.01f)
+	: m_flares(0),
+	  m_clouds(0),
+	  m_radius(1000.0f * 0.01f),
+	  m_time(0.0f),
+	  m_delta(0.0f),
+	  m_fadeTime(0.0f),
+	  m_dome(0),
+	  m_domeVertices(0),
+	  m_flareBuffer(0),
+	  m_sunVisibility(0.0f),
+	  m_fading(false)
 {
 	m_horizon = Vec4f(0.9f, 0.7f, 0.7f, 1.0f);
+	memset(m_queries, 0, sizeof(m_queries));
+	m_queryPending[0] = m_queryPending[1] = false;
 }
 
 Skydome::Skydome(float radius, const std::string& clouds, const std::string& shader, const std::string& fileName, const std::string& flares)
-	: m_list(0),
-	  m_radius(1000.0f * 0.01f)
+	: m_flares(0),
+	  m_clouds(0),
+	  m_radius(1000.0f * 0.01f),
+	  m_time(0.0f),
+	  m_delta(0.0f),
+	  m_fadeTime(0.0f),
+	  m_dome(0),
+	  m_domeVertices(0),
+	  m_flareBuffer(0),
+	  m_sunVisibility(0.0f),
+	  m_fading(false)
 {
+	m_horizon = Vec4f(0.9f, 0.7f, 0.7f, 1.0f);
+	memset(m_queries, 0, sizeof(m_queries));
+	m_queryPending[0] = m_queryPending[1] = false;
 	load(radius, clouds, shader, fileName, flares);
 }
 
@@ -53,6 +77,10 @@ void Skydome::load(float radius, const std::string& clouds, const std::string& s
 	m_radius = radius * 0.01f;
 	m_flares = TextureMgr::instance().get(flares)->m_textureID;
 
+	glGenBuffers(1, &m_flareBuffer);
+	if (GLEW_ARB_occlusion_query)
+		glGenQueries(4, m_queries[0]);
+
 	Lib3dsFile* model = lib3ds_file_load(fileName.c_str());
 	if(!model)
 		return;
@@ -64,36 +92,47 @@ void Skydome::load(float radius, const std::string& clouds, const std::string& s
 			faceCount += mesh->faces;
 	}
 
+	std::vector<float> vertices;
+	vertices.reserve(faceCount * 9);
+
 	Lib3dsMesh* mesh;
-	unsigned finishedFaces = 0;
-	m_list = glGenLists(1);
-	glNewList(m_list, GL_COMPILE);
-	glBegin(GL_TRIANGLES);
 	for (mesh = model->meshes; mesh != NULL; mesh = mesh->next) {
 
 		for (unsigned curFace = 0; curFace < mesh->faces; curFace++) {
 
 			Lib3dsFace* face = &mesh->faceL[curFace];
-			for (unsigned i = 0; i < 3; i++)
-				glVertex3f(
-						(mesh->pointL[face->points[i]].pos[0] - 0.0f) * m_radius,
-						(mesh->pointL[face->points[i]].pos[1] - 16.0f) * m_radius,
-						(mesh->pointL[face->points[i]].pos[2] - 0.0f) * m_radius
-				);
-
-			finishedFaces++;
+			for (unsigned i = 0; i < 3; i++) {
+				vertices.push_back((mesh->pointL[face->points[i]].pos[0] - 0.0f) * m_radius);
+				vertices.push_back((mesh->pointL[face->points[i]].pos[1] - 16.0f) * m_radius);
+				vertices.push_back((mesh->pointL[face->points[i]].pos[2] - 0.0f) * m_radius);
+			}
 		}
 	}
-	glEnd();
-	glEndList();
 	lib3ds_file_free(model);
+
+	m_domeVertices = vertices.size() / 3;
+	glGenBuffers(1, &m_dome);
+	glBindBuffer(GL_ARRAY_BUFFER, m_dome);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void Skydome::clear()
 {
-	if (m_list)
-		glDeleteLists(m_list, 1);
-	m_list = 0;
+	if (m_dome)
+		glDeleteBuffers(1, &m_dome);
+	m_dome = 0;
+	m_domeVertices = 0;
+	if (m_flareBuffer)
+		glDeleteBuffers(1, &m_flareBuffer);
+	m_flareBuffer = 0;
+	if (m_queries[0][0])
+		glDeleteQueries(4, m_queries[0]);
+	memset(m_queries, 0, sizeof(m_queries));
+	m_queryPending[0] = m_queryPending[1] = false;
+	m_sunVisibility = 0.0f;
+	m_fadeTime = 0.0f;
+	m_fading = false;
 	m_shader = Shader();
 	m_clouds = 0;
 	m_time = 0.0f;
@@ -109,28 +148,93 @@ void Skydome::update(float dt)
 	//std::cout << m_horizon << std::endl;
 }
 
-static inline void drawFlare(Skydome::Flares flare, const Vec4f& color, const Mat4f& mat, const Vec3f& position, float scale)
+void Skydome::addFlare(GLenum blend, bool depthTest, int flare, const Vec4f& color,
+		const Mat4f& mat, const Vec3f& position, float scale)
 {
+	if (m_flareBatches.empty() || m_flareBatches.back().blend != blend ||
+			m_flareBatches.back().depthTest != depthTest) {
+		FlareBatch batch = { blend, depthTest, (GLint)(m_flareData.size() / 9), 0 };
+		m_flareBatches.push_back(batch);
+	}
+	m_flareBatches.back().count += 4;
+
 	scale *= 5.0f;
 	Vec3f pos = position * mat;
-	float v[4][3] = {
+	const float v[4][3] = {
 			{ pos[0] - scale, pos[1] - scale, pos[2] },
 			{ pos[0] - scale, pos[1] + scale, pos[2] },
 			{ pos[0] + scale, pos[1] + scale, pos[2] },
 			{ pos[0] + scale, pos[1] - scale, pos[2] }
 	};
-	glColor4fv(&color[0]);
-	glTexCoord2fv(flare_uv[flare][0]); glVertex3fv(v[0]);
-	glTexCoord2fv(flare_uv[flare][1]); glVertex3fv(v[1]);
-	glTexCoord2fv(flare_uv[flare][2]); glVertex3fv(v[2]);
-	glTexCoord2fv(flare_uv[flare][3]); glVertex3fv(v[3]);
+	for (unsigned i = 0; i < 4; ++i) {
+		m_flareData.insert(m_flareData.end(), flare_uv[flare][i], flare_uv[flare][i] + 2);
+		m_flareData.insert(m_flareData.end(), &color[0], &color[0] + 4);
+		m_flareData.insert(m_flareData.end(), v[i], v[i] + 3);
+	}
 }
 
-void Skydome::render(const Camera& cam, const Vec3f& light, bool concealed)
+void Skydome::querySun(const Mat4f& modelview, const Vec3f& light)
+{
+	if (!m_queries[0][0]) {
+		// no occlusion queries, the sun is always visible
+		m_sunVisibility = 1.0f;
+		return;
+	}
+
+	// collect the results of previous frames, but never wait for them
+	for (unsigned i = 0; i < 2; ++i) {
+		if (!m_queryPending[i])
+			continue;
+		GLint available = 0;
+		glGetQueryObjectiv(m_queries[i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+		GLuint total = 0, visible = 0;
+		glGetQueryObjectuiv(m_queries[i][0], GL_QUERY_RESULT, &total);
+		glGetQueryObjectuiv(m_queries[i][1], GL_QUERY_RESULT, &visible);
+		m_sunVisibility = total ? std::min(1.0f, (float)visible / (float)total) : 0.0f;
+		m_queryPending[i] = false;
+	}
+
+	unsigned set = m_queryPending[0] ? 1 : 0;
+	if (m_queryPending[set])
+		return;
+
+	// the sun disc, in eye space
+	const float scale = 20.0f;
+	Vec3f pos = light * modelview;
+	const float disc[4][3] = {
+			{ pos[0] - scale, pos[1] - scale, pos[2] },
+			{ pos[0] - scale, pos[1] + scale, pos[2] },
+			{ pos[0] + scale, pos[1] + scale, pos[2] },
+			{ pos[0] + scale, pos[1] - scale, pos[2] }
+	};
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, disc);
+
+	glDisable(GL_DEPTH_TEST);
+	glBeginQuery(GL_SAMPLES_PASSED, m_queries[set][0]);
+	glDrawArrays(GL_QUADS, 0, 4);
+	glEndQuery(GL_SAMPLES_PASSED);
+
+	glEnable(GL_DEPTH_TEST);
+	glBeginQuery(GL_SAMPLES_PASSED, m_queries[set][1]);
+	glDrawArrays(GL_QUADS, 0, 4);
+	glEndQuery(GL_SAMPLES_PASSED);
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	m_queryPending[set] = true;
+}
+
+void Skydome::render(const Camera& cam, const Vec3f& light)
 {
 	// skydome
 	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, m_clouds);
+	RenderState::instance().bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_clouds);
 
 	m_shader->bind();
 	m_shader->setUniform1f("time", m_time);
@@ -141,7 +245,12 @@ void Skydome::render(const Camera& cam, const Vec3f& light, bool concealed)
 	m_shader->setUniform1i("s_texture_1", 0);
 
 	glDepthMask(GL_FALSE);
-	glCallList(m_list);
+	glBindBuffer(GL_ARRAY_BUFFER, m_dome);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, NULL);
+	glDrawArrays(GL_TRIANGLES, 0, m_domeVertices);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glDepthMask(GL_TRUE);
 	__Shader::unbind();
 
@@ -152,8 +261,14 @@ void Skydome::render(const Camera& cam, const Vec3f& light, bool concealed)
 
 	visible = cam.testSphere(light, 50.0f);
 
+	Mat4f modelviewf(cam.m_modelview);
+
+	glPushMatrix();
+	glLoadIdentity();
+
 	if (visible) {
-		inside = !concealed;
+		querySun(modelviewf, light);
+		inside = m_sunVisibility > 0.5f;
 	}
 
 	if (inside) {
@@ -165,9 +280,12 @@ void Skydome::render(const Camera& cam, const Vec3f& light, bool concealed)
 			m_fadeTime = 4.5f;
 		m_fadeTime -= m_delta * 0.05f;
 	}
+	m_fading = inside ? m_fadeTime < 20.0f : m_fadeTime > 0.0f;
 
-	if (!visible && m_fadeTime <= 0.0f)
+	if (!visible && m_fadeTime <= 0.0f) {
+		glPopMatrix();
 		return;
+	}
 
 	glCullFace(GL_FRONT);
 
@@ -176,88 +294,98 @@ void Skydome::render(const Camera& cam, const Vec3f& light, bool concealed)
 	gluProject(light.x, light.y, light.z, modelview[0], projection[0],
 			&cam.m_viewport[0], &window.x, &window.y, &window.z);
 
-	Mat4f modelviewf(cam.m_modelview);
-
-	Vec3f dir = modelviewf.getZ();
-	dir.z *= -1.0f;
-	Vec3f lightToCam = cam.m_position - light;
-	Vec3f intersection = (dir * lightToCam.len()) + cam.m_position;
-	Vec3f lToInt = intersection - light;
-	float length = lToInt.len() * 0.3f;
-	lToInt.normalize();
-
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-	glDisable(GL_DEPTH_TEST);
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, m_flares);
-
 	float alpha = 2.0f * m_fadeTime / 10.0f;
 	Vec2f tmp(cam.m_viewport[2] * 0.5f - window[0], cam.m_viewport[3] * 0.5f - (window[1] / alpha));
 	float len = tmp.len();
 	float Alpha = ((cam.m_viewport[3] / len) / 5.0f) * alpha;
 
-	glPushMatrix();
-	glLoadIdentity();
+	m_flareData.clear();
+	m_flareBatches.clear();
 
 	if (m_fadeTime > 0.0f) {
 		Vec4f ctemp(0.6f, 0.6f, 0.8f, 20.0f * Alpha);
-		glBegin(GL_QUADS);
-		drawFlare(BIG_GLOW, ctemp, modelviewf, light, 32.0f);
-		drawFlare(BIG_GLOW, ctemp, modelviewf, light, 32.0f);
-		drawFlare(BIG_GLOW, ctemp, modelviewf, light, 32.0f);
-		drawFlare(BIG_GLOW, ctemp, modelviewf, light, 32.0f);
-
-		drawFlare(STREAK, ctemp, modelviewf, light, 32.0f);
-		glEnd();
-
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glBegin(GL_QUADS);
-		drawFlare(BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 50.0f * Alpha), modelviewf, light, 32.0f);
-		glEnd();
-
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-		glBegin(GL_QUADS);
-		Vec3f vtemp = lToInt * 2.0f * length;
-		drawFlare(STREAK, Vec4f(0.6f, 0.6f, 0.80f, 0.25f * Alpha), modelviewf, light, 32.0f);
-		drawFlare(GLOW, Vec4f(0.80f, 0.80f, 1.00f, 0.5f * Alpha), modelviewf, light, 3.5f);
+		addFlare(GL_ONE, false, BIG_GLOW, ctemp, modelviewf, light, 32.0f);
+		addFlare(GL_ONE, false, BIG_GLOW, ctemp, modelviewf, light, 32.0f);
+		addFlare(GL_ONE, false, BIG_GLOW, ctemp, modelviewf, light, 32.0f);
+		addFlare(GL_ONE, false, BIG_GLOW, ctemp, modelviewf, light, 32.0f);
+
+		addFlare(GL_ONE, false, STREAK, ctemp, modelviewf, light, 32.0f);
+
+		addFlare(GL_ONE_MINUS_SRC_ALPHA, false, BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 50.0f * Alpha), modelviewf, light, 32.0f);
+
+		addFlare(GL_ONE, false, STREAK, Vec4f(0.6f, 0.6f, 0.80f, 0.25f * Alpha), modelviewf, light, 32.0f);
+		addFlare(GL_ONE, false, GLOW, Vec4f(0.80f, 0.80f, 1.00f, 0.5f * Alpha), modelviewf, light, 3.5f);
 		/*
-		drawFlare(GLOW, Vec4f(0.90f, 0.60f, 0.40f, 0.5f * Alpha), modelviewf, vtemp * 0.1000f + light, 0.60f);
-		drawFlare(HALO, Vec4f(0.80f, 0.50f, 0.60f, 0.5f * Alpha), modelviewf, vtemp * 0.1500f + light, 1.70f);
-		drawFlare(HALO, Vec4f(0.90f, 0.20f, 0.10f, 0.5f * Alpha), modelviewf, vtemp * 0.1750f + light, 0.83f);
-		drawFlare(HALO, Vec4f(0.70f, 0.70f, 0.40f, 0.5f * Alpha), modelviewf, vtemp * 0.2850f + light, 1.60f);
-		drawFlare(GLOW, Vec4f(0.90f, 0.90f, 0.20f, 0.5f * Alpha), modelviewf, vtemp * 0.2755f + light, 0.80f);
-		drawFlare(GLOW, Vec4f(0.93f, 0.82f, 0.73f, 0.5f * Alpha), modelviewf, vtemp * 0.4775f + light, 1.00f);
-		drawFlare(HALO, Vec4f(0.70f, 0.60f, 0.50f, 0.5f * Alpha), modelviewf, vtemp * 0.4900f + light, 1.40f);
-		drawFlare(GLOW, Vec4f(0.70f, 0.80f, 0.30f, 0.5f * Alpha), modelviewf, vtemp * 0.6500f + light, 1.80f);
-		drawFlare(GLOW, Vec4f(0.40f, 0.30f, 0.20f, 0.5f * Alpha), modelviewf, vtemp * 0.6300f + light, 1.40f);
-		drawFlare(HALO, Vec4f(0.70f, 0.50f, 0.50f, 0.5f * Alpha), modelviewf, vtemp * 0.8000f + light, 1.40f);
-		drawFlare(GLOW, Vec4f(0.80f, 0.50f, 0.10f, 0.5f * Alpha), modelviewf, vtemp * 0.7825f + light, 0.60f);
-		drawFlare(HALO, Vec4f(0.50f, 0.50f, 0.70f, 0.5f * Alpha), modelviewf, vtemp * 1.0000f + light, 1.70f);
-		drawFlare(GLOW, Vec4f(0.40f, 0.10f, 0.90f, 0.5f * Alpha), modelviewf, vtemp * 0.9750f + light, 2.00f);
+		// the ghost flares along the line from the sun through the view center
+		Vec3f dir = modelviewf.getZ();
+		dir.z *= -1.0f;
+		Vec3f lightToCam = cam.m_position - light;
+		Vec3f intersection = (dir * lightToCam.len()) + cam.m_position;
+		Vec3f lToInt = intersection - light;
+		float length = lToInt.len() * 0.3f;
+		lToInt.normalize();
+		Vec3f vtemp = lToInt * 2.0f * length;
+		addFlare(GL_ONE, false, GLOW, Vec4f(0.90f, 0.60f, 0.40f, 0.5f * Alpha), modelviewf, vtemp * 0.1000f + light, 0.60f);
+		addFlare(GL_ONE, false, HALO, Vec4f(0.80f, 0.50f, 0.60f, 0.5f * Alpha), modelviewf, vtemp * 0.1500f + light, 1.70f);
+		addFlare(GL_ONE, false, HALO, Vec4f(0.90f, 0.20f, 0.10f, 0.5f * Alpha), modelviewf, vtemp * 0.1750f + light, 0.83f);
+		addFlare(GL_ONE, false, HALO, Vec4f(0.70f, 0.70f, 0.40f, 0.5f * Alpha), modelviewf, vtemp * 0.2850f + light, 1.60f);
+		addFlare(GL_ONE, false, GLOW, Vec4f(0.90f, 0.90f, 0.20f, 0.5f * Alpha), modelviewf, vtemp * 0.2755f + light, 0.80f);
+		addFlare(GL_ONE, false, GLOW, Vec4f(0.93f, 0.82f, 0.73f, 0.5f * Alpha), modelviewf, vtemp * 0.4775f + light, 1.00f);
+		addFlare(GL_ONE, false, HALO, Vec4f(0.70f, 0.60f, 0.50f, 0.5f * Alpha), modelviewf, vtemp * 0.4900f + light, 1.40f);
+		addFlare(GL_ONE, false, GLOW, Vec4f(0.70f, 0.80f, 0.30f, 0.5f * Alpha), modelviewf, vtemp * 0.6500f + light, 1.80f);
+		addFlare(GL_ONE, false, GLOW, Vec4f(0.40f, 0.30f, 0.20f, 0.5f * Alpha), modelviewf, vtemp * 0.6300f + light, 1.40f);
+		addFlare(GL_ONE, false, HALO, Vec4f(0.70f, 0.50f, 0.50f, 0.5f * Alpha), modelviewf, vtemp * 0.8000f + light, 1.40f);
+		addFlare(GL_ONE, false, GLOW, Vec4f(0.80f, 0.50f, 0.10f, 0.5f * Alpha), modelviewf, vtemp * 0.7825f + light, 0.60f);
+		addFlare(GL_ONE, false, HALO, Vec4f(0.50f, 0.50f, 0.70f, 0.5f * Alpha), modelviewf, vtemp * 1.0000f + light, 1.70f);
+		addFlare(GL_ONE, false, GLOW, Vec4f(0.40f, 0.10f, 0.90f, 0.5f * Alpha), modelviewf, vtemp * 0.9750f + light, 2.00f);
 		*/
-		glEnd();
 	}
 
-
-	glEnable(GL_DEPTH_TEST);
-	glDepthMask(GL_FALSE);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glBegin(GL_QUADS);
-
 	if (m_fadeTime > 1.0f)
-		drawFlare(BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f / m_fadeTime), modelviewf, light, 32.0f);
+		addFlare(GL_ONE_MINUS_SRC_ALPHA, true, BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f / m_fadeTime), modelviewf, light, 32.0f);
 
 	if (m_fadeTime < 1.0f) {
-		drawFlare(BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f), modelviewf, light, 24.0f);
-		drawFlare(BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f), modelviewf, light, 16.0f);
+		addFlare(GL_ONE_MINUS_SRC_ALPHA, true, BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f), modelviewf, light, 24.0f);
+		addFlare(GL_ONE_MINUS_SRC_ALPHA, true, BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f), modelviewf, light, 16.0f);
 		if (m_fadeTime < 0.5f) {
-			drawFlare(BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 10.0f), modelviewf, light, 16.0f);
-			drawFlare(BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f), modelviewf, light, 12.0f);
-			drawFlare(BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f), modelviewf, light, 8.0f);
+			addFlare(GL_ONE_MINUS_SRC_ALPHA, true, BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 10.0f), modelviewf, light, 16.0f);
+			addFlare(GL_ONE_MINUS_SRC_ALPHA, true, BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f), modelviewf, light, 12.0f);
+			addFlare(GL_ONE_MINUS_SRC_ALPHA, true, BIG_GLOW, Vec4f(1.0f, 1.0f, 0.0f, 1.0f), modelviewf, light, 8.0f);
 		}
 	}
-	glEnd();
+
+	// upload all flares at once, orphaning the storage of the last frame
+	const GLsizei stride = 9 * sizeof(float);
+	glBindBuffer(GL_ARRAY_BUFFER, m_flareBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_flareData.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_flareData.size() * sizeof(float), &m_flareData[0]);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glTexCoordPointer(2, GL_FLOAT, stride, (void*)0);
+	glColorPointer(4, GL_FLOAT, stride, (void*)(2 * sizeof(float)));
+	glVertexPointer(3, GL_FLOAT, stride, (void*)(6 * sizeof(float)));
+
+	glEnable(GL_BLEND);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_TEXTURE_2D);
+	RenderState::instance().bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, m_flares);
+
+	std::vector<FlareBatch>::const_iterator batch = m_flareBatches.begin();
+	for ( ; batch != m_flareBatches.end(); ++batch) {
+		glBlendFunc(GL_SRC_ALPHA, batch->blend);
+		if (batch->depthTest)
+			glEnable(GL_DEPTH_TEST);
+		else
+			glDisable(GL_DEPTH_TEST);
+		glDrawArrays(GL_QUADS, batch->first, batch->count);
+	}
+
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
 	glPopMatrix();
 	glDepthMask(GL_TRUE);
 	glEnable(GL_DEPTH_TEST);
@@ -8,16 +8,31 @@
 #include "stb_image.hpp"
 #define BOOST_FILESYSTEM_VERSION 2
 #include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
 #include <stdexcept>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
 #include <util/config.hpp>
 
 namespace ogl {
 
+/** Identifies the files of the texture cache */
+static const char TEXTURE_CACHE_MAGIC[4] = { 'D', 'T', 'E', 'X' };
+static const uint32_t TEXTURE_CACHE_VERSION = 1;
+
+/** The maximum number of levels of a cached texture, i.e. up to 32768x32768 */
+static const uint32_t MAX_CACHE_LEVELS = 16;
+
+/** The maximum width and height of a level of a cached texture */
+static const uint32_t MAX_CACHE_SIZE = 1 << (MAX_CACHE_LEVELS - 1);
+
 TextureMgr* TextureMgr::s_instance = NULL;
 
 __Texture::__Texture(GLuint textureID, GLuint target)
-	: m_textureID(textureID), m_target(target)
+	: m_textureID(textureID), m_target(target), m_loaded(true)
 {
 }
 
@@ -26,8 +41,10 @@ __Texture::~__Texture()
 #ifdef _DEBUG
 	std::cout << "delete texture" << std::endl;
 #endif
-	if (glIsTexture(m_textureID))
-		glDeleteTextures(0, &m_textureID);
+	if (glIsTexture(m_textureID)) {
+		glDeleteTextures(1, &m_textureID);
+		RenderState::instance().textureDeleted(m_textureID);
+	}
 }
 
 Texture __Texture::load(std::string file, GLuint target)
@@ -40,7 +57,7 @@ Texture __Texture::load(std::string file, GLuint target)
 
     GLuint textureID = 0;
     glGenTextures(1, &textureID);
-    glBindTexture(target, textureID);
+    RenderState::instance().bindTexture(target, textureID);
 
     //glTexImage2D(stage, 0, GL_RGBA, Image.GetWidth(), Image.GetHeight(), 0, GL_RGB, GL_UNSIGNED_BYTE, Image.GetPixelsPtr());
     //gluBuild2DMipmaps(target, GL_RGBA, Image.GetWidth(), Image.GetHeight(), GL_RGBA, GL_UNSIGNED_BYTE, Image.GetPixelsPtr());
@@ -68,15 +85,21 @@ Texture __Texture::create(GLuint target)
 {
     GLuint textureID = 0;
     glGenTextures(1, &textureID);
-    glBindTexture(target, textureID);
+    RenderState::instance().bindTexture(target, textureID);
 
     Texture result(new __Texture(textureID, target));
     return result;
 }
 
 TextureMgr::TextureMgr()
-	: std::map<std::string, Texture>()
+	: std::map<std::string, Texture>(),
+	  m_thread(NULL),
+	  m_running(false),
+	  m_pbo(0),
+	  m_generation(0),
+	  m_streaming(0)
 {
+	m_cacheFolder = util::Config::instance().get<std::string>("textureCache", "data/cache/");
 }
 
 TextureMgr::TextureMgr(const TextureMgr& other)
@@ -85,6 +108,29 @@ TextureMgr::TextureMgr(const TextureMgr& other)
 
 TextureMgr::~TextureMgr()
 {
+	// stop the streaming thread, unfinished jobs are discarded
+	if (m_thread) {
+		m_mutex.lock();
+		m_running = false;
+		m_condition.notify_all();
+		m_mutex.unlock();
+		m_thread->join();
+		delete m_thread;
+	}
+
+	while (!m_pending.empty()) {
+		delete m_pending.front();
+		m_pending.pop();
+	}
+	while (!m_finished.empty()) {
+		delete m_finished.front();
+		m_finished.pop();
+	}
+	for (std::vector<Readback>::iterator itr = m_readbacks.begin(); itr != m_readbacks.end(); ++itr)
+		delete itr->job;
+
+	if (m_pbo && glIsBuffer(m_pbo))
+		glDeleteBuffers(1, &m_pbo);
 }
 
 void TextureMgr::destroy()
@@ -96,6 +142,7 @@ void TextureMgr::destroy()
 
 Texture TextureMgr::add(const std::string& name, Texture texture)
 {
+	m_generation++;
 	(*this)[name] = texture;
 	return texture;
 }
@@ -106,36 +153,461 @@ unsigned TextureMgr::load(const std::string& folder)
 	using namespace boost::filesystem;
 
 	path p (folder);
-	
+	m_generation++;
+
 	if(is_directory(p)) {
 		if(!is_empty(p)) {
 			directory_iterator end_itr;
 			for(directory_iterator itr(p); itr != end_itr; ++itr) {
 				if(itr->leaf().size() > 3) {
-					Texture texture = __Texture::load(itr->string(), GL_TEXTURE_2D);
-					add(basename(*itr), texture);
+					// only register the file, it is streamed in on the first request
+					std::string name = basename(*itr);
+					m_files[name] = itr->string();
+					erase(name);
+					count++;
 				}
 			}
 		}
 
 	}
-	// open folder
-	// iterate over the folder
-	// find *.[a-zA-Z] files
-	// load with Texture Manager
-	// close folder
 	return count;
 }
 
 Texture TextureMgr::get(const std::string& name)
 {
 	TextureMgr::iterator it = this->find(name);
-	if (it == this->end()) {
+	if (it != this->end())
+		return it->second;
+
+	std::map<std::string, std::string>::iterator file = m_files.find(name);
+	if (file == m_files.end()) {
 		Texture result;
 		return result;
 	}
-	return it->second;
 
+	// bind a placeholder until the streaming thread has decoded the image
+	static const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+	Texture result = __Texture::create(GL_TEXTURE_2D);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	result->setFilter(GL_LINEAR, GL_LINEAR);
+	result->setWrap(GL_REPEAT, GL_REPEAT);
+	result->unbind();
+	result->m_loaded = false;
+	(*this)[name] = result;
+
+	TextureJob* job = new TextureJob();
+	job->name = name;
+	job->fileName = file->second;
+	// the cache holds S3TC levels, which are useless without the extension
+	job->cacheFile = m_cacheFolder.empty() || !GLEW_EXT_texture_compression_s3tc ? "" :
+			m_cacheFolder + name + ".tex";
+	job->format = 0;
+	job->store = false;
+	enqueue(job);
+	m_streaming++;
+
+	return result;
+}
+
+unsigned TextureMgr::update(unsigned maxUploads)
+{
+	// the textures uploaded by the previous call have been compressed by now
+	if (!m_readbacks.empty()) {
+		std::vector<Readback> readbacks;
+		readbacks.swap(m_readbacks);
+		readBack(readbacks);
+	}
+
+	unsigned count = 0;
+	while (count < maxUploads) {
+		TextureJob* job = NULL;
+		m_mutex.lock();
+		if (!m_finished.empty()) {
+			job = m_finished.front();
+			m_finished.pop();
+		}
+		m_mutex.unlock();
+
+		if (!job)
+			break;
+		m_streaming--;
+
+		// the texture might have been replaced in the meantime
+		TextureMgr::iterator it = this->find(job->name);
+		if (it != this->end() && it->second && !it->second->m_loaded) {
+			if (job->levels.empty()) {
+				// the materials may already use the texture, so it keeps the
+				// placeholder image instead of being deleted
+				std::cerr << "Could not load texture " << job->fileName << std::endl;
+				m_files.erase(job->name);
+				it->second->m_loaded = true;
+			} else {
+				upload(job, it->second);
+				count++;
+			}
+		}
+		delete job;
+	}
+	return count;
+}
+
+void TextureMgr::enqueue(TextureJob* job)
+{
+	m_mutex.lock();
+	if (!m_thread) {
+		m_running = true;
+		m_thread = new boost::thread(boost::bind(&TextureMgr::run, this));
+	}
+	m_pending.push(job);
+	m_condition.notify_one();
+	m_mutex.unlock();
+}
+
+void TextureMgr::run()
+{
+	for (;;) {
+		TextureJob* job = NULL;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			while (m_running && m_pending.empty())
+				m_condition.wait(lock);
+			if (!m_running)
+				return;
+			job = m_pending.front();
+			m_pending.pop();
+		}
+
+		if (job->store) {
+			store(job);
+			delete job;
+			continue;
+		}
+
+		if (!decode(job))
+			job->levels.clear();
+
+		m_mutex.lock();
+		m_finished.push(job);
+		m_mutex.unlock();
+	}
+}
+
+/**
+ * Returns the modification time of the given file, or 0 if it
+ * does not exist.
+ */
+static int64_t modificationTime(const std::string& fileName)
+{
+	try {
+		return (int64_t)boost::filesystem::last_write_time(boost::filesystem::path(fileName));
+	} catch (...) {
+		return 0;
+	}
+}
+
+/**
+ * Returns the size of a level in the given compressed format, or 0 if the
+ * format is none of the S3TC formats the cache stores.
+ */
+static uint64_t compressedSize(uint32_t format, uint32_t width, uint32_t height)
+{
+	uint64_t blockSize;
+	switch (format) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		blockSize = 8;
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		blockSize = 16;
+		break;
+	default:
+		return 0;
+	}
+	return ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+template<typename T>
+static bool readValue(std::istream& in, T& value)
+{
+	return in.read((char*)&value, sizeof(T));
+}
+
+template<typename T>
+static void writeValue(std::ostream& out, const T& value)
+{
+	out.write((const char*)&value, sizeof(T));
+}
+
+bool TextureMgr::decode(TextureJob* job)
+{
+	const int64_t modified = modificationTime(job->fileName);
+
+	// try the texture cache first, it is only valid for the same source file
+	if (!job->cacheFile.empty()) {
+		std::ifstream in(job->cacheFile.c_str(), std::ios::in | std::ios::binary);
+		char magic[4];
+		uint32_t version, format, levels;
+		int64_t sourceModified;
+		if (in.read(magic, 4) && memcmp(magic, TEXTURE_CACHE_MAGIC, 4) == 0 &&
+				readValue(in, version) && version == TEXTURE_CACHE_VERSION &&
+				readValue(in, format) && readValue(in, levels) &&
+				readValue(in, sourceModified) && sourceModified == modified &&
+				levels > 0 && levels <= MAX_CACHE_LEVELS) {
+			job->format = format;
+			job->levels.resize(levels);
+			for (unsigned i = 0; in && i < levels; ++i) {
+				uint32_t width, height, size;
+				// a corrupt file must neither allocate huge levels nor pass
+				// levels to the driver that do not match the format, both
+				// are treated as a cache miss and the image is encoded again
+				if (readValue(in, width) && readValue(in, height) && readValue(in, size) &&
+						width > 0 && width <= MAX_CACHE_SIZE && height > 0 && height <= MAX_CACHE_SIZE &&
+						size > 0 && size == compressedSize(format, width, height)) {
+					TextureJob::Level& level = job->levels[i];
+					level.width = width;
+					level.height = height;
+					level.data.resize(size);
+					in.read((char*)&level.data[0], size);
+				} else {
+					in.setstate(std::ios::failbit);
+				}
+			}
+			if (in)
+				return true;
+			job->levels.clear();
+			job->format = 0;
+		}
+	}
+
+	int w, h, c;
+	unsigned char* data = stbi_load(job->fileName.c_str(), &w, &h, &c, STBI_rgb_alpha);
+	if (!data)
+		return false;
+
+	job->levels.resize(1);
+	job->levels[0].width = w;
+	job->levels[0].height = h;
+	job->levels[0].data.assign(data, data + w * h * 4);
+	stbi_image_free(data);
+
+	// generate the mip-maps with a box filter
+	while (w > 1 || h > 1) {
+		const int nw = std::max(1, w / 2);
+		const int nh = std::max(1, h / 2);
+
+		job->levels.resize(job->levels.size() + 1);
+		const std::vector<unsigned char>& src = job->levels[job->levels.size() - 2].data;
+		TextureJob::Level& level = job->levels.back();
+		level.width = nw;
+		level.height = nh;
+		level.data.resize(nw * nh * 4);
+
+		for (int y = 0; y < nh; ++y) {
+			const int y0 = std::min(2 * y, h - 1) * w;
+			const int y1 = std::min(2 * y + 1, h - 1) * w;
+			for (int x = 0; x < nw; ++x) {
+				const int x0 = std::min(2 * x, w - 1);
+				const int x1 = std::min(2 * x + 1, w - 1);
+				for (int i = 0; i < 4; ++i) {
+					unsigned sum = src[(y0 + x0) * 4 + i] + src[(y0 + x1) * 4 + i] +
+							src[(y1 + x0) * 4 + i] + src[(y1 + x1) * 4 + i];
+					level.data[(y * nw + x) * 4 + i] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+
+		w = nw;
+		h = nh;
+	}
+
+	return true;
+}
+
+void TextureMgr::store(TextureJob* job)
+{
+	using namespace boost::filesystem;
+
+	try {
+		path folder = path(job->cacheFile).branch_path();
+		if (!folder.empty() && !exists(folder))
+			create_directories(folder);
+	} catch (...) {
+		std::cerr << "Could not create the texture cache for " << job->cacheFile << std::endl;
+		return;
+	}
+
+	std::ofstream out(job->cacheFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out)
+		return;
+
+	out.write(TEXTURE_CACHE_MAGIC, 4);
+	writeValue(out, TEXTURE_CACHE_VERSION);
+	writeValue(out, (uint32_t)job->format);
+	writeValue(out, (uint32_t)job->levels.size());
+	writeValue(out, modificationTime(job->fileName));
+	for (unsigned i = 0; i < job->levels.size(); ++i) {
+		const TextureJob::Level& level = job->levels[i];
+		writeValue(out, (uint32_t)level.width);
+		writeValue(out, (uint32_t)level.height);
+		writeValue(out, (uint32_t)level.data.size());
+		if (!level.data.empty())
+			out.write((const char*)&level.data[0], level.data.size());
+	}
+}
+
+void TextureMgr::upload(TextureJob* job, Texture texture)
+{
+	const GLenum target = texture->m_target;
+	const bool compress = !job->format && !job->cacheFile.empty() && GLEW_EXT_texture_compression_s3tc;
+
+	// copy all levels into the pixel buffer object, so that the driver can
+	// transfer them asynchronously
+	bool usePBO = false;
+	if (GLEW_ARB_pixel_buffer_object) {
+		size_t size = 0;
+		for (unsigned i = 0; i < job->levels.size(); ++i)
+			size += job->levels[i].data.size();
+
+		if (!m_pbo)
+			glGenBuffers(1, &m_pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, m_pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER_ARB, size, NULL, GL_STREAM_DRAW);
+		unsigned char* dst = (unsigned char*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY);
+		if (dst) {
+			for (unsigned i = 0; i < job->levels.size(); ++i) {
+				std::copy(job->levels[i].data.begin(), job->levels[i].data.end(), dst);
+				dst += job->levels[i].data.size();
+			}
+			usePBO = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB) == GL_TRUE;
+		}
+		if (!usePBO)
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	}
+
+	texture->bind();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	size_t offset = 0;
+	for (unsigned i = 0; i < job->levels.size(); ++i) {
+		const TextureJob::Level& level = job->levels[i];
+		const GLvoid* pixels = usePBO ? (const GLvoid*)offset :
+				level.data.empty() ? NULL : (const GLvoid*)&level.data[0];
+		if (job->format)
+			glCompressedTexImage2D(target, i, job->format, level.width, level.height, 0, level.data.size(), pixels);
+		else
+			glTexImage2D(target, i, compress ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA,
+					level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		offset += level.data.size();
+	}
+
+	if (usePBO)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, job->levels.size() - 1);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	// enable anisotropic filtering
+	if (util::Config::instance().get("useAF", false) && GLEW_EXT_texture_filter_anisotropic) {
+		float maxAF;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAF);
+		glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAF);
+	}
+
+	texture->m_loaded = true;
+
+	// the levels compressed by the driver are read back by a later call to
+	// update(), so that the upload does not wait for the compression
+	if (compress) {
+		Readback readback;
+		readback.texture = texture;
+		readback.pbo = 0;
+		readback.job = new TextureJob();
+		readback.job->name = job->name;
+		readback.job->fileName = job->fileName;
+		readback.job->cacheFile = job->cacheFile;
+		readback.job->format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		readback.job->store = true;
+		readback.job->levels.resize(job->levels.size());
+		for (unsigned i = 0; i < job->levels.size(); ++i) {
+			readback.job->levels[i].width = job->levels[i].width;
+			readback.job->levels[i].height = job->levels[i].height;
+		}
+		m_readbacks.push_back(readback);
+	}
+
+	texture->unbind();
+}
+
+void TextureMgr::readBack(std::vector<Readback>& readbacks)
+{
+	// first pass: start the transfers of all textures into pixel buffers
+	for (std::vector<Readback>::iterator itr = readbacks.begin(); itr != readbacks.end(); ++itr) {
+		const GLenum target = itr->texture->m_target;
+		itr->texture->bind();
+		GLint compressed = GL_FALSE;
+		glGetTexLevelParameteriv(target, 0, GL_TEXTURE_COMPRESSED, &compressed);
+		if (!compressed) {
+			itr->job->levels.clear();
+			itr->texture->unbind();
+			continue;
+		}
+
+		size_t size = 0;
+		for (unsigned i = 0; i < itr->job->levels.size(); ++i) {
+			GLint levelSize = 0;
+			glGetTexLevelParameteriv(target, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &levelSize);
+			itr->job->levels[i].data.resize(levelSize);
+			size += levelSize;
+		}
+
+		if (GLEW_ARB_pixel_buffer_object && size) {
+			glGenBuffers(1, &itr->pbo);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, itr->pbo);
+			glBufferData(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ);
+			size_t offset = 0;
+			for (unsigned i = 0; i < itr->job->levels.size(); ++i) {
+				glGetCompressedTexImage(target, i, (GLvoid*)offset);
+				offset += itr->job->levels[i].data.size();
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+		} else {
+			for (unsigned i = 0; i < itr->job->levels.size(); ++i) {
+				if (!itr->job->levels[i].data.empty())
+					glGetCompressedTexImage(target, i, &itr->job->levels[i].data[0]);
+			}
+		}
+		itr->texture->unbind();
+	}
+
+	// second pass: copy the pixel buffers, the transfers ran meanwhile
+	for (std::vector<Readback>::iterator itr = readbacks.begin(); itr != readbacks.end(); ++itr) {
+		bool valid = !itr->job->levels.empty();
+		if (itr->pbo) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, itr->pbo);
+			const unsigned char* src = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY);
+			valid = src != NULL;
+			if (src) {
+				for (unsigned i = 0; i < itr->job->levels.size(); ++i) {
+					std::vector<unsigned char>& data = itr->job->levels[i].data;
+					std::copy(src, src + data.size(), data.begin());
+					src += data.size();
+				}
+				valid = glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB) == GL_TRUE;
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+			glDeleteBuffers(1, &itr->pbo);
+		}
+
+		for (unsigned i = 0; i < itr->job->levels.size(); ++i)
+			valid &= !itr->job->levels[i].data.empty();
+		if (valid)
+			enqueue(itr->job);
+		else
+			delete itr->job;
+	}
 }
 
 }
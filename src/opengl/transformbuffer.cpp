@@ -0,0 +1,76 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 15, 2011
+ * @file opengl/transformbuffer.cpp
+ */
+
+#include <opengl/transformbuffer.hpp>
+#include <opengl/renderstate.hpp>
+
+namespace ogl {
+
+const char* const TransformBuffer::ATTRIBUTE_NAME = "transformIndex";
+const char* const TransformBuffer::SAMPLER_NAME = "transforms";
+
+TransformBuffer::TransformBuffer()
+	: m_buffer(0), m_texture(0), m_capacity(0), m_uploaded(0)
+{
+}
+
+TransformBuffer::~TransformBuffer()
+{
+	if (m_texture) {
+		RenderState::instance().textureDeleted(m_texture);
+		glDeleteTextures(1, &m_texture);
+	}
+	if (m_buffer)
+		glDeleteBuffers(1, &m_buffer);
+}
+
+bool TransformBuffer::isSupported()
+{
+	return GLEW_ARB_texture_buffer_object;
+}
+
+bool TransformBuffer::reserve(unsigned count)
+{
+	if (count <= m_capacity)
+		return false;
+
+	if (!m_buffer) {
+		glGenBuffers(1, &m_buffer);
+		glGenTextures(1, &m_texture);
+	}
+
+	// grow geometrically, the old content is not copied because
+	// the caller uploads all transforms after a re-allocation
+	unsigned capacity = m_capacity ? m_capacity : 1024;
+	while (capacity < count)
+		capacity *= 2;
+
+	glBindBuffer(GL_TEXTURE_BUFFER_ARB, m_buffer);
+	glBufferData(GL_TEXTURE_BUFFER_ARB, capacity * FLOATS * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER_ARB, 0);
+
+	RenderState::instance().bindTexture(UNIT, GL_TEXTURE_BUFFER_ARB, m_texture);
+	glTexBufferARB(GL_TEXTURE_BUFFER_ARB, GL_RGBA32F_ARB, m_buffer);
+
+	m_capacity = capacity;
+	return true;
+}
+
+void TransformBuffer::upload(unsigned first, unsigned count, const float* data)
+{
+	const unsigned size = count * FLOATS * sizeof(GLfloat);
+	glBindBuffer(GL_TEXTURE_BUFFER_ARB, m_buffer);
+	glBufferSubData(GL_TEXTURE_BUFFER_ARB, first * FLOATS * sizeof(GLfloat), size, data);
+	glBindBuffer(GL_TEXTURE_BUFFER_ARB, 0);
+	m_uploaded += size;
+}
+
+void TransformBuffer::bind() const
+{
+	RenderState::instance().bindTexture(UNIT, GL_TEXTURE_BUFFER_ARB, m_texture);
+}
+
+}
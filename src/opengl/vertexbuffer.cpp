@@ -5,9 +5,148 @@
  */
 
 #include <opengl/vertexbuffer.hpp>
+#include <algorithm>
 
 namespace ogl {
 
+/**
+ * Ranges of a buffer that are erased, sorted by their offset and merged.
+ * An offset behind a range moves to the front by the size of all ranges
+ * in front of it.
+ */
+class ErasedRanges {
+protected:
+	/** The offset and the count of each range */
+	std::vector<std::pair<uint32_t, uint32_t> > m_ranges;
+
+	/** The offsets of the ranges and the erased size up to the end of each range */
+	std::vector<uint32_t> m_offsets, m_erased;
+
+public:
+	/** Adds a range, empty ranges are ignored */
+	void add(uint32_t offset, uint32_t count);
+
+	/** Sorts and merges the ranges, has to be called after the last add() */
+	void finish();
+
+	bool empty() const;
+
+	/**
+	 * Erases the ranges from the given data in a single pass.
+	 *
+	 * @param data   The data
+	 * @param stride The number of elements per offset
+	 */
+	template<typename T>
+	void erase(std::vector<T>& data, unsigned stride) const;
+
+	/**
+	 * @param offset An offset that is not inside one of the ranges
+	 * @return       The offset after the ranges have been erased
+	 */
+	uint32_t rebase(uint32_t offset) const;
+};
+
+void ErasedRanges::add(uint32_t offset, uint32_t count)
+{
+	if (count)
+		m_ranges.push_back(std::make_pair(offset, count));
+}
+
+void ErasedRanges::finish()
+{
+	std::sort(m_ranges.begin(), m_ranges.end());
+	std::vector<std::pair<uint32_t, uint32_t> > merged;
+	for (unsigned i = 0; i < m_ranges.size(); ++i) {
+		if (!merged.empty() && m_ranges[i].first <= merged.back().first + merged.back().second) {
+			const uint32_t end = std::max(merged.back().first + merged.back().second,
+					m_ranges[i].first + m_ranges[i].second);
+			merged.back().second = end - merged.back().first;
+		} else {
+			merged.push_back(m_ranges[i]);
+		}
+	}
+	m_ranges.swap(merged);
+
+	m_offsets.resize(m_ranges.size());
+	m_erased.resize(m_ranges.size());
+	uint32_t erased = 0;
+	for (unsigned i = 0; i < m_ranges.size(); ++i) {
+		m_offsets[i] = m_ranges[i].first;
+		m_erased[i] = erased += m_ranges[i].second;
+	}
+}
+
+inline bool ErasedRanges::empty() const
+{
+	return m_ranges.empty();
+}
+
+template<typename T>
+void ErasedRanges::erase(std::vector<T>& data, unsigned stride) const
+{
+	if (m_ranges.empty())
+		return;
+
+	// move the data between the ranges to the front
+	typename std::vector<T>::iterator dst = data.begin() + m_ranges[0].first * stride;
+	for (unsigned i = 0; i < m_ranges.size(); ++i) {
+		const size_t begin = std::min(data.size(), (size_t)(m_ranges[i].first + m_ranges[i].second) * stride);
+		const size_t end = i + 1 < m_ranges.size() ? m_ranges[i + 1].first * stride : data.size();
+		dst = std::copy(data.begin() + begin, data.begin() + end, dst);
+	}
+	data.erase(dst, data.end());
+}
+
+inline uint32_t ErasedRanges::rebase(uint32_t offset) const
+{
+	// the number of ranges in front of the offset
+	const unsigned count = std::lower_bound(m_offsets.begin(), m_offsets.end(), offset) - m_offsets.begin();
+	return count ? offset - m_erased[count - 1] : offset;
+}
+
+/** The material names, indexed by their id */
+static std::vector<std::string>& materialNames()
+{
+	static std::vector<std::string> names(1, "");
+	return names;
+}
+
+/** The material ids, indexed by their name */
+static std::map<std::string, int>& materialIDs()
+{
+	static std::map<std::string, int> ids;
+	if (ids.empty())
+		ids[""] = 0;
+	return ids;
+}
+
+int SubBuffer::materialID(const std::string& name)
+{
+	std::map<std::string, int>& ids = materialIDs();
+	std::map<std::string, int>::iterator itr = ids.find(name);
+	if (itr != ids.end())
+		return itr->second;
+
+	int id = materialNames().size();
+	materialNames().push_back(name);
+	ids[name] = id;
+	return id;
+}
+
+const std::string& SubBuffer::materialName(int id)
+{
+	const std::vector<std::string>& names = materialNames();
+	if (id < 0 || (unsigned)id >= names.size())
+		return names[0];
+	return names[id];
+}
+
+unsigned SubBuffer::materialCount()
+{
+	return materialNames().size();
+}
+
 VertexBuffer::VertexBuffer()
 	: m_format(GL_T2F_N3F_V3F),
 	  m_ibo(0), m_vbo(0),
@@ -134,4 +273,51 @@ void VertexBuffer::flush() {
 	}
 }
 
+void VertexBuffer::erase(const std::set<SubBuffer*>& buffers)
+{
+	if (buffers.empty())
+		return;
+
+	// the simplified levels of detail are stored behind the full geometry
+	// of the mesh, see __Mesh::genLODs(), so they are separate ranges
+	ErasedRanges indices, vertices;
+	for (std::set<SubBuffer*>::const_iterator itr = buffers.begin(); itr != buffers.end(); ++itr) {
+		const SubBuffer* buffer = *itr;
+		indices.add(buffer->indexOffset, buffer->indexCount);
+		for (unsigned i = 0; i < SubBuffer::LOD_LEVELS - 1; ++i)
+			indices.add(buffer->lodOffset[i], buffer->lodCount[i]);
+		vertices.add(buffer->dataOffset, buffer->dataCount);
+	}
+	indices.finish();
+	vertices.finish();
+
+	for (SubBuffers::iterator itr = m_buffers.begin(); itr != m_buffers.end(); ) {
+		if (buffers.find(*itr) != buffers.end()) {
+			delete *itr;
+			itr = m_buffers.erase(itr);
+		} else {
+			++itr;
+		}
+	}
+
+	indices.erase(m_indices, 1);
+	vertices.erase(m_data, floatSize());
+
+	for (SubBuffers::iterator itr = m_buffers.begin(); itr != m_buffers.end(); ++itr) {
+		SubBuffer* buffer = *itr;
+		buffer->indexOffset = indices.rebase(buffer->indexOffset);
+		for (unsigned i = 0; i < SubBuffer::LOD_LEVELS - 1; ++i) {
+			if (buffer->lodCount[i])
+				buffer->lodOffset[i] = indices.rebase(buffer->lodOffset[i]);
+		}
+		buffer->dataOffset = vertices.rebase(buffer->dataOffset);
+	}
+
+	// the remaining indices only refer to remaining vertices
+	if (!vertices.empty()) {
+		for (UInts::iterator itr = m_indices.begin(); itr != m_indices.end(); ++itr)
+			*itr = vertices.rebase(*itr);
+	}
+}
+
 }
@@ -0,0 +1,433 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 12, 2011
+ * @file simulation/benchmark.cpp
+ */
+
+#include <simulation/benchmark.hpp>
+#include <simulation/simulation.hpp>
+#include <simulation/domino.hpp>
+#include <simulation/treecollision.hpp>
+#include <opengl/texture.hpp>
+#include <util/clock.hpp>
+#define BOOST_FILESYSTEM_VERSION 2
+#include <boost/filesystem.hpp>
+#include <GL/glew.h>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#ifdef _WIN32
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+	#include <unistd.h>
+#endif
+
+namespace sim {
+
+Benchmark::Params::Params()
+	: runs(5),
+	  steps(200),
+	  frames(100),
+	  editorObjects(1000),
+	  levels("data/levels/"),
+	  threshold(0.1)
+{
+	for (int i = Generator::GRID; i <= Generator::HILBERT; ++i) {
+		Generator::Params scene;
+		scene.layout = (Generator::Layout)i;
+		scene.count = 10000;
+		scene.materials.push_back("planks");
+		generated.push_back(scene);
+	}
+
+#ifdef _WIN32
+	const char* temp = getenv("TEMP");
+	scratch = temp ? std::string(temp) + "\\" : "";
+#else
+	scratch = "/tmp/";
+#endif
+}
+
+Benchmark::Benchmark(const Params& params)
+	: m_params(params)
+{
+}
+
+long Benchmark::getPeakMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (long)(counters.PeakWorkingSetSize / 1024);
+	return 0;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+		// reported in bytes instead of KiB
+		return usage.ru_maxrss / 1024;
+#else
+		return usage.ru_maxrss;
+#endif
+	}
+	return 0;
+#endif
+}
+
+long Benchmark::getMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (long)(counters.WorkingSetSize / 1024);
+	return 0;
+#elif defined(__linux__)
+	// the second value is the resident set size in pages
+	std::ifstream in("/proc/self/statm");
+	long size = 0, resident = 0;
+	if (in >> size >> resident)
+		return resident * (sysconf(_SC_PAGESIZE) / 1024);
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+void Benchmark::addResult(const std::string& level, const std::string& scenario, std::vector<double>& samples,
+		long memoryGrowth)
+{
+	if (samples.empty())
+		return;
+	std::sort(samples.begin(), samples.end());
+
+	Result result;
+	result.level = level;
+	result.scenario = scenario;
+	result.samples = samples.size();
+	result.min = samples.front();
+	result.median = samples[samples.size() / 2];
+	// nearest rank, i.e. the maximum for less than 100 samples
+	result.p99 = samples[std::min(samples.size() - 1, (size_t)ceil(samples.size() * 0.99) - 1)];
+	result.memoryGrowth = memoryGrowth;
+	m_results.push_back(result);
+
+	std::cout << "  " << scenario << ": median " << result.median << " ms, min " << result.min
+			  << " ms, p99 " << result.p99 << " ms (" << result.samples << " samples)" << std::endl;
+}
+
+/**
+ * Renders a single frame like the render widget does, but waits until it
+ * has been finished by the GPU.
+ */
+static void renderFrame()
+{
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	ogl::TextureMgr::instance().update();
+	Simulation::instance().render();
+	glFinish();
+}
+
+void Benchmark::runMath()
+{
+	// the number of operations per sample
+	static const unsigned COUNT = 1000000;
+	util::Clock clock;
+
+	std::cout << "m3d" << std::endl;
+
+	// the same matrices and points on all systems
+	std::vector<Mat4f> matrices(64);
+	for (unsigned i = 0; i < matrices.size(); ++i)
+		matrices[i] = Mat4f::rotAxis(Vec3f(1.0f, i * 0.37f, i * 0.11f).normalized(), i * 0.1f) *
+				Mat4f::translate(i * 0.5f, 1.0f, -(float)i);
+	std::vector<Vec3f> points(COUNT), transformed(COUNT);
+	for (unsigned i = 0; i < COUNT; ++i)
+		points[i] = Vec3f(i % 97 * 0.1f, i % 89 * 0.1f, i % 83 * 0.1f);
+
+	std::vector<double> multiplies, affineMultiplies, inverses, affineInverses, rigidInverses, transforms;
+	Mat4f result = Mat4f::identity(), affine = Mat4f::identity();
+	float checksum = 0.0f;
+	for (unsigned run = 0; run < m_params.runs; ++run) {
+		clock.reset();
+		for (unsigned i = 0; i < COUNT; ++i)
+			result = result * matrices[i & 63];
+		multiplies.push_back(clock.get() * 1000.0);
+
+		clock.reset();
+		for (unsigned i = 0; i < COUNT; ++i)
+			affine = affine.affineMultiply(matrices[i & 63]);
+		affineMultiplies.push_back(clock.get() * 1000.0);
+
+		clock.reset();
+		for (unsigned i = 0; i < COUNT; ++i)
+			checksum += matrices[i & 63].inverse()._41;
+		inverses.push_back(clock.get() * 1000.0);
+
+		clock.reset();
+		for (unsigned i = 0; i < COUNT; ++i)
+			checksum += matrices[i & 63].affineInverse()._41;
+		affineInverses.push_back(clock.get() * 1000.0);
+
+		clock.reset();
+		for (unsigned i = 0; i < COUNT; ++i)
+			checksum += matrices[i & 63].orthonormalInverse()._41;
+		rigidInverses.push_back(clock.get() * 1000.0);
+
+		clock.reset();
+		transformPoints(matrices[run & 63], &points[0], &transformed[0], COUNT);
+		transforms.push_back(clock.get() * 1000.0);
+	}
+
+	// use the results, so that the loops are not optimized away
+	if (result[0][0] != result[0][0] || affine[0][0] != affine[0][0] || checksum != checksum ||
+			transformed[COUNT - 1].x != transformed[COUNT - 1].x)
+		std::cout << "  the results are not finite" << std::endl;
+
+	addResult("m3d", "mat4_multiply_1m", multiplies, 0);
+	addResult("m3d", "mat4_affine_multiply_1m", affineMultiplies, 0);
+	addResult("m3d", "mat4_inverse_1m", inverses, 0);
+	addResult("m3d", "mat4_affine_inverse_1m", affineInverses, 0);
+	addResult("m3d", "mat4_orthonormal_inverse_1m", rigidInverses, 0);
+	addResult("m3d", "transform_points_1m", transforms, 0);
+}
+
+bool Benchmark::runLevel(const std::string& name, const std::string& fileName)
+{
+	Simulation& simulation = Simulation::instance();
+	const std::string saveFile = m_params.scratch + "benchmark_save.xml";
+	util::Clock clock;
+
+	// dominos for the editor scenario, high above the level
+	Generator::Params editorScene;
+	editorScene.count = m_params.editorObjects;
+	std::vector<Mat4f> editorMatrices;
+	Generator::generate(editorScene, editorMatrices);
+	for (std::vector<Mat4f>::iterator itr = editorMatrices.begin(); itr != editorMatrices.end(); ++itr)
+		itr->_42 += 500.0f;
+
+	std::cout << name << std::endl;
+
+	std::vector<double> coldLoads, warmLoads, saves, uploads, frames, adds, removes, steps;
+
+	// the growth of the resident memory during the scenarios of the first
+	// run, the warm load is measured in the second run
+	long coldLoadMemory = 0, warmLoadMemory = 0, saveMemory = 0, uploadMemory = 0;
+	long frameMemory = 0, addMemory = 0, removeMemory = 0, stepMemory = 0;
+	for (unsigned run = 0; run < m_params.runs; ++run) {
+		// the first load of a level reads the level, the models and the
+		// textures from the disk, all further loads are served from caches.
+		// load() initializes the simulation itself
+		long memory = getMemory();
+		clock.reset();
+		if (!simulation.load(fileName)) {
+			std::cout << "  skipped, the level could not be loaded" << std::endl;
+			return false;
+		}
+		glFinish();
+		(run == 0 ? coldLoads : warmLoads).push_back(clock.get() * 1000.0);
+		if (run < 2)
+			(run == 0 ? coldLoadMemory : warmLoadMemory) = getMemory() - memory;
+
+		// the footprint of the welded environment, compared to one vertex per corner
+		const Object& environment = simulation.getEnvironment();
+		if (run == 0 && environment && environment->getType() == __Object::TREE_COLLISION) {
+			const __TreeCollision& tree = (const __TreeCollision&)*environment;
+			std::cout << "  environment: " << tree.getVertexCount() << " vertices, " << tree.getFaceCount()
+					  << " faces, " << tree.getMemoryUsage() / 1024 << " KiB (vertices without welding "
+					  << tree.getUnweldedMemoryUsage() / 1024 << " KiB)" << std::endl;
+		}
+
+		memory = getMemory();
+		clock.reset();
+		simulation.save(saveFile);
+		saves.push_back(clock.get() * 1000.0);
+		if (run == 0)
+			saveMemory = getMemory() - memory;
+
+		memory = getMemory();
+		clock.reset();
+		simulation.rebuildBuffers();
+		glFinish();
+		uploads.push_back(clock.get() * 1000.0);
+		if (run == 0)
+			uploadMemory = getMemory() - memory;
+
+		// the first frame uploads the textures of the level
+		memory = getMemory();
+		renderFrame();
+		for (unsigned i = 0; i < m_params.frames; ++i) {
+			clock.reset();
+			renderFrame();
+			frames.push_back(clock.get() * 1000.0);
+		}
+		if (run == 0)
+			frameMemory = getMemory() - memory;
+
+		std::vector<Object> objects;
+		objects.reserve(editorMatrices.size());
+		memory = getMemory();
+		clock.reset();
+		for (std::vector<Mat4f>::const_iterator itr = editorMatrices.begin(); itr != editorMatrices.end(); ++itr) {
+			objects.push_back(__Domino::createDomino(__Object::DOMINO_SMALL, *itr, -1.0f, "planks", false));
+			simulation.add(objects.back());
+		}
+		adds.push_back(clock.get() * 1000.0);
+		if (run == 0)
+			addMemory = getMemory() - memory;
+
+		memory = getMemory();
+		clock.reset();
+		for (std::vector<Object>::const_iterator itr = objects.begin(); itr != objects.end(); ++itr)
+			simulation.remove(*itr);
+		removes.push_back(clock.get() * 1000.0);
+		objects.clear();
+		if (run == 0)
+			removeMemory = getMemory() - memory;
+
+		memory = getMemory();
+		for (unsigned i = 0; i < m_params.steps; ++i) {
+			clock.reset();
+			simulation.step();
+			steps.push_back(clock.get() * 1000.0);
+		}
+		if (run == 0)
+			stepMemory = getMemory() - memory;
+	}
+
+	addResult(name, "load_cold", coldLoads, coldLoadMemory);
+	addResult(name, "load_warm", warmLoads, warmLoadMemory);
+	addResult(name, "save", saves, saveMemory);
+	addResult(name, "vbo_upload", uploads, uploadMemory);
+	addResult(name, "render_frame", frames, frameMemory);
+	addResult(name, "editor_add", adds, addMemory);
+	addResult(name, "editor_remove", removes, removeMemory);
+	addResult(name, "physics_step", steps, stepMemory);
+
+	::remove(saveFile.c_str());
+	return true;
+}
+
+const Benchmark::Results& Benchmark::run()
+{
+	using namespace boost::filesystem;
+	m_results.clear();
+	runMath();
+
+	// the bundled levels, sorted to get the same order on all systems
+	std::vector<std::string> levels;
+	if (!m_params.levels.empty() && is_directory(m_params.levels)) {
+		directory_iterator end_itr;
+		for (directory_iterator itr(m_params.levels); itr != end_itr; ++itr) {
+			if (extension(*itr) == ".xml")
+				levels.push_back(itr->string());
+		}
+	}
+	std::sort(levels.begin(), levels.end());
+
+	for (std::vector<std::string>::const_iterator itr = levels.begin(); itr != levels.end(); ++itr)
+		runLevel(basename(*itr), *itr);
+
+	for (std::vector<Generator::Params>::const_iterator itr = m_params.generated.begin();
+			itr != m_params.generated.end(); ++itr) {
+		std::stringstream name;
+		name << "generated_" << Generator::LayoutStr[itr->layout] << "_" << itr->count;
+		std::string fileName = m_params.scratch + "benchmark_" + name.str() + ".xml";
+
+		Generator::save(*itr, fileName);
+		runLevel(name.str(), fileName);
+		::remove(fileName.c_str());
+	}
+
+	Simulation::instance().init();
+	return m_results;
+}
+
+void Benchmark::save(const std::string& fileName) const
+{
+	std::ofstream out(fileName.c_str());
+	if (!out)
+		throw std::runtime_error("Could not open benchmark file " + fileName + " for writing");
+
+	out << "{\n";
+	out << "\t\"runs\": " << m_params.runs << ",\n";
+	out << "\t\"steps\": " << m_params.steps << ",\n";
+	out << "\t\"frames\": " << m_params.frames << ",\n";
+	out << "\t\"editorObjects\": " << m_params.editorObjects << ",\n";
+	out << "\t\"peakMemory\": " << getPeakMemory() << ",\n";
+	out << "\t\"results\": [\n";
+	for (Results::const_iterator itr = m_results.begin(); itr != m_results.end(); ++itr) {
+		out << "\t\t{ \"level\": \"" << itr->level << "\", \"scenario\": \"" << itr->scenario << "\""
+			<< ", \"samples\": " << itr->samples
+			<< ", \"min\": " << itr->min
+			<< ", \"median\": " << itr->median
+			<< ", \"p99\": " << itr->p99
+			<< ", \"memoryGrowth\": " << itr->memoryGrowth << " }"
+			<< (itr + 1 != m_results.end() ? ",\n" : "\n");
+	}
+	out << "\t]\n";
+	out << "}\n";
+
+	if (!out)
+		throw std::runtime_error("Could not write benchmark file " + fileName);
+}
+
+/**
+ * Returns the value of the given key in a JSON object written by
+ * Benchmark::save(). This is not a general JSON parser.
+ */
+static std::string getValue(const std::string& object, const std::string& key)
+{
+	size_t pos = object.find("\"" + key + "\":");
+	if (pos == std::string::npos)
+		return "";
+	pos = object.find_first_not_of(" \t", pos + key.size() + 3);
+	if (pos == std::string::npos)
+		return "";
+	if (object[pos] == '"') {
+		size_t end = object.find('"', pos + 1);
+		return object.substr(pos + 1, end - pos - 1);
+	}
+	return object.substr(pos, object.find_first_of(",}", pos) - pos);
+}
+
+unsigned Benchmark::compare(const std::string& fileName) const
+{
+	std::ifstream in(fileName.c_str());
+	if (!in)
+		throw std::runtime_error("Could not open baseline file " + fileName);
+
+	// each result is a single line with a JSON object
+	std::map<std::string, double> baseline;
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t begin = line.find('{');
+		if (begin == std::string::npos || line.find("\"scenario\"") == std::string::npos)
+			continue;
+		std::string object = line.substr(begin);
+		baseline[getValue(object, "level") + "/" + getValue(object, "scenario")] =
+				atof(getValue(object, "median").c_str());
+	}
+
+	unsigned regressions = 0;
+	for (Results::const_iterator itr = m_results.begin(); itr != m_results.end(); ++itr) {
+		std::map<std::string, double>::const_iterator base = baseline.find(itr->level + "/" + itr->scenario);
+		if (base == baseline.end() || base->second <= 0.0)
+			continue;
+
+		double change = itr->median / base->second - 1.0;
+		if (change > m_params.threshold) {
+			std::cout << "Regression: " << base->first << " " << base->second << " ms -> "
+					  << itr->median << " ms (+" << (int)(change * 100.0) << "%)" << std::endl;
+			regressions++;
+		}
+	}
+	return regressions;
+}
+
+}
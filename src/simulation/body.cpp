@@ -5,34 +5,41 @@
  */
 
 #include <simulation/body.hpp>
+#include <simulation/world.hpp>
 #include <newton/util.hpp>
+#include <util/profiler.hpp>
 
 namespace sim {
 
 Body::Body()
-	: m_matrix(Mat4f::identity()),
+	: m_store(&World::current()->getTransforms()),
+	  m_slot(m_store->allocate(Mat4f::identity())),
+	  m_matrix(m_store->getMatrixPtr(m_slot)),
 	  m_body(NULL)
-
 {
 }
 
 Body::Body(NewtonBody* body)
-	: m_matrix(Mat4f::identity()),
+	: m_store(&World::current()->getTransforms()),
+	  m_slot(m_store->allocate(Mat4f::identity())),
+	  m_matrix(m_store->getMatrixPtr(m_slot)),
 	  m_body(body)
-
 {
 }
 
 Body::Body(const Mat4f& matrix)
-	: m_matrix(matrix),
+	: m_store(&World::current()->getTransforms()),
+	  m_slot(m_store->allocate(matrix)),
+	  m_matrix(m_store->getMatrixPtr(m_slot)),
 	  m_body(NULL)
 {
 }
 
 Body::Body(NewtonBody* body, const Mat4f& matrix)
-	: m_matrix(matrix),
+	: m_store(&World::current()->getTransforms()),
+	  m_slot(m_store->allocate(matrix)),
+	  m_matrix(m_store->getMatrixPtr(m_slot)),
 	  m_body(body)
-
 {
 }
 
@@ -40,6 +47,7 @@ Body::~Body()
 {
 	if (m_body)
 		NewtonDestroyBody(NewtonBodyGetWorld(m_body), m_body);
+	m_store->release(m_slot);
 }
 
 NewtonBody* Body::create(NewtonCollision* collision, float mass, int freezeState, const Vec4f& damping)
@@ -47,10 +55,10 @@ NewtonBody* Body::create(NewtonCollision* collision, float mass, int freezeState
 	Vec4f minBox, maxBox;
 	Vec4f origin, inertia;
 
-	m_body = NewtonCreateBody(newton::world, collision, this->m_matrix[0]);
+	m_body = NewtonCreateBody(newton::world, collision, (*m_matrix)[0]);
 
 	NewtonBodySetUserData(m_body, this);
-	NewtonBodySetMatrix(m_body, this->m_matrix[0]);
+	NewtonBodySetMatrix(m_body, (*m_matrix)[0]);
 	NewtonConvexCollisionCalculateInertialMatrix(collision, &inertia[0], &origin[0]);
 
 	if (mass < 0.0f)
@@ -80,21 +88,26 @@ void Body::__destroyBodyCallback(const NewtonBody* body)
 void Body::__setTransformCallback(const NewtonBody* body, const dFloat* matrix, int threadIndex)
 {
 	//std::cout << "\ttransform " << threadIndex << " " << body << std::endl;
+	PROFILE_SCOPE_THREAD("setTransform", threadIndex);
 	Body* _body = (Body*)NewtonBodyGetUserData(body);
-	_body->m_matrix = Mat4f(matrix);
+	_body->m_store->setMatrix(_body->m_slot, Mat4f(matrix));
 	//std::cout << "\ttransform end " << threadIndex << " " << body << std::endl;
 }
 
 void Body::__applyForceAndTorqueCallback(const NewtonBody* body, dFloat timestep, int threadIndex)
 {
 	//std::cout << "\tforce " << threadIndex << " " << body << std::endl;
+	PROFILE_SCOPE_THREAD("applyForceAndTorque", threadIndex);
 	dFloat Ixx;
 	dFloat Iyy;
 	dFloat Izz;
 	dFloat mass;
 
+	// called from the worker threads of the world, which have no current world
+	const float gravity = World::fromNewton(NewtonBodyGetWorld(body))->getGravity();
+
 	NewtonBodyGetMassMatrix(body, &mass, &Ixx, &Iyy, &Izz);
-	Vec4f gravityForce(0.0f, mass * newton::gravity, 0.0f, 1.0f);
+	Vec4f gravityForce(0.0f, mass * gravity, 0.0f, 1.0f);
 	NewtonBodySetForce(body, &gravityForce[0]);
 	//std::cout << "\tforce end " << threadIndex << " " << body << std::endl;
 }
@@ -61,15 +61,20 @@ void __Compound::getAABB(Vec3f& min, Vec3f& max)
 	}
 }
 
-float __Compound::convexCastPlacement(bool apply, std::list<NewtonBody*>* noCollision)
+float __Compound::convexCastPlacement(bool apply, const newton::BodySet* exclude)
 {
-	std::list<NewtonBody*> temp;
+	// place all nodes in one batch, ignoring each other
+	std::vector<NewtonBody*> bodies;
 	for (std::list<Object>::iterator itr = m_nodes.begin(); itr != m_nodes.end(); ++itr) {
-		temp.push_back(((__RigidBody*)itr->get())->m_body);
+		bodies.push_back(((__RigidBody*)itr->get())->m_body);
 	}
+	std::vector<float> placements;
+	newton::getConvexCastPlacements(bodies, placements, exclude);
+
 	float maximum = -1000.0f;
-	for (std::list<Object>::iterator itr = m_nodes.begin(); itr != m_nodes.end(); ++itr) {
-		float current = (*itr)->convexCastPlacement(false, &temp);
+	unsigned i = 0;
+	for (std::list<Object>::iterator itr = m_nodes.begin(); itr != m_nodes.end(); ++itr, ++i) {
+		float current = placements[i] + 0.0001f;
 		current += (m_matrix._42 - (*itr)->getMatrix()._42);
 		if (current > maximum) maximum = current;
 	}
@@ -185,7 +190,7 @@ BallAndSocket __Compound::createBallAndSocket(const Vec3f& pivot, const Vec3f& p
 void __Compound::add(Object object)
 {
 	object->setID(m_nextID++);
-	Mat4f matrix = object->getMatrix() * m_matrix;
+	Mat4f matrix = object->getMatrix().affineMultiply(m_matrix);
 	object->setMatrix(matrix);
 	m_nodes.push_back(object);
 }
@@ -194,12 +199,12 @@ void __Compound::setMatrix(const Mat4f& matrix)
 {
 	// We have to renew the matrix of all nodes by
 	// untransforming them first with the old matrix
-	// and then transforming them with the new one
-	Mat4f inverse = m_matrix.inverse();
+	// and then transforming them with the new one.
+	// Both matrices are rigid transforms.
+	Mat4f transform = m_matrix.orthonormalInverse().affineMultiply(matrix);
 	for (std::list<Object>::iterator itr = m_nodes.begin();
 				itr != m_nodes.end(); ++itr) {
-		Mat4f newMatrix = (*itr)->getMatrix();
-		newMatrix *= inverse * matrix;
+		Mat4f newMatrix = (*itr)->getMatrix().affineMultiply(transform);
 		(*itr)->setMatrix(newMatrix);
 	}
 	m_matrix = matrix;
@@ -247,6 +252,14 @@ bool __Compound::contains(const __Object* object)
 	return false;
 }
 
+void __Compound::getBodies(std::vector<Body*>& bodies)
+{
+	for (std::list<Object>::iterator itr = m_nodes.begin();
+			itr != m_nodes.end(); ++itr) {
+		(*itr)->getBodies(bodies);
+	}
+}
+
 void __Compound::genBuffers(ogl::VertexBuffer& vbo)
 {
 	for (std::list<Object>::iterator itr = m_nodes.begin();
@@ -255,11 +268,11 @@ void __Compound::genBuffers(ogl::VertexBuffer& vbo)
 	}
 }
 
-void __Compound::render()
+void __Compound::render(const ogl::Camera& camera)
 {
 	for (std::list<Object>::iterator itr = m_nodes.begin();
 			itr != m_nodes.end(); ++itr) {
-		(*itr)->render();
+		(*itr)->render(camera);
 	}
 }
 
@@ -7,6 +7,7 @@
 #include <simulation/crspline.hpp>
 #include <GL/glew.h>
 #include <newton/util.hpp>
+#include <algorithm>
 
 namespace sim {
 
@@ -50,6 +51,10 @@ static inline float lerp(float a, float a0, float a1, float t0, float t1) {
 }
 
 
+/** The maximum recursion depth when subdividing a segment */
+static const unsigned MAX_SUBDIVISION_DEPTH = 16;
+
+
 CRSpline::CRSpline(float error)
 	: m_error(error)
 {
@@ -75,64 +80,107 @@ unsigned CRSpline::binarySearch(float length)
 	return lower;
 }
 
+unsigned CRSpline::findSegment(float length, unsigned hint)
+{
+	if (hint + 1 < m_table.size() && length >= m_table[hint].len) {
+		if (length < m_table[hint + 1].len)
+			return hint;
+		if (hint + 2 < m_table.size() && length < m_table[hint + 2].len)
+			return hint + 1;
+	}
+	return binarySearch(length);
+}
+
 float CRSpline::getT(float length)
 {
 	// check if the length is out of bounds
     if (length <= m_table.front().len)
-    	return m_table.front().t;
+    	return 0.0f;
     else if (length >= m_table.back().len)
-    	return m_table.back().t;
+    	return 1.0f;
 
     unsigned lower = binarySearch(length);
 
+    // the table stores the knot parameter, normalize it
     return lerp(length, m_table[lower].len, m_table[lower + 1].len,
-    		m_table[lower].t, m_table[lower + 1].t);
+    		m_table[lower].t, m_table[lower + 1].t) / m_table.back().t;
 
 }
 
-Vec3f CRSpline::getPos(float length)
+Vec2f CRSpline::getPlanePos(float length, unsigned& hint)
 {
-	float x = 0.0f;
-	float z = 0.0f;
-
-	if (length <= m_table.front().len) {
-		x = m_table.front().pos.x;
-		z = m_table.front().pos.y;
-	} else if (length >= m_table.back().len) {
-		x = m_table.back().pos.x;
-		z = m_table.back().pos.y;
-	} else {
-		// perform a linear interpolation between the two nearest help points
-		unsigned lower = binarySearch(length);
+	if (length <= m_table.front().len)
+		return m_table.front().pos;
+	if (length >= m_table.back().len)
+		return m_table.back().pos;
 
-		x = lerp(length, m_table[lower].len, m_table[lower + 1].len,
-				m_table[lower].pos.x, m_table[lower +1].pos.x);
+	// perform a linear interpolation between the two nearest help points
+	unsigned lower = hint = findSegment(length, hint);
 
-		z = lerp(length, m_table[lower].len, m_table[lower + 1].len,
-				m_table[lower].pos.y, m_table[lower + 1].pos.y);
-	}
+	float x = lerp(length, m_table[lower].len, m_table[lower + 1].len,
+			m_table[lower].pos.x, m_table[lower +1].pos.x);
+
+	float z = lerp(length, m_table[lower].len, m_table[lower + 1].len,
+			m_table[lower].pos.y, m_table[lower + 1].pos.y);
 
-	return Vec3f(x, newton::getVerticalPosition(x, z), z);
+	return Vec2f(x, z);
 }
 
-Vec3f CRSpline::getTangent(float length)
+Vec2f CRSpline::getPlaneTangent(float length, unsigned& hint)
 {
 	// check if the length is out of bounds
-    if (length <= m_table.front().len)
-    	return m_table.front().tangent.xz3(0.0f);
-    else if (length >= m_table.back().len)
-    	return m_table.back().tangent.xz3(0.0f);
+	if (length <= m_table.front().len)
+		return m_table.front().tangent;
+	if (length >= m_table.back().len)
+		return m_table.back().tangent;
 
-    // perform a linear interpolation between the two nearest help points
-    unsigned lower = binarySearch(length);
+	// perform a linear interpolation between the two nearest help points
+	unsigned lower = hint = findSegment(length, hint);
 
-    float x = lerp(length, m_table[lower].len, m_table[lower + 1].len,
+	float x = lerp(length, m_table[lower].len, m_table[lower + 1].len,
 			m_table[lower].tangent.x, m_table[lower + 1].tangent.x);
 
 	float z = lerp(length, m_table[lower].len, m_table[lower + 1].len,
 			m_table[lower].tangent.y, m_table[lower + 1].tangent.y);
 
-    return Vec3f(x, 0.0f, z);
+	return Vec2f(x, z);
+}
+
+Vec3f CRSpline::getPos(float length)
+{
+	unsigned hint = 0;
+	Vec2f p = getPlanePos(length, hint);
+	return p.xz3(newton::getVerticalPosition(p.x, p.y));
+}
+
+void CRSpline::getPositions(const std::vector<float>& lengths, std::vector<Vec3f>& result)
+{
+	unsigned hint = 0;
+	std::vector<Vec2f> points;
+	points.reserve(lengths.size());
+	for (std::vector<float>::const_iterator itr = lengths.begin(); itr != lengths.end(); ++itr)
+		points.push_back(getPlanePos(*itr, hint));
+
+	std::vector<float> heights;
+	newton::getVerticalPositions(points, heights);
+
+	result.resize(points.size());
+	for (unsigned i = 0; i < points.size(); ++i)
+		result[i] = points[i].xz3(heights[i]);
+}
+
+Vec3f CRSpline::getTangent(float length)
+{
+	unsigned hint = 0;
+	return getPlaneTangent(length, hint).xz3(0.0f);
+}
+
+void CRSpline::getTangents(const std::vector<float>& lengths, std::vector<Vec3f>& result)
+{
+	unsigned hint = 0;
+	result.resize(lengths.size());
+	for (unsigned i = 0; i < lengths.size(); ++i)
+		result[i] = getPlaneTangent(lengths[i], hint).xz3(0.0f);
 }
 
 std::pair<Vec3f, Vec3f> CRSpline::getPoint(float length)
@@ -142,52 +190,66 @@ std::pair<Vec3f, Vec3f> CRSpline::getPoint(float length)
 
 float CRSpline::update()
 {
-	m_table.clear();
-	if (m_knots.size() < 3)
+	if (m_knots.size() < 3) {
+		m_table.clear();
+		m_segments.clear();
+		m_builtKnots = m_knots;
 		return 0.0f;
+	}
 
-    // add the first help point to the temporary help list
-    HelpPoint helpPoint;
-    helpPoint.t = helpPoint.len = 0.0f;
-    helpPoint.pos = interpolate(m_knots[0], m_knots[0], m_knots[1], m_knots[2], 0.0f);
-    helpPoint.tangent = derive(m_knots[0], m_knots[0], m_knots[1], m_knots[2], 0.0f);
-
-    HelpList helpList;
-    helpList.push_back(helpPoint);
-
-    HelpList::iterator curPoint;
-    curPoint = helpList.begin();
-
-    // for each knot (except the last), insert the knot as a help point
-    for (unsigned i = 0; i < m_knots.size() - 1; ++i) {
-    	// construct the new help point at the end of the current knot
-        helpPoint.t = (float)(i + 1);
-        helpPoint.pos = interpolate(at(i-1), at(i), at(i+1), at(i+2), 1.0f);
-        helpPoint.tangent = derive(at(i-1), at(i), at(i+1), at(i+2), 1.0f);
-        helpPoint.len = (helpPoint.pos - curPoint->pos).len() + helpList.back().len;
-        helpList.push_back(helpPoint);
-
-		// recursively subdivide the segments
-        curPoint = divideSegment(helpList, curPoint, i);
-    }
+	// find the first knot that changed since the last update
+	const unsigned common = std::min(m_knots.size(), m_builtKnots.size());
+	unsigned changed = 0;
+	while (changed < common && m_knots[changed] == m_builtKnots[changed])
+		++changed;
+
+	if (!m_table.empty() && changed == m_knots.size() && changed == m_builtKnots.size())
+		return m_table.back().len;
+
+	// segment i depends on the knots i-1 to i+2, keep all segments before the change
+	unsigned first = changed > 2 ? changed - 2 : 0;
+	if (m_table.empty() || first > m_segments.size())
+		first = 0;
+
+	if (first == 0) {
+		// add the first help point to the table
+		HelpPoint helpPoint;
+		helpPoint.t = helpPoint.len = 0.0f;
+		helpPoint.pos = interpolate(m_knots[0], m_knots[0], m_knots[1], m_knots[2], 0.0f);
+		helpPoint.tangent = derive(m_knots[0], m_knots[0], m_knots[1], m_knots[2], 0.0f);
+
+		m_table.clear();
+		m_segments.clear();
+		m_table.push_back(helpPoint);
+	} else {
+		m_table.resize(m_segments[first] + 1);
+		m_segments.resize(first);
+	}
 
-    // add the list of help point to the table
-    float param = 1.0f / helpList.back().t;
-    for (curPoint = helpList.begin(); curPoint != helpList.end(); ++curPoint) {
-        m_table.push_back(*curPoint);
-        m_table.back().t *= param;
-    }
+	// for each knot (except the last), append the segment to the next knot
+	for (unsigned i = first; i < m_knots.size() - 1; ++i) {
+		m_segments.push_back(m_table.size() - 1);
+
+		// construct the new help point at the end of the current knot
+		HelpPoint cur = m_table.back();
+		HelpPoint next;
+		next.t = (float)(i + 1);
+		next.pos = interpolate(at(i-1), at(i), at(i+1), at(i+2), 1.0f);
+		next.tangent = derive(at(i-1), at(i), at(i+1), at(i+2), 1.0f);
 
-    return (m_table.size() > 0) ? m_table.back().len : 0.0f;
+		// recursively subdivide the segment
+		divideSegment(i, cur, next);
+	}
+
+	m_builtKnots = m_knots;
+	return m_table.back().len;
 }
 
-CRSpline::HelpList::iterator CRSpline::divideSegment(HelpList &helpPoints, HelpList::iterator cur, unsigned knot)
+void CRSpline::divideSegment(unsigned knot, const HelpPoint& cur, const HelpPoint& next, unsigned depth)
 {
-    HelpList::iterator next = cur; ++next;
-
     // construct a new help point between the current and the next point
     HelpPoint middle;
-    middle.t = (cur->t + next->t) * 0.5f;
+    middle.t = (cur.t + next.t) * 0.5f;
     middle.pos = interpolate(at(knot - 1), at(knot), at(knot + 1), at(knot + 2), middle.t - (float)knot);
     middle.tangent = derive(at(knot - 1), at(knot), at(knot + 1), at(knot + 2), middle.t - (float)knot);
 
@@ -200,41 +262,36 @@ CRSpline::HelpList::iterator CRSpline::divideSegment(HelpList &helpPoints, HelpL
      * C ------- N
      *      m
      */
-    float n = (middle.pos - cur->pos).len();
-    float c = (next->pos - middle.pos).len();
-    float m = (next->pos - cur->pos).len();
+    float n = (middle.pos - cur.pos).len();
+    float c = (next.pos - middle.pos).len();
+    float m = (next.pos - cur.pos).len();
 
     // The deviation is a measure of the height of the triangle,
     // or the difference in the edge lengths
     float deviation = n + c - m;
 
     // subdivide the segments if the deviation exceeds the allowed error
-    if (deviation > m_error) {
-
-    	// add the increase in length to the subsequent help points
-        HelpList::iterator itr = next;
-        while (itr != helpPoints.end())
-        	(itr++)->len += deviation;
-
-        // insert middle before next
-        middle.len = cur->len + n;
-        helpPoints.insert(next, middle);
-
-        // divide the newly generated segments
-        next = divideSegment(helpPoints, cur, knot);
-        next = divideSegment(helpPoints, next, knot);
+    if (deviation > m_error && depth < MAX_SUBDIVISION_DEPTH) {
+        divideSegment(knot, cur, middle, depth + 1);
+        divideSegment(knot, middle, next, depth + 1);
+    } else {
+    	// the segment is straight enough, append its end
+    	float len = m_table.back().len + m;
+    	m_table.push_back(next);
+    	m_table.back().len = len;
     }
-
-    return next;
 }
 
 void CRSpline::renderKnots(bool link, const Vec3f& color)
 {
+	std::vector<float> heights;
+	newton::getVerticalPositions(m_knots, heights);
+
 	Vec3f p;
 	glColor3fv(&color.x);
 	glBegin(GL_POINTS);
 	for (unsigned i = 0; i < m_knots.size(); ++i) {
-		p = m_knots[i].xz3(newton::getVerticalPosition(m_knots[i].x, m_knots[i].y));
+		p = m_knots[i].xz3(heights[i]);
 		glVertex3fv(&p.x);
 	}
 	glEnd();
@@ -242,7 +299,7 @@ void CRSpline::renderKnots(bool link, const Vec3f& color)
 	if (link) {
 		glBegin(GL_LINE_STRIP);
 		for (unsigned i = 0; i < m_knots.size(); ++i) {
-			p = m_knots[i].xz3(newton::getVerticalPosition(m_knots[i].x, m_knots[i].y));
+			p = m_knots[i].xz3(heights[i]);
 			glVertex3fv(&p.x);
 		}
 		glEnd();
@@ -252,22 +309,26 @@ void CRSpline::renderKnots(bool link, const Vec3f& color)
 void CRSpline::renderSpline(float accuracy, const Vec3f& color)
 {
 	if (m_knots.size() >= 3)  {
-		glColor3fv(&color.x);
-	    glBegin(GL_LINES);
-	    Vec2f p;
-	    Vec3f q;
+	    std::vector<Vec2f> points;
 	    unsigned int size = m_knots.size();
 
 	    for (unsigned i = 0; i < size; ++i) {
 			for (float t = 0.0f; t < 1.0f; t += 0.01f) {
-				p = interpolate(at(i-1), at(i+0), at(i+1), at(i+2), t);
-				q = p.xz3(newton::getVerticalPosition(p.x, p.y));
-				glVertex3fv(&q.x);
-				p = interpolate(at(i-1), at(i+0), at(i+1), at(i+2), t + 0.01f);
-				q = p.xz3(newton::getVerticalPosition(p.x, p.y));
-				glVertex3fv(&q.x);
+				points.push_back(interpolate(at(i-1), at(i+0), at(i+1), at(i+2), t));
+				points.push_back(interpolate(at(i-1), at(i+0), at(i+1), at(i+2), t + 0.01f));
 			}
 	    }
+
+	    std::vector<float> heights;
+	    newton::getVerticalPositions(points, heights);
+
+		glColor3fv(&color.x);
+	    glBegin(GL_LINES);
+	    Vec3f q;
+	    for (unsigned i = 0; i < points.size(); ++i) {
+	    	q = points[i].xz3(heights[i]);
+	    	glVertex3fv(&q.x);
+	    }
 	    glEnd();
 	}
 }
@@ -276,9 +337,17 @@ void CRSpline::renderSpline(float accuracy, const Vec3f& color)
 void CRSpline::renderPoints(float gap, const Vec3f& color, bool tangent, const Vec3f& tangentColor, float tangentLength)
 {
 	if (m_table.size()) {
-		for (float t = 0.0f; t < m_table.back().len; t += gap) {
-			Vec3f p = getPos(t);
-			Vec3f q = p + getTangent(t).normalized() * tangentLength;
+		std::vector<float> lengths;
+		for (float t = 0.0f; t < m_table.back().len; t += gap)
+			lengths.push_back(t);
+
+		std::vector<Vec3f> positions, tangents;
+		getPositions(lengths, positions);
+		getTangents(lengths, tangents);
+
+		for (unsigned i = 0; i < lengths.size(); ++i) {
+			Vec3f p = positions[i];
+			Vec3f q = p + tangents[i].normalized() * tangentLength;
 
 			glColor3fv(&color.x);
 			glBegin(GL_POINTS);
@@ -7,11 +7,14 @@
 #include <simulation/domino.hpp>
 #include <newton/util.hpp>
 #include <simulation/material.hpp>
+#include <simulation/world.hpp>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 
 namespace sim {
 
 
-NewtonCollision* __Domino::s_domino_collision[3] = { NULL, NULL, NULL };
 Vec3f __Domino::s_domino_size[3] = { Vec3f(3.0f, 8.0f, 0.5f) * 0.4f, Vec3f(3.0f, 8.0f, 0.5f) * 0.55f, Vec3f(3.0f, 8.0f, 0.5f) * 0.75f };
 float __Domino::s_domino_gap[3] = { 2.5f, 3.5f, 4.5f };
 
@@ -29,22 +32,15 @@ __Domino::~__Domino()
 #ifndef CONVEX_DOMINO
 NewtonCollision*  __Domino::getCollision(Type type, int materialID)
 {
-	Mat4f identity = Mat4f::identity();
-	Vec3f size = s_domino_size[type];
-	if (!s_domino_collision[type]) {
-		s_domino_collision[type] = NewtonCreateBox(newton::world, size.x, size.y, size.z, materialID, identity[0]);
-	}
-	return s_domino_collision[type];
-}
-
-void __Domino::freeCollisions()
-{
-	for (int i = 0; i <= __Domino::DOMINO_LARGE; ++i) {
-		if (s_domino_collision[i]) {
-			NewtonReleaseCollision(newton::world, s_domino_collision[i]);
-			s_domino_collision[i] = NULL;
-		}
+	std::ostringstream key;
+	key << TypeStr[type] << "|" << materialID;
+	NewtonCollision*& collision = World::current()->getCollision(key.str());
+	if (!collision) {
+		Mat4f identity = Mat4f::identity();
+		Vec3f size = s_domino_size[type];
+		collision = NewtonCreateBox(newton::world, size.x, size.y, size.z, materialID, identity[0]);
 	}
+	return collision;
 }
 #endif
 
@@ -66,11 +62,60 @@ void __Domino::genBuffers(ogl::VertexBuffer& vbo)
 	buffer->indexCount = (*itr)->indexCount;
 	buffer->indexOffset = (*itr)->indexOffset;
 	buffer->userData = this;
-	buffer->material = m_material;
+	buffer->transform = m_slot;
+	buffer->copyLOD(**itr, 0);
+	buffer->material = ogl::SubBuffer::materialID(m_material);
 	vbo.m_buffers.push_back(buffer);
 
 }
 
+// functor to sort the axes of a box by the area of their faces
+struct AreaSorter {
+	const float* area;
+	AreaSorter(const float* area) : area(area) { }
+	bool operator()(int first, int second) const {
+		return area[first] < area[second];
+	}
+};
+
+void __Domino::genDominoLODs(Type type, ogl::VertexBuffer& vbo, ogl::SubBuffer* buffer,
+		const float* positions, const uint32_t* indices)
+{
+	const Vec3f& size = s_domino_size[type];
+	const unsigned stride = vbo.floatSize();
+	const uint32_t vertexOffset = buffer->dataOffset;
+	buffer->radius = size.len() * 0.5f;
+
+	// the area of the faces along each axis, sorted ascending
+	float area[3] = { size.y * size.z, size.x * size.z, size.x * size.y };
+	int axes[3] = { 0, 1, 2 };
+	std::sort(axes, axes + 3, AreaSorter(area));
+
+	// level 1 drops the smallest pair of faces, level 2 keeps only the
+	// two largest faces, which is a double-sided quad
+	for (unsigned level = 0; level < ogl::SubBuffer::LOD_LEVELS - 1; ++level) {
+		buffer->lodOffset[level] = vbo.m_indices.size();
+		for (unsigned i = 0; i + 2 < buffer->indexCount; i += 3) {
+			Vec3f a(positions + indices[i] * stride);
+			Vec3f b(positions + indices[i + 1] * stride);
+			Vec3f c(positions + indices[i + 2] * stride);
+			Vec3f normal = (b - a) % (c - a);
+
+			// the axis of the face
+			int axis = 0;
+			for (int j = 1; j < 3; ++j)
+				if (fabs(normal[j]) > fabs(normal[axis]))
+					axis = j;
+
+			if (axis == axes[0] || (level > 0 && axis == axes[1]))
+				continue;
+			for (int j = 0; j < 3; ++j)
+				vbo.m_indices.push_back(vertexOffset + indices[i + j]);
+		}
+		buffer->lodCount[level] = vbo.m_indices.size() - buffer->lodOffset[level];
+	}
+}
+
 void __Domino::genDominoBuffers(ogl::VertexBuffer& vbo)
 {
 	for (int i = DOMINO_SMALL; i <= DOMINO_LARGE; ++i) {
@@ -105,7 +150,7 @@ void __Domino::genDominoBuffers(ogl::VertexBuffer& vbo)
 
 			// create a new submesh
 			ogl::SubBuffer* subBuffer = new ogl::SubBuffer();
-			subBuffer->material = "";
+			subBuffer->material = 0;
 			subBuffer->userData = NULL;
 
 			subBuffer->dataCount = vertexCount;
@@ -123,6 +168,8 @@ void __Domino::genDominoBuffers(ogl::VertexBuffer& vbo)
 			for (unsigned i = 0; i < subBuffer->indexCount; ++i)
 				vbo.m_indices.push_back(vertexOffset + indices[i]);
 
+			genDominoLODs((Type)i, vbo, subBuffer, &vbo.m_data[floatOffset + 2 + 3], indices);
+
 			delete indices;
 			vbo.m_buffers.push_back(subBuffer);
 		}
@@ -133,41 +180,56 @@ void __Domino::genDominoBuffers(ogl::VertexBuffer& vbo)
 }
 #endif
 
-Domino __Domino::createDomino(Type type, const Mat4f& matrix, float mass, const std::string& material, bool doPlacement)
+void __Domino::placeDominos(Type type, std::vector<Mat4f>& matrices)
 {
 	const float VERTICAL_DELTA = 0.01f;
-	const int materialID = MaterialMgr::instance().getID(material);
 
 	type = std::min(type, DOMINO_LARGE);
 	Vec3f size = s_domino_size[type];
 	Vec3f sz = size * 0.5f;
 
+	// generate the four corners of each domino
+	const Vec3f corners[4] = {
+		Vec3f(sz.x, 0.0f, sz.z), Vec3f(-sz.x, 0.0f, sz.z),
+		Vec3f(-sz.x, 0.0f, -sz.z), Vec3f(sz.x, 0.0f, -sz.z)
+	};
+	std::vector<Vec2f> points;
+	points.reserve(matrices.size() * 4);
+	for (std::vector<Mat4f>::const_iterator itr = matrices.begin(); itr != matrices.end(); ++itr) {
+		Vec3f p[4];
+		transformPoints(*itr, corners, p, 4);
+		for (unsigned i = 0; i < 4; ++i)
+			points.push_back(Vec2f(p[i].x, p[i].z));
+	}
+
+	std::vector<float> heights;
+	newton::getVerticalPositions(points, heights);
+
+	for (unsigned i = 0; i < matrices.size(); ++i) {
+		const float* y = &heights[i * 4];
+		Vec3f pos = matrices[i].getW();
+		pos.y = std::max(std::max(std::max(y[0], y[1]), y[2]), y[3]) + VERTICAL_DELTA + size.y * 0.5f;
+		matrices[i].setW(pos);
+	}
+}
+
+Domino __Domino::createDomino(Type type, const Mat4f& matrix, float mass, const std::string& material, bool doPlacement)
+{
+	const int materialID = MaterialMgr::instance().getID(material);
+
+	type = std::min(type, DOMINO_LARGE);
+	Vec3f size = s_domino_size[type];
+
 	Mat4f mat(matrix);
 
 	if (doPlacement) {
-		Vec3f p0 = mat.getW();
-		mat.setW(Vec3f());
-
-		// generate points
-		Vec3f p[4][2];
-		p[0][0] = p[0][1] = p0 + Vec3f(sz.x, 0.0f, sz.z) * mat;
-		p[0][0].y = newton::getVerticalPosition(p[0][0].x, p[0][0].z) + VERTICAL_DELTA;
-		p[1][0] = p[1][1] = p0 + Vec3f(-sz.x, 0.0f, sz.z) * mat;
-		p[1][0].y = newton::getVerticalPosition(p[1][0].x, p[1][0].z) + VERTICAL_DELTA;
-		p[2][0] = p[2][1] = p0 + Vec3f(-sz.x, 0.0f, -sz.z) * mat;
-		p[2][0].y = newton::getVerticalPosition(p[2][0].x, p[2][0].z) + VERTICAL_DELTA;
-		p[3][0] = p[3][1] = p0 + Vec3f(sz.x, 0.0f, -sz.z) * mat;
-		p[3][0].y = newton::getVerticalPosition(p[3][0].x, p[3][0].z) + VERTICAL_DELTA;
-
-		mat = matrix;
-		Vec3f pos = mat.getW();
-		pos.y = std::max(std::max(std::max(p[0][0].y, p[1][0].y), p[2][0].y), p[3][0].y) + size.y * 0.5f;
-		mat.setW(pos);
+		std::vector<Mat4f> matrices(1, matrix);
+		placeDominos(type, matrices);
+		mat = matrices[0];
 	}
 
 	Mat4f identity = Mat4f::identity();
 
-	// getCollision(type, materialID);
 	NewtonCollision* collision = NewtonCreateBox(newton::world, size.x, size.y, size.z, materialID, identity[0]);
 
 	Domino result = Domino(new __Domino(type, mat, material));
@@ -0,0 +1,326 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 11, 2011
+ * @file simulation/generator.cpp
+ */
+
+#include <simulation/generator.hpp>
+#include <simulation/domino.hpp>
+#include <simulation/world.hpp>
+#include <stdexcept>
+#include <fstream>
+#include <cmath>
+
+namespace sim {
+
+const char* Generator::LayoutStr[] = {
+	"grid", "spiral", "tree", "hilbert"
+};
+
+/** The maximum random deviation of the domino orientation, in radians */
+static const float MAX_YAW_JITTER = 0.02f;
+
+/** The vertical distance between the dominos and the ground */
+static const float VERTICAL_DELTA = 0.01f;
+
+/** The number of dominos on the edge of a hilbert curve cell */
+static const unsigned HILBERT_EDGE = 2;
+
+/** The distance between the dominos and the border of the world */
+static const float GROUND_MARGIN = 100.0f;
+
+/**
+ * A small xorshift random number generator. It is used instead of rand(),
+ * because the generated scenes have to be identical on all platforms.
+ */
+class Random {
+protected:
+	uint32_t m_state;
+public:
+	Random(unsigned seed) : m_state(seed ? seed : 0x9E3779B9u) { }
+
+	/** @return The next random number */
+	uint32_t next()
+	{
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return m_state;
+	}
+
+	/** @return A random number between -1 and 1 */
+	float signedUnit()
+	{
+		return (float)(next() & 0xFFFFFF) / (float)0x7FFFFF - 1.0f;
+	}
+};
+
+/**
+ * Appends a domino at the given position in the plane, facing along the
+ * given direction in the plane.
+ */
+static inline void addDomino(std::vector<Mat4f>& matrices, const Vec2f& pos, const Vec2f& dir)
+{
+	matrices.push_back(Mat4f(Vec3f::yAxis(), dir.xz3(0.0f), pos.xz3(0.0f)));
+}
+
+/**
+ * Appends dominos along the line from start to end, excluding end. The
+ * first domino is placed at the given offset from the start.
+ */
+static void addLine(std::vector<Mat4f>& matrices, unsigned count, const Vec2f& start, const Vec2f& end, float gap, float offset = 0.0f)
+{
+	Vec2f dir = end - start;
+	float len = dir.len();
+	dir.normalize();
+	for (float d = offset; d < len - gap * 0.5f && matrices.size() < count; d += gap)
+		addDomino(matrices, start + dir * d, dir);
+}
+
+static void generateGrid(std::vector<Mat4f>& matrices, unsigned count, float gap, float rowSpacing)
+{
+	// choose the number of dominos per row, so that the grid is a square
+	unsigned perRow = (unsigned)ceil(sqrt(count * rowSpacing / gap));
+	if (perRow == 0) perRow = 1;
+
+	for (unsigned i = 0; i < count; ++i) {
+		Vec2f pos((i / perRow) * rowSpacing, (i % perRow) * gap);
+		addDomino(matrices, pos, Vec2f(0.0f, 1.0f));
+	}
+}
+
+static void generateSpiral(std::vector<Mat4f>& matrices, unsigned count, float gap, float rowSpacing)
+{
+	// archimedean spiral r = r0 + b * theta with a distance of rowSpacing between the rings
+	const float b = rowSpacing / (2.0f * PI);
+	const float r0 = rowSpacing;
+
+	float theta = 0.0f;
+	for (unsigned i = 0; i < count; ++i) {
+		float r = r0 + b * theta;
+		Vec2f pos(r * cos(theta), r * sin(theta));
+		Vec2f dir(b * cos(theta) - r * sin(theta), b * sin(theta) + r * cos(theta));
+		addDomino(matrices, pos, dir.normalized());
+
+		// advance by the gap along the arc
+		theta += gap / sqrt(r * r + b * b);
+	}
+}
+
+static void generateTree(std::vector<Mat4f>& matrices, unsigned count, float gap)
+{
+	// An H-tree: each line branches into two perpendicular lines that are
+	// centered at its ends and shorter by a factor of sqrt(2). The lines of
+	// an H-tree never cross. Find the smallest trunk that holds all dominos.
+	const float minLength = 4.0f * gap;
+	float trunk = minLength;
+	unsigned depth = 0;
+	for (;;) {
+		unsigned total = 0;
+		float length = trunk;
+		for (unsigned d = 0; d <= depth; ++d, length /= (float)M_SQRT2)
+			total += (1u << d) * (unsigned)std::max(0.0f, ceilf(length / gap - 1.0f));
+		if (total >= count || depth >= 24)
+			break;
+		++depth;
+		trunk *= (float)M_SQRT2;
+	}
+
+	// breadth-first, so that a truncated tree stays balanced
+	std::vector<std::pair<Vec2f, Vec2f> > lines, next;
+	lines.push_back(std::make_pair(Vec2f(-trunk * 0.5f, 0.0f), Vec2f(trunk * 0.5f, 0.0f)));
+	for (unsigned d = 0; d <= depth && matrices.size() < count; ++d) {
+		next.clear();
+		for (unsigned i = 0; i < lines.size() && matrices.size() < count; ++i) {
+			const Vec2f& start = lines[i].first;
+			const Vec2f& end = lines[i].second;
+			// the ends are the centers of the branches, keep them free
+			addLine(matrices, count, start, end, gap, gap * 0.5f);
+
+			Vec2f half = end - start;
+			half = Vec2f(-half.y, half.x) * (0.5f / (float)M_SQRT2);
+			next.push_back(std::make_pair(start - half, start + half));
+			next.push_back(std::make_pair(end - half, end + half));
+		}
+		lines.swap(next);
+	}
+}
+
+/**
+ * Converts the distance d along a hilbert curve with n x n cells to
+ * the coordinates of the cell.
+ */
+static Vec2f hilbertPoint(unsigned n, unsigned d)
+{
+	unsigned x = 0, y = 0;
+	for (unsigned s = 1; s < n; s *= 2) {
+		unsigned rx = 1 & (d / 2);
+		unsigned ry = 1 & (d ^ rx);
+		if (ry == 0) {
+			if (rx == 1) {
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+		x += s * rx;
+		y += s * ry;
+		d /= 4;
+	}
+	return Vec2f((float)x, (float)y);
+}
+
+static void generateHilbert(std::vector<Mat4f>& matrices, unsigned count, float gap)
+{
+	// find the smallest curve with enough edges for all dominos
+	unsigned n = 1;
+	while ((n * n - 1) * HILBERT_EDGE < count && n < (1u << 15))
+		n *= 2;
+
+	const float cell = HILBERT_EDGE * gap;
+	Vec2f prev = hilbertPoint(n, 0) * cell;
+	for (unsigned d = 1; d < n * n && matrices.size() < count; ++d) {
+		Vec2f cur = hilbertPoint(n, d) * cell;
+		addLine(matrices, count, prev, cur, gap);
+		prev = cur;
+	}
+}
+
+Generator::Params::Params()
+	: layout(GRID),
+	  count(1000),
+	  type(__Object::DOMINO_SMALL),
+	  gap(0.0f),
+	  groundMaterial("asphalt"),
+	  seed(1)
+{
+}
+
+void Generator::generate(const Params& params, std::vector<Mat4f>& matrices)
+{
+	const __Object::Type type = std::min(params.type, __Object::DOMINO_LARGE);
+	const Vec3f& size = __Domino::getSize(type);
+	const float gap = params.gap > 0.0f ? params.gap : __Domino::s_domino_gap[type];
+	const float rowSpacing = size.y + gap;
+
+	matrices.clear();
+	matrices.reserve(params.count);
+
+	switch (params.layout) {
+	case GRID:
+		generateGrid(matrices, params.count, gap, rowSpacing);
+		break;
+	case SPIRAL:
+		generateSpiral(matrices, params.count, gap, rowSpacing);
+		break;
+	case TREE:
+		generateTree(matrices, params.count, gap);
+		break;
+	case HILBERT:
+		generateHilbert(matrices, params.count, gap);
+		break;
+	}
+
+	if (matrices.empty())
+		return;
+
+	// center the layout at the origin
+	Vec3f min = matrices[0].getW(), max = min;
+	for (std::vector<Mat4f>::const_iterator itr = matrices.begin(); itr != matrices.end(); ++itr) {
+		Vec3f p = itr->getW();
+		min = Vec3f(std::min(min.x, p.x), 0.0f, std::min(min.z, p.z));
+		max = Vec3f(std::max(max.x, p.x), 0.0f, std::max(max.z, p.z));
+	}
+	Vec3f center = (min + max) * 0.5f;
+	center.y = -(size.y * 0.5f + VERTICAL_DELTA);
+
+	// place the dominos on the ground and slightly rotate them
+	Random random(params.seed);
+	for (std::vector<Mat4f>::iterator itr = matrices.begin(); itr != matrices.end(); ++itr) {
+		Vec3f pos = itr->getW() - center;
+		itr->setW(Vec3f());
+		*itr = *itr * Mat4f::rotY(random.signedUnit() * MAX_YAW_JITTER);
+		itr->setW(pos);
+	}
+}
+
+/**
+ * Writes the matrix in the format of the level files, but with a
+ * smaller precision to keep large scenes small.
+ */
+static void writeMatrix(std::ostream& out, const Mat4f& m)
+{
+	out << m._11 << ", " << m._12 << ", " << m._13 << ", " << m._14 << "; "
+		<< m._21 << ", " << m._22 << ", " << m._23 << ", " << m._24 << "; "
+		<< m._31 << ", " << m._32 << ", " << m._33 << ", " << m._34 << "; "
+		<< m._41 << ", " << m._42 << ", " << m._43 << ", " << m._44;
+}
+
+unsigned Generator::save(const Params& params, const std::string& fileName)
+{
+	std::vector<Mat4f> matrices;
+	generate(params, matrices);
+
+	std::ofstream out(fileName.c_str());
+	if (!out)
+		throw std::runtime_error("Could not open level file " + fileName + " for writing");
+
+	// the extent of the scene, to position the camera and the ground
+	float extent = 0.0f;
+	for (std::vector<Mat4f>::const_iterator itr = matrices.begin(); itr != matrices.end(); ++itr)
+		extent = std::max(extent, std::max(fabs(itr->_41), fabs(itr->_43)));
+
+	Vec3f position(0.0f, extent * 0.5f + 20.0f, extent + 20.0f);
+	Vec3f eye = position - position.normalized();
+
+	out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+	out << "<level gravity=\"9.84\" position=\"" << position << "\" eye=\"" << eye << "\" up=\"0, 1, 0\"";
+	// larger scenes set the size of the newton world
+	if (extent + GROUND_MARGIN > World::DEFAULT_SIZE)
+		out << " size=\"" << (extent + GROUND_MARGIN) << "\"";
+	out << ">\n";
+
+	// the vector output uses a fixed precision, reset it for the matrices
+	out.unsetf(std::ios::floatfield);
+	out.precision(7);
+
+	// the seed also selects the materials, but independent of the jitter
+	Random random(params.seed ^ 0x5bd1e995u);
+	const char* type = __Object::TypeStr[std::min(params.type, __Object::DOMINO_LARGE)];
+	for (unsigned i = 0; i < matrices.size(); ++i) {
+		std::string material = params.materials.empty() ? "" :
+				params.materials[random.next() % params.materials.size()];
+		out << "\t<object id=\"" << (i + 1) << "\" type=\"" << type << "\" matrix=\"";
+		writeMatrix(out, matrices[i]);
+		out << "\" freezeState=\"1\" damping=\"0.1, 0.1, 0.1, 0.1\" material=\"" << material << "\" mass=\"-1\"/>\n";
+	}
+
+	if (params.environment.empty()) {
+		// a static ground box, the world is large enough to contain it
+		float size = (extent + GROUND_MARGIN * 0.5f) * 2.0f;
+		Mat4f ground = Mat4f::translate(Vec3f(0.0f, -0.5f, 0.0f));
+		out << "\t<object id=\"0\" type=\"box\" matrix=\"";
+		writeMatrix(out, ground);
+		out << "\" width=\"" << size << "\" height=\"1\" depth=\"" << size
+			<< "\" freezeState=\"0\" damping=\"0.1, 0.1, 0.1, 0.1\" material=\"" << params.groundMaterial << "\" mass=\"0\"/>\n";
+	} else {
+		out << "\t<environment filename=\"" << params.environment << "\" octree=\"1\"/>\n";
+	}
+	out << "</level>\n";
+
+	if (!out)
+		throw std::runtime_error("Could not write level file " + fileName);
+
+	return matrices.size();
+}
+
+Generator::Layout Generator::getLayout(const std::string& name)
+{
+	for (int i = GRID; i <= HILBERT; ++i) {
+		if (name == LayoutStr[i])
+			return (Layout)i;
+	}
+	throw std::runtime_error("Unknown layout " + name);
+}
+
+}
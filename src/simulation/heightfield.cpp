@@ -0,0 +1,346 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/heightfield.cpp
+ */
+
+#include <util/config.hpp>
+#include <simulation/heightfield.hpp>
+#include <simulation/material.hpp>
+#include <util/tostring.hpp>
+#include "../opengl/stb_image.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+namespace sim {
+
+/** The number of pixels a cell should cover at least before a finer level is used */
+static const float LOD_PIXELS = 6.0f;
+
+/** The depth of the skirts relative to the distance between two samples */
+static const float SKIRT_DEPTH = 2.0f;
+
+/** The number of texture repetitions per sample */
+static const float UV_SCALE = 0.25f;
+
+/**
+ * Returns the grid position of the given vertex on the border of a chunk.
+ * The border is walked such that the skirt faces point outwards.
+ *
+ * @param p The position on the border, less than 4 * CHUNK_CELLS
+ * @param i The column within the chunk
+ * @param j The row within the chunk
+ */
+static void borderPosition(unsigned p, unsigned& i, unsigned& j)
+{
+	const unsigned c = __HeightField::CHUNK_CELLS;
+	const unsigned side = p / c, k = p % c;
+	switch (side) {
+	case 0: i = c - k; j = 0;     break;
+	case 1: i = 0;     j = k;     break;
+	case 2: i = k;     j = c;     break;
+	default: i = c;    j = c - k; break;
+	}
+}
+
+__HeightField::__HeightField(const Mat4f& matrix, const std::string& fileName, float scale, float height,
+		const std::string& material)
+	: __Object(HEIGHTFIELD), Body(matrix), m_fileName(fileName), m_material(material),
+	  m_scale(scale), m_height(height), m_width(0), m_depth(0), m_chunksX(0), m_chunksZ(0),
+	  m_vbo(0), m_ibo(0), m_useShadows(util::Config::instance().get("enableShadows", false))
+{
+	int channels;
+	unsigned char* data = stbi_load(fileName.c_str(), &m_width, &m_depth, &channels, 0);
+	if (!data)
+		throw std::runtime_error(fileName + " couldn't be loaded: " + stbi_failure_reason());
+
+	if (m_width < 2 || m_depth < 2) {
+		stbi_image_free(data);
+		throw std::runtime_error(fileName + " is too small for a height field");
+	}
+
+	// grey images repeat the byte, colored images carry the low byte in green
+	m_elevation.resize(m_width * m_depth);
+	for (int i = 0; i < m_width * m_depth; ++i) {
+		const unsigned char* pixel = &data[i * channels];
+		const unsigned char low = channels >= 3 ? pixel[1] : pixel[0];
+		m_elevation[i] = (unsigned short)((pixel[0] << 8) | low);
+	}
+	stbi_image_free(data);
+
+	// the bounding boxes of the chunks, relative to the first sample
+	m_chunksX = (m_width - 2) / CHUNK_CELLS + 1;
+	m_chunksZ = (m_depth - 2) / CHUNK_CELLS + 1;
+	m_chunks.resize(m_chunksX * m_chunksZ);
+	for (unsigned cz = 0; cz < m_chunksZ; ++cz) {
+		for (unsigned cx = 0; cx < m_chunksX; ++cx) {
+			Chunk& chunk = m_chunks[cz * m_chunksX + cx];
+			float low = m_height, high = 0.0f;
+			for (unsigned j = 0; j <= CHUNK_CELLS; ++j) {
+				for (unsigned i = 0; i <= CHUNK_CELLS; ++i) {
+					const float h = sample(cx * CHUNK_CELLS + i, cz * CHUNK_CELLS + j);
+					low = std::min(low, h);
+					high = std::max(high, h);
+				}
+			}
+			const float x0 = cx * CHUNK_CELLS * m_scale, z0 = cz * CHUNK_CELLS * m_scale;
+			const float x1 = std::min(cx * CHUNK_CELLS + CHUNK_CELLS, (unsigned)m_width - 1) * m_scale;
+			const float z1 = std::min(cz * CHUNK_CELLS + CHUNK_CELLS, (unsigned)m_depth - 1) * m_scale;
+			chunk.localMin = Vec3f(x0, low - SKIRT_DEPTH * m_scale, z0);
+			chunk.localMax = Vec3f(x1, high, z1);
+		}
+	}
+	updateChunks();
+
+	// the collision uses the material id as shape id, like the
+	// face attributes of the tree collision
+	std::vector<char> attributes(m_width * m_depth, 0);
+	NewtonCollision* collision = NewtonCreateHeightFieldCollision(newton::world, m_width, m_depth, 0,
+			&m_elevation[0], &attributes[0], m_scale, m_height / 65535.0f,
+			MaterialMgr::instance().getID(m_material));
+
+	this->create(collision, 0.0f);
+	NewtonReleaseCollision(newton::world, collision);
+}
+
+__HeightField::~__HeightField()
+{
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+	if (m_ibo) glDeleteBuffers(1, &m_ibo);
+}
+
+void __HeightField::createBuffers()
+{
+	const unsigned c = CHUNK_CELLS;
+	const unsigned grid = (c + 1) * (c + 1);
+
+	// the vertices of all chunks, T2F_N3F_V3F
+	std::vector<float> data;
+	data.reserve(m_chunks.size() * CHUNK_VERTICES * 8);
+	for (unsigned cz = 0; cz < m_chunksZ; ++cz) {
+		for (unsigned cx = 0; cx < m_chunksX; ++cx) {
+			for (unsigned v = 0; v < CHUNK_VERTICES; ++v) {
+				unsigned i, j;
+				float drop = 0.0f;
+				if (v < grid) {
+					i = v % (c + 1);
+					j = v / (c + 1);
+				} else {
+					borderPosition(v - grid, i, j);
+					drop = SKIRT_DEPTH * m_scale;
+				}
+
+				// samples beyond the map are clamped and give degenerate triangles
+				const int x = std::min(cx * c + i, (unsigned)m_width - 1);
+				const int z = std::min(cz * c + j, (unsigned)m_depth - 1);
+
+				Vec3f normal(sample(x - 1, z) - sample(x + 1, z), 2.0f * m_scale,
+						sample(x, z - 1) - sample(x, z + 1));
+				normal.normalize();
+
+				data.push_back(x * UV_SCALE);
+				data.push_back(z * UV_SCALE);
+				data.push_back(normal.x);
+				data.push_back(normal.y);
+				data.push_back(normal.z);
+				data.push_back(x * m_scale);
+				data.push_back(sample(x, z) - drop);
+				data.push_back(z * m_scale);
+			}
+		}
+	}
+
+	// the indices of a single chunk for every level, shared by all chunks
+	std::vector<GLushort> indices;
+	for (unsigned level = 0; level < LOD_LEVELS; ++level) {
+		const unsigned step = 1 << level;
+		m_lodOffset[level] = indices.size();
+		for (unsigned j = 0; j < c; j += step) {
+			for (unsigned i = 0; i < c; i += step) {
+				const GLushort v00 = j * (c + 1) + i, v10 = v00 + step;
+				const GLushort v01 = (j + step) * (c + 1) + i, v11 = v01 + step;
+				indices.push_back(v00); indices.push_back(v01); indices.push_back(v10);
+				indices.push_back(v10); indices.push_back(v01); indices.push_back(v11);
+			}
+		}
+
+		// the skirt connects the border with the dropped copy of the border
+		for (unsigned p = 0; p < 4 * c; p += step) {
+			const unsigned q = (p + step) % (4 * c);
+			unsigned ai, aj, bi, bj;
+			borderPosition(p, ai, aj);
+			borderPosition(q, bi, bj);
+			const GLushort a = aj * (c + 1) + ai, b = bj * (c + 1) + bi;
+			const GLushort as = grid + p, bs = grid + q;
+			indices.push_back(a); indices.push_back(as); indices.push_back(b);
+			indices.push_back(b); indices.push_back(as); indices.push_back(bs);
+		}
+		m_lodCount[level] = indices.size() - m_lodOffset[level];
+	}
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+}
+
+void __HeightField::updateChunks()
+{
+	// the box around a rotated box, see "Transforming Axis-Aligned
+	// Bounding Boxes" by Jim Arvo in Graphics Gems
+	const Mat4f& m = getMatrix();
+	for (std::vector<Chunk>::iterator itr = m_chunks.begin(); itr != m_chunks.end(); ++itr) {
+		const Vec3f center = (itr->localMin + itr->localMax) * 0.5f * m;
+		const Vec3f e = (itr->localMax - itr->localMin) * 0.5f;
+		const Vec3f extent(fabsf(m._11) * e.x + fabsf(m._21) * e.y + fabsf(m._31) * e.z,
+				fabsf(m._12) * e.x + fabsf(m._22) * e.y + fabsf(m._32) * e.z,
+				fabsf(m._13) * e.x + fabsf(m._23) * e.y + fabsf(m._33) * e.z);
+		itr->min = center - extent;
+		itr->max = center + extent;
+	}
+}
+
+void __HeightField::setMatrix(const Mat4f& matrix)
+{
+	Body::setMatrix(matrix);
+	updateChunks();
+}
+
+bool __HeightField::contains(const NewtonBody* const body)
+{
+	return m_body == body;
+}
+
+bool __HeightField::contains(const __Object* object)
+{
+	return object == this;
+}
+
+void __HeightField::getBodies(std::vector<Body*>& bodies)
+{
+	bodies.push_back(this);
+}
+
+void __HeightField::genBuffers(ogl::VertexBuffer&)
+{
+	// the terrain is drawn by render(), which selects the chunks
+	// and their levels of detail in every frame
+}
+
+void __HeightField::render(const ogl::Camera& camera)
+{
+	if (!m_vbo)
+		createBuffers();
+
+	const float pixelScale = camera.pixelScale();
+
+	const GLsizei stride = 8 * sizeof(float);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+
+	MaterialMgr::instance().applyMaterial(m_material, m_useShadows);
+
+	glPushMatrix();
+	glMultMatrixf(getMatrix()[0]);
+	for (unsigned k = 0; k < m_chunks.size(); ++k) {
+		const Chunk& chunk = m_chunks[k];
+		if (camera.testAABB(chunk.min, chunk.max) == ogl::Camera::OUTSIDE)
+			continue;
+
+		// use the coarsest level whose cells are still large enough on the screen
+		const float distance = std::max((camera.m_position - (chunk.min + chunk.max) * 0.5f).len(), 1.0f);
+		const float cellPixels = m_scale * pixelScale / distance;
+		unsigned level = 0;
+		while (level + 1 < LOD_LEVELS && cellPixels * (2 << level) < LOD_PIXELS)
+			++level;
+
+		const char* base = (const char*)0 + k * CHUNK_VERTICES * stride;
+		glTexCoordPointer(2, GL_FLOAT, stride, base);
+		glNormalPointer(GL_FLOAT, stride, base + 2 * sizeof(float));
+		glVertexPointer(3, GL_FLOAT, stride, base + 5 * sizeof(float));
+		glDrawElements(GL_TRIANGLES, m_lodCount[level], GL_UNSIGNED_SHORT,
+				(void*)(m_lodOffset[level] * sizeof(GLushort)));
+	}
+	glPopMatrix();
+
+	ogl::VertexBuffer::unbind();
+}
+
+unsigned __HeightField::getMemoryUsage() const
+{
+	return m_elevation.capacity() * sizeof(unsigned short) + m_chunks.capacity() * sizeof(Chunk);
+}
+
+void __HeightField::save(__HeightField& object, rapidxml::xml_node<>* parent, rapidxml::xml_document<>* doc)
+{
+	using namespace rapidxml;
+
+	xml_node<>* node = doc->allocate_node(node_element, "environment");
+	parent->insert_node(0, node);
+
+	char* pValue = doc->allocate_string(TypeStr[HEIGHTFIELD]);
+	node->append_attribute(doc->allocate_attribute("type", pValue));
+
+	pValue = doc->allocate_string(object.m_fileName.c_str());
+	node->append_attribute(doc->allocate_attribute("filename", pValue));
+
+	// height fields do not use an octree
+	pValue = doc->allocate_string("0");
+	node->append_attribute(doc->allocate_attribute("octree", pValue));
+
+	pValue = doc->allocate_string(util::toString(object.m_scale));
+	node->append_attribute(doc->allocate_attribute("scale", pValue));
+
+	pValue = doc->allocate_string(util::toString(object.m_height));
+	node->append_attribute(doc->allocate_attribute("height", pValue));
+
+	pValue = doc->allocate_string(object.m_material.c_str());
+	node->append_attribute(doc->allocate_attribute("material", pValue));
+
+	pValue = doc->allocate_string(util::toString(object.getMatrix()));
+	node->append_attribute(doc->allocate_attribute("matrix", pValue));
+}
+
+HeightField __HeightField::load(rapidxml::xml_node<>* node)
+{
+	using namespace rapidxml;
+
+	xml_attribute<>* attr = node->first_attribute("filename");
+	if (!attr)
+		throw parse_error("No \"filename\" attribute in environment tag found", node->name());
+	std::string fileName = attr->value();
+
+	attr = node->first_attribute("scale");
+	if (!attr)
+		throw parse_error("No \"scale\" attribute in environment tag found", node->name());
+	float scale = atof(attr->value());
+
+	attr = node->first_attribute("height");
+	if (!attr)
+		throw parse_error("No \"height\" attribute in environment tag found", node->name());
+	float height = atof(attr->value());
+
+	// optional attributes
+	attr = node->first_attribute("material");
+	std::string material = attr ? attr->value() : "yellow";
+
+	Mat4f matrix = Mat4f::identity();
+	attr = node->first_attribute("matrix");
+	if (attr)
+		matrix.assign(attr->value());
+
+	if (scale <= 0.0f)
+		throw parse_error("The \"scale\" attribute of the environment has to be positive", node->name());
+
+	return HeightField(new __HeightField(matrix, fileName, scale, height, material));
+}
+
+}
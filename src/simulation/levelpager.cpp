@@ -0,0 +1,289 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/levelpager.cpp
+ */
+
+#include <simulation/levelpager.hpp>
+#include <simulation/treecollision.hpp>
+#include <simulation/heightfield.hpp>
+#include <xml/rapidxml_print.hpp>
+#include <util/config.hpp>
+#include <util/tostring.hpp>
+#include <iterator>
+#include <cmath>
+
+namespace sim {
+
+/**
+ * Prints the children of the given node.
+ *
+ * @param node   The parent node
+ * @param result The text of the children
+ */
+static void printChildren(rapidxml::xml_node<>* node, std::string& result)
+{
+	result.clear();
+	for (rapidxml::xml_node<>* child = node->first_node(); child; child = child->next_sibling())
+		rapidxml::print(std::back_inserter(result), *child, rapidxml::print_no_indenting);
+}
+
+/**
+ * Parses the given text and copies its nodes to the given parent.
+ *
+ * @param text   Nodes printed by printChildren()
+ * @param parent The parent of the copies
+ * @param doc    The document of the parent
+ */
+static void copyChildren(const std::string& text, rapidxml::xml_node<>* parent, rapidxml::xml_document<>* doc)
+{
+	if (text.empty())
+		return;
+
+	// the copies point into the buffer, so it has to live in the document
+	char* buffer = doc->allocate_string(text.c_str(), text.size() + 1);
+	rapidxml::xml_document<> fragment;
+	fragment.parse<0>(buffer);
+	for (rapidxml::xml_node<>* child = fragment.first_node(); child; child = child->next_sibling())
+		parent->append_node(doc->clone_node(child));
+}
+
+/**
+ * Creates an environment object from the given node.
+ *
+ * @param node The <environment> node
+ * @return     The environment
+ * @throws rapidxml::parse_error Attribute not found
+ */
+static Object loadEnvironment(rapidxml::xml_node<>* node)
+{
+	rapidxml::xml_attribute<>* type = node->first_attribute("type");
+	if (type && std::string(type->value()) == __Object::TypeStr[__Object::HEIGHTFIELD])
+		return __HeightField::load(node);
+	return __TreeCollision::load(node);
+}
+
+LevelPager::LevelPager()
+	: m_cellSize(0.0f)
+{
+	m_loadDistance = util::Config::instance().get("pagingLoadDistance", 1.0f);
+	m_unloadDistance = util::Config::instance().get("pagingUnloadDistance", 2.0f);
+	if (m_unloadDistance < m_loadDistance)
+		m_unloadDistance = m_loadDistance;
+}
+
+void LevelPager::clear()
+{
+	m_cells.clear();
+	m_cellSize = 0.0f;
+}
+
+void LevelPager::setCellSize(float cellSize)
+{
+	m_cellSize = cellSize;
+}
+
+LevelPager::Key LevelPager::getKey(const Vec3f& point) const
+{
+	return Key((int)floorf(point.x / m_cellSize), (int)floorf(point.z / m_cellSize));
+}
+
+float LevelPager::distance2(const Key& key, const Vec3f& point) const
+{
+	const float x0 = key.first * m_cellSize, z0 = key.second * m_cellSize;
+	const float dx = point.x < x0 ? x0 - point.x : std::max(0.0f, point.x - (x0 + m_cellSize));
+	const float dz = point.z < z0 ? z0 - point.z : std::max(0.0f, point.z - (z0 + m_cellSize));
+	return dx * dx + dz * dz;
+}
+
+bool LevelPager::getBounds(Vec3f& min, Vec3f& max) const
+{
+	if (m_cells.empty())
+		return false;
+
+	Key low = m_cells.begin()->first, high = low;
+	for (Cells::const_iterator itr = m_cells.begin(); itr != m_cells.end(); ++itr) {
+		low.first = std::min(low.first, itr->first.first);
+		low.second = std::min(low.second, itr->first.second);
+		high.first = std::max(high.first, itr->first.first);
+		high.second = std::max(high.second, itr->first.second);
+	}
+	min = Vec3f(low.first * m_cellSize, 0.0f, low.second * m_cellSize);
+	max = Vec3f((high.first + 1) * m_cellSize, 0.0f, (high.second + 1) * m_cellSize);
+	return true;
+}
+
+int LevelPager::addCell(rapidxml::xml_node<>* node)
+{
+	using namespace rapidxml;
+
+	xml_attribute<>* x = node->first_attribute("x");
+	xml_attribute<>* z = node->first_attribute("z");
+	if (!x || !z)
+		throw parse_error("No \"x\" or \"z\" attribute in cell tag found", node->name());
+
+	Cell& cell = m_cells[Key(atoi(x->value()), atoi(z->value()))];
+
+	// keep the environment apart, because it is not saved with the objects
+	int maxID = -1;
+	std::string text;
+	for (xml_node<>* child = node->first_node(); child; child = child->next_sibling()) {
+		text.clear();
+		print(std::back_inserter(text), *child, print_no_indenting);
+		if (std::string(child->name()) == "environment") {
+			cell.environment += text;
+		} else {
+			cell.objects += text;
+			if (xml_attribute<>* id = child->first_attribute("id"))
+				maxID = std::max(maxID, atoi(id->value()));
+		}
+	}
+	return maxID;
+}
+
+void LevelPager::getCellsToLoad(const std::vector<Vec3f>& points, Keys& result) const
+{
+	const float distance = m_loadDistance * m_cellSize;
+	for (Cells::const_iterator itr = m_cells.begin(); itr != m_cells.end(); ++itr) {
+		if (itr->second.loaded)
+			continue;
+		for (std::vector<Vec3f>::const_iterator p = points.begin(); p != points.end(); ++p) {
+			if (distance2(itr->first, *p) <= distance * distance) {
+				result.push_back(itr->first);
+				break;
+			}
+		}
+	}
+}
+
+bool LevelPager::isFar(const Key& key, const std::vector<Vec3f>& points) const
+{
+	const float distance = m_unloadDistance * m_cellSize;
+	for (std::vector<Vec3f>::const_iterator p = points.begin(); p != points.end(); ++p) {
+		if (distance2(key, *p) <= distance * distance)
+			return false;
+	}
+	return true;
+}
+
+void LevelPager::getCellsToUnload(const std::vector<Vec3f>& points, Keys& result) const
+{
+	// the active bodies are among the points, so cells with
+	// active bodies are never far
+	for (Cells::const_iterator itr = m_cells.begin(); itr != m_cells.end(); ++itr) {
+		if (itr->second.loaded && isFar(itr->first, points))
+			result.push_back(itr->first);
+	}
+}
+
+void LevelPager::load(const Key& key, std::list<Object>& objects)
+{
+	using namespace rapidxml;
+
+	Cell& cell = m_cells[key];
+	if (cell.loaded)
+		return;
+
+	// rapidxml parses in place
+	std::string text = cell.objects + cell.environment;
+	std::vector<char> buffer(text.begin(), text.end());
+	buffer.push_back('\0');
+
+	xml_document<> doc;
+	doc.parse<0>(&buffer[0]);
+	for (xml_node<>* node = doc.first_node(); node; node = node->next_sibling()) {
+		std::string type(node->name());
+		if (type == "object" || type == "compound") {
+			Object object = __Object::load(node);
+			object->setID(atoi(node->first_attribute("id")->value()));
+			objects.push_back(object);
+		} else if (type == "environment") {
+			cell.environments.push_back(loadEnvironment(node));
+		}
+	}
+
+	cell.objects.clear();
+	cell.loaded = true;
+}
+
+void LevelPager::unload(const Key& key, const std::list<Object>& objects)
+{
+	using namespace rapidxml;
+
+	Cell& cell = m_cells[key];
+
+	xml_document<> doc;
+	xml_node<>* parent = doc.allocate_node(node_element, "cell");
+	doc.append_node(parent);
+	for (std::list<Object>::const_iterator itr = objects.begin(); itr != objects.end(); ++itr)
+		__Object::save(*itr->get(), parent, &doc);
+
+	// objects that moved into an unloaded cell are added to its objects
+	std::string text;
+	printChildren(parent, text);
+	if (cell.loaded)
+		cell.objects = text;
+	else
+		cell.objects += text;
+
+	cell.environments.clear();
+	cell.loaded = false;
+}
+
+bool LevelPager::isLoaded(const Key& key) const
+{
+	Cells::const_iterator itr = m_cells.find(key);
+	return itr != m_cells.end() && itr->second.loaded;
+}
+
+void LevelPager::save(const std::list<Object>& objects, rapidxml::xml_node<>* level, rapidxml::xml_document<>* doc) const
+{
+	using namespace rapidxml;
+
+	level->append_attribute(doc->allocate_attribute("cellsize", doc->allocate_string(util::toString(m_cellSize))));
+
+	// group the loaded objects by the cells they are in now
+	std::map<Key, xml_node<>*> nodes;
+	for (Cells::const_iterator itr = m_cells.begin(); itr != m_cells.end(); ++itr) {
+		xml_node<>* node = doc->allocate_node(node_element, "cell");
+		node->append_attribute(doc->allocate_attribute("x", doc->allocate_string(util::toString(itr->first.first))));
+		node->append_attribute(doc->allocate_attribute("z", doc->allocate_string(util::toString(itr->first.second))));
+		level->append_node(node);
+		nodes[itr->first] = node;
+
+		if (!itr->second.loaded)
+			copyChildren(itr->second.objects, node, doc);
+		copyChildren(itr->second.environment, node, doc);
+	}
+
+	for (std::list<Object>::const_iterator itr = objects.begin(); itr != objects.end(); ++itr) {
+		const Key key = getKey((*itr)->getMatrix().getW());
+		std::map<Key, xml_node<>*>::iterator node = nodes.find(key);
+		if (node == nodes.end()) {
+			node = nodes.insert(std::make_pair(key, doc->allocate_node(node_element, "cell"))).first;
+			node->second->append_attribute(doc->allocate_attribute("x", doc->allocate_string(util::toString(key.first))));
+			node->second->append_attribute(doc->allocate_attribute("z", doc->allocate_string(util::toString(key.second))));
+			level->append_node(node->second);
+		}
+		__Object::save(*itr->get(), node->second, doc);
+	}
+}
+
+void LevelPager::render(const ogl::Camera& camera)
+{
+	for (Cells::iterator itr = m_cells.begin(); itr != m_cells.end(); ++itr) {
+		std::list<Object>& environments = itr->second.environments;
+		for (std::list<Object>::iterator env = environments.begin(); env != environments.end(); ++env)
+			(*env)->render(camera);
+	}
+}
+
+unsigned LevelPager::getLoadedCount() const
+{
+	unsigned result = 0;
+	for (Cells::const_iterator itr = m_cells.begin(); itr != m_cells.end(); ++itr)
+		result += itr->second.loaded;
+	return result;
+}
+
+}
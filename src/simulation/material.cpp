@@ -7,8 +7,11 @@
 #include <simulation/material.hpp>
 #include <opengl/texture.hpp>
 #include <opengl/shader.hpp>
+#include <opengl/transformbuffer.hpp>
+#include <opengl/renderstate.hpp>
 #include <GL/glew.h>
 #include <limits.h>
+#include <algorithm>
 #include <boost/functional/hash.hpp>
 #include <Newton.h>
 #include <xml/rapidxml_utils.hpp>
@@ -17,6 +20,7 @@
 #include <string.h>
 #include <util/tostring.hpp>
 #include <util/erroradapters.hpp>
+#include <util/profiler.hpp>
 #include <clocale>
 #include <sound/soundmgr.hpp>
 #include <simulation/simulation.hpp>
@@ -293,7 +297,18 @@ void MaterialPair::save(rapidxml::xml_node<>* materials, rapidxml::xml_document<
 
 
 
+RenderMaterial::RenderMaterial()
+	: material(NULL),
+	  texture0Location(-1), texture1Location(-1),
+	  shadowMapLocation(-1), shadowTexelLocation(-1), transformsLocation(-1),
+	  generation(~0u), textureGeneration(~0u), shaderGeneration(~0u)
+{
+}
+
+
+
 MaterialMgr::MaterialMgr()
+	: m_generation(0)
 {
 	clear(true);
 }
@@ -322,45 +337,39 @@ int MaterialMgr::getMaterials(std::set<std::string>& materials)
 	return m_materials.size();
 }
 
-void MaterialMgr::applyMaterial(const std::string& material, bool useShadows) {
-	const Material* const _mat = get(material);
-	/// @todo only switch shader/texture if necessary
-	if (_mat != NULL) {
-		const Material& mat = *_mat;
-		ogl::Texture texture = ogl::TextureMgr::instance().get(mat.texture);
-		ogl::Texture texture1 = ogl::TextureMgr::instance().get(mat.texture1);
+void MaterialMgr::applyMaterial(const std::string& material, bool useShadows)
+{
+	applyMaterial(ogl::SubBuffer::materialID(material), useShadows);
+}
 
-		if (texture) {
+void MaterialMgr::applyMaterial(int id, bool useShadows)
+{
+	const RenderMaterial& record = getRenderMaterial(id);
+	// the render state filters all changes that are not necessary
+	if (record.material != NULL) {
+		const Material& mat = *record.material;
+		ogl::RenderState& state = ogl::RenderState::instance();
+
+		// bind the second unit first, so that the first unit stays active
+		state.bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, record.texture1 ? record.texture1->m_textureID : 0);
+		state.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, record.texture ? record.texture->m_textureID : 0);
+		if (record.texture || record.texture1)
 			glEnable(GL_TEXTURE_2D);
-			texture->bind();
-		} else {
-			glBindTexture(GL_TEXTURE_2D, 0);
-		}
 
-		if (texture1) {
-			glEnable(GL_TEXTURE_2D);
-			glActiveTexture(GL_TEXTURE1);
-			texture1->bind();
-			glActiveTexture(GL_TEXTURE0);
-		} else {
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, 0);
-			glActiveTexture(GL_TEXTURE0);
-		}
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, &mat.diffuse[0]);
-		glMaterialfv(GL_FRONT, GL_AMBIENT, &mat.ambient[0]);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, &mat.specular[0]);
-		glMaterialf(GL_FRONT, GL_SHININESS, mat.shininess);
+		state.material(GL_DIFFUSE, &mat.diffuse[0]);
+		state.material(GL_AMBIENT, &mat.ambient[0]);
+		state.material(GL_SPECULAR, &mat.specular[0]);
+		state.shininess(mat.shininess);
 
-		ogl::Shader shader = ogl::ShaderMgr::instance().get(mat.shader);
-		if (shader) {
-			shader->bind();
-			shader->setUniform1i("Texture0", 0);
-			shader->setUniform1i("Texture1", 1);
+		if (record.shader) {
+			record.shader->bind();
+			state.uniform1i(record.texture0Location, 0);
+			state.uniform1i(record.texture1Location, 1);
+			state.uniform1i(record.transformsLocation, ogl::TransformBuffer::UNIT - GL_TEXTURE0);
 
 			if (useShadows) {
-				shader->setUniform1i("ShadowMap", 7);
-				shader->setUniform1f("shadowTexel", 1.0 / SHADOW_MAP_SIZE);
+				state.uniform1i(record.shadowMapLocation, 7);
+				state.uniform1f(record.shadowTexelLocation, 1.0 / SHADOW_MAP_SIZE);
 			}
 		} else {
 			ogl::__Shader::unbind();
@@ -373,8 +382,48 @@ void MaterialMgr::applyMaterial(const std::string& material, bool useShadows) {
 	}
 }
 
+const RenderMaterial& MaterialMgr::getRenderMaterial(int id)
+{
+	if (id < 0)
+		id = 0;
+	if ((unsigned)id >= m_renderMaterials.size())
+		m_renderMaterials.resize(std::max((unsigned)id + 1, ogl::SubBuffer::materialCount()));
+
+	RenderMaterial& record = m_renderMaterials[id];
+	if (record.generation != m_generation ||
+			record.textureGeneration != ogl::TextureMgr::instance().getGeneration() ||
+			record.shaderGeneration != ogl::ShaderMgr::instance().getGeneration())
+		compile(ogl::SubBuffer::materialName(id), record);
+	return record;
+}
+
+void MaterialMgr::compile(const std::string& name, RenderMaterial& record)
+{
+	record = RenderMaterial();
+	record.material = get(name);
+	if (record.material) {
+		const Material& mat = *record.material;
+		record.texture = ogl::TextureMgr::instance().get(mat.texture);
+		record.texture1 = ogl::TextureMgr::instance().get(mat.texture1);
+		record.shader = ogl::ShaderMgr::instance().get(mat.shader);
+		if (record.shader) {
+			record.texture0Location = record.shader->getUniformLocation("Texture0");
+			record.texture1Location = record.shader->getUniformLocation("Texture1");
+			record.shadowMapLocation = record.shader->getUniformLocation("ShadowMap");
+			record.shadowTexelLocation = record.shader->getUniformLocation("shadowTexel");
+			record.transformsLocation = record.shader->getUniformLocation(ogl::TransformBuffer::SAMPLER_NAME);
+		}
+	}
+
+	// get() might have registered new textures
+	record.generation = m_generation;
+	record.textureGeneration = ogl::TextureMgr::instance().getGeneration();
+	record.shaderGeneration = ogl::ShaderMgr::instance().getGeneration();
+}
+
 std::string MaterialMgr::add(const Material& mat)
 {
+	m_generation++;
 	m_materials.insert(std::make_pair(mat.name, mat));
 	return mat.name;
 }
@@ -393,6 +442,7 @@ void MaterialMgr::remove(const std::string& name)
 			++it;
 	}
 	m_materials.erase(name);
+	m_generation++;
 }
 
 
@@ -401,6 +451,7 @@ void MaterialMgr::clear(bool addDefault)
 {
 	m_pairs.clear();
 	m_materials.clear();
+	m_generation++;
 	if (addDefault) {
 		MaterialPair pair;
 		m_pairs[std::make_pair(0, 0)] = pair;
@@ -602,6 +653,9 @@ MaterialPair& MaterialMgr::getPair(int mat0, int mat1)
 
 void MaterialMgr::processContact(const NewtonJoint* contactJoint, float timestep, int threadIndex)
 {
+	PROFILE_SCOPE_THREAD("processContact", threadIndex);
+	PROFILE_COUNT("contacts", 1);
+
 	Vec3f contactPos, contactNormal;
 	float bestNormalSpeed = 6.7f;
 	std::string bestSound = "";
@@ -673,7 +727,8 @@ void MaterialMgr::processContact(const NewtonJoint* contactJoint, float timestep
 	*/
 	}
 
-	if (bestSound.size()) {
+	// headless worlds run without a simulation, and nobody listens
+	if (bestSound.size() && !World::fromNewton(NewtonBodyGetWorld(body0))->isHeadless()) {
 		Vec3f distance(Simulation::instance().getCamera().m_position - contactPos);
 		float dist2 = distance * distance;
 		if (dist2 < (MAX_SOUND_DISTANCE * MAX_SOUND_DISTANCE)) {
@@ -8,6 +8,7 @@
 #include <simulation/compound.hpp>
 #include <simulation/material.hpp>
 #include <simulation/domino.hpp>
+#include <simulation/world.hpp>
 #include <newton/util.hpp>
 #include <iostream>
 #include <lib3ds/file.h>
@@ -17,6 +18,8 @@
 #include <stdio.h>
 #include <util/tostring.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <stdexcept>
 
 namespace sim {
 
@@ -29,35 +32,35 @@ const char* __Object::TypeStr[] = {
 	"box", "sphere", "cylinder",
 	"capsule", "cone", "chamfercylinder",
 	"hull", "assembly", "compound",
-	"environment"
+	"environment", "heightfield"
 };
 const char* __Object::TypeName[] = {
 		"Domino (small)", "Domino (middle)", "Domino (large)",
 		"Box", "Sphere", "Cylinder",
 		"Capsule", "Cone", "Chamfer Cylinder",
 		"Hull", "Assembly", "Compound",
-		"Environment"
+		"Environment", "Heightfield"
 	};
 const float __Object::TypeMass[] = {
 		-1.0f, -1.0f, -1.0f,
 		-1.0f, -1.0f, -1.0f,
 		-1.0f, -1.0f, -1.0f,
 		-1.0f, -1.0f, -1.0f,
-		-1.0f
+		-1.0f, -1.0f
 	};
 const bool __Object::TypeFreezeState[] = {
 		true, true, true,
 		false, false, false,
 		false, false, false,
 		false, false, false,
-		false
+		false, false
 	};
 const Vec3f __Object::TypeSize[] = {
 		Vec3f(), Vec3f(), Vec3f(),
 		Vec3f(1.0f, 1.0f, 1.0f), Vec3f(1.0f, 1.0f, 1.0f), Vec3f(1.0f, 2.0f, 1.0f),
 		Vec3f(1.0f, 6.0f, 1.0f), Vec3f(1.0f, 2.0f, 1.0f), Vec3f(5.0f, 1.0f, 1.0f),
 		Vec3f(), Vec3f(), Vec3f(),
-		Vec3f()
+		Vec3f(), Vec3f()
 	};
 
 __Object::__Object(Type type)
@@ -318,10 +321,10 @@ __RigidBody::__RigidBody(Type type, NewtonBody* body, const Mat4f& matrix, const
 {
 }
 
-float __RigidBody::convexCastPlacement(bool apply, std::list<NewtonBody*>* noCollision)
+float __RigidBody::convexCastPlacement(bool apply, const newton::BodySet* exclude)
 {
-	float vertical = newton::getConvexCastPlacement(m_body, noCollision);
-	Mat4f matrix = m_matrix;
+	float vertical = newton::getConvexCastPlacement(m_body, exclude);
+	Mat4f matrix = *m_matrix;
 	matrix._42 = vertical + 0.0001f;
 	if (apply)
 		setMatrix(matrix);
@@ -750,8 +753,9 @@ void __RigidBody::genBuffers(ogl::VertexBuffer& vbo)
 
 		// create a new submesh
 		ogl::SubBuffer* subBuffer = new ogl::SubBuffer();
-		subBuffer->material = m_material;
+		subBuffer->material = ogl::SubBuffer::materialID(m_material);
 		subBuffer->userData = this;
+		subBuffer->transform = m_slot;
 
 		subBuffer->dataCount = vertexCount;
 		subBuffer->dataOffset = vertexOffset;
@@ -787,15 +791,25 @@ bool __RigidBody::contains(const __Object* object)
 	return false;
 }
 
-void __RigidBody::render()
+void __RigidBody::getBodies(std::vector<Body*>& bodies)
+{
+	bodies.push_back(this);
+}
+
+void __RigidBody::render(const ogl::Camera& camera)
 {
 	if (NewtonBodyGetSleepState(m_body))
 		glColor3f(1.0f, 1.0f, 0.0f);
 	else
 		glColor3f(1.0f, 0.0f, 0.0f);
-	newton::showCollisionShape(getCollision(), m_matrix);
+	newton::showCollisionShape(getCollision(), *m_matrix);
 }
 
+std::map<std::string, ogl::Mesh> __Convex::s_meshes;
+
+/** Guards the model cache, the worlds of other threads load models too */
+static boost::mutex s_meshMutex;
+
 __Convex::__Convex(Type type, const Mat4f& matrix, float mass, const std::string& material,
 		const std::string& fileName, int freezeState, const Vec4f& damping)
 	: __RigidBody(type, matrix, material, freezeState, damping), m_fileName(fileName)
@@ -806,21 +820,45 @@ __Convex::~__Convex()
 {
 }
 
+ogl::Mesh __Convex::getMesh(const std::string& fileName, ogl::SubBuffers* originalMeshes)
+{
+	boost::mutex::scoped_lock lock(s_meshMutex);
+	std::map<std::string, ogl::Mesh>::iterator itr = s_meshes.find(fileName);
+	if (itr != s_meshes.end() && !originalMeshes)
+		return itr->second;
+
+	// the userData is set per object in genBuffers()
+	ogl::Mesh mesh = ogl::__Mesh::load3ds(fileName, NULL, originalMeshes);
+	if (itr == s_meshes.end() && mesh)
+		s_meshes[fileName] = mesh;
+	return itr != s_meshes.end() ? itr->second : mesh;
+}
+
+void __Convex::freeMeshes()
+{
+	boost::mutex::scoped_lock lock(s_meshMutex);
+	s_meshes.clear();
+}
+
 Convex __Convex::createHull(const Mat4f& matrix, float mass, const std::string& material,
 		const std::string& fileName, int freezeState, const Vec4f& damping)
 {
 	Convex result(new __Convex(CONVEX_HULL, matrix, mass, material, fileName, freezeState, damping));
 
 	// load the visual
-	ogl::Mesh visual = ogl::__Mesh::load3ds(fileName, result.get());
-
-	int materialID = MaterialMgr::instance().getID(material);
-
-	// create a hull from the visual
-	NewtonCollision* collision = NewtonCreateConvexHull(newton::world, visual->vertexCount(),
-			visual->firstVertex(), visual->byteSize(), 0.002f, materialID, NULL);
+	ogl::Mesh visual = getMesh(fileName);
+	if (!visual)
+		throw std::runtime_error("Could not load model file " + fileName);
+
+	// create a hull from the visual, or use the cached one
+	std::string key = std::string(TypeStr[CONVEX_HULL]) + "|" + material + "|" + fileName;
+	NewtonCollision*& collision = World::current()->getCollision(key);
+	if (!collision) {
+		int materialID = MaterialMgr::instance().getID(material);
+		collision = NewtonCreateConvexHull(newton::world, visual->vertexCount(),
+				visual->firstVertex(), visual->byteSize(), 0.002f, materialID, NULL);
+	}
 	result->create(collision, mass, freezeState, damping);
-	NewtonReleaseCollision(newton::world, collision);
 
 	result->m_visual = visual;
 
@@ -832,9 +870,22 @@ Convex __Convex::createAssembly(const Mat4f& matrix, float mass, const std::stri
 {
 	Convex result(new __Convex(CONVEX_ASSEMBLY, matrix, mass, material, fileName, freezeState, damping));
 
+	std::string key = std::string(TypeStr[CONVEX_ASSEMBLY]) + "|" + material + "|" + fileName;
+	NewtonCollision*& collision = World::current()->getCollision(key);
+
+	if (collision) {
+		result->m_visual = getMesh(fileName);
+		result->create(collision, mass, freezeState, damping);
+		return result;
+	}
+
 	// load the visual entity and preserve the original sub-meshes
 	ogl::SubBuffers buffers;
-	ogl::Mesh visual = ogl::__Mesh::load3ds(fileName, result.get(), &buffers);
+	ogl::Mesh visual = getMesh(fileName, &buffers);
+	if (!visual) {
+		World::current()->eraseCollision(key);
+		throw std::runtime_error("Could not load model file " + fileName);
+	}
 
 	int defaultMaterial = MaterialMgr::instance().getID(material);
 
@@ -842,18 +893,16 @@ Convex __Convex::createAssembly(const Mat4f& matrix, float mass, const std::stri
 	std::vector<NewtonCollision*> collisions;
 	//BOOST_FOREACH(ogl::SubBuffer* buf, buffers) {
 	for (ogl::SubBuffers::iterator itr = buffers.begin(); itr != buffers.end(); ++itr) {
-		int meshMaterial = MaterialMgr::instance().getID((*itr)->material);
+		int meshMaterial = MaterialMgr::instance().getID(ogl::SubBuffer::materialName((*itr)->material));
 		const float* data = visual->firstVertex() + (*itr)->dataOffset * visual->floatSize();
 		collisions.push_back(NewtonCreateConvexHull(newton::world, (*itr)->dataCount, data, visual->byteSize(), 0.002f, meshMaterial, NULL));
 		delete *itr;
 	}
 
-	// create a compound from all hulls
-	NewtonCollision* collision = NewtonCreateCompoundCollision(newton::world, collisions.size(), &collisions[0], defaultMaterial);
+	// create a compound from all hulls, the cache keeps the reference
+	collision = NewtonCreateCompoundCollision(newton::world, collisions.size(), &collisions[0], defaultMaterial);
 	result->create(collision, mass, freezeState, damping);
 
-	NewtonReleaseCollision(newton::world, collision);
-
 	//BOOST_FOREACH(NewtonCollision* hull, collisions)
 	for (std::vector<NewtonCollision*>::iterator itr = collisions.begin(); itr != collisions.end(); ++itr)
 		NewtonReleaseCollision(newton::world, *itr);
@@ -865,7 +914,8 @@ Convex __Convex::createAssembly(const Mat4f& matrix, float mass, const std::stri
 
 void __Convex::genBuffers(ogl::VertexBuffer& vbo)
 {
-	m_visual->genBuffers(vbo);
+	// the mesh is shared, so the sub-buffers have to reference this object
+	m_visual->genBuffers(vbo, this, m_slot);
 }
 
 
@@ -0,0 +1,477 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/replay.cpp
+ */
+
+#include <simulation/replay.hpp>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+namespace sim {
+
+/** The first bytes of a replay file */
+static const char REPLAY_MAGIC[4] = { 'D', 'R', 'P', 'L' };
+static const uint32_t REPLAY_VERSION = 1;
+
+static const float SQRT2 = 1.41421356f;
+
+/** Appends the value with 7 bits per byte, small values need a single byte */
+static inline void writeVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+	while (value >= 0x80) {
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+/**
+ * Reads a value written by writeVarint().
+ *
+ * @param data  The position of the value, moved behind it
+ * @param end   The end of the data
+ * @param value The value
+ * @return      False, if the value is truncated or too large
+ */
+static inline bool readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+{
+	value = 0;
+	for (unsigned shift = 0; data < end && shift < 35; shift += 7) {
+		const uint8_t byte = *data++;
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+/** Maps signed to unsigned values, so that small differences stay small */
+static inline uint32_t zigzag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+Replay::Transform::Transform()
+	: largest(0)
+{
+	position[0] = position[1] = position[2] = 0;
+	rotation[0] = rotation[1] = rotation[2] = 0;
+}
+
+/**
+ * Checks that a frame written by Replay::record() fills the given range.
+ *
+ * @param data   The first byte of the frame
+ * @param end    The first byte behind the frame
+ * @param bodies The number of bodies
+ * @return       False, if the frame is truncated, too long or refers to unknown bodies
+ */
+static bool checkFrame(const uint8_t* data, const uint8_t* end, uint32_t bodies)
+{
+	uint32_t count, value;
+	if (!readVarint(data, end, count))
+		return false;
+
+	int64_t last = -1;
+	for (uint32_t n = 0; n < count; ++n) {
+		if (!readVarint(data, end, value) || (last += (int64_t)value + 1) >= bodies)
+			return false;
+		for (int k = 0; k < 3; ++k) {
+			if (!readVarint(data, end, value))
+				return false;
+		}
+		if (data == end || *data++ > 3)
+			return false;
+		for (int k = 0; k < 3; ++k) {
+			if (!readVarint(data, end, value))
+				return false;
+		}
+	}
+	return data == end;
+}
+
+/** @return True, if both transforms are equal */
+static inline bool equal(const int32_t* p0, const int16_t* r0, uint8_t l0,
+		const int32_t* p1, const int16_t* r1, uint8_t l1)
+{
+	return l0 == l1 && p0[0] == p1[0] && p0[1] == p1[1] && p0[2] == p1[2] &&
+			r0[0] == r1[0] && r0[1] == r1[1] && r0[2] == r1[2];
+}
+
+Replay::Replay()
+	: m_state(IDLE),
+	  m_store(NULL),
+	  m_frameCount(0),
+	  m_bodyCount(0),
+	  m_timeStep(0.0f),
+	  m_frame(0),
+	  m_time(0.0f),
+	  m_speed(1.0f),
+	  m_paused(false)
+{
+}
+
+void Replay::clear()
+{
+	m_state = IDLE;
+	m_bodies.clear();
+	m_store = NULL;
+	m_chunks.clear();
+	m_transforms.clear();
+	m_frameCount = 0;
+	m_bodyCount = 0;
+	m_frame = 0;
+	m_time = 0.0f;
+}
+
+void Replay::attach(const std::list<Object>& objects)
+{
+	m_bodies.clear();
+	for (std::list<Object>::const_iterator itr = objects.begin(); itr != objects.end(); ++itr)
+		(*itr)->getBodies(m_bodies);
+	m_transforms.assign(m_bodies.size(), Transform());
+}
+
+Replay::Transform Replay::quantise(const Mat4f& matrix)
+{
+	Transform result;
+	const Vec3f position = matrix.getW();
+	for (int i = 0; i < 3; ++i)
+		result.position[i] = (int32_t)floorf(position[i] * POSITION_SCALE + 0.5f);
+
+	// q and -q are the same rotation, so the largest component can be
+	// made positive and restored from the other three
+	Quatf q(matrix);
+	for (int i = 1; i < 4; ++i) {
+		if (fabsf(q[i]) > fabsf(q[result.largest]))
+			result.largest = i;
+	}
+	const float sign = q[result.largest] < 0.0f ? -1.0f : 1.0f;
+
+	// the other components are within [-1/sqrt(2), 1/sqrt(2)]
+	const float scale = ROTATION_SCALE * SQRT2 * sign;
+	for (int i = 0, j = 0; i < 4; ++i) {
+		if (i != result.largest) {
+			float value = floorf(q[i] * scale + 0.5f);
+			result.rotation[j++] = (int16_t)std::max(-(float)ROTATION_SCALE, std::min((float)ROTATION_SCALE, value));
+		}
+	}
+	return result;
+}
+
+Mat4f Replay::dequantise(const Transform& transform)
+{
+	Quatf q;
+	float sum = 0.0f;
+	for (int i = 0, j = 0; i < 4; ++i) {
+		if (i != transform.largest) {
+			q[i] = transform.rotation[j++] / (ROTATION_SCALE * SQRT2);
+			sum += q[i] * q[i];
+		}
+	}
+	q[transform.largest] = sqrtf(std::max(0.0f, 1.0f - sum));
+
+	Mat4f result = q.mat4();
+	result.setW(Vec3f(transform.position[0], transform.position[1], transform.position[2]) * (1.0f / POSITION_SCALE));
+	return result;
+}
+
+void Replay::startRecording(const std::list<Object>& objects, TransformStore& store, float timeStep)
+{
+	clear();
+	attach(objects);
+	m_store = &store;
+	m_bodyCount = m_bodies.size();
+	m_timeStep = timeStep;
+	m_state = RECORDING;
+	record();
+}
+
+void Replay::record()
+{
+	if (m_state != RECORDING)
+		return;
+
+	const bool keyframe = m_frameCount % KEYFRAME_INTERVAL == 0;
+	if (keyframe) {
+		m_chunks.push_back(Chunk());
+		m_transforms.assign(m_bodyCount, Transform());
+	}
+	Chunk& chunk = m_chunks.back();
+	chunk.frames.push_back(chunk.data.size());
+
+	// keyframes contain all bodies, the other frames only the moving ones
+	m_records.clear();
+	unsigned count = 0;
+	int last = -1;
+	for (unsigned i = 0; i < m_bodyCount; ++i) {
+		Body* body = m_bodies[i];
+		if (!keyframe && (!body->m_body || NewtonBodyGetSleepState(body->m_body)))
+			continue;
+
+		const Transform t = quantise(body->getMatrix());
+		Transform& prev = m_transforms[i];
+		if (!keyframe && equal(t.position, t.rotation, t.largest, prev.position, prev.rotation, prev.largest))
+			continue;
+
+		writeVarint(m_records, i - last - 1);
+		last = i;
+		for (int k = 0; k < 3; ++k)
+			writeVarint(m_records, zigzag(t.position[k] - prev.position[k]));
+
+		// the differences of the rotation are only small, if the same
+		// component is omitted
+		m_records.push_back(t.largest);
+		const bool same = t.largest == prev.largest;
+		for (int k = 0; k < 3; ++k)
+			writeVarint(m_records, zigzag(t.rotation[k] - (same ? prev.rotation[k] : 0)));
+
+		prev = t;
+		++count;
+	}
+
+	writeVarint(chunk.data, count);
+	chunk.data.insert(chunk.data.end(), m_records.begin(), m_records.end());
+	++m_frameCount;
+}
+
+void Replay::decode(unsigned frame)
+{
+	const Chunk& chunk = m_chunks[frame / KEYFRAME_INTERVAL];
+	const unsigned index = frame % KEYFRAME_INTERVAL;
+	if (index == 0)
+		m_transforms.assign(m_bodyCount, Transform());
+
+	// recorded and loaded frames are valid, see checkFrame(), the
+	// bounds only keep the reads inside the chunk
+	const uint8_t* data = &chunk.data[0] + chunk.frames[index];
+	const uint8_t* end = &chunk.data[0] + chunk.data.size();
+	uint32_t count, value;
+	readVarint(data, end, count);
+	int last = -1;
+	for (unsigned n = 0; n < count && data < end; ++n) {
+		readVarint(data, end, value);
+		const unsigned i = last + 1 + value;
+		last = i;
+		if (i >= m_bodyCount)
+			break;
+
+		Transform& t = m_transforms[i];
+		for (int k = 0; k < 3; ++k) {
+			readVarint(data, end, value);
+			t.position[k] += unzigzag(value);
+		}
+
+		const uint8_t largest = data < end ? std::min(*data++, (uint8_t)3) : t.largest;
+		const bool same = largest == t.largest;
+		for (int k = 0; k < 3; ++k) {
+			readVarint(data, end, value);
+			t.rotation[k] = (int16_t)((same ? t.rotation[k] : 0) + unzigzag(value));
+		}
+		t.largest = largest;
+
+		m_store->setMatrix(m_bodies[i]->getSlot(), dequantise(t));
+	}
+	m_frame = frame;
+}
+
+void Replay::seekFrame(unsigned frame)
+{
+	if (frame == m_frame)
+		return;
+
+	// continue within the chunk, or start at the keyframe
+	unsigned first = frame - frame % KEYFRAME_INTERVAL;
+	if (m_frame < m_frameCount && frame > m_frame && m_frame >= first)
+		first = m_frame + 1;
+
+	for (unsigned f = first; f <= frame; ++f)
+		decode(f);
+}
+
+bool Replay::startPlayback(const std::list<Object>& objects, TransformStore& store)
+{
+	if (m_state == RECORDING)
+		stop();
+	if (!m_frameCount)
+		return false;
+
+	attach(objects);
+	if (m_bodies.size() != m_bodyCount) {
+		m_bodies.clear();
+		return false;
+	}
+
+	m_store = &store;
+	m_state = PLAYING;
+	m_frame = m_frameCount;
+	m_paused = false;
+	seek(0.0f);
+	return true;
+}
+
+void Replay::update(float delta)
+{
+	if (m_state != PLAYING)
+		return;
+
+	if (!m_paused)
+		seek(m_time + delta * m_speed);
+}
+
+void Replay::seek(float time)
+{
+	m_time = std::max(0.0f, std::min(getDuration(), time));
+	if (m_state == PLAYING && m_frameCount)
+		seekFrame(std::min(m_frameCount - 1, (unsigned)(m_time / m_timeStep + 0.5f)));
+}
+
+void Replay::stop()
+{
+	if (m_state == PLAYING) {
+		// continue the simulation from the played back state
+		const Vec3f zero;
+		for (std::vector<Body*>::iterator itr = m_bodies.begin(); itr != m_bodies.end(); ++itr) {
+			if ((*itr)->m_body) {
+				NewtonBodySetMatrix((*itr)->m_body, (*itr)->getMatrix()[0]);
+				NewtonBodySetVelocity((*itr)->m_body, &zero[0]);
+				NewtonBodySetOmega((*itr)->m_body, &zero[0]);
+			}
+		}
+	}
+
+	m_state = IDLE;
+	m_bodies.clear();
+	m_store = NULL;
+	m_frame = m_frameCount;
+}
+
+void Replay::setSpeed(float speed)
+{
+	m_speed = speed;
+}
+
+void Replay::setPaused(bool paused)
+{
+	m_paused = paused;
+}
+
+unsigned Replay::getMemoryUsage() const
+{
+	unsigned result = 0;
+	for (std::vector<Chunk>::const_iterator itr = m_chunks.begin(); itr != m_chunks.end(); ++itr)
+		result += itr->data.size() + itr->frames.size() * sizeof(uint32_t);
+	return result;
+}
+
+template <typename T>
+static inline void write(std::ofstream& out, const T& value)
+{
+	out.write((const char*)&value, sizeof(T));
+}
+
+template <typename T>
+static inline void read(std::ifstream& in, T& value)
+{
+	in.read((char*)&value, sizeof(T));
+}
+
+void Replay::save(const std::string& fileName) const
+{
+	std::ofstream out(fileName.c_str(), std::ios::binary);
+	if (!out)
+		throw std::runtime_error("Could not open replay file " + fileName + " for writing");
+
+	out.write(REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+	write(out, REPLAY_VERSION);
+	write(out, (uint32_t)m_bodyCount);
+	write(out, (uint32_t)m_frameCount);
+	write(out, m_timeStep);
+	write(out, (uint32_t)m_chunks.size());
+	for (std::vector<Chunk>::const_iterator itr = m_chunks.begin(); itr != m_chunks.end(); ++itr) {
+		write(out, (uint32_t)itr->frames.size());
+		if (!itr->frames.empty())
+			out.write((const char*)&itr->frames[0], itr->frames.size() * sizeof(uint32_t));
+		write(out, (uint32_t)itr->data.size());
+		if (!itr->data.empty())
+			out.write((const char*)&itr->data[0], itr->data.size());
+	}
+
+	if (!out)
+		throw std::runtime_error("Could not write replay file " + fileName);
+}
+
+void Replay::load(const std::string& fileName)
+{
+	std::ifstream in(fileName.c_str(), std::ios::binary);
+	if (!in)
+		throw std::runtime_error("Could not open replay file " + fileName);
+
+	char magic[sizeof(REPLAY_MAGIC)];
+	uint32_t version, bodies, frames, chunks;
+	float timeStep;
+	in.read(magic, sizeof(magic));
+	read(in, version);
+	if (!in || !std::equal(magic, magic + sizeof(magic), REPLAY_MAGIC) || version != REPLAY_VERSION)
+		throw std::runtime_error("Unsupported replay file " + fileName);
+
+	const std::string corrupt = "Corrupt replay file " + fileName;
+	read(in, bodies);
+	read(in, frames);
+	read(in, timeStep);
+	read(in, chunks);
+	if (!in || !frames || !(timeStep > 0.0f) || chunks != (frames + KEYFRAME_INTERVAL - 1) / KEYFRAME_INTERVAL)
+		throw std::runtime_error(corrupt);
+
+	// the frames are read into a new list, so that a corrupt file
+	// does not replace the current recording
+	std::vector<Chunk> result(chunks);
+	for (uint32_t c = 0; c < chunks; ++c) {
+		Chunk& chunk = result[c];
+
+		// all chunks but the last one are full, see decode()
+		uint32_t count, size;
+		read(in, count);
+		const uint32_t expected = c + 1 < chunks ? KEYFRAME_INTERVAL : frames - c * KEYFRAME_INTERVAL;
+		if (!in || count != expected)
+			throw std::runtime_error(corrupt);
+		chunk.frames.resize(count);
+		in.read((char*)&chunk.frames[0], count * sizeof(uint32_t));
+
+		// each frame has at least the number of its bodies
+		read(in, size);
+		if (!in || size < count || size > (1u << 30))
+			throw std::runtime_error(corrupt);
+		chunk.data.resize(size);
+		in.read((char*)&chunk.data[0], size);
+		if (!in)
+			throw std::runtime_error(corrupt);
+
+		// the frames follow each other without gaps
+		const uint8_t* data = &chunk.data[0];
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t begin = chunk.frames[i];
+			const uint32_t end = i + 1 < count ? chunk.frames[i + 1] : size;
+			if ((i == 0 && begin != 0) || begin >= end || end > size ||
+					!checkFrame(data + begin, data + end, bodies))
+				throw std::runtime_error(corrupt);
+		}
+	}
+
+	clear();
+	m_chunks.swap(result);
+	m_timeStep = timeStep;
+	m_bodyCount = bodies;
+	m_frameCount = frames;
+	m_frame = m_frameCount;
+}
+
+}
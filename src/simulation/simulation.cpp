@@ -11,17 +11,22 @@
 #include <simulation/simulation.hpp>
 #include <simulation/compound.hpp>
 #include <simulation/treecollision.hpp>
+#include <simulation/heightfield.hpp>
+#include <simulation/templatemgr.hpp>
 #include <simulation/material.hpp>
 #include <opengl/texture.hpp>
 #include <opengl/shader.hpp>
+#include <opengl/renderstate.hpp>
 #include <iostream>
 #include <newton/util.hpp>
 #include <simulation/domino.hpp>
 #include <simulation/crspline.hpp>
+#include <simulation/transformstore.hpp>
 #include <opengl/oglutil.hpp>
 #include <util/config.hpp>
 #include <util/threadcounter.hpp>
 #include <util/tostring.hpp>
+#include <util/profiler.hpp>
 #include <stdlib.h>
 #include <sound/soundmgr.hpp>
 #include <clocale>
@@ -32,6 +37,15 @@ namespace sim {
 
 Simulation* Simulation::s_instance = NULL;
 
+/** The real time covered by a physics step of World::TIME_STEP, in milliseconds */
+static const float TIME_SLICE = 12.0f;
+
+/** The time spent on physics steps per frame in fast forward mode, in milliseconds */
+static const float FAST_FORWARD_BUDGET = 25.0f;
+
+/** The time between two updates of the paged cells, in seconds */
+static const float PAGING_INTERVAL = 0.5f;
+
 // INT_ROTATE
 static Mat4f rot_mat_start;
 static Vec3f rot_drag_start;
@@ -78,43 +92,15 @@ Object ObjectInfo::create(const Mat4f& matrix) const
 	case __Object::CONVEX_ASSEMBLY:
 	case __Object::CONVEX_HULL:
 		{
-			using namespace rapidxml;
-			file<char>* f = 0;
-
-			try {
-				f = new file<char>(fileName.c_str());
-			} catch ( std::runtime_error& e ) {
-				const std::string error = e.what();
-				util::ErrorAdapter::instance().displayErrorMessage(error);
-				return __Domino::createDomino(__Object::DOMINO_SMALL, matrix, 1, "yellow", 0);
-			} catch(...) {
-				const std::string error = "An unknown error occured while loading this template. Here's a domino instead.";
-				util::ErrorAdapter::instance().displayErrorMessage(error);
+			// the template is parsed only once, all further objects are
+			// instantiated from the cached prototype
+			Template prototype = TemplateMgr::instance().get(fileName);
+			if (!prototype)
 				return __Domino::createDomino(__Object::DOMINO_SMALL, matrix, 1, "yellow", 0);
-			}
-			
-			try {
-				xml_document<> doc;
-				doc.parse<0>(f->data());
-
-				// this is important so we don't parse the template tag but the object or compound tag
-				xml_node<>* nodes = doc.first_node();
-
-				// only the first tag is loaded the rest will be ignored
-				xml_node<>* node = nodes->first_node();
-				std::string type = "";
-				if(node)
-					type = std::string(node->name());
-				else {
-					throw new std::runtime_error("template file broken");
-				}
 
-				if (type == "object" || type == "compound") {
-					result = __Object::load(node);
-					if (result) result->setMatrix(matrix);
-					return result;
-				}
-			} catch(parse_error& e) {
+			try {
+				result = prototype->instantiate(matrix);
+			} catch(rapidxml::parse_error& e) {
 				const std::string error = e.what();
 				util::ErrorAdapter::instance().displayErrorMessage(error);
 				return __Domino::createDomino(__Object::DOMINO_SMALL, matrix, 1, "yellow", 0);
@@ -150,22 +136,38 @@ void Simulation::destroyInstance()
 	s_instance = NULL;
 }
 
+Simulation::SettleResult::SettleResult()
+	: running(false),
+	  settled(false),
+	  steps(0),
+	  simulatedTime(0.0f),
+	  realTime(0.0)
+{
+}
+
 Simulation::Simulation(util::KeyAdapter& keyAdapter,
 						util::MouseAdapter& mouseAdapter)
 	: m_keyAdapter(keyAdapter),
 	  m_mouseAdapter(mouseAdapter),
-	  m_nextID(0)
+	  m_world(NULL),
+	  m_nextID(0),
+	  m_pagingTime(0.0f),
+	  m_fastForward(false),
+	  m_settleSteps(0),
+	  m_stepCount(0),
+	  m_dirty(true),
+	  m_moving(false)
 {
 	m_interactionTypes[util::LEFT] = INT_NONE;
 	m_interactionTypes[util::RIGHT] = INT_CREATE_OBJECT;
 	m_interactionTypes[util::MIDDLE] = INT_DOMINO_CURVE;
-	newton::world = NULL;
 	m_enabled = true;
-	newton::gravity = util::Config::instance().get("gravity", 9.81f) * -4.0f;
 	m_mouseAdapter.addListener(this);
 	m_environment = Object();
 	m_lightPos = Vec4f(100.0f, 500.0f, 700.0f, 0.0f);
 	m_useShadows = util::Config::instance().get("enableShadows", false);
+	for (unsigned i = 0; i <= ogl::SubBuffer::LOD_LEVELS; ++i)
+		m_lodCounts[i] = 0;
 #ifndef UNIT_TESTS
 	if (m_useShadows)
 		m_shadow = ogl::createShadowFBO(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
@@ -197,7 +199,7 @@ void Simulation::save(const std::string& fileName)
 	doc.append_node(level);
 
 	// save attribute "gravity"
-	char* pG = doc.allocate_string(util::toString(newton::gravity/-4.0f));
+	char* pG = doc.allocate_string(util::toString(m_world->getGravity()/-4.0f));
 	xml_attribute<>* attrG = doc.allocate_attribute("gravity", pG);
 	level->append_attribute(attrG);
 
@@ -216,15 +218,28 @@ void Simulation::save(const std::string& fileName)
 	xml_attribute<>* attrUp = doc.allocate_attribute("up", pUp);
 	level->append_attribute(attrUp);
 
+	// save attribute "size" of large levels, the outer bodies would be frozen otherwise
+	if (m_world->getSize() > World::DEFAULT_SIZE) {
+		char* pSize = doc.allocate_string(util::toString(m_world->getSize()));
+		level->append_attribute(doc.allocate_attribute("size", pSize));
+	}
+
 	
-	ObjectList::iterator itr = m_objects.begin();
-	for ( ; itr != m_objects.end(); ++itr) {
-		// add node paramenter to save method
-		__Object::save(*itr->get(), level, &doc);
+	// paged levels store the objects in the cells they are in
+	if (m_pager.isEnabled()) {
+		m_pager.save(m_objects, level, &doc);
+	} else {
+		ObjectList::iterator itr = m_objects.begin();
+		for ( ; itr != m_objects.end(); ++itr) {
+			// add node paramenter to save method
+			__Object::save(*itr->get(), level, &doc);
+		}
 	}
 
 	// save attribute "environment" __treecollision.save(m_environment)
-	if (m_environment)
+	if (m_environment && m_environment->getType() == __Object::HEIGHTFIELD)
+		__HeightField::save((__HeightField&)*m_environment.get(), level, &doc);
+	else if (m_environment)
 		__TreeCollision::save((__TreeCollision&)*m_environment.get(), level, &doc);
 
 	std::string s;
@@ -243,6 +258,8 @@ void Simulation::save(const std::string& fileName)
 
 bool Simulation::load(const std::string& fileName)
 {
+	PROFILE_SCOPE("load");
+
 	/* information for error messages */
 	std::string function = "Simulation::load";
 	std::vector<std::string> args;
@@ -284,11 +301,38 @@ bool Simulation::load(const std::string& fileName)
 
 			// load gravity
 			if(nodes->first_attribute("gravity")) {
-				newton::gravity = (float)atof(nodes->first_attribute("gravity")->value()) * -4.0f;
+				m_world->setGravity((float)atof(nodes->first_attribute("gravity")->value()) * -4.0f);
 			} else {
-				newton::gravity = util::Config::instance().get("gravity", 9.81) * -4.0f;
+				m_world->setGravity(util::Config::instance().get("gravity", 9.81f) * -4.0f);
 			}
 
+			// large levels may need a larger world than the default one
+			float size = 0.0f;
+			if (nodes->first_attribute("size"))
+				size = (float)atof(nodes->first_attribute("size")->value());
+
+			// paged levels keep their cells serialized until they are near
+			if (nodes->first_attribute("cellsize")) {
+				float cellSize = (float)atof(nodes->first_attribute("cellsize")->value());
+				if (cellSize <= 0.0f)
+					throw parse_error("The \"cellsize\" attribute of the level has to be positive", nodes->name());
+				m_pager.setCellSize(cellSize);
+				// the ids of the unloaded objects must not be given to new objects
+				for (xml_node<>* cell = nodes->first_node("cell"); cell; cell = cell->next_sibling("cell")) {
+					const int id = m_pager.addCell(cell);
+					if (id >= m_nextID)
+						m_nextID = id + 1;
+				}
+
+				Vec3f min, max;
+				if (m_pager.getBounds(min, max)) {
+					size = std::max(size, std::max(std::max(-min.x, -min.z), std::max(max.x, max.z)) + cellSize);
+				}
+			}
+
+			if (size > World::DEFAULT_SIZE)
+				m_world->setSize(size);
+
 			// load camera stuff
 			if( nodes->first_attribute("position") && nodes->first_attribute("eye") && nodes->first_attribute("up") ) {
 			m_camera.m_position.assign(nodes->first_attribute("position")->value());
@@ -304,7 +348,9 @@ bool Simulation::load(const std::string& fileName)
 				m_camera.update();
 			}
 
-			// iterate over all nodes
+			// iterate over all nodes, the bodies are created in the order
+			// of the document, so that the same file simulates the same way
+			// in every run
 			for (xml_node<>* node = nodes->first_node(); node; node = node->next_sibling()) {
 				std::string type(node->name());
 				if (type == "object" || type == "compound") {
@@ -317,10 +363,18 @@ bool Simulation::load(const std::string& fileName)
 
 			// load "environment" and create tree collision from it
 			xml_node<>* node = nodes->first_node("environment");
+			// the environment is optional, generated levels bring their own ground
 			if (node) {
-				m_environment = __TreeCollision::load(node);
+				xml_attribute<>* type = node->first_attribute("type");
+				if (type && std::string(type->value()) == __Object::TypeStr[__Object::HEIGHTFIELD])
+					m_environment = __HeightField::load(node);
+				else
+					m_environment = __TreeCollision::load(node);
 				//((__TreeCollision*)m_environment.get())->createOctree();
-			} else throw parse_error("No environment node found", (void*)function.c_str());
+			}
+
+			// load the cells around the camera
+			updatePaging();
 
 			m_clock.reset();
 
@@ -344,22 +398,9 @@ void Simulation::init()
 #ifndef UNIT_TESTS
 	m_camera.positionCamera(Vec3f(0.0f, 10.0f, 0.0f), -Vec3f::zAxis(), Vec3f::yAxis());
 #endif
-	newton::world = NewtonCreate();
-	NewtonWorldSetUserData(newton::world, this);
-
-	NewtonSetPlatformArchitecture(newton::world, 3);
-	// set a fixed world size
-	Vec3f minSize(-2000.0f, -2000.0f, -2000.0f);
-	Vec3f maxSize(2000.0f, 2000.0f, 2000.0f);
-	NewtonSetWorldSize(newton::world, &minSize[0], &maxSize[0]);
-
-	NewtonSetSolverModel(newton::world, 1);
-	NewtonSetFrictionModel(newton::world, 1);
-	NewtonSetThreadsCount(newton::world, util::getThreadCount());
-	NewtonSetMultiThreadSolverOnSingleIsland(newton::world, 0);
-
-	int id = NewtonMaterialGetDefaultGroupID(newton::world);
-	NewtonMaterialSetCollisionCallback(newton::world, id, id, NULL, NULL, MaterialMgr::GenericContactCallback);
+	// a fixed number of threads makes runs comparable, see StateHash
+	int threads = util::Config::instance().get("physicsThreads", 0);
+	m_world = new World(threads > 0 ? threads : util::getThreadCount());
 
 #ifndef UNIT_TESTS
 	__Domino::genDominoBuffers(m_vbo);
@@ -705,21 +746,26 @@ void Simulation::init()
 
 void Simulation::clear()
 {
+	// the frames are kept for a playback on the reloaded level
+	m_replay.stop();
+	m_stateHash.stop();
 	m_selectedObject = Object();
+	m_dirty = true;
 #ifndef UNIT_TESTS
 	m_sortedBuffers.clear();
 	m_vbo.flush();
 #endif
 	m_objects.clear();
 	m_environment = Object();
-	__Domino::freeCollisions();
+	m_pager.clear();
+	__Convex::freeMeshes();
 	m_skydome.clear();
-	if (newton::world) {
-		std::cout << "Remaining bodies: " << NewtonWorldGetBodyCount(newton::world) << std::endl;
-		NewtonDestroy(newton::world);
+	if (m_world) {
+		std::cout << "Remaining bodies: " << NewtonWorldGetBodyCount(m_world->getNewton()) << std::endl;
+		delete m_world;
 		std::cout << "Remaining memory: " << NewtonGetMemoryUsed() << std::endl;
 	}
-	newton::world = NULL;
+	m_world = NULL;
 }
 
 int Simulation::add(const Object& object)
@@ -735,9 +781,12 @@ int Simulation::add(const Object& object, int id)
 		return -1;
 
 	object->setID(id);
+	if (id >= m_nextID)
+		m_nextID = id + 1;
 	ObjectList::iterator begin = m_objects.insert(m_objects.end(), object);
 
 	upload(begin, m_objects.end());
+	m_dirty = true;
 	return id;
 }
 
@@ -752,26 +801,11 @@ int Simulation::add(const ObjectInfo& info)
 
 void Simulation::remove(const Object& object)
 {
+	m_replay.stop();
+	m_dirty = true;
 #ifndef UNIT_TESTS
-	// check if it is a compound, if so we have to check whether
-	// one of its children is in a sub-mesh
-
-	// the offset that has to be subtracted from the index offset
-	// of all sub-meshes after the sub-mesh that has been deleted.
-	// this is necessary, because index data will be removed from
-	// the global index list
-	unsigned indexOffset = 0;
-
-	// the offset that has to be subtracted from the individual index
-	// values of the indices after the deleted sub-mesh. this has to be
-	// done because data will be removed from the global vertex list
-	unsigned dataOffset = 0;
-
-	// delete vertices only once per object, because there may be
-	// multiple sub-meshes with the same data and different materials
-	std::set<__Object*> deleted;
-
 	if (object->getType() <= __Object::DOMINO_LARGE) {
+		// the geometry of dominos is shared, only the sub-buffer is deleted
 		for (ogl::SubBuffers::iterator it = m_vbo.m_buffers.begin(); it != m_vbo.m_buffers.end(); ++it) {
 			if ((*it)->userData == object.get()) {
 				delete (*it);
@@ -780,74 +814,27 @@ void Simulation::remove(const Object& object)
 			}
 		}
 	} else {
-		// iterate over all sub-buffers and check if it has to be deleted
+		// collect the sub-buffers of the object, or of its children if it
+		// is a compound. shared buffers have no object
+		std::set<ogl::SubBuffer*> buffers;
 		for (ogl::SubBuffers::iterator it = m_vbo.m_buffers.begin(); it != m_vbo.m_buffers.end(); ) {
-
-			// do nothing if it is a shared buffer
-			ogl::SubBuffer* curBuf = *it;
-			__Object* curObj = (__Object*)curBuf->userData;
-			if (curObj == NULL) {
-				++it;
-				continue;
-			}
-
-			// Check if a domino is inside a compound (it cannot be a single domino,
-			// because we checked that prior to the for-loop).
-			// If so, do not adjust anything, because domino data is stored globally
-			if (curObj->getType() <= __Object::DOMINO_LARGE) {
-				if (object->contains(curObj)) {
-					delete curBuf;
+			__Object* curObj = (__Object*)(*it)->userData;
+			if (curObj && object->contains(curObj)) {
+				if (curObj->getType() <= __Object::DOMINO_LARGE) {
+					// a domino inside a compound, its geometry is shared
+					delete (*it);
 					it = m_vbo.m_buffers.erase(it);
+					continue;
 				}
-				++it;
-			} else {
+				buffers.insert(*it);
+			}
+			++it;
+		}
 
-				// adjust the offsets according to the previously deleted buffers
-				curBuf->indexOffset -= indexOffset;
-				curBuf->dataOffset -= dataOffset;
-
-				// delete the data associated with the object
-				if (object->contains(curObj)) {
-					const unsigned co = curBuf->indexOffset;
-					const unsigned cc = curBuf->indexCount;
-					indexOffset += cc;
-
-					//TODO: With primitives that may be valid (if applyMapping is called with
-					// different materials). However for other types of meshes this will leave
-					// some data in the VBO, because each sub-mesh has its own data.
-					// 1) Ensure that primitives only have a single sub-mesh and remove this check
-					// 2) Ensure that sub-buffers for all objects have dataOffset and count for the entire object
-					// 3) Delete depended on object type? --> rather not
-
-					// delete vertices only if a sub-buffer of this objects
-					// has not already been deleted
-					if (deleted.find(curObj) == deleted.end()) {
-						const unsigned vo = curBuf->dataOffset * m_vbo.floatSize();
-						const unsigned vc = curBuf->dataCount * m_vbo.floatSize();
-						dataOffset += curBuf->dataCount;
-						m_vbo.m_data.erase(m_vbo.m_data.begin() + vo,
-								m_vbo.m_data.begin() + vo + vc);
-						deleted.insert(curObj);
-					}
-
-					// delete indices
-					m_vbo.m_indices.erase(m_vbo.m_indices.begin() + co,
-							m_vbo.m_indices.begin() + co + cc);
-
-					// delete sub-mesh
-					delete curBuf;
-					it = m_vbo.m_buffers.erase(it);
-				} else {
-					// adjust the indices of the object, because vertices were deleted
-					if (dataOffset > 0) {
-						for (unsigned i = 0; i < curBuf->indexCount; ++i)
-							m_vbo.m_indices[i + curBuf->indexOffset] -= dataOffset;
-					}
-					++it;
-				} /* end check if object has to be deleted */
-			} /* end check if domino is in compound */
-		} /* end for-loop */
-	} /* end check if object is domino */
+		// delete the geometry, including the levels of detail, and move
+		// the geometry of all other sub-buffers to the front
+		m_vbo.erase(buffers);
+	}
 #endif
 	m_objects.remove(object);
 
@@ -868,6 +855,7 @@ static bool isSharedBuffer(const ogl::SubBuffer* const buffer)
 
 void Simulation::upload(const ObjectList::iterator& begin, const ObjectList::iterator& end)
 {
+	PROFILE_SCOPE("upload");
 #ifndef UNIT_TESTS
 	for (ObjectList::iterator itr = begin; itr != end; ++itr)
 		(*itr)->genBuffers(m_vbo);
@@ -987,7 +975,7 @@ void Simulation::mouseMove(int x, int y)
 				if (angle == angle) {
 					Mat4f rot = Mat4f::rotAxis(Vec3f::yAxis() * factor, angle);
 					Mat4f matrix = m_selectedObject->getMatrix();
-					matrix = rot * matrix;
+					matrix = rot.affineMultiply(matrix);
 					m_selectedObject->setMatrix(matrix);
 				}
 			} else {
@@ -1066,32 +1054,48 @@ void Simulation::mouseDoubleClick(util::Button button, int x, int y)
 		// spline
 		if (curve_spline.knots().size() > 2) {
 			curve_spline.update();
-			Domino domino;
-			for (float t = 0.0f; t < curve_spline.table().back().len; t += gap) {
-				Vec3f p = curve_spline.getPos(t);
-				Vec3f q = curve_spline.getTangent(t).normalized();
-				if (domino && (t + gap) < curve_spline.table().back().len)
-					q = (curve_spline.getPos(t-gap) - curve_spline.getPos(t+gap)).normalized();
-				Mat4f matrix(Vec3f::yAxis(), q, p);
+			const float length = curve_spline.table().back().len;
+
+			// sample the spline at all domino positions in one batch
+			std::vector<float> lengths;
+			float t = 0.0f;
+			for ( ; t < length; t += gap)
+				lengths.push_back(t);
+			lengths.push_back(t);
+			std::vector<Vec3f> positions, tangents;
+			curve_spline.getPositions(lengths, positions);
+			curve_spline.getTangents(lengths, tangents);
+
+			std::vector<Mat4f> matrices;
+			for (unsigned i = 0; i + 1 < lengths.size(); ++i) {
+				Vec3f p = positions[i];
+				Vec3f q = tangents[i].normalized();
+				if (i > 0 && lengths[i + 1] < length)
+					q = (positions[i - 1] - positions[i + 1]).normalized();
+				matrices.push_back(Mat4f(Vec3f::yAxis(), q, p));
 				//Mat4f matrix = Mat4f::gramSchmidt(q, p);
-				domino = __Domino::createDomino(type, matrix, -1.0f, m_newObjectMaterial);
-				add(domino);
 			}
+			__Domino::placeDominos(type, matrices);
+			for (unsigned i = 0; i < matrices.size(); ++i)
+				add(__Domino::createDomino(type, matrices[i], -1.0f, m_newObjectMaterial, false));
 		// line
 		} else if (curve_spline.knots().size() == 2) {
-			Vec3f start = curve_spline.knots()[0].xz3(0.0f);
-			start.y = newton::getVerticalPosition(start.x, start.z);
-			Vec3f end = curve_spline.knots()[1].xz3(0.0f);
-			end.y = newton::getVerticalPosition(end.x, end.z);
+			std::vector<float> heights;
+			newton::getVerticalPositions(curve_spline.knots(), heights);
+			Vec3f start = curve_spline.knots()[0].xz3(heights[0]);
+			Vec3f end = curve_spline.knots()[1].xz3(heights[1]);
 			Vec3f dir = (end - start);
 			float len = dir.normalize();
 			Mat4f matrix(Vec3f::yAxis(), dir, start);
 			//Mat4f matrix = Mat4f::gramSchmidt(dir, start);
+			std::vector<Mat4f> matrices;
 			for (float d = 0.0f; d <= len; d += gap) {
 				matrix.setW(start + dir * d);
-				Domino domino = __Domino::createDomino(type, matrix, -1.0f, m_newObjectMaterial);
-				add(domino);
+				matrices.push_back(matrix);
 			}
+			__Domino::placeDominos(type, matrices);
+			for (unsigned i = 0; i < matrices.size(); ++i)
+				add(__Domino::createDomino(type, matrices[i], -1.0f, m_newObjectMaterial, false));
 		}
 		curve_spline.knots().clear();
 		curve_spline.update();
@@ -1114,8 +1118,99 @@ void Simulation::mouseWheel(int delta) {
 	}
 }
 
+void Simulation::step()
+{
+	{
+		PROFILE_SCOPE("NewtonUpdate");
+		NewtonUpdate(newton::world, World::TIME_STEP);
+	}
+	PROFILE_COUNT("steps", 1);
+	m_stateHash.record(++m_stepCount);
+}
+
+void Simulation::startStateHash(const std::string& fileName)
+{
+	// the caches of the world depend on the previous steps
+	NewtonInvalidateCache(m_world->getNewton());
+	m_stepCount = 0;
+	m_stateHash.start(fileName, m_objects);
+	m_stateHash.record(m_stepCount);
+}
+
+void Simulation::stopStateHash()
+{
+	m_stateHash.stop();
+}
+
+void Simulation::setFastForward(bool enabled)
+{
+	if (!enabled && m_settle.running)
+		finishSettle(false);
+	m_fastForward = enabled;
+}
+
+void Simulation::runUntilSettled(float timeout)
+{
+	m_settle = SettleResult();
+	m_settle.running = true;
+	m_settleSteps = (unsigned)(timeout / World::TIME_STEP);
+	m_settleClock.reset();
+	m_fastForward = true;
+}
+
+bool Simulation::isSettled()
+{
+	for (NewtonBody* body = NewtonWorldGetFirstBody(newton::world); body;
+			body = NewtonWorldGetNextBody(newton::world, body)) {
+		float mass, ix, iy, iz;
+		NewtonBodyGetMassMatrix(body, &mass, &ix, &iy, &iz);
+		if (mass > 0.0f && !NewtonBodyGetSleepState(body))
+			return false;
+	}
+	return true;
+}
+
+void Simulation::finishSettle(bool settled)
+{
+	m_settle.running = false;
+	m_settle.settled = settled;
+	// the same unit as Sweep::Result::lastFall
+	m_settle.simulatedTime = m_settle.steps * World::TIME_STEP;
+	m_settle.realTime = m_settleClock.get();
+	m_fastForward = false;
+}
+
+void Simulation::startRecording()
+{
+	// a step is taken every TIME_SLICE, so this is the real time speed
+	m_replay.startRecording(m_objects, m_world->getTransforms(), TIME_SLICE / 1000.0f);
+}
+
+bool Simulation::startPlayback()
+{
+	// the playback starts at the beginning, not after the idle time
+	m_clock.reset();
+	return m_replay.startPlayback(m_objects, m_world->getTransforms());
+}
+
+void Simulation::rebuildBuffers()
+{
+#ifndef UNIT_TESTS
+	m_vbo.flush();
+	__Domino::genDominoBuffers(m_vbo);
+	upload(m_objects.begin(), m_objects.end());
+#endif
+}
+
+bool Simulation::needsRender() const
+{
+	return m_dirty || m_enabled || m_moving || m_replay.getState() == Replay::PLAYING ||
+			ogl::TextureMgr::instance().isStreaming() || m_skydome.isFading();
+}
+
 void Simulation::update()
 {
+	PROFILE_SCOPE("update");
 	float delta = m_clock.get();
 	m_clock.reset();
 
@@ -1124,17 +1219,48 @@ void Simulation::update()
 	Vec3f dir = m_camera.viewVector();
 	Vec3f vel;
 	snd::SoundMgr::instance().SetListenerPos(&m_camera.m_position[0], &dir[0], &m_camera.m_up[0], &vel[0]);
-	if (m_enabled) {
+	if (m_replay.getState() == Replay::PLAYING) {
+		m_replay.update(delta);
+	} else if (m_enabled && m_fastForward) {
+		// as many steps as fit into the budget, the state after the
+		// last one is rendered
+		util::Clock budget;
+		do {
+			step();
+			m_replay.record();
+
+			if (m_settle.running) {
+				++m_settle.steps;
+				if (isSettled())
+					finishSettle(true);
+				else if (m_settle.steps >= m_settleSteps)
+					finishSettle(false);
+			}
+		} while (m_fastForward && budget.get() * 1000.0f < FAST_FORWARD_BUDGET);
+		timeSlice = 0.0f;
+	} else if (m_enabled) {
 		timeSlice += delta * 1000.0f;
 
-		while (timeSlice > 12.0f) {
-			NewtonUpdate(newton::world, (12.0f / 1000.0f) * 20.0f);
-			timeSlice = timeSlice - 12.0f;
+		while (timeSlice > TIME_SLICE) {
+			step();
+			m_replay.record();
+			timeSlice = timeSlice - TIME_SLICE;
 		}
 	}
 	snd::SoundMgr::instance().SoundUpdate();
 	m_skydome.update(delta);
-	float step = delta * (m_keyAdapter.shift() ? 25.f : 10.0f);
+
+	// paging would change the bodies of a replay
+	m_pagingTime += delta;
+	if (m_pagingTime >= PAGING_INTERVAL && m_replay.getState() == Replay::IDLE) {
+		m_pagingTime = 0.0f;
+		updatePaging();
+	}
+	// the first frame after a key press might follow a long idle time, see
+	// needsRender(), so the camera only starts moving in the next one
+	float step = (m_moving ? delta : 0.0f) * (m_keyAdapter.shift() ? 25.f : 10.0f);
+	m_moving = m_keyAdapter.isDown('w') || m_keyAdapter.isDown('a') ||
+			m_keyAdapter.isDown('s') || m_keyAdapter.isDown('d');
 
 	if (m_keyAdapter.isDown('w')) m_camera.move(step);
 	if (m_keyAdapter.isDown('a')) m_camera.strafe(-step);
@@ -1147,13 +1273,173 @@ void Simulation::update()
 	}
 }
 
+void Simulation::updatePaging()
+{
+	if (!m_pager.isEnabled())
+		return;
+
+	// the camera and the cells with active bodies keep the cells around
+	// them loaded, one point per cell is enough for the distance tests
+	std::vector<Vec3f> points(1, m_camera.m_position);
+	std::set<LevelPager::Key> active;
+	for (NewtonBody* body = NewtonWorldGetFirstBody(newton::world); body;
+			body = NewtonWorldGetNextBody(newton::world, body)) {
+		float mass, ix, iy, iz;
+		NewtonBodyGetMassMatrix(body, &mass, &ix, &iy, &iz);
+		if (mass > 0.0f && !NewtonBodyGetSleepState(body)) {
+			Mat4f matrix;
+			NewtonBodyGetMatrix(body, matrix[0]);
+			if (active.insert(m_pager.getKey(matrix.getW())).second)
+				points.push_back(matrix.getW());
+		}
+	}
+
+	LevelPager::Keys keys;
+	m_pager.getCellsToUnload(points, keys);
+	std::set<LevelPager::Key> unload(keys.begin(), keys.end());
+
+	// take the objects out of the distant cells, including objects that
+	// moved into a cell that is not loaded
+	std::map<LevelPager::Key, ObjectList> unloaded;
+	for (ObjectList::iterator itr = m_objects.begin(); itr != m_objects.end(); ) {
+		const LevelPager::Key key = m_pager.getKey((*itr)->getMatrix().getW());
+		if (*itr != m_selectedObject && (unload.count(key) || !m_pager.isLoaded(key)) && m_pager.isFar(key, points)) {
+			unloaded[key].push_back(*itr);
+			itr = m_objects.erase(itr);
+		} else {
+			++itr;
+		}
+	}
+	for (std::set<LevelPager::Key>::iterator itr = unload.begin(); itr != unload.end(); ++itr)
+		m_pager.unload(*itr, unloaded[*itr]);
+	for (std::map<LevelPager::Key, ObjectList>::iterator itr = unloaded.begin(); itr != unloaded.end(); ++itr) {
+		if (!unload.count(itr->first))
+			m_pager.unload(itr->first, itr->second);
+	}
+
+	// instantiate the near cells
+	keys.clear();
+	m_pager.getCellsToLoad(points, keys);
+	ObjectList loaded;
+	for (LevelPager::Keys::iterator itr = keys.begin(); itr != keys.end(); ++itr) {
+		try {
+			m_pager.load(*itr, loaded);
+		} catch (rapidxml::parse_error& e) {
+			const std::string error = e.what();
+			util::ErrorAdapter::instance().displayErrorMessage(error);
+		}
+	}
+	for (ObjectList::iterator itr = loaded.begin(); itr != loaded.end(); ++itr) {
+		if ((*itr)->getID() >= m_nextID)
+			m_nextID = (*itr)->getID() + 1;
+	}
+
+	if (loaded.empty() && unloaded.empty())
+		return;
+
+	ObjectList::iterator begin = loaded.begin();
+	m_objects.splice(m_objects.end(), loaded);
+
+	// removing objects invalidates the offsets of the sub-buffers, so
+	// all buffers are rebuilt in this case
+	if (!unloaded.empty())
+		rebuildBuffers();
+	else
+		upload(begin, m_objects.end());
+}
+
+/**
+ * Returns the level of detail for a sub-buffer with the given projected
+ * radius in pixels. A coarser level is only left, if the size exceeds the
+ * threshold by the hysteresis, so that objects near a threshold do not
+ * switch between two levels in every frame.
+ *
+ * @param current The level of the last frame
+ * @param size    The projected radius in pixels
+ * @return        The level of detail, or LOD_SKIPPED
+ */
+static uint32_t selectLOD(uint32_t current, float size)
+{
+	// the sizes below which the levels 1, 2 and LOD_SKIPPED are used
+	static const float THRESHOLDS[ogl::SubBuffer::LOD_LEVELS] = { 40.0f, 12.0f, 0.5f };
+	static const float HYSTERESIS = 1.25f;
+
+	uint32_t level = 0;
+	while (level < ogl::SubBuffer::LOD_SKIPPED &&
+			size < THRESHOLDS[level] * (current > level ? HYSTERESIS : 1.0f))
+		++level;
+	return level;
+}
+
+void Simulation::uploadTransforms()
+{
+	PROFILE_SCOPE("upload transforms");
+
+	// clean slots between two dirty ones are uploaded as well, if
+	// there are less than this, to save calls
+	static const unsigned MAX_GAP = 16;
+
+	TransformStore& store = m_world->getTransforms();
+	const unsigned size = store.size();
+	if (!ogl::TransformBuffer::isSupported() || !size) {
+		store.clearDirty();
+		return;
+	}
+
+	const bool all = m_transforms.reserve(size);
+	const std::vector<uint32_t>& dirty = store.getDirty();
+	unsigned first = 0;
+	while (first < size) {
+		if (!all && !store.isDirty(first)) {
+			// skip clean words at once
+			first = dirty[first >> 5] ? first + 1 : (first | 31) + 1;
+			continue;
+		}
+
+		unsigned last = first;
+		for (unsigned slot = first + 1; slot < size && slot - last <= MAX_GAP; ++slot) {
+			if (all || store.isDirty(slot))
+				last = slot;
+		}
+
+		// the first three rows of the OpenGL matrix, i.e. the columns
+		const unsigned count = last - first + 1;
+		m_transformData.resize(count * ogl::TransformBuffer::FLOATS);
+		float* data = &m_transformData[0];
+		for (unsigned slot = first; slot <= last; ++slot) {
+			const Mat4f& m = store.getMatrix(slot);
+			for (int col = 0; col < 3; ++col) {
+				*data++ = m[0][col];
+				*data++ = m[1][col];
+				*data++ = m[2][col];
+				*data++ = m[3][col];
+			}
+		}
+		m_transforms.upload(first, count, &m_transformData[0]);
+		first = last + 1;
+	}
+
+	store.clearDirty();
+}
+
 void Simulation::render()
 {
+	PROFILE_SCOPE("render");
+	m_dirty = false;
+
+	// the state might have been changed outside of the render methods
+	ogl::RenderState::instance().invalidate();
+
 	const Mat4f lightProjection = Mat4f::perspective(45.0f, 1.0f, 10.0f, 2048.0f);
 	const Mat4f lightModelview = Mat4f::lookAt(m_lightPos.xyz(), Vec3f(), Vec3f::yAxis());
 
+	// the matrices of the sub-buffers, indexed by their transform slot
+	uploadTransforms();
+	const TransformStore& transforms = m_world->getTransforms();
+
 	// Render scene from light into FBO and store depth buffer
 	if (m_useShadows) {
+		PROFILE_SCOPE("shadow pass");
 		m_vbo.bind();
 		m_shadow.first->bind();
 		ogl::__Shader::unbind();
@@ -1172,20 +1458,25 @@ void Simulation::render()
 		glEnable(GL_CULL_FACE);
 		glCullFace(GL_FRONT);
 
+		// the levels of detail of the last frame are good enough for the shadows
 		ogl::SubBuffers::const_iterator itr = m_sortedBuffers.begin();
 		for ( ; itr != m_sortedBuffers.end(); ++itr) {
 			const ogl::SubBuffer* const buf = (*itr);
-			const __Object* const obj = (const __Object* const)buf->userData;
+			if (buf->lod == ogl::SubBuffer::LOD_SKIPPED)
+				continue;
+			uint32_t offset, count;
+			buf->getRange(buf->lod, offset, count);
 			glPushMatrix();
-			glMultMatrixf(obj->getMatrix()[0]);
-			glDrawElements(GL_TRIANGLES, buf->indexCount, GL_UNSIGNED_INT, (void*)(buf->indexOffset * 4));
+			glMultMatrixf(transforms.getMatrix(buf->transform)[0]);
+			glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(offset * 4));
 			glPopMatrix();
 		}
 
 		ogl::VertexBuffer::unbind();
 
 		if (m_environment)
-			m_environment->render();
+			m_environment->render(m_camera);
+		m_pager.render(m_camera);
 
 		ogl::__FrameBuffer::unbind();
 		//glDisable(GL_POLYGON_OFFSET_FILL);
@@ -1201,7 +1492,7 @@ void Simulation::render()
 		};
 
 		glMatrixMode(GL_TEXTURE);
-		glActiveTextureARB(GL_TEXTURE7);
+		ogl::__Texture::stage(GL_TEXTURE7);
 
 		glLoadIdentity();
 		glLoadMatrixf(bias);
@@ -1222,6 +1513,8 @@ void Simulation::render()
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	}
 
+	// measured until the end of the method
+	PROFILE_SCOPE("main pass");
 	m_vbo.bind();
 	m_camera.apply();
 
@@ -1236,35 +1529,65 @@ void Simulation::render()
 	glLightfv(GL_LIGHT0, GL_SPECULAR, specular);
 
 	ogl::SubBuffers::const_iterator itr = m_sortedBuffers.begin();
-	std::string material = "";
+	int material = 0;
 	if (itr != m_sortedBuffers.end()) {
 		material = (*itr)->material;
 	}
 	MaterialMgr& mmgr = MaterialMgr::instance();
 	mmgr.applyMaterial(material, m_useShadows);
-	for ( ; itr != m_sortedBuffers.end(); ++itr) {
-		const ogl::SubBuffer* const buf = (*itr);
-		const __Object* const obj = (const __Object* const)buf->userData;
+
+	// shaders that support the transform buffer fetch the matrix of the
+	// object themselves, all others get it from the modelview matrix
+	const bool transformBuffer = m_transforms.getCapacity() > 0;
+	if (transformBuffer)
+		m_transforms.bind();
+	bool fetch = transformBuffer && mmgr.getRenderMaterial(material).transformsLocation >= 0;
+
+	const float pixelScale = m_camera.pixelScale();
+	for (unsigned i = 0; i <= ogl::SubBuffer::LOD_LEVELS; ++i)
+		m_lodCounts[i] = 0;
+
+	for (ogl::SubBuffers::iterator itr = m_sortedBuffers.begin(); itr != m_sortedBuffers.end(); ++itr) {
+		ogl::SubBuffer* const buf = (*itr);
+		if (buf->radius > 0.0f) {
+			float distance = (transforms.getPosition(buf->transform) - m_camera.m_position).len();
+			buf->lod = selectLOD(buf->lod, buf->radius * pixelScale / std::max(distance, 1.0f));
+		}
+		m_lodCounts[buf->lod]++;
+		if (buf->lod == ogl::SubBuffer::LOD_SKIPPED)
+			continue;
+
 		if (material != buf->material) {
 			material = buf->material;
 			mmgr.applyMaterial(material, m_useShadows);
+			fetch = transformBuffer && mmgr.getRenderMaterial(material).transformsLocation >= 0;
 		}
 
-		glPushMatrix();
-		glMultMatrixf(obj->getMatrix()[0]);
-		glDrawElements(GL_TRIANGLES, buf->indexCount, GL_UNSIGNED_INT, (void*)(buf->indexOffset * 4));
-		glPopMatrix();
+		uint32_t offset, count;
+		buf->getRange(buf->lod, offset, count);
+		if (fetch) {
+			ogl::TransformBuffer::setSlot(buf->transform);
+			glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(offset * 4));
+		} else {
+			glPushMatrix();
+			glMultMatrixf(transforms.getMatrix(buf->transform)[0]);
+			glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(offset * 4));
+			glPopMatrix();
+		}
 	}
 
+	ogl::TransformBuffer::resetSlot();
+
 	ogl::VertexBuffer::unbind();
 
 	if (m_environment)
-		m_environment->render();
+		m_environment->render(m_camera);
+	m_pager.render(m_camera);
 
 	glDisable(GL_LIGHTING);
-	m_skydome.render(m_camera, m_lightPos.xyz(), newton::getRayCastBody(m_camera.m_position, m_lightPos.xyz() - m_camera.m_position));
+	m_skydome.render(m_camera, m_lightPos.xyz());
 
-	glUseProgram(0);
+	ogl::__Shader::unbind();
 	glDisable(GL_TEXTURE_2D);
 	glColor3f(1.0f, 0.0, 0.0f);
 
@@ -1275,7 +1598,7 @@ void Simulation::render()
 		ObjectList::iterator itr = m_objects.begin();
 		for ( ; itr != m_objects.end(); ++itr) {
 			if (*itr == m_selectedObject) {
-				(*itr)->render();
+				(*itr)->render(m_camera);
 				(*itr)->getAABB(min, max);
 				if (m_camera.testAABB(min, max) == 1)
 					glColor3f(1.0f, 1.0f, 0.0f);
@@ -0,0 +1,190 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/statehash.cpp
+ */
+
+#include <simulation/statehash.hpp>
+#include <stdexcept>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+namespace sim {
+
+/** The first line of a stream */
+static const char* STATEHASH_HEADER = "statehash 1";
+
+StateHash::Divergence::Divergence()
+	: diverged(false),
+	  step(0),
+	  body(-1),
+	  id(-1),
+	  steps(0)
+{
+}
+
+uint64_t StateHash::hash(const void* data, unsigned size, uint64_t hash)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (unsigned i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+uint64_t StateHash::hash(const NewtonBody* body)
+{
+	float matrix[16], velocity[3], omega[3];
+	NewtonBodyGetMatrix(body, matrix);
+	NewtonBodyGetVelocity(body, velocity);
+	NewtonBodyGetOmega(body, omega);
+	int32_t freezeState = NewtonBodyGetFreezeState(body);
+
+	uint64_t result = hash(matrix, sizeof(matrix));
+	result = hash(velocity, sizeof(velocity), result);
+	result = hash(omega, sizeof(omega), result);
+	return hash(&freezeState, sizeof(freezeState), result);
+}
+
+void StateHash::start(const std::string& fileName, const std::list<Object>& objects)
+{
+	stop();
+	m_file.open(fileName.c_str());
+	if (!m_file)
+		throw std::runtime_error("Could not open state hash file " + fileName + " for writing");
+
+	std::vector<int> ids;
+	m_bodies.clear();
+	for (std::list<Object>::const_iterator itr = objects.begin(); itr != objects.end(); ++itr) {
+		(*itr)->getBodies(m_bodies);
+		ids.resize(m_bodies.size(), (*itr)->getID());
+	}
+	m_hashes.resize(m_bodies.size());
+
+	m_file << STATEHASH_HEADER << "\n" << ids.size();
+	for (std::vector<int>::const_iterator itr = ids.begin(); itr != ids.end(); ++itr)
+		m_file << " " << *itr;
+	m_file << "\n" << std::hex << std::setfill('0');
+}
+
+void StateHash::record(unsigned step)
+{
+	if (!m_file.is_open())
+		return;
+
+	uint64_t world = hash(&step, sizeof(step));
+	for (unsigned i = 0; i < m_bodies.size(); ++i) {
+		m_hashes[i] = m_bodies[i]->m_body ? hash(m_bodies[i]->m_body) : 0;
+		world = hash(&m_hashes[i], sizeof(uint64_t), world);
+	}
+
+	m_file << std::dec << step << std::hex << " " << std::setw(16) << world;
+	for (std::vector<uint64_t>::const_iterator itr = m_hashes.begin(); itr != m_hashes.end(); ++itr)
+		m_file << " " << std::setw(16) << *itr;
+	m_file << "\n";
+}
+
+void StateHash::stop()
+{
+	if (m_file.is_open())
+		m_file.close();
+	m_file.clear();
+	m_bodies.clear();
+	m_hashes.clear();
+}
+
+/**
+ * Reads the header of a stream.
+ *
+ * @param in       The stream
+ * @param fileName The name of the stream, for the error messages
+ * @param ids      The ids of the bodies
+ */
+static void readHeader(std::ifstream& in, const std::string& fileName, std::vector<int>& ids)
+{
+	std::string header;
+	std::getline(in, header);
+	unsigned count = 0;
+	in >> count;
+	if (!in || header != STATEHASH_HEADER)
+		throw std::runtime_error("Invalid state hash file " + fileName);
+
+	ids.resize(count);
+	for (unsigned i = 0; i < count && in; ++i)
+		in >> ids[i];
+	if (!in)
+		throw std::runtime_error("Invalid state hash file " + fileName);
+}
+
+/**
+ * Reads the hashes of the next step.
+ *
+ * @param in     The stream
+ * @param step   The number of the step
+ * @param hashes The hash of the world followed by the hashes of the bodies
+ * @return       False, if the stream ended
+ */
+static bool readStep(std::ifstream& in, unsigned& step, std::vector<uint64_t>& hashes)
+{
+	in >> std::dec >> step >> std::hex;
+	for (unsigned i = 0; i < hashes.size() && in; ++i)
+		in >> hashes[i];
+	return !in.fail();
+}
+
+StateHash::Divergence StateHash::compare(const std::string& fileName0, const std::string& fileName1)
+{
+	std::ifstream in0(fileName0.c_str()), in1(fileName1.c_str());
+	if (!in0)
+		throw std::runtime_error("Could not open state hash file " + fileName0);
+	if (!in1)
+		throw std::runtime_error("Could not open state hash file " + fileName1);
+
+	std::vector<int> ids0, ids1;
+	readHeader(in0, fileName0, ids0);
+	readHeader(in1, fileName1, ids1);
+
+	Divergence result;
+	if (ids0 != ids1) {
+		result.diverged = true;
+		result.reason = "The bodies are different";
+		return result;
+	}
+
+	std::vector<uint64_t> hashes0(ids0.size() + 1), hashes1(ids1.size() + 1);
+	unsigned step0, step1;
+	for (;;) {
+		bool valid0 = readStep(in0, step0, hashes0);
+		bool valid1 = readStep(in1, step1, hashes1);
+		if (!valid0 || !valid1) {
+			// a stream that ends early, e.g. after a crash, is a difference
+			if (valid0 || valid1) {
+				std::ostringstream reason;
+				reason << "The stream " << (valid0 ? fileName1 : fileName0) << " ends after "
+						<< result.steps << " steps";
+				result.diverged = true;
+				result.step = valid0 ? step0 : step1;
+				result.reason = reason.str();
+			}
+			return result;
+		}
+
+		if (step0 != step1 || hashes0[0] != hashes1[0]) {
+			result.diverged = true;
+			result.step = std::min(step0, step1);
+			for (unsigned i = 1; i < hashes0.size() && result.body < 0; ++i) {
+				if (hashes0[i] != hashes1[i]) {
+					result.body = i - 1;
+					result.id = ids0[i - 1];
+				}
+			}
+			result.reason = step0 != step1 ? "The steps are different" : "The state is different";
+			return result;
+		}
+		++result.steps;
+	}
+}
+
+}
@@ -0,0 +1,234 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/sweep.cpp
+ */
+
+#include <simulation/sweep.hpp>
+#include <simulation/world.hpp>
+#include <simulation/domino.hpp>
+#include <simulation/material.hpp>
+#include <util/threadcounter.hpp>
+#include <util/clock.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+namespace sim {
+
+/** The velocity given to the top of the first domino */
+static const float TIP_VELOCITY = 2.0f;
+
+/** A domino has fallen, if its up axis is tilted by more than 45 degrees */
+static const float FALLEN_COS = 0.7071f;
+
+/** The distance between the dominos and the border of the ground */
+static const float GROUND_MARGIN = 20.0f;
+
+Sweep::Run::Run()
+	: mass(-1.0f),
+	  material("planks"),
+	  steps(500)
+{
+}
+
+Sweep::Result::Result()
+	: count(0),
+	  fallen(0),
+	  lastFall(0.0f),
+	  duration(0.0)
+{
+}
+
+Sweep::Sweep()
+	: m_next(0)
+{
+}
+
+void Sweep::add(const Run& run)
+{
+	m_runs.push_back(run);
+}
+
+void Sweep::addGrid(const Run& base, const std::vector<float>& gaps, const std::vector<float>& masses,
+		const std::vector<std::string>& materials, const std::vector<std::string>& grounds)
+{
+	const std::vector<float> gap(gaps.empty() ? std::vector<float>(1, base.scene.gap) : gaps);
+	const std::vector<float> mass(masses.empty() ? std::vector<float>(1, base.mass) : masses);
+	const std::vector<std::string> material(materials.empty() ? std::vector<std::string>(1, base.material) : materials);
+	const std::vector<std::string> ground(grounds.empty() ? std::vector<std::string>(1, base.scene.groundMaterial) : grounds);
+
+	Run run(base);
+	for (unsigned g = 0; g < gap.size(); ++g) {
+		run.scene.gap = gap[g];
+		for (unsigned m = 0; m < mass.size(); ++m) {
+			run.mass = mass[m];
+			for (unsigned i = 0; i < material.size(); ++i) {
+				run.material = material[i];
+				for (unsigned j = 0; j < ground.size(); ++j) {
+					run.scene.groundMaterial = ground[j];
+					add(run);
+				}
+			}
+		}
+	}
+}
+
+Sweep::Result Sweep::simulate(const Run& run)
+{
+	Result result;
+	util::Clock clock;
+	clock.reset();
+
+	try {
+		std::vector<Mat4f> matrices;
+		Generator::generate(run.scene, matrices);
+		result.count = matrices.size();
+
+		// the world is created first, so that the bodies are destroyed before it
+		World world(1, true);
+
+		float extent = 0.0f;
+		for (std::vector<Mat4f>::const_iterator itr = matrices.begin(); itr != matrices.end(); ++itr)
+			extent = std::max(extent, std::max(fabsf(itr->_41), fabsf(itr->_43)));
+		const float size = (extent + GROUND_MARGIN) * 2.0f;
+		RigidBody ground = __RigidBody::createBox(Mat4f::translate(Vec3f(0.0f, -0.5f, 0.0f)), size, 1.0f, size,
+				0.0f, run.scene.groundMaterial);
+
+		std::vector<Domino> dominos;
+		dominos.reserve(matrices.size());
+		for (std::vector<Mat4f>::const_iterator itr = matrices.begin(); itr != matrices.end(); ++itr)
+			dominos.push_back(__Domino::createDomino(run.scene.type, *itr, run.mass, run.material, false));
+
+		if (!dominos.empty()) {
+			// push the top of the first domino along its facing direction
+			const Mat4f& first = dominos[0]->getMatrix();
+			const Vec3f& dominoSize = __Domino::getSize(std::min(run.scene.type, __Object::DOMINO_LARGE));
+			const Vec3f top = first.getW() + first.getY() * (dominoSize.y * 0.5f);
+			const Vec3f velocity = first.getZ() * TIP_VELOCITY;
+			dominos[0]->setFreezeState(0);
+			NewtonBodyAddImpulse(dominos[0]->m_body, &velocity[0], &top[0]);
+		}
+
+		std::vector<bool> fallen(dominos.size(), false);
+		for (unsigned step = 0; step < run.steps; ++step) {
+			NewtonUpdate(world.getNewton(), World::TIME_STEP);
+			for (unsigned i = 0; i < dominos.size(); ++i) {
+				if (!fallen[i] && dominos[i]->getMatrix().getY().y < FALLEN_COS) {
+					fallen[i] = true;
+					++result.fallen;
+					result.lastFall = (step + 1) * World::TIME_STEP;
+				}
+			}
+		}
+	} catch (std::exception& e) {
+		result.error = e.what();
+	}
+
+	result.duration = clock.get() * 1000.0;
+	return result;
+}
+
+void Sweep::work()
+{
+	for (;;) {
+		unsigned index;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if (m_next >= m_runs.size())
+				return;
+			index = m_next++;
+		}
+
+		Result result = simulate(m_runs[index]);
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_results[index] = result;
+		std::cout << "  run " << (index + 1) << "/" << m_runs.size() << ": "
+				  << result.fallen << " of " << result.count << " fallen in "
+				  << result.duration << " ms" << std::endl;
+	}
+}
+
+const std::vector<Sweep::Result>& Sweep::run(unsigned threads)
+{
+	if (!threads)
+		threads = util::getThreadCount();
+	threads = std::max(1u, std::min(threads, (unsigned)m_runs.size()));
+
+	m_results.assign(m_runs.size(), Result());
+	m_next = 0;
+
+	// the singleton has to exist before the workers share it
+	MaterialMgr::instance();
+
+	boost::thread_group group;
+	for (unsigned t = 0; t < threads; ++t)
+		group.create_thread(boost::bind(&Sweep::work, this));
+	group.join_all();
+
+	return m_results;
+}
+
+/** Escapes the quotes, backslashes and control characters of a JSON string */
+static std::string escapeJson(const std::string& str)
+{
+	std::ostringstream result;
+	for (std::string::const_iterator itr = str.begin(); itr != str.end(); ++itr) {
+		switch (*itr) {
+		case '"':  result << "\\\""; break;
+		case '\\': result << "\\\\"; break;
+		case '\n': result << "\\n"; break;
+		case '\r': result << "\\r"; break;
+		case '\t': result << "\\t"; break;
+		default:
+			if ((unsigned char)*itr < 0x20)
+				result << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)*itr << std::dec;
+			else
+				result << *itr;
+		}
+	}
+	return result.str();
+}
+
+void Sweep::save(const std::string& fileName) const
+{
+	std::ofstream out(fileName.c_str());
+	if (!out)
+		throw std::runtime_error("Could not open sweep file " + fileName + " for writing");
+
+	out << "{\n";
+	out << "\t\"runs\": [\n";
+	for (unsigned i = 0; i < m_runs.size(); ++i) {
+		const Run& run = m_runs[i];
+		const Result& result = i < m_results.size() ? m_results[i] : Result();
+		out << "\t\t{ \"layout\": \"" << Generator::LayoutStr[run.scene.layout] << "\""
+			<< ", \"count\": " << result.count
+			<< ", \"type\": \"" << __Object::TypeStr[run.scene.type] << "\""
+			<< ", \"gap\": " << run.scene.gap
+			<< ", \"mass\": " << run.mass
+			<< ", \"material\": \"" << escapeJson(run.material) << "\""
+			<< ", \"ground\": \"" << escapeJson(run.scene.groundMaterial) << "\""
+			<< ", \"seed\": " << run.scene.seed
+			<< ", \"steps\": " << run.steps
+			<< ", \"fallen\": " << result.fallen
+			<< ", \"lastFall\": " << result.lastFall
+			<< ", \"duration\": " << result.duration;
+		if (!result.error.empty())
+			out << ", \"error\": \"" << escapeJson(result.error) << "\"";
+		out << " }" << (i + 1 != m_runs.size() ? ",\n" : "\n");
+	}
+	out << "\t]\n";
+	out << "}\n";
+
+	if (!out)
+		throw std::runtime_error("Could not write sweep file " + fileName);
+}
+
+}
@@ -0,0 +1,117 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 3, 2011
+ * @file simulation/templatemgr.cpp
+ */
+
+#include <simulation/templatemgr.hpp>
+#include <util/erroradapters.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace sim {
+
+TemplateMgr* TemplateMgr::s_instance = NULL;
+
+__Template::__Template(const std::string& fileName)
+	: m_fileName(fileName), m_file(NULL), m_node(NULL)
+{
+}
+
+__Template::__Template(const __Template& other)
+{
+}
+
+__Template::~__Template()
+{
+	m_doc.clear();
+	if (m_file) delete m_file;
+}
+
+Object __Template::instantiate(const Mat4f& matrix) const
+{
+	Object result = __Object::load(m_node);
+	if (result) result->setMatrix(matrix);
+	return result;
+}
+
+Template __Template::load(const std::string& fileName)
+{
+	using namespace rapidxml;
+
+	Template result(new __Template(fileName));
+	result->m_file = new file<char>(fileName.c_str());
+	result->m_doc.parse<0>(result->m_file->data());
+
+	// skip the template tag, only the first object or compound is used
+	xml_node<>* root = result->m_doc.first_node();
+	if (!root)
+		throw parse_error("No valid root node found", (void*)"__Template::load");
+
+	xml_node<>* node = root->first_node();
+	if (!node)
+		throw parse_error("Template file contains no object", root->name());
+
+	std::string type(node->name());
+	if (type != "object" && type != "compound")
+		throw parse_error("Template file contains no object or compound tag", node->name());
+
+	result->m_node = node;
+	return result;
+}
+
+TemplateMgr::TemplateMgr()
+	: std::map<std::string, Template>()
+{
+}
+
+TemplateMgr::TemplateMgr(const TemplateMgr& other)
+{
+}
+
+TemplateMgr::~TemplateMgr()
+{
+}
+
+void TemplateMgr::destroy()
+{
+	if (s_instance)
+		delete s_instance;
+	s_instance = NULL;
+}
+
+Template TemplateMgr::load(const std::string& fileName)
+{
+	/* information for error messages */
+	std::string function = "TemplateMgr::load";
+	std::vector<std::string> args;
+	args.push_back(fileName);
+	/* END information for error messages */
+
+	Template result;
+	try {
+		result = __Template::load(fileName);
+	} catch (rapidxml::parse_error& e) {
+		util::ErrorAdapter::instance().displayErrorMessage(function, args, e);
+		return Template();
+	} catch (std::runtime_error& e) {
+		util::ErrorAdapter::instance().displayErrorMessage(function, args, e);
+		return Template();
+	} catch (...) {
+		util::ErrorAdapter::instance().displayErrorMessage(function, args);
+		return Template();
+	}
+
+	(*this)[fileName] = result;
+	return result;
+}
+
+Template TemplateMgr::get(const std::string& fileName)
+{
+	TemplateMgr::iterator it = this->find(fileName);
+	if (it == this->end())
+		return load(fileName);
+	return it->second;
+}
+
+}
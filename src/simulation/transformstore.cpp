@@ -0,0 +1,56 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 14, 2011
+ * @file simulation/transformstore.cpp
+ */
+
+#include <simulation/transformstore.hpp>
+#include <algorithm>
+
+namespace sim {
+
+TransformStore::TransformStore()
+	: m_size(0)
+{
+}
+
+TransformStore::TransformStore(const TransformStore& other)
+{
+}
+
+TransformStore::~TransformStore()
+{
+	for (std::vector<Page*>::iterator itr = m_pages.begin(); itr != m_pages.end(); ++itr)
+		delete *itr;
+}
+
+unsigned TransformStore::allocate(const Mat4f& matrix)
+{
+	unsigned slot;
+	if (!m_free.empty()) {
+		slot = m_free.back();
+		m_free.pop_back();
+	} else {
+		slot = m_size++;
+		if ((slot >> PAGE_SHIFT) >= m_pages.size()) {
+			m_pages.push_back(new Page());
+			m_dirty.resize(m_pages.size() * PAGE_SIZE / 32, 0);
+		}
+	}
+
+	setMatrix(slot, matrix);
+	return slot;
+}
+
+void TransformStore::release(unsigned slot)
+{
+	m_dirty[slot >> 5] &= ~(1u << (slot & 31));
+	m_free.push_back(slot);
+}
+
+void TransformStore::clearDirty()
+{
+	std::fill(m_dirty.begin(), m_dirty.end(), 0);
+}
+
+}
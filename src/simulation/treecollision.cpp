@@ -11,6 +11,8 @@
 #include <simulation/material.hpp>
 #include <newton/util.hpp>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <lib3ds/file.h>
 #include <lib3ds/mesh.h>
 #include <lib3ds/vector.h>
@@ -77,7 +79,7 @@ bool __TreeCollision::Node::isEmpty() {
 bool __TreeCollision::Node::inside(uint32_t* i0) {
 	const Vec3f sz(size, size, size);
 	for (unsigned i = 0; i < 3; ++i) {
-		Vec3f v(&tree->m_data[i0[i] * 3]);
+		Vec3f v(tree->position(i0[i]));
 		if (v >= (pos - sz) &&
 			v <= (pos + sz))
 			return true;
@@ -156,7 +158,7 @@ int __TreeCollision::Node::draw(bool test) {
 		glNewList(list, GL_COMPILE_AND_EXECUTE);
 		glBegin(GL_TRIANGLES);
 		for (unsigned i = 0; i < indices.size(); ++i)
-			glVertex3fv(&tree->m_data[indices[i] * 3]);
+			glVertex3fv(tree->position(indices[i]));
 		glEnd();
 		glEndList();
 	}
@@ -168,105 +170,141 @@ int __TreeCollision::Node::draw(bool test) {
 	return result;
 }
 
-__TreeCollision::__TreeCollision(const Mat4f& matrix, std::string& fileName)
-	: __Object(TREE_COLLISION), Body(matrix), m_fileName(fileName), m_nodeCount(0), m_node(NULL)
+unsigned __TreeCollision::Node::getMemoryUsage() const
 {
-	m_list = 0;
+	unsigned result = sizeof(Node) + indices.capacity() * sizeof(uint32_t) + childs.capacity() * sizeof(Node*);
+	for (unsigned i = 0; i < childs.size(); ++i)
+		result += childs[i]->getMemoryUsage();
+	return result;
+}
+
+/** Sorts faces by their material */
+struct FaceMaterialSorter {
+	const std::vector<int>& materials;
+	FaceMaterialSorter(const std::vector<int>& materials) : materials(materials) { }
+	bool operator()(uint32_t first, uint32_t second) const {
+		return materials[first] < materials[second];
+	}
+};
 
+__TreeCollision::__TreeCollision(const Mat4f& matrix, std::string& fileName)
+	: __Object(TREE_COLLISION), Body(matrix), m_fileName(fileName), m_nodeCount(0), m_node(NULL),
+	  m_vbo(0), m_ibo(0), m_useShadows(util::Config::instance().get("enableShadows", false))
+{
 	/*
-	 * There are n meshes, each mesh has a global normal, uv, and vertex array
-	 * Each face has 3 indices and a material
-	 *
-	 * make a T2F_N3F_V3F interleaved array of all meshes and a global index array
-	 *
-	 * Foreach face store indexOffset and indexCount (is it always 3?) and material
-	 * Sort
-	 *
-	 * Or immediately in ocree? with displaylists, should be better to implement
+	 * The meshes of the file are welded into a single T2F_N3F_V3F vertex
+	 * array and a global index array. Within a mesh, the corners of the
+	 * faces that share a point and its normal share a vertex, the uvs are
+	 * stored per point anyway. The faces are then sorted by material, so
+	 * that each material is a single range of indices.
 	 */
 
 	Lib3dsFile* file = lib3ds_file_load(fileName.c_str());
-	
+
 	if (!file) {
 		fileName.append(" couldn't be loaded");
 		throw std::runtime_error(fileName.c_str());
 	}
 
-	int defaultMaterial = MaterialMgr::instance().getID("yellow");
-	int numFaces = 0;
+	const int defaultMaterial = MaterialMgr::instance().getID("yellow");
+	unsigned numFaces = 0;
 
 	// count the faces
-	for(Lib3dsMesh* mesh = file->meshes; mesh != NULL; mesh = mesh->next)
+	for (Lib3dsMesh* mesh = file->meshes; mesh != NULL; mesh = mesh->next)
 		numFaces += mesh->faces;
 
-	m_vertexCount = numFaces*3;
-	m_vertices = new Lib3dsVector[numFaces * 3];
-	m_normals = new Lib3dsVector[numFaces * 3];
-	m_uvs = new Lib3dsTexel[numFaces * 3];
+	std::vector<uint32_t> indices;
+	std::vector<int> faceMaterials;
+	indices.reserve(numFaces * 3);
+	faceMaterials.reserve(numFaces);
 
-	int32_t* faceIndexCount = new int32_t[numFaces];
-	for (int i = 0; i < numFaces; ++i)
-		faceIndexCount[i] = 3;
+	// the vertices emitted for each point of the current mesh
+	std::vector<std::vector<uint32_t> > emitted;
 
-	int32_t* faceMaterials = new int32_t[numFaces];
+	for (Lib3dsMesh* mesh = file->meshes; mesh != NULL; mesh = mesh->next) {
+		if (!mesh->faces)
+			continue;
 
-	m_data.reserve(3 * numFaces * 3);
-	m_indices.reserve(3 * numFaces);
+		Lib3dsVector* normals = new Lib3dsVector[mesh->faces * 3];
+		lib3ds_mesh_calculate_normals(mesh, normals);
 
-	unsigned finishedFaces = 0;
-
-	NewtonCollision* collision = NewtonCreateTreeCollision(newton::world, 0);
-	NewtonTreeCollisionBeginBuild(collision);
+		emitted.clear();
+		emitted.resize(mesh->points);
 
-	//TODO sort the meshes and then only appy and begin() if it is another material
-
-	m_list = glGenLists(1);
-	glNewList(m_list, GL_COMPILE);
-	for(Lib3dsMesh* mesh = file->meshes; mesh != NULL; mesh = mesh->next) {
-		//data.reserve(data.size() + (mesh->points * (3 + 3 + 2)));
-		//data.resize(data.size() + (mesh->points * (3 + 3 + 2)));
-		int faceMaterial = defaultMaterial;
-		lib3ds_mesh_calculate_normals(mesh, &m_normals[finishedFaces*3]);
-		if (mesh->faces) {
-			faceMaterial = mesh->faceL[0].material && mesh->faceL[0].material[0] ? MaterialMgr::instance().getID(mesh->faceL[0].material) : defaultMaterial;
-			Material* mat = MaterialMgr::instance().fromID(faceMaterial);
-			MaterialMgr::instance().applyMaterial(mat ? mat->name : "yellow", util::Config::instance().get("enableShadows", false));
-		}
-		glBegin(GL_TRIANGLES);
-		for(unsigned cur_face = 0; cur_face < mesh->faces; cur_face++) {
+		for (unsigned cur_face = 0; cur_face < mesh->faces; cur_face++) {
 			Lib3dsFace* face = &mesh->faceL[cur_face];
-			for(unsigned int i = 0;i < 3; i++) {
-				memcpy(&m_vertices[finishedFaces*3 + i], mesh->pointL[face->points[i]].pos, sizeof(Lib3dsVector));
-				if (mesh->texelL) {
-					memcpy(&m_uvs[finishedFaces*3 + i], mesh->texelL[face->points[i]], sizeof(Lib3dsTexel));
-					glTexCoord2fv(m_uvs[finishedFaces*3 + i]);
+			for (unsigned i = 0; i < 3; i++) {
+				const unsigned point = face->points[i];
+				const float* normal = normals[cur_face * 3 + i];
+
+				// re-use a vertex of this point with the same normal
+				std::vector<uint32_t>& candidates = emitted[point];
+				uint32_t index = (uint32_t)-1;
+				for (unsigned j = 0; j < candidates.size(); ++j) {
+					if (memcmp(&m_data[candidates[j] * VERTEX_SIZE + 2], normal, sizeof(Lib3dsVector)) == 0) {
+						index = candidates[j];
+						break;
+					}
 				}
-				glNormal3fv(m_normals[finishedFaces*3 + i]);
-				glVertex3fv(m_vertices[finishedFaces*3 + i]);
 
-				m_data.push_back(mesh->pointL[face->points[i]].pos[0]);
-				m_data.push_back(mesh->pointL[face->points[i]].pos[1]);
-				m_data.push_back(mesh->pointL[face->points[i]].pos[2]);
-				m_indices.push_back(m_indices.size());
+				if (index == (uint32_t)-1) {
+					index = m_data.size() / VERTEX_SIZE;
+					candidates.push_back(index);
+					if (mesh->texelL) {
+						m_data.push_back(mesh->texelL[point][0]);
+						m_data.push_back(mesh->texelL[point][1]);
+					} else {
+						m_data.push_back(0.0f);
+						m_data.push_back(0.0f);
+					}
+					m_data.insert(m_data.end(), normal, normal + 3);
+					m_data.insert(m_data.end(), mesh->pointL[point].pos, mesh->pointL[point].pos + 3);
+				}
+				indices.push_back(index);
 			}
-			faceMaterial = face->material && face->material[0] ? MaterialMgr::instance().getID(face->material) : defaultMaterial;
-			//std::cout << faceMaterial << std::endl;
-			faceMaterials[finishedFaces] = faceMaterial;
-			NewtonTreeCollisionAddFace(collision, 3, m_vertices[finishedFaces*3], sizeof(Lib3dsVector), faceMaterial);
-			finishedFaces++;
+			faceMaterials.push_back(face->material && face->material[0] ?
+					MaterialMgr::instance().getID(face->material) : defaultMaterial);
 		}
-		glEnd();
+
+		delete[] normals;
 	}
-	glEndList();
 	lib3ds_file_free(file);
-	NewtonTreeCollisionEndBuild(collision, 1);
 
-	m_mesh = NewtonMeshCreate(newton::world);
-	NewtonMeshBuildFromVertexListIndexList(m_mesh, numFaces, (const int*)faceIndexCount, (const int*)faceMaterials,
-			m_vertices[0], sizeof(Lib3dsVector), (const int*)&m_indices[0],
-			m_normals[0], sizeof(Lib3dsVector), (const int*)&m_indices[0],
-			m_uvs[0], sizeof(Lib3dsTexel), (const int*)&m_indices[0],
-			m_uvs[0], sizeof(Lib3dsTexel), (const int*)&m_indices[0]);
+	// release the over-allocation of the growing vertex array
+	std::vector<float>(m_data).swap(m_data);
+
+	// sort the faces by material, stable to keep the faces of a mesh together
+	std::vector<uint32_t> faces(numFaces);
+	for (unsigned i = 0; i < numFaces; ++i)
+		faces[i] = i;
+	std::stable_sort(faces.begin(), faces.end(), FaceMaterialSorter(faceMaterials));
+
+	m_indices.reserve(numFaces * 3);
+	for (unsigned i = 0; i < numFaces; ++i) {
+		const uint32_t face = faces[i];
+		const int material = faceMaterials[face];
+		if (m_ranges.empty() || m_ranges.back().material != material) {
+			Material* mat = MaterialMgr::instance().fromID(material);
+			Range range;
+			range.material = ogl::SubBuffer::materialID(mat ? mat->name : "yellow");
+			range.offset = m_indices.size();
+			range.count = 0;
+			m_ranges.push_back(range);
+		}
+		m_indices.insert(m_indices.end(), &indices[face * 3], &indices[face * 3] + 3);
+		m_ranges.back().count += 3;
+	}
+
+	// build the collision from the welded vertices, Newton copies them
+	NewtonCollision* collision = NewtonCreateTreeCollision(newton::world, 0);
+	NewtonTreeCollisionBeginBuild(collision);
+	for (unsigned i = 0; i < numFaces; ++i) {
+		float vertices[3 * 3];
+		for (unsigned j = 0; j < 3; ++j)
+			memcpy(&vertices[j * 3], position(indices[i * 3 + j]), 3 * sizeof(float));
+		NewtonTreeCollisionAddFace(collision, 3, vertices, 3 * sizeof(float), faceMaterials[i]);
+	}
+	NewtonTreeCollisionEndBuild(collision, 1);
 
 	this->create(collision, 0.0f);
 	//NewtonBodySetContinuousCollisionMode(m_body, 1);
@@ -276,9 +314,18 @@ __TreeCollision::__TreeCollision(const Mat4f& matrix, std::string& fileName)
 __TreeCollision::~__TreeCollision()
 {
 	if (m_node) delete m_node;
-	if (m_vertices) delete m_vertices;
-	if (m_normals) delete m_normals;
-	if (m_uvs) delete m_uvs;
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+	if (m_ibo) glDeleteBuffers(1, &m_ibo);
+}
+
+unsigned __TreeCollision::getMemoryUsage() const
+{
+	unsigned result = m_data.capacity() * sizeof(float) +
+			m_indices.capacity() * sizeof(uint32_t) +
+			m_ranges.capacity() * sizeof(Range);
+	if (m_node)
+		result += m_node->getMemoryUsage();
+	return result;
 }
 
 
@@ -334,24 +381,22 @@ TreeCollision __TreeCollision::load(rapidxml::xml_node<>* node)
 
 void __TreeCollision::createOctree()
 {
-	if (m_data.size() == 0)
+	if (m_data.size() == 0 || m_node)
 		return;
 
-	float min = m_data[0], max = m_data[0];
-
-	for (unsigned i = 0; i < m_data.size() / 3; i += 3) {
-		min = min(min, m_data[i * 3 + 0]);
-		max = max(max, m_data[i * 3 + 0]);
-		min = min(min, m_data[i * 3 + 1]);
-		max = max(max, m_data[i * 3 + 1]);
-		min = min(min, m_data[i * 3 + 2]);
-		max = max(max, m_data[i * 3 + 2]);
+	Vec3f min(position(0)), max(min);
+	for (unsigned i = 1; i < getVertexCount(); ++i) {
+		const float* v = position(i);
+		for (unsigned j = 0; j < 3; ++j) {
+			min[j] = std::min(min[j], v[j]);
+			max[j] = std::max(max[j], v[j]);
+		}
 	}
 
-	float p = (min + max) * 0.5f;
-	Vec3f pos(p, p, p);
-
-	float size = (max - min) * 0.5f;
+	// the octree is a cube around the bounding box
+	Vec3f pos = (min + max) * 0.5f;
+	Vec3f extent = (max - min) * 0.5f;
+	float size = std::max(extent.x, std::max(extent.y, extent.z));
 
 	std::vector<uint32_t> indices(m_indices);
 	m_node = new Node(this, pos, size, indices);
@@ -360,66 +405,31 @@ void __TreeCollision::createOctree()
 void __TreeCollision::genBuffers(ogl::VertexBuffer& vbo)
 {
 	// get the offset in floats and vertices
-	const unsigned vertexSize = vbo.floatSize();
-	const unsigned byteSize = vbo.byteSize();
 	const unsigned floatOffset = vbo.m_data.size();
-	const unsigned vertexOffset = floatOffset / vertexSize;
-
-	//NewtonCollision* collision = NewtonBodyGetCollision(m_body);
-
-	// create a mesh from the collision
-	NewtonMesh* collisionMesh = m_mesh;//NewtonMeshCreateFromCollision(collision);
-
-	NewtonMeshCalculateVertexNormals(collisionMesh, 45.0f * 3.1416f/180.0f);
-
-	// allocate the vertex data
-	int vertexCount = NewtonMeshGetPointCount(collisionMesh);
+	const unsigned vertexOffset = floatOffset / vbo.floatSize();
 
-	vbo.m_data.reserve(floatOffset + vertexCount * vertexSize);
-	vbo.m_data.resize(floatOffset + vertexCount * vertexSize);
+	// the format of the store is the format of the buffer
+	vbo.m_data.insert(vbo.m_data.end(), m_data.begin(), m_data.end());
 
-	NewtonMeshGetVertexStreams(collisionMesh,
-			byteSize, &vbo.m_data[floatOffset + 2 + 3],
-			byteSize, &vbo.m_data[floatOffset + 2],
-			byteSize, &vbo.m_data[floatOffset],
-			byteSize, &vbo.m_data[floatOffset]);
-
-	// iterate over the submeshes and store the indices
-	void* const meshCookie = NewtonMeshBeginHandle(collisionMesh);
-	for (int handle = NewtonMeshFirstMaterial(collisionMesh, meshCookie);
-			handle != -1; handle = NewtonMeshNextMaterial(collisionMesh, meshCookie, handle)) {
-
-		int material = NewtonMeshMaterialGetMaterial(collisionMesh, meshCookie, handle);
-		//std::cout << "material " << material << std::endl;
-		//std::cout << "mesh " << material << std::endl;
-
-		// create a new submesh
+	for (std::vector<Range>::const_iterator itr = m_ranges.begin(); itr != m_ranges.end(); ++itr) {
 		ogl::SubBuffer* subBuffer = new ogl::SubBuffer();
-		subBuffer->material = MaterialMgr::instance().fromID(material)->name;
+		subBuffer->material = itr->material;
 		subBuffer->userData = this;
+		subBuffer->transform = m_slot;
 
-		subBuffer->dataCount = vertexCount;
+		subBuffer->dataCount = getVertexCount();
 		subBuffer->dataOffset = vertexOffset;
 
-		// get the indices
-		subBuffer->indexCount = NewtonMeshMaterialGetIndexCount(collisionMesh, meshCookie, handle);
-		//std::cout << subBuffer->indexCount << std::endl;
-		uint32_t* indices = new uint32_t[subBuffer->indexCount];
-		NewtonMeshMaterialGetIndexStream(collisionMesh, meshCookie, handle, (int*)indices);
-//std::cout << "indices " << subBuffer->indexCount << std::endl;
 		subBuffer->indexOffset = vbo.m_indices.size();
+		subBuffer->indexCount = itr->count;
 
 		// copy the indices to the global list and add the offset
-		vbo.m_indices.reserve(vbo.m_indices.size() + subBuffer->indexCount);
-		for (unsigned i = 0; i < subBuffer->indexCount; ++i)
-			vbo.m_indices.push_back(vertexOffset + indices[i]);
+		vbo.m_indices.reserve(vbo.m_indices.size() + itr->count);
+		for (unsigned i = 0; i < itr->count; ++i)
+			vbo.m_indices.push_back(vertexOffset + m_indices[itr->offset + i]);
 
-		delete indices;
 		vbo.m_buffers.push_back(subBuffer);
 	}
-	NewtonMeshEndHandle(collisionMesh, meshCookie);
-
-	NewtonMeshDestroy(collisionMesh);
 }
 
 bool __TreeCollision::contains(const NewtonBody* const body)
@@ -434,8 +444,13 @@ bool __TreeCollision::contains(const __Object* object)
 	return false;
 }
 
+void __TreeCollision::getBodies(std::vector<Body*>& bodies)
+{
+	bodies.push_back(this);
+}
 
-void __TreeCollision::render()
+
+void __TreeCollision::render(const ogl::Camera& camera)
 {
 
 	//newton::showCollisionShape(getCollision(), m_matrix);
@@ -445,12 +460,36 @@ void __TreeCollision::render()
 	//	m_node->drawWireFrame();
 	//glEnd();
 
-	//MaterialMgr::instance().applyMaterial("yellow");
+	if (m_indices.empty())
+		return;
 
-	if (glIsList(m_list))
-		glCallList(m_list);
+	if (!m_vbo) {
+		glGenBuffers(1, &m_vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBufferData(GL_ARRAY_BUFFER, m_data.size() * sizeof(float), &m_data[0], GL_STATIC_DRAW);
 
+		glGenBuffers(1, &m_ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(uint32_t), &m_indices[0], GL_STATIC_DRAW);
+	}
+
+	const GLsizei stride = VERTEX_SIZE * sizeof(float);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glTexCoordPointer(2, GL_FLOAT, stride, (void*)0);
+	glNormalPointer(GL_FLOAT, stride, (void*)(2 * sizeof(float)));
+	glVertexPointer(3, GL_FLOAT, stride, (void*)(POSITION_OFFSET * sizeof(float)));
+
+	for (std::vector<Range>::const_iterator itr = m_ranges.begin(); itr != m_ranges.end(); ++itr) {
+		MaterialMgr::instance().applyMaterial(itr->material, m_useShadows);
+		glDrawElements(GL_TRIANGLES, itr->count, GL_UNSIGNED_INT, (void*)(itr->offset * sizeof(uint32_t)));
+	}
 
+	ogl::VertexBuffer::unbind();
 
 	//if (m_node)
 	//	m_node->draw();
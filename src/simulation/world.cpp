@@ -0,0 +1,70 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file simulation/world.cpp
+ */
+
+#include <simulation/world.hpp>
+#include <simulation/material.hpp>
+#include <newton/util.hpp>
+#include <util/config.hpp>
+
+namespace sim {
+
+const float World::DEFAULT_SIZE = 2000.0f;
+const float World::TIME_STEP = 0.24f;
+
+World::World(int threads, bool headless)
+	: m_world(NewtonCreate()),
+	  m_headless(headless),
+	  m_size(DEFAULT_SIZE)
+{
+	NewtonWorldSetUserData(m_world, this);
+	m_gravity = util::Config::instance().get("gravity", 9.81f) * -4.0f;
+
+	NewtonSetPlatformArchitecture(m_world, 3);
+	// large levels set a larger size, see Simulation::load()
+	setSize(DEFAULT_SIZE);
+
+	// the solver model changes the outcome, so it is fixed by the settings
+	NewtonSetSolverModel(m_world, util::Config::instance().get("solverModel", 1));
+	NewtonSetFrictionModel(m_world, 1);
+	NewtonSetThreadsCount(m_world, threads);
+	NewtonSetMultiThreadSolverOnSingleIsland(m_world, 0);
+
+	int id = NewtonMaterialGetDefaultGroupID(m_world);
+	NewtonMaterialSetCollisionCallback(m_world, id, id, NULL, NULL, MaterialMgr::GenericContactCallback);
+
+	makeCurrent();
+}
+
+World::~World()
+{
+	for (Collisions::iterator itr = m_collisions.begin(); itr != m_collisions.end(); ++itr)
+		if (itr->second) NewtonReleaseCollision(m_world, itr->second);
+	m_collisions.clear();
+
+	NewtonDestroy(m_world);
+	if (newton::world == m_world)
+		newton::world = NULL;
+}
+
+void World::setSize(float size)
+{
+	m_size = size;
+	Vec3f minSize(-size, -DEFAULT_SIZE, -size);
+	Vec3f maxSize(size, DEFAULT_SIZE, size);
+	NewtonSetWorldSize(m_world, &minSize[0], &maxSize[0]);
+}
+
+void World::makeCurrent()
+{
+	newton::world = m_world;
+}
+
+World* World::current()
+{
+	return newton::world ? fromNewton(newton::world) : NULL;
+}
+
+}
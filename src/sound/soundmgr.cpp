@@ -7,6 +7,7 @@
 #include <sound/soundmgr.hpp>
 #define BOOST_FILESYSTEM_VERSION 2
 #include <boost/filesystem.hpp>
+#include <util/profiler.hpp>
 
 #define SOUND_MAX_CHANNELS 32
 
@@ -68,6 +69,7 @@ SoundMgr::~SoundMgr()
 
 void SoundMgr::SoundUpdate()
 {
+	PROFILE_SCOPE("sound");
 	FMOD_RESULT result;
 	int channels = 0;
 	std::map<std::string, FMOD::Sound*>::iterator itr;
@@ -6,6 +6,7 @@
 
 #include <unittests/m3dtest.hpp>
 #include <m3d/m3d.hpp>
+#include <vector>
 
 #ifdef _WIN32
 	#include <time.h>
@@ -123,6 +124,30 @@ void m3dTest::quaternionTest()
 	}
 }
 
+void m3dTest::quaternionFromMatrixTest()
+{
+	using namespace m3d;
+
+	for (int i = 0; i < 100; ++i) {
+		Vec3f axis = Vec3f(frand(), frand(), frand()).normalized();
+		float angle = frand(0, 2.0f*PI);
+		Mat4f input = Mat4f::rotAxis(axis, angle);
+
+		Quatf quat(input);
+		Mat4f output = quat.mat4();
+
+		// the quaternion has unit length
+		CPPUNIT_ASSERT(fabs(quat.norm() - 1.0f) < EPSILON);
+
+		for (int x = 0; x < 3; ++x) {
+			for (int y = 0; y < 3; ++y) {
+				CPPUNIT_ASSERT(fabs(input[x][y] - output[x][y]) < EPSILON);
+				CPPUNIT_ASSERT(output[x][y] == output[x][y]);
+			}
+		}
+	}
+}
+
 void m3dTest::orthonormalInverseTest()
 {
 	using namespace m3d;
@@ -217,5 +242,147 @@ void m3dTest::gramSchmidtTest()
 	CPPUNIT_ASSERT(matrix.getW() == pos);
 }
 
+static m3d::Mat4f mrand(float a, float b)
+{
+	m3d::Mat4f result;
+	for (int x = 0; x < 4; ++x)
+		for (int y = 0; y < 4; ++y)
+			result[x][y] = frand(a, b);
+	return result;
+}
+
+/**
+ * Returns true if the single and double precision values are equal,
+ * with a deviation relative to the magnitude of the operands.
+ */
+static inline bool equals(float value, double reference, double magnitude)
+{
+	return fabs(value - reference) <= 1e-5 * magnitude && value == value;
+}
+
+void m3dTest::multiplyTest()
+{
+	using namespace m3d;
+	Mat4f a = mrand(-100.0f, 100.0f);
+	Mat4f b = mrand(-100.0f, 100.0f);
+
+	Mat4f product = a * b;
+	Mat4d reference = Mat4d(a) * Mat4d(b);
+
+	Mat4f assigned = a;
+	assigned *= b;
+
+	// the multiplication in place has to work as well
+	Mat4f self = a;
+	self *= self;
+	Mat4d selfReference = Mat4d(a) * Mat4d(a);
+
+	Mat4f transposed = a.transposed();
+
+	for (int x = 0; x < 4; ++x) {
+		for (int y = 0; y < 4; ++y) {
+			CPPUNIT_ASSERT(equals(product[x][y], reference[x][y], 4.0 * 100.0 * 100.0));
+			CPPUNIT_ASSERT(assigned[x][y] == product[x][y]);
+			CPPUNIT_ASSERT(equals(self[x][y], selfReference[x][y], 4.0 * 100.0 * 100.0));
+			CPPUNIT_ASSERT(transposed[x][y] == a[y][x]);
+		}
+	}
+}
+
+void m3dTest::transformTest()
+{
+	using namespace m3d;
+	Mat4f matrix = mrand(-10.0f, 10.0f);
+	Mat4d reference(matrix);
+
+	Vec4f v4(frand(-10.0f, 10.0f), frand(-10.0f, 10.0f), frand(-10.0f, 10.0f), frand(-10.0f, 10.0f));
+	Vec4f r4 = v4 * matrix;
+	Vec4d r4d = Vec4d(v4) * reference;
+	Vec4f a4 = v4;
+	a4 *= matrix;
+
+	for (int i = 0; i < 4; ++i) {
+		CPPUNIT_ASSERT(equals(r4[i], r4d[i], 4.0 * 10.0 * 10.0));
+		CPPUNIT_ASSERT(a4[i] == r4[i]);
+	}
+
+	// odd count to test the last point, which is followed by other data
+	std::vector<Vec3f> points(17), transformed(17), inPlace;
+	for (unsigned i = 0; i < points.size(); ++i)
+		points[i] = Vec3f(frand(-10.0f, 10.0f), frand(-10.0f, 10.0f), frand(-10.0f, 10.0f));
+	inPlace = points;
+
+	transformPoints(matrix, &points[0], &transformed[0], points.size() - 1);
+	transformPoints(matrix, &inPlace[0], &inPlace[0], inPlace.size());
+
+	for (unsigned i = 0; i < points.size() - 1; ++i) {
+		Vec3f r3 = points[i] * matrix;
+		Vec3d r3d = Vec3d(points[i].x, points[i].y, points[i].z) * reference;
+		for (int j = 0; j < 3; ++j) {
+			CPPUNIT_ASSERT(equals(r3[j], r3d[j], 4.0 * 10.0 * 10.0));
+			CPPUNIT_ASSERT(transformed[i][j] == r3[j]);
+			CPPUNIT_ASSERT(inPlace[i][j] == r3[j]);
+		}
+	}
+
+	// the point after the range must not be touched
+	CPPUNIT_ASSERT(transformed.back() == Vec3f());
+}
+
+void m3dTest::generalInverseTest()
+{
+	using namespace m3d;
+	Vec3f axis(frand(), frand(), frand());
+	Vec3f scale(frand(0.5f, 2.0f), frand(0.5f, 2.0f), frand(0.5f, 2.0f));
+	Vec3f pos(frand(-100.0f, 100.0f), frand(-100.0f, 100.0f), frand(-100.0f, 100.0f));
+	Mat4f matrix = Mat4f::scale(scale) * Mat4f::rotAxis(axis, frand(0, 2.0f*PI)) * Mat4f::translate(pos);
+
+	Mat4f inverse = matrix.inverse();
+	Mat4d reference = Mat4d(matrix).inverse();
+
+	for (int x = 0; x < 4; ++x) {
+		for (int y = 0; y < 4; ++y) {
+			// the translation of the inverse is in the range of the position
+			CPPUNIT_ASSERT(equals(inverse[x][y], reference[x][y], x == 3 ? 1000.0 : 10.0));
+		}
+	}
+}
+
+void m3dTest::affineTest()
+{
+	using namespace m3d;
+	Vec3f axis(frand(), frand(), frand());
+	Vec3f scale(frand(0.5f, 2.0f), frand(0.5f, 2.0f), frand(0.5f, 2.0f));
+	Vec3f pos(frand(-100.0f, 100.0f), frand(-100.0f, 100.0f), frand(-100.0f, 100.0f));
+	Mat4f rigid = Mat4f::rotAxis(axis, frand(0, 2.0f*PI)) * Mat4f::translate(pos);
+	Mat4f affine = Mat4f::scale(scale) * Mat4f::rotAxis(Vec3f(frand(), frand(), frand()), frand(0, 2.0f*PI)) *
+			Mat4f::translate(-pos);
+
+	Mat4f product = rigid.affineMultiply(affine);
+	Mat4d productReference = Mat4d(rigid) * Mat4d(affine);
+
+	Mat4f rigidInverse = rigid.orthonormalInverse();
+	Mat4d rigidReference = Mat4d(rigid).inverse();
+
+	Mat4f affineInverse = affine.affineInverse();
+	Mat4d affineReference = Mat4d(affine).inverse();
+
+	for (int x = 0; x < 4; ++x) {
+		for (int y = 0; y < 4; ++y) {
+			// the translations are in the range of the position
+			double magnitude = x == 3 ? 1000.0 : 10.0;
+			CPPUNIT_ASSERT(equals(product[x][y], productReference[x][y], magnitude));
+			CPPUNIT_ASSERT(equals(rigidInverse[x][y], rigidReference[x][y], magnitude));
+			CPPUNIT_ASSERT(equals(affineInverse[x][y], affineReference[x][y], magnitude));
+		}
+	}
+
+	// the last column has to be exact
+	for (int x = 0; x < 4; ++x) {
+		CPPUNIT_ASSERT(product[x][3] == (x == 3 ? 1.0f : 0.0f));
+		CPPUNIT_ASSERT(rigidInverse[x][3] == (x == 3 ? 1.0f : 0.0f));
+		CPPUNIT_ASSERT(affineInverse[x][3] == (x == 3 ? 1.0f : 0.0f));
+	}
+}
 
 }
@@ -0,0 +1,143 @@
+/**
+ * @author Markus Doellinger
+ * @date October 19, 2026
+ * @file unittests/ogltest.cpp
+ */
+
+#include <unittests/ogltest.hpp>
+#include <opengl/vertexbuffer.hpp>
+#include <set>
+
+namespace test {
+
+CPPUNIT_TEST_SUITE_REGISTRATION(oglTest);
+
+/** The number of vertices of each test object */
+static const uint32_t VERTICES = 4;
+
+/** The index pattern of the full geometry and of the simplified levels */
+static const uint32_t BASE[] = { 0, 1, 2, 0, 2, 3 };
+static const uint32_t LOD1[] = { 0, 1, 3 };
+static const uint32_t LOD2[] = { 0, 2, 3 };
+
+void oglTest::setUp()
+{
+}
+
+void oglTest::tearDown()
+{
+}
+
+/**
+ * Appends an object to the vertex buffer the way __Mesh::genBuffers()
+ * and __Mesh::genLODs() do: the vertices, then the full geometry followed
+ * by the simplified levels. The first float of each vertex is the tag.
+ */
+static ogl::SubBuffer* addObject(ogl::VertexBuffer& vbo, float tag, bool lod2)
+{
+	ogl::SubBuffer* buffer = new ogl::SubBuffer();
+	const uint32_t base = vbo.m_data.size() / vbo.floatSize();
+	buffer->dataOffset = base;
+	buffer->dataCount = VERTICES;
+	for (uint32_t i = 0; i < VERTICES * vbo.floatSize(); ++i)
+		vbo.m_data.push_back(tag);
+
+	buffer->indexOffset = vbo.m_indices.size();
+	buffer->indexCount = sizeof(BASE) / sizeof(BASE[0]);
+	for (uint32_t i = 0; i < buffer->indexCount; ++i)
+		vbo.m_indices.push_back(base + BASE[i]);
+
+	buffer->lodOffset[0] = vbo.m_indices.size();
+	buffer->lodCount[0] = sizeof(LOD1) / sizeof(LOD1[0]);
+	for (uint32_t i = 0; i < buffer->lodCount[0]; ++i)
+		vbo.m_indices.push_back(base + LOD1[i]);
+
+	if (lod2) {
+		buffer->lodOffset[1] = vbo.m_indices.size();
+		buffer->lodCount[1] = sizeof(LOD2) / sizeof(LOD2[0]);
+		for (uint32_t i = 0; i < buffer->lodCount[1]; ++i)
+			vbo.m_indices.push_back(base + LOD2[i]);
+	}
+
+	buffer->userData = buffer;
+	vbo.m_buffers.push_back(buffer);
+	return buffer;
+}
+
+/**
+ * Checks that every level of detail of the given sub-buffer refers to its
+ * own vertices with the original pattern.
+ */
+static void checkObject(ogl::VertexBuffer& vbo, const ogl::SubBuffer* buffer, float tag, bool lod2)
+{
+	const uint32_t* patterns[] = { BASE, LOD1, lod2 ? LOD2 : LOD1 };
+	const uint32_t counts[] = { 6, 3, 3 };
+
+	CPPUNIT_ASSERT((buffer->dataOffset + buffer->dataCount) * vbo.floatSize() <= vbo.m_data.size());
+	CPPUNIT_ASSERT_EQUAL(tag, vbo.m_data[buffer->dataOffset * vbo.floatSize()]);
+
+	for (unsigned level = 0; level < ogl::SubBuffer::LOD_LEVELS; ++level) {
+		uint32_t offset, count;
+		buffer->getRange(level, offset, count);
+		CPPUNIT_ASSERT_EQUAL(counts[level], count);
+		CPPUNIT_ASSERT(offset + count <= vbo.m_indices.size());
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t index = vbo.m_indices[offset + i];
+			CPPUNIT_ASSERT_EQUAL(buffer->dataOffset + patterns[level][i], index);
+			CPPUNIT_ASSERT_EQUAL(tag, vbo.m_data[index * vbo.floatSize()]);
+		}
+	}
+}
+
+void oglTest::eraseTest()
+{
+	ogl::VertexBuffer vbo;
+	ogl::SubBuffer* first = addObject(vbo, 1.0f, true);
+	ogl::SubBuffer* second = addObject(vbo, 2.0f, true);
+	ogl::SubBuffer* third = addObject(vbo, 3.0f, true);
+
+	std::set<ogl::SubBuffer*> buffers;
+	buffers.insert(first);
+	buffers.insert(third);
+	vbo.erase(buffers);
+
+	CPPUNIT_ASSERT_EQUAL((size_t)1, vbo.m_buffers.size());
+	CPPUNIT_ASSERT(vbo.m_buffers.front() == second);
+	CPPUNIT_ASSERT_EQUAL((size_t)12, vbo.m_indices.size());
+	CPPUNIT_ASSERT_EQUAL((size_t)VERTICES * vbo.floatSize(), vbo.m_data.size());
+	CPPUNIT_ASSERT_EQUAL(0u, second->indexOffset);
+	CPPUNIT_ASSERT_EQUAL(0u, second->dataOffset);
+	checkObject(vbo, second, 2.0f, true);
+}
+
+void oglTest::eraseLODTest()
+{
+	ogl::VertexBuffer vbo;
+	ogl::SubBuffer* first = addObject(vbo, 1.0f, true);
+	ogl::SubBuffer* second = addObject(vbo, 2.0f, false);
+	ogl::SubBuffer* third = addObject(vbo, 3.0f, true);
+	const size_t indices = vbo.m_indices.size();
+	const size_t data = vbo.m_data.size();
+
+	std::set<ogl::SubBuffer*> buffers;
+	buffers.insert(second);
+	vbo.erase(buffers);
+
+	CPPUNIT_ASSERT_EQUAL((size_t)2, vbo.m_buffers.size());
+	CPPUNIT_ASSERT_EQUAL(indices - 9, vbo.m_indices.size());
+	CPPUNIT_ASSERT_EQUAL(data - VERTICES * vbo.floatSize(), vbo.m_data.size());
+
+	// the first object is unchanged, the third one moves to the front
+	CPPUNIT_ASSERT_EQUAL(0u, first->indexOffset);
+	CPPUNIT_ASSERT_EQUAL(6u, first->lodOffset[0]);
+	CPPUNIT_ASSERT_EQUAL(9u, first->lodOffset[1]);
+	CPPUNIT_ASSERT_EQUAL(12u, third->indexOffset);
+	CPPUNIT_ASSERT_EQUAL(18u, third->lodOffset[0]);
+	CPPUNIT_ASSERT_EQUAL(21u, third->lodOffset[1]);
+	CPPUNIT_ASSERT_EQUAL(VERTICES, third->dataOffset);
+
+	checkObject(vbo, first, 1.0f, true);
+	checkObject(vbo, third, 3.0f, true);
+}
+
+}
@@ -0,0 +1,432 @@
+/**
+ * @author Markus Doellinger
+ * @date October 19, 2026
+ * @file unittests/simtest.cpp
+ */
+
+#include <unittests/simtest.hpp>
+#include <simulation/simulation.hpp>
+#include <simulation/levelpager.hpp>
+#include <simulation/replay.hpp>
+#include <simulation/statehash.hpp>
+#include <simulation/generator.hpp>
+#include <util/inputadapters.hpp>
+#include <xml/rapidxml.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace test {
+
+CPPUNIT_TEST_SUITE_REGISTRATION(simTest);
+
+void simTest::setUp()
+{
+}
+
+void simTest::tearDown()
+{
+}
+
+/**
+ * Adds a cell to the pager from the given <cell> node.
+ *
+ * @param pager The pager
+ * @param text  The text of the <cell> node
+ * @return      The result of LevelPager::addCell()
+ */
+static int addCell(sim::LevelPager& pager, const std::string& text)
+{
+	std::vector<char> buffer(text.begin(), text.end());
+	buffer.push_back('\0');
+	rapidxml::xml_document<> doc;
+	doc.parse<0>(&buffer[0]);
+	return pager.addCell(doc.first_node("cell"));
+}
+
+/** Gives access to the quantisation of the transforms */
+class ReplayCodec : public sim::Replay {
+public:
+	static Mat4f roundTrip(const Mat4f& matrix) {
+		return dequantise(quantise(matrix));
+	}
+};
+
+/** @return True, if all elements of the matrices differ by at most epsilon */
+static bool equal(Mat4f a, Mat4f b, float epsilon)
+{
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			if (fabsf(a[i][j] - b[i][j]) > epsilon)
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Creates a simulation with falling boxes and records the given number
+ * of steps.
+ *
+ * @param steps    The number of steps to record
+ * @param boxes    The boxes, the first one is the static ground
+ * @param matrices The matrices of the boxes after each step
+ */
+static void recordBoxes(unsigned steps, std::vector<sim::Object>& boxes, std::vector<std::vector<Mat4f> >& matrices)
+{
+	sim::Simulation& simulation = sim::Simulation::instance();
+	simulation.init();
+
+	boxes.clear();
+	boxes.push_back(sim::__RigidBody::createBox(Mat4f::identity(), 100.0f, 1.0f, 100.0f, 0.0f, "wood"));
+	for (int i = 0; i < 4; ++i) {
+		const Mat4f matrix = Mat4f::rotY(i * 0.7f) * Mat4f::rotX(i * 0.3f) * Mat4f::translate(i * 3.0f, 2.0f + i, -i * 2.0f);
+		boxes.push_back(sim::__RigidBody::createBox(matrix, 1.0f, 1.0f, 1.0f, 1.0f, "wood"));
+	}
+	for (unsigned i = 0; i < boxes.size(); ++i)
+		simulation.add(boxes[i]);
+
+	matrices.clear();
+	simulation.startRecording();
+	for (unsigned step = 0; step <= steps; ++step) {
+		if (step) {
+			simulation.step();
+			simulation.getReplay().record();
+		}
+		matrices.push_back(std::vector<Mat4f>());
+		for (unsigned i = 0; i < boxes.size(); ++i)
+			matrices.back().push_back(boxes[i]->getMatrix());
+	}
+	simulation.getReplay().stop();
+}
+
+void simTest::pagerKeyTest()
+{
+	sim::LevelPager pager;
+	pager.setCellSize(10.0f);
+	CPPUNIT_ASSERT(pager.isEnabled());
+
+	CPPUNIT_ASSERT(pager.getKey(Vec3f(5.0f, 100.0f, 5.0f)) == sim::LevelPager::Key(0, 0));
+	CPPUNIT_ASSERT(pager.getKey(Vec3f(10.0f, 0.0f, 0.0f)) == sim::LevelPager::Key(1, 0));
+	CPPUNIT_ASSERT(pager.getKey(Vec3f(-0.5f, 0.0f, 15.0f)) == sim::LevelPager::Key(-1, 1));
+	CPPUNIT_ASSERT(pager.getKey(Vec3f(25.0f, 0.0f, -10.0f)) == sim::LevelPager::Key(2, -1));
+}
+
+void simTest::pagerCellsTest()
+{
+	sim::LevelPager pager;
+	pager.setCellSize(10.0f);
+	CPPUNIT_ASSERT_EQUAL(-1, addCell(pager, "<cell x=\"0\" z=\"0\"/>"));
+	CPPUNIT_ASSERT_EQUAL(-1, addCell(pager, "<cell x=\"100\" z=\"0\"/>"));
+	CPPUNIT_ASSERT_EQUAL(2u, pager.getCellCount());
+
+	std::vector<Vec3f> points(1, Vec3f(5.0f, 0.0f, 5.0f));
+	sim::LevelPager::Keys keys;
+	pager.getCellsToLoad(points, keys);
+	CPPUNIT_ASSERT_EQUAL((size_t)1, keys.size());
+	CPPUNIT_ASSERT(keys[0] == sim::LevelPager::Key(0, 0));
+
+	// nothing is loaded, so nothing can be unloaded
+	keys.clear();
+	pager.getCellsToUnload(points, keys);
+	CPPUNIT_ASSERT(keys.empty());
+
+	std::list<sim::Object> objects;
+	pager.load(sim::LevelPager::Key(0, 0), objects);
+	CPPUNIT_ASSERT(pager.isLoaded(sim::LevelPager::Key(0, 0)));
+	CPPUNIT_ASSERT_EQUAL(1u, pager.getLoadedCount());
+
+	// loaded cells are not loaded again
+	keys.clear();
+	pager.getCellsToLoad(points, keys);
+	CPPUNIT_ASSERT(keys.empty());
+
+	// the cell is kept while a point is near
+	pager.getCellsToUnload(points, keys);
+	CPPUNIT_ASSERT(keys.empty());
+
+	// and unloaded when all points are far, the far cell is loaded instead
+	points[0] = Vec3f(1005.0f, 0.0f, 5.0f);
+	pager.getCellsToUnload(points, keys);
+	CPPUNIT_ASSERT_EQUAL((size_t)1, keys.size());
+	CPPUNIT_ASSERT(keys[0] == sim::LevelPager::Key(0, 0));
+	CPPUNIT_ASSERT(pager.isFar(sim::LevelPager::Key(0, 0), points));
+
+	keys.clear();
+	pager.getCellsToLoad(points, keys);
+	CPPUNIT_ASSERT_EQUAL((size_t)1, keys.size());
+	CPPUNIT_ASSERT(keys[0] == sim::LevelPager::Key(100, 0));
+}
+
+void simTest::pagerRoundTripTest()
+{
+	// the objects need the world of the simulation
+	util::MouseAdapter ma;
+	util::KeyAdapter ka;
+	sim::Simulation::createInstance(ka, ma);
+	sim::Simulation::instance().init();
+
+	sim::LevelPager pager;
+	pager.setCellSize(10.0f);
+	const std::string box = "type=\"box\" width=\"1\" height=\"1\" depth=\"1\" freezeState=\"0\" "
+			"damping=\"0.1, 0.1, 0.1, 0.1\" material=\"wood\" mass=\"1\"";
+	const int maxID = addCell(pager, "<cell x=\"0\" z=\"0\">"
+			"<object id=\"7\" " + box + " matrix=\"1, 0, 0, 0; 0, 1, 0, 0; 0, 0, 1, 0; 2, 1, 2, 1\"/>"
+			"<object id=\"3\" " + box + " matrix=\"1, 0, 0, 0; 0, 1, 0, 0; 0, 0, 1, 0; 6, 1, 6, 1\"/>"
+			"</cell>");
+	CPPUNIT_ASSERT_EQUAL(7, maxID);
+
+	const sim::LevelPager::Key key(0, 0);
+	std::list<sim::Object> objects;
+	pager.load(key, objects);
+	CPPUNIT_ASSERT(pager.isLoaded(key));
+	CPPUNIT_ASSERT_EQUAL((size_t)2, objects.size());
+
+	std::vector<int> ids;
+	for (std::list<sim::Object>::iterator itr = objects.begin(); itr != objects.end(); ++itr)
+		ids.push_back((*itr)->getID());
+	std::sort(ids.begin(), ids.end());
+
+	pager.unload(key, objects);
+	CPPUNIT_ASSERT(!pager.isLoaded(key));
+	CPPUNIT_ASSERT_EQUAL(0u, pager.getLoadedCount());
+	objects.clear();
+
+	pager.load(key, objects);
+	CPPUNIT_ASSERT(pager.isLoaded(key));
+	CPPUNIT_ASSERT_EQUAL(ids.size(), objects.size());
+
+	std::vector<int> reloaded;
+	for (std::list<sim::Object>::iterator itr = objects.begin(); itr != objects.end(); ++itr)
+		reloaded.push_back((*itr)->getID());
+	std::sort(reloaded.begin(), reloaded.end());
+	CPPUNIT_ASSERT(ids == reloaded);
+	CPPUNIT_ASSERT_EQUAL(3, reloaded.front());
+	CPPUNIT_ASSERT_EQUAL(7, reloaded.back());
+
+	objects.clear();
+	sim::Simulation::destroyInstance();
+}
+
+
+void simTest::replayQuantiseTest()
+{
+	for (int i = 0; i < 64; ++i) {
+		// cover all quadrants, so that every component is the largest and negative once
+		const Mat4f matrix = Mat4f::rotZ(i * 0.37f) * Mat4f::rotX(i * 0.91f) * Mat4f::rotY(i * 1.53f) *
+				Mat4f::translate(i * 10.5f - 300.0f, i * 0.25f, -i * 7.125f);
+		const Mat4f result = ReplayCodec::roundTrip(matrix);
+		CPPUNIT_ASSERT(equal(matrix, result, 1e-3f));
+
+		// the positions are exact to half a step
+		Mat4f a = matrix, b = result;
+		for (int k = 0; k < 3; ++k)
+			CPPUNIT_ASSERT(fabsf(a[3][k] - b[3][k]) <= 0.5f / sim::Replay::POSITION_SCALE + 1e-4f);
+	}
+}
+
+void simTest::replayEncodeTest()
+{
+	util::MouseAdapter ma;
+	util::KeyAdapter ka;
+	sim::Simulation::createInstance(ka, ma);
+
+	// more than two chunks, the last one is not full
+	const unsigned steps = sim::Replay::KEYFRAME_INTERVAL * 2 + 10;
+	std::vector<sim::Object> boxes;
+	std::vector<std::vector<Mat4f> > matrices;
+	recordBoxes(steps, boxes, matrices);
+
+	sim::Replay& replay = sim::Simulation::instance().getReplay();
+	CPPUNIT_ASSERT_EQUAL(steps + 1, replay.getFrameCount());
+
+	const std::string fileName = "data/unittest_replay.rec";
+	replay.save(fileName);
+	replay.clear();
+	CPPUNIT_ASSERT_EQUAL(0u, replay.getFrameCount());
+	replay.load(fileName);
+	std::remove(fileName.c_str());
+	CPPUNIT_ASSERT_EQUAL(steps + 1, replay.getFrameCount());
+
+	// play the frames forward and then backward, which starts at the keyframes
+	CPPUNIT_ASSERT(sim::Simulation::instance().startPlayback());
+	for (int pass = 0; pass < 2; ++pass) {
+		for (unsigned n = 0; n <= steps; ++n) {
+			const unsigned frame = pass ? steps - n : n;
+			replay.seek(frame * (replay.getDuration() / steps));
+			for (unsigned i = 0; i < boxes.size(); ++i)
+				CPPUNIT_ASSERT(equal(matrices[frame][i], boxes[i]->getMatrix(), 1e-3f));
+		}
+	}
+	replay.stop();
+
+	boxes.clear();
+	sim::Simulation::destroyInstance();
+}
+
+void simTest::replayCorruptTest()
+{
+	util::MouseAdapter ma;
+	util::KeyAdapter ka;
+	sim::Simulation::createInstance(ka, ma);
+
+	std::vector<sim::Object> boxes;
+	std::vector<std::vector<Mat4f> > matrices;
+	recordBoxes(sim::Replay::KEYFRAME_INTERVAL + 5, boxes, matrices);
+	sim::Replay& replay = sim::Simulation::instance().getReplay();
+	const unsigned frames = replay.getFrameCount();
+
+	const std::string fileName = "data/unittest_replay.rec";
+	replay.save(fileName);
+	std::vector<char> file;
+	{
+		std::ifstream in(fileName.c_str(), std::ios::binary);
+		file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	CPPUNIT_ASSERT(file.size() > 64);
+
+	// the header is the magic, the version, the bodies, the frames, the
+	// time step and the number of chunks, then the frame count of the first chunk
+	std::vector<std::vector<char> > corrupt;
+	corrupt.push_back(std::vector<char>(file.begin(), file.end() - 1));
+	corrupt.push_back(std::vector<char>(file.begin(), file.begin() + file.size() / 2));
+	corrupt.push_back(file);
+	corrupt.back()[12] += 1;
+	corrupt.push_back(file);
+	corrupt.back()[24] = 1;
+	corrupt.push_back(file);
+	corrupt.back()[28 + 4] += 1;
+	corrupt.push_back(file);
+	corrupt.back()[file.size() - 1] = (char)0x80;
+	corrupt.push_back(file);
+	corrupt.back()[8] -= 1;
+
+	for (unsigned i = 0; i < corrupt.size(); ++i) {
+		{
+			std::ofstream out(fileName.c_str(), std::ios::binary);
+			out.write(&corrupt[i][0], corrupt[i].size());
+		}
+		CPPUNIT_ASSERT_THROW(replay.load(fileName), std::runtime_error);
+		CPPUNIT_ASSERT_EQUAL(frames, replay.getFrameCount());
+	}
+	std::remove(fileName.c_str());
+
+	boxes.clear();
+	sim::Simulation::destroyInstance();
+}
+
+
+void simTest::stateHashTest()
+{
+	// the reference values of the 64 bit FNV-1a hash
+	CPPUNIT_ASSERT(sim::StateHash::hash("", 0) == 0xcbf29ce484222325ULL);
+	CPPUNIT_ASSERT(sim::StateHash::hash("a", 1) == 0xaf63dc4c8601ec8cULL);
+	CPPUNIT_ASSERT(sim::StateHash::hash("foobar", 6) == 0x85944171f73967e8ULL);
+
+	// the hash of the preceding data continues the hash
+	CPPUNIT_ASSERT(sim::StateHash::hash("bar", 3, sim::StateHash::hash("foo", 3)) ==
+			sim::StateHash::hash("foobar", 6));
+	CPPUNIT_ASSERT(sim::StateHash::hash("foobaz", 6) != sim::StateHash::hash("foobar", 6));
+}
+
+/**
+ * Writes a state hash stream of two bodies with the ids 4 and 9.
+ *
+ * @param fileName The file to write
+ * @param steps    The lines of the steps
+ */
+static void writeStateHash(const std::string& fileName, const std::vector<std::string>& steps)
+{
+	std::ofstream out(fileName.c_str());
+	out << "statehash 1\n2 4 9\n";
+	for (unsigned i = 0; i < steps.size(); ++i)
+		out << steps[i] << "\n";
+}
+
+void simTest::stateHashCompareTest()
+{
+	const std::string fileName0 = "data/unittest_hash0.txt", fileName1 = "data/unittest_hash1.txt";
+	std::vector<std::string> steps;
+	steps.push_back("0 00000000000000a0 0000000000000001 0000000000000002");
+	steps.push_back("1 00000000000000a1 0000000000000003 0000000000000004");
+	steps.push_back("2 00000000000000a2 0000000000000005 0000000000000006");
+	writeStateHash(fileName0, steps);
+
+	// equal streams
+	writeStateHash(fileName1, steps);
+	sim::StateHash::Divergence result = sim::StateHash::compare(fileName0, fileName1);
+	CPPUNIT_ASSERT(!result.diverged);
+	CPPUNIT_ASSERT_EQUAL(3u, result.steps);
+
+	// the second body differs in the second step
+	std::vector<std::string> other = steps;
+	other[1] = "1 00000000000000b1 0000000000000003 0000000000000007";
+	writeStateHash(fileName1, other);
+	result = sim::StateHash::compare(fileName0, fileName1);
+	CPPUNIT_ASSERT(result.diverged);
+	CPPUNIT_ASSERT_EQUAL(1u, result.step);
+	CPPUNIT_ASSERT_EQUAL(1, result.body);
+	CPPUNIT_ASSERT_EQUAL(9, result.id);
+	CPPUNIT_ASSERT_EQUAL(1u, result.steps);
+
+	// the second stream ends early, in both orders
+	other = steps;
+	other.pop_back();
+	writeStateHash(fileName1, other);
+	result = sim::StateHash::compare(fileName0, fileName1);
+	CPPUNIT_ASSERT(result.diverged);
+	CPPUNIT_ASSERT_EQUAL(2u, result.step);
+	CPPUNIT_ASSERT_EQUAL(2u, result.steps);
+	result = sim::StateHash::compare(fileName1, fileName0);
+	CPPUNIT_ASSERT(result.diverged);
+	CPPUNIT_ASSERT_EQUAL(2u, result.step);
+
+	// the bodies are different
+	{
+		std::ofstream out(fileName1.c_str());
+		out << "statehash 1\n2 4 8\n" << steps[0] << "\n";
+	}
+	result = sim::StateHash::compare(fileName0, fileName1);
+	CPPUNIT_ASSERT(result.diverged);
+
+	std::remove(fileName0.c_str());
+	std::remove(fileName1.c_str());
+}
+
+void simTest::stateHashRunTest()
+{
+	const std::string level = "data/unittest_hash_level.xml";
+	const std::string fileNames[] = { "data/unittest_hash0.txt", "data/unittest_hash1.txt" };
+	sim::Generator::Params params;
+	params.layout = sim::Generator::SPIRAL;
+	params.count = 50;
+	CPPUNIT_ASSERT_EQUAL(50u, sim::Generator::save(params, level));
+
+	util::MouseAdapter ma;
+	util::KeyAdapter ka;
+	for (int run = 0; run < 2; ++run) {
+		sim::Simulation::createInstance(ka, ma);
+		sim::Simulation& simulation = sim::Simulation::instance();
+		CPPUNIT_ASSERT(simulation.load(level));
+		simulation.startStateHash(fileNames[run]);
+		for (int step = 0; step < 30; ++step)
+			simulation.step();
+		simulation.stopStateHash();
+		sim::Simulation::destroyInstance();
+	}
+
+	const sim::StateHash::Divergence result = sim::StateHash::compare(fileNames[0], fileNames[1]);
+	CPPUNIT_ASSERT(!result.diverged);
+	CPPUNIT_ASSERT_EQUAL(31u, result.steps);
+
+	std::remove(level.c_str());
+	std::remove(fileNames[0].c_str());
+	std::remove(fileNames[1].c_str());
+}
+
+}
@@ -9,6 +9,8 @@
 #include <util/inputadapters.hpp>
 #include <simulation/simulation.hpp>
 #include <simulation/material.hpp>
+#include <simulation/generator.hpp>
+#include <cstdio>
 #include <string>
 
 namespace test {
@@ -109,9 +111,41 @@ namespace test {
 		util::KeyAdapter ka;
 		sim::Simulation::createInstance(ka, ma);
 		std::string filename = "data/unittest_xml/level/level_no_environment.xml";
-		// expected to fail
-		CPPUNIT_ASSERT(!sim::Simulation::instance().load(filename));
+		// should work, the environment is optional
+		CPPUNIT_ASSERT(sim::Simulation::instance().load(filename));
+		sim::Simulation::destroyInstance();
+	}
+
+	void xmlTest::loadGeneratedLevelTest() {
+		util::MouseAdapter ma;
+		util::KeyAdapter ka;
+		sim::Simulation::createInstance(ka, ma);
+		std::string filename = "data/unittest_xml/level/level_generated.xml";
+		std::string saved = "data/unittest_xml/level/level_generated_saved.xml";
+		// a sparse grid that is larger than the default world
+		sim::Generator::Params params;
+		params.layout = sim::Generator::GRID;
+		params.count = 9;
+		params.gap = 1500.0f;
+		CPPUNIT_ASSERT_EQUAL(9u, sim::Generator::save(params, filename));
+
+		// should work, the level has a ground box instead of an environment
+		sim::Simulation& simulation = sim::Simulation::instance();
+		CPPUNIT_ASSERT(simulation.load(filename));
+		const unsigned count = simulation.getObjectCount();
+		const float size = simulation.getWorld()->getSize();
+		CPPUNIT_ASSERT(count > params.count);
+		CPPUNIT_ASSERT(size > sim::World::DEFAULT_SIZE);
+
+		// the saved level keeps the objects and the size of the world
+		simulation.save(saved);
+		CPPUNIT_ASSERT(simulation.load(saved));
+		CPPUNIT_ASSERT_EQUAL(count, simulation.getObjectCount());
+		CPPUNIT_ASSERT_DOUBLES_EQUAL(size, simulation.getWorld()->getSize(), 1e-3f * size);
+
 		sim::Simulation::destroyInstance();
+		std::remove(filename.c_str());
+		std::remove(saved.c_str());
 	}
 
 	void xmlTest::loadLevelNoRootTest() {
@@ -204,6 +238,46 @@ namespace test {
 		sim::Simulation::destroyInstance();
 	}
 
+	void xmlTest::loadLevelHeightFieldTest() {
+		util::MouseAdapter ma;
+		util::KeyAdapter ka;
+		sim::Simulation::createInstance(ka, ma);
+		std::string filename = "data/unittest_xml/level/level_heightfield.xml";
+		// should work
+		CPPUNIT_ASSERT(sim::Simulation::instance().load(filename));
+		const sim::Object& environment = sim::Simulation::instance().getEnvironment();
+		CPPUNIT_ASSERT(environment);
+		CPPUNIT_ASSERT_EQUAL(sim::__Object::HEIGHTFIELD, environment->getType());
+		sim::Simulation::destroyInstance();
+	}
+
+	void xmlTest::saveLevelHeightFieldTest() {
+		util::MouseAdapter ma;
+		util::KeyAdapter ka;
+		sim::Simulation::createInstance(ka, ma);
+		std::string filename = "data/unittest_xml/level/level_heightfield.xml";
+		std::string saved = "data/unittest_xml/level/level_heightfield_saved.xml";
+		CPPUNIT_ASSERT(sim::Simulation::instance().load(filename));
+		sim::Simulation::instance().save(saved);
+		// the saved level has to load the height field again
+		CPPUNIT_ASSERT(sim::Simulation::instance().load(saved));
+		const sim::Object& environment = sim::Simulation::instance().getEnvironment();
+		CPPUNIT_ASSERT(environment);
+		CPPUNIT_ASSERT_EQUAL(sim::__Object::HEIGHTFIELD, environment->getType());
+		sim::Simulation::destroyInstance();
+		std::remove(saved.c_str());
+	}
+
+	void xmlTest::loadLevelHeightFieldBrokenTest() {
+		util::MouseAdapter ma;
+		util::KeyAdapter ka;
+		sim::Simulation::createInstance(ka, ma);
+		std::string filename = "data/unittest_xml/level/level_heightfield_broken.xml";
+		// expected to fail, the scale is missing
+		CPPUNIT_ASSERT(!sim::Simulation::instance().load(filename));
+		sim::Simulation::destroyInstance();
+	}
+
 	void xmlTest::loadLevelObjectTypeBrokenTest() {
 		util::MouseAdapter ma;
 		util::KeyAdapter ka;
@@ -8,7 +8,7 @@
 #ifdef _WIN32
 	#include <windows.h>
 #else
-	#include <sys/time.h>
+	#include <time.h>
 #endif
 
 namespace util {
@@ -38,9 +38,10 @@ double Clock::sysTime() const
 	
 	return time;
 #else
-	timeval time = { 0, 0 };
-	gettimeofday(&time, 0);
-	return time.tv_sec + time.tv_usec / 1000000.0;
+	// unlike gettimeofday, the monotonic clock does not jump
+	timespec time = { 0, 0 };
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1000000000.0;
 #endif
 }
 
@@ -0,0 +1,273 @@
+/**
+ * @author Markus Doellinger
+ * @date Oct 17, 2011
+ * @file util/profiler.cpp
+ */
+
+#include <util/profiler.hpp>
+#include <util/erroradapters.hpp>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+
+namespace util {
+
+// created before main(), so that the threads do not race for it
+Profiler* Profiler::s_instance = new Profiler();
+volatile bool Profiler::s_capturing = false;
+THREAD_LOCAL Profiler::ThreadBuffer* Profiler::t_buffer = NULL;
+THREAD_LOCAL ScopedTimer* ScopedTimer::t_current = NULL;
+
+Profiler::Entry::Entry(const std::string& name, bool counter)
+	: name(name),
+	  counter(counter),
+	  mainThread(false)
+{
+	for (unsigned i = 0; i < HISTORY; ++i)
+		values[i] = 0.0f;
+}
+
+Profiler::Profiler()
+	: m_buffers(NULL),
+	  m_threads(0),
+	  m_owner(&Profiler::releaseBuffer),
+	  m_frame(0),
+	  m_frameStart(now()),
+	  m_captureStart(0),
+	  m_captureFrames(0)
+{
+	for (unsigned i = 0; i < HISTORY; ++i)
+		m_frameTimes[i] = 0.0f;
+}
+
+Profiler::~Profiler()
+{
+	// the buffer of the calling thread is deleted below
+	m_owner.release();
+	while (m_buffers) {
+		ThreadBuffer* next = m_buffers->next;
+		delete m_buffers;
+		m_buffers = next;
+	}
+}
+
+Profiler& Profiler::instance()
+{
+	return *s_instance;
+}
+
+Profiler::Time Profiler::now()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq = { 0 };
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// split the conversion to avoid an overflow
+	const Time seconds = counter.QuadPart / freq.QuadPart;
+	const Time rest = counter.QuadPart % freq.QuadPart;
+	return seconds * 1000000000ULL + rest * 1000000000ULL / freq.QuadPart;
+#else
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (Time)time.tv_sec * 1000000000ULL + time.tv_nsec;
+#endif
+}
+
+Profiler::ThreadBuffer* Profiler::getBuffer()
+{
+	if (!t_buffer) {
+		ThreadBuffer* buffer = new ThreadBuffer();
+		buffer->size = 0;
+		buffer->dropped = 0;
+		buffer->exited = false;
+		boost::mutex::scoped_lock lock(m_mutex);
+		buffer->index = m_threads++;
+		buffer->next = m_buffers;
+		m_buffers = buffer;
+		t_buffer = buffer;
+		m_owner.reset(buffer);
+	}
+	return t_buffer;
+}
+
+void Profiler::merge(ThreadBuffer* buffer)
+{
+	const unsigned slot = m_frame % HISTORY;
+	for (unsigned i = 0; i < buffer->size; ++i) {
+		// the same literal may have different addresses in different modules
+		unsigned e = 0;
+		while (e < m_entries.size() && (m_entries[e].counter != buffer->counter[i] ||
+				strcmp(m_entries[e].name.c_str(), buffer->names[i]) != 0))
+			++e;
+		if (e == m_entries.size())
+			m_entries.push_back(Entry(buffer->names[i], buffer->counter[i]));
+
+		Entry& entry = m_entries[e];
+		entry.mainThread |= buffer == t_buffer && !buffer->exited;
+		entry.values[slot] += entry.counter ? buffer->values[i] : buffer->values[i] / 1000000.0f;
+		buffer->values[i] = 0;
+	}
+}
+
+void Profiler::remove(ThreadBuffer* buffer)
+{
+	ThreadBuffer** itr = &m_buffers;
+	while (*itr != buffer)
+		itr = &(*itr)->next;
+	*itr = buffer->next;
+	delete buffer;
+}
+
+void Profiler::releaseBuffer(ThreadBuffer* buffer)
+{
+	Profiler& profiler = instance();
+	boost::mutex::scoped_lock lock(profiler.m_mutex);
+	buffer->exited = true;
+	profiler.merge(buffer);
+	t_buffer = NULL;
+
+	// the events of a running capture are written by stopCapture()
+	if (buffer->events.empty())
+		profiler.remove(buffer);
+}
+
+void Profiler::add(const char* name, bool counter, Time value)
+{
+	ThreadBuffer* buffer = t_buffer ? t_buffer : instance().getBuffer();
+
+	// the names are literals, so comparing the pointers is enough
+	unsigned i = 0;
+	while (i < buffer->size && buffer->names[i] != name)
+		++i;
+	if (i == buffer->size) {
+		if (i == MAX_ENTRIES)
+			return;
+		buffer->names[i] = name;
+		buffer->counter[i] = counter;
+		buffer->values[i] = 0;
+		++buffer->size;
+	}
+	buffer->values[i] += value;
+}
+
+void Profiler::record(const char* name, Time start, Time duration, int threadIndex)
+{
+	ThreadBuffer* buffer = t_buffer ? t_buffer : instance().getBuffer();
+	if (buffer->events.size() >= MAX_EVENTS) {
+		++buffer->dropped;
+		return;
+	}
+
+	Event event = { name, start, duration, threadIndex };
+	buffer->events.push_back(event);
+}
+
+void Profiler::startCapture(const std::string& fileName, unsigned frames)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	for (ThreadBuffer* buffer = m_buffers; buffer; ) {
+		ThreadBuffer* next = buffer->next;
+		buffer->events.clear();
+		buffer->dropped = 0;
+		if (buffer->exited)
+			remove(buffer);
+		buffer = next;
+	}
+	m_captureFile = fileName;
+	m_captureFrames = frames;
+	m_captureStart = now();
+	s_capturing = true;
+}
+
+/** Writes a time in microseconds, the unit of the trace events */
+static inline std::ostream& writeTime(std::ostream& out, Profiler::Time time)
+{
+	return out << time / 1000 << "." << (char)('0' + time / 100 % 10) << (char)('0' + time / 10 % 10)
+			<< (char)('0' + time % 10);
+}
+
+void Profiler::stopCapture()
+{
+	if (!s_capturing)
+		return;
+	s_capturing = false;
+
+	std::ofstream out(m_captureFile.c_str());
+	if (!out)
+		throw std::runtime_error("Could not open trace file " + m_captureFile + " for writing");
+
+	boost::mutex::scoped_lock lock(m_mutex);
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	bool first = true;
+	for (ThreadBuffer* buffer = m_buffers, *next; buffer; buffer = next) {
+		next = buffer->next;
+		out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+			<< buffer->index << ", \"args\": {\"name\": \"";
+		if (buffer == t_buffer)
+			out << "main";
+		else
+			out << "thread " << buffer->index;
+		out << "\"}}";
+		if (buffer->dropped)
+			out << ",\n{\"name\": \"dropped " << buffer->dropped << " events\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": "
+				<< buffer->index << ", \"ts\": 0}";
+		first = false;
+
+		for (std::vector<Event>::const_iterator itr = buffer->events.begin(); itr != buffer->events.end(); ++itr) {
+			if (itr->start < m_captureStart)
+				continue;
+			out << ",\n{\"name\": \"" << itr->name << "\", \"cat\": \"dominator\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+				<< buffer->index << ", \"ts\": ";
+			writeTime(out, itr->start - m_captureStart) << ", \"dur\": ";
+			writeTime(out, itr->duration);
+			if (itr->threadIndex >= 0)
+				out << ", \"args\": {\"threadIndex\": " << itr->threadIndex << "}";
+			out << "}";
+		}
+		buffer->events.clear();
+		buffer->dropped = 0;
+		if (buffer->exited)
+			remove(buffer);
+	}
+	out << "\n]}\n";
+
+	if (!out)
+		throw std::runtime_error("Could not write trace file " + m_captureFile);
+}
+
+void Profiler::endFrame()
+{
+	const Time time = now();
+	m_frameTimes[m_frame % HISTORY] = (time - m_frameStart) / 1000000.0f;
+	if (s_capturing)
+		record("frame", m_frameStart, time - m_frameStart, -1);
+	m_frameStart = time;
+
+	boost::mutex::scoped_lock lock(m_mutex);
+	for (ThreadBuffer* buffer = m_buffers; buffer; buffer = buffer->next)
+		merge(buffer);
+
+	++m_frame;
+	for (std::vector<Entry>::iterator itr = m_entries.begin(); itr != m_entries.end(); ++itr)
+		itr->values[m_frame % HISTORY] = 0.0f;
+	lock.unlock();
+
+	if (s_capturing && m_captureFrames && --m_captureFrames == 0) {
+		try {
+			stopCapture();
+		} catch (std::runtime_error& e) {
+			std::vector<std::string> args(1, m_captureFile);
+			ErrorAdapter::instance().displayErrorMessage("Profiler::endFrame", args, e);
+		}
+	}
+}
+
+}